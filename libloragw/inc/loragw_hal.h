@@ -22,6 +22,7 @@ Maintainer: Sylvain Miermont
 
 #include <stdint.h>		/* C99 types */
 #include <stdbool.h>	/* bool type */
+#include <stddef.h>		/* offsetof */
 
 #include "config.h"	/* library configuration options (dynamically generated) */
 
@@ -38,6 +39,10 @@ Maintainer: Sylvain Miermont
 
 #define	IS_TX_MODE(mode)		((mode == IMMEDIATE) || (mode == TIMESTAMPED) || (mode == ON_GPS))
 
+/* compact RX records written by lgw_receive_into: size of a record with 'size' payload bytes, padding included, and next record */
+#define LGW_PKT_REC_SIZE(size)	((offsetof(struct lgw_pkt_rec_s, payload) + (size) + LGW_PKT_REC_ALIGN - 1) & ~(size_t)(LGW_PKT_REC_ALIGN - 1))
+#define LGW_PKT_REC_NEXT(rec)	((struct lgw_pkt_rec_s *)((uint8_t *)(rec) + LGW_PKT_REC_SIZE((rec)->size)))
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC CONSTANTS ----------------------------------------------------- */
 
@@ -220,9 +225,44 @@ Maintainer: Sylvain Miermont
 #define RX_ON				2	/* RX modem is receiving */
 #define RX_SUSPENDED		3	/* RX is suspended while a TX is ongoing */
 
+/* phases of lgw_start, see lgw_get_start_profile */
+#define LGW_START_CONNECT		0	/* connection, soft reset */
+#define LGW_START_RADIO_POWER	1	/* radios power-up and reset */
+#define LGW_START_RADIO_SETUP	2	/* radios configuration and PLL lock */
+#define LGW_START_CALIBRATION	3	/* calibration run and results */
+#define LGW_START_FW_LOAD		4	/* calibration, ARB and AGC firmwares upload */
+#define LGW_START_CONST_ADJUST	5	/* lgw_constant_adjust */
+#define LGW_START_MODEM_CONFIG	6	/* IF chains and modems configuration */
+#define LGW_START_AGC_INIT		7	/* AGC firmware initialization handshakes */
+#define LGW_START_FINISH		8	/* GPS capture, LEDs and 'packets waiting' line */
+#define LGW_START_PHASE_NB		9
+
+/* compact RX records, see lgw_receive_into */
+#define LGW_PKT_REC_ALIGN		4	/* records start on that boundary, so must the arena */
+#define LGW_PKT_REC_SLACK		16	/* room needed after the payload of a record while it is fetched (raw metadata) */
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC TYPES --------------------------------------------------------- */
 
+/**
+@brief Opaque handle on one concentrator, see lgw_ctx_new
+Each handle has its own configuration, SPI link and state, so several
+concentrators can be driven from the same process. The functions without the
+_ctx suffix act on a default concentrator that always exists.
+*/
+typedef struct lgw_ctx_s lgw_ctx_t;
+
+/**
+@struct lgw_conf_board_s
+@brief Configuration structure for the link to the board, see lgw_board_setconf
+*/
+struct lgw_conf_board_s {
+	char		spi_path[64];	/*!> SPI device (spidev path, FTDI serial number or emulator name), empty for default */
+	uint32_t	spi_speed;		/*!> SPI clock in Hz, 0 for default; highest clock tried by the auto-tune (0 for 10 MHz) */
+	uint16_t	spi_chunk;		/*!> max number of bytes per SPI transfer, 0 for default */
+	bool		spi_autotune;	/*!> search the fastest reliable SPI clock at start */
+};
+
 /**
 @struct lgw_conf_rxrf_s
 @brief Configuration structure for a RF chain
@@ -244,6 +284,57 @@ struct lgw_conf_rxif_s {
 	uint32_t	datarate;	/*!> RX datarate, 0 for default */
 };
 
+/**
+@struct lgw_conf_start_s
+@brief Start options, see lgw_start_ex
+*/
+struct lgw_conf_start_s {
+	const char	*cal_cache;		/*!> calibration cache file, NULL to calibrate at every start */
+	uint32_t	cal_max_age;	/*!> age in seconds after which the cache is stale, 0 for no limit */
+	bool		cal_refresh;	/*!> ignore the cache content, calibrate and rewrite the cache */
+	uint32_t	cal_timeout_ms;	/*!> max calibration time, 0 for default (twice the typical time of the board) */
+	uint32_t	agc_timeout_ms;	/*!> max time for the AGC firmware to acknowledge a command, 0 for default (20 ms) */
+	uint32_t	agc_cmd_delay_us;	/*!> delay between an AGC command and its parameter, 0 for default (1 ms) */
+	uint32_t	poll_min_us;	/*!> first MCU status polling period, 0 for default (100 us) */
+	uint32_t	poll_max_us;	/*!> the polling period doubles up to that, 0 for default (10 ms) */
+};
+
+/**
+@struct lgw_start_wait_s
+@brief Time spent waiting for the concentrator MCUs during the last start
+*/
+struct lgw_start_wait_s {
+	uint32_t	cal_us;			/*!> calibration firmware run */
+	uint32_t	agc_boot_us;	/*!> AGC firmware boot */
+	uint32_t	agc_lut_us;		/*!> TX gain LUT load (or skip) */
+	uint32_t	agc_chan_us;	/*!> chan_select option, fixed delays only */
+	uint32_t	agc_final_us;	/*!> end of the AGC firmware initialization */
+	uint32_t	nb_poll;		/*!> number of MCU status reads */
+};
+
+/**
+@struct lgw_start_phase_s
+@brief Cost of a phase of lgw_start
+*/
+struct lgw_start_phase_s {
+	const char	*name;			/*!> name of the phase, for display */
+	uint32_t	duration_us;	/*!> wall time */
+	uint32_t	nb_submit;		/*!> number of SPI submissions (system calls on native SPI) */
+	uint32_t	nb_frame;		/*!> number of chip-select framed SPI accesses */
+	uint64_t	nb_byte;		/*!> number of bytes moved on the SPI bus */
+};
+
+/**
+@struct lgw_start_profile_s
+@brief Cost of the last call to lgw_start, phase by phase
+*/
+struct lgw_start_profile_s {
+	struct lgw_start_phase_s phase[LGW_START_PHASE_NB];	/*!> indexed by LGW_START_xxx */
+	uint32_t	total_us;		/*!> wall time of the whole start */
+	uint8_t		pll_attempts[LGW_RF_CHAIN_NB];	/*!> PLL lock attempts of each radio */
+	bool		complete;		/*!> false if the start failed, the phases after the failure are empty */
+};
+
 /**
 @struct lgw_pkt_rx_s
 @brief Structure containing the metadata of a packet that was received and a pointer to the payload
@@ -267,6 +358,31 @@ struct lgw_pkt_rx_s {
 	uint8_t		payload[256]; /*!> buffer containing the payload */
 };
 
+/**
+@struct lgw_pkt_rec_s
+@brief Compact record of a received packet, written by lgw_receive_into
+Same metadata as lgw_pkt_rx_s, followed by exactly 'size' payload bytes, then
+padding up to the next record (see LGW_PKT_REC_SIZE and LGW_PKT_REC_NEXT).
+*/
+struct lgw_pkt_rec_s {
+	uint32_t	freq_hz;	/*!> central frequency of the IF chain */
+	uint32_t	count_us;	/*!> internal concentrator counter for timestamping, 1 microsecond resolution */
+	uint32_t	datarate;	/*!> RX datarate of the packet (SF for LoRa) */
+	float		rssi;		/*!> average packet RSSI in dB */
+	float		snr;		/*!> average packet SNR, in dB (LoRa only) */
+	float		snr_min;	/*!> minimum packet SNR, in dB (LoRa only) */
+	float		snr_max;	/*!> maximum packet SNR, in dB (LoRa only) */
+	uint16_t	crc;		/*!> CRC that was received in the payload */
+	uint16_t	size;		/*!> payload size in bytes */
+	uint8_t		if_chain;	/*!> by which IF chain was packet received */
+	uint8_t		status;		/*!> status of the received packet */
+	uint8_t		rf_chain;	/*!> through which RF chain the packet was received */
+	uint8_t		modulation; /*!> modulation used by the packet */
+	uint8_t		bandwidth;	/*!> modulation bandwidth (LoRa only) */
+	uint8_t		coderate;	/*!> error-correcting code of the packet (LoRa only) */
+	uint8_t		payload[];	/*!> payload, 'size' bytes */
+};
+
 /**
 @struct lgw_pkt_tx_s
 @brief Structure containing the configuration of a packet to send and a pointer to the payload
@@ -293,6 +409,18 @@ struct lgw_pkt_tx_s {
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
 
+/**
+@brief Configure the SPI link to the board (must configure before start)
+@param conf structure containing the configuration parameters
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+
+The defaults can be overridden by the environment variables LGW_SPI_PATH,
+LGW_SPI_SPEED and LGW_SPI_CHUNK. With spi_autotune, the burst chunk is raised
+to the largest the SPI driver accepts (unless spi_chunk is set) and the clock
+to the fastest one passing a readback test, see lgw_reg_spi_autotune.
+*/
+int lgw_board_setconf(struct lgw_conf_board_s conf);
+
 /**
 @brief Configure an RF chain (must configure before start)
 @param rf_chain number of the RF chain to configure [0, LGW_RF_CHAIN_NB - 1]
@@ -315,6 +443,18 @@ int lgw_rxif_setconf(uint8_t if_chain, struct lgw_conf_rxif_s conf);
 */
 int lgw_start(void);
 
+/**
+@brief Same as lgw_start, with a calibration cache to shorten restarts
+@param conf start options, NULL for the lgw_start behaviour
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+
+When the cache matches the configuration (calibration command, radio
+frequencies, calibration firmware and library options) and is not stale, the
+TX DC offsets are taken from it and only the RX calibration runs. Otherwise a
+full calibration runs and its results are saved in the cache if successful.
+*/
+int lgw_start_ex(const struct lgw_conf_start_s *conf);
+
 /**
 @brief Stop the LoRa concentrator and disconnect it
 @return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
@@ -329,6 +469,52 @@ int lgw_stop(void);
 */
 int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data);
 
+/**
+@brief Same as lgw_receive, but writes compact variable-length records directly in a caller-supplied buffer
+@param arena buffer receiving the records back to back, aligned on LGW_PKT_REC_ALIGN bytes
+@param len size of the buffer in bytes
+@return LGW_HAL_ERROR id the operation failed, else the number of records written
+
+The first record is at the start of the buffer, walk the others with LGW_PKT_REC_NEXT.
+The payload is read from the concentrator straight into its record (no intermediate copy).
+A packet is only fetched if LGW_PKT_REC_SIZE(size) + LGW_PKT_REC_SLACK bytes are left,
+otherwise it stays in the FIFO for the next call.
+*/
+int lgw_receive_into(uint8_t *arena, uint32_t len);
+
+/**
+@brief Configure the GPIO line wired to the concentrator DGPIO0 'packets waiting' output (must configure before start)
+@param gpio_chip path of the GPIO character device (eg. "/dev/gpiochip0"), NULL to disable
+@param line offset of the line on that GPIO chip
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+*/
+int lgw_rxirq_setconf(const char *gpio_chip, uint32_t line);
+
+/**
+@brief Use an externally managed file descriptor as 'packets waiting' event (eg. an eventfd), instead of the GPIO line
+@param fd file descriptor that becomes readable when packets are waiting, -1 to stop using it (the fd is not closed by the HAL)
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+*/
+int lgw_rxirq_setfd(int fd);
+
+/**
+@brief Get the file descriptor that becomes readable when packets are waiting, to be used in the user's own poll/select loop
+@return file descriptor, -1 if no event source is available (RX must then be polled)
+*/
+int lgw_get_rx_fd(void);
+
+/**
+@brief Same as lgw_receive, but blocks until at least one packet is fetched or the timeout expires
+@param timeout_ms maximum time to wait in milliseconds, 0 to return immediately, negative to wait forever
+@param max_pkt maximum number of packet that must be retrieved (equal to the size of the array of struct)
+@param pkt_data pointer to an array of struct that will receive the packet metadata and payload pointers
+@return LGW_HAL_ERROR id the operation failed, else the number of packets retrieved (0 on timeout)
+
+Sleeps on the 'packets waiting' event when one is available (see lgw_rxirq_setconf and
+lgw_rxirq_setfd), polls the FIFO every few milliseconds otherwise.
+*/
+int lgw_receive_wait(int timeout_ms, uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data);
+
 /**
 @brief Schedule a packet to be send immediately or after a delay depending on tx_mode
 @param pkt_data structure containing the data and metadata for the packet to send
@@ -351,6 +537,165 @@ int lgw_status(uint8_t select, uint8_t *code);
 */
 int lgw_get_trigcnt(uint32_t* trig_cnt_us);
 
+/**
+@brief Return instantaneous value of internal counter
+@param inst_cnt_us pointer to receive timestamp value
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+GPS event capture is disabled for the duration of the read.
+*/
+int lgw_get_instcnt(uint32_t* inst_cnt_us);
+
+/**
+@brief Return the calibration status of the last start
+@param cal_status pointer to receive the status byte of the calibration firmware
+@param cached pointer set to true if the TX calibration results came from the cache
+@return LGW_HAL_ERROR if the concentrator is not started, LGW_HAL_SUCCESS else
+*/
+int lgw_get_cal_info(uint8_t *cal_status, bool *cached);
+
+/**
+@brief Return the time spent waiting for the concentrator MCUs during the last start
+@param wait pointer to the structure receiving the wait times
+@return LGW_HAL_ERROR if the concentrator is not started, LGW_HAL_SUCCESS else
+*/
+int lgw_get_start_wait(struct lgw_start_wait_s *wait);
+
+/**
+@brief Return the wall time and SPI traffic of each phase of the last start
+@param profile pointer to the structure receiving the profile
+@return LGW_HAL_ERROR if lgw_start was never called, LGW_HAL_SUCCESS else
+Also available after a failed start, to see where it failed.
+*/
+int lgw_get_start_profile(struct lgw_start_profile_s *profile);
+
+/**
+@brief Create a handle on a concentrator, not connected until lgw_start_ctx
+@param spi_path SPI device of that concentrator (spidev path, FTDI serial number or emulator name), NULL for the default one
+@return pointer to the new handle, NULL if the allocation failed
+*/
+lgw_ctx_t *lgw_ctx_new(const char *spi_path);
+
+/**
+@brief Stop the concentrator if it is running and free its handle
+@param ctx handle returned by lgw_ctx_new, can be NULL
+*/
+void lgw_ctx_free(lgw_ctx_t *ctx);
+
+/**
+@brief Same as lgw_board_setconf, for the concentrator of a handle
+An empty spi_path keeps the device given to lgw_ctx_new.
+*/
+int lgw_board_setconf_ctx(lgw_ctx_t *ctx, struct lgw_conf_board_s conf);
+
+/**
+@brief Same as lgw_rxrf_setconf, for the concentrator of a handle
+*/
+int lgw_rxrf_setconf_ctx(lgw_ctx_t *ctx, uint8_t rf_chain, struct lgw_conf_rxrf_s conf);
+
+/**
+@brief Same as lgw_rxif_setconf, for the concentrator of a handle
+*/
+int lgw_rxif_setconf_ctx(lgw_ctx_t *ctx, uint8_t if_chain, struct lgw_conf_rxif_s conf);
+
+/**
+@brief Same as lgw_start_ex, for the concentrator of a handle
+While a _ctx function runs, the register functions of the calling thread are
+redirected to the SPI link of that concentrator (see lgw_reg_ctx_select).
+*/
+int lgw_start_ctx(lgw_ctx_t *ctx, const struct lgw_conf_start_s *conf);
+
+/**
+@brief Same as lgw_stop, for the concentrator of a handle
+*/
+int lgw_stop_ctx(lgw_ctx_t *ctx);
+
+/**
+@brief Same as lgw_receive, for the concentrator of a handle
+*/
+int lgw_receive_ctx(lgw_ctx_t *ctx, uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data);
+
+/**
+@brief Same as lgw_receive_into, for the concentrator of a handle
+*/
+int lgw_receive_into_ctx(lgw_ctx_t *ctx, uint8_t *arena, uint32_t len);
+
+/**
+@brief Same as lgw_rxirq_setconf, for the concentrator of a handle
+*/
+int lgw_rxirq_setconf_ctx(lgw_ctx_t *ctx, const char *gpio_chip, uint32_t line);
+
+/**
+@brief Same as lgw_rxirq_setfd, for the concentrator of a handle
+*/
+int lgw_rxirq_setfd_ctx(lgw_ctx_t *ctx, int fd);
+
+/**
+@brief Same as lgw_get_rx_fd, for the concentrator of a handle
+*/
+int lgw_get_rx_fd_ctx(lgw_ctx_t *ctx);
+
+/**
+@brief Same as lgw_receive_wait, for the concentrator of a handle
+*/
+int lgw_receive_wait_ctx(lgw_ctx_t *ctx, int timeout_ms, uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data);
+
+/**
+@brief Same as lgw_send, for the concentrator of a handle
+*/
+int lgw_send_ctx(lgw_ctx_t *ctx, struct lgw_pkt_tx_s pkt_data);
+
+/**
+@brief Same as lgw_status, for the concentrator of a handle
+*/
+int lgw_status_ctx(lgw_ctx_t *ctx, uint8_t select, uint8_t *code);
+
+/**
+@brief Same as lgw_get_trigcnt, for the concentrator of a handle
+*/
+int lgw_get_trigcnt_ctx(lgw_ctx_t *ctx, uint32_t* trig_cnt_us);
+
+/**
+@brief Same as lgw_get_instcnt, for the concentrator of a handle
+*/
+int lgw_get_instcnt_ctx(lgw_ctx_t *ctx, uint32_t* inst_cnt_us);
+
+/**
+@brief Same as lgw_get_cal_info, for the concentrator of a handle
+*/
+int lgw_get_cal_info_ctx(lgw_ctx_t *ctx, uint8_t *cal_status, bool *cached);
+
+/**
+@brief Same as lgw_get_start_wait, for the concentrator of a handle
+*/
+int lgw_get_start_wait_ctx(lgw_ctx_t *ctx, struct lgw_start_wait_s *wait);
+
+/**
+@brief Same as lgw_get_start_profile, for the concentrator of a handle
+*/
+int lgw_get_start_profile_ctx(lgw_ctx_t *ctx, struct lgw_start_profile_s *profile);
+
+/**
+@brief Compute the time on air of a packet to send
+@param packet pointer to the packet, with the modulation parameters, size, preamble, CRC and header options given to lgw_send
+@return time on air in microseconds, 0 if the modulation parameters are invalid
+
+Same preamble defaults and limits as lgw_send. LoRa durations are exact (every
+symbol lasts a whole number of microseconds), FSK ones are rounded up. Only
+table lookups and integer arithmetic are involved.
+*/
+uint32_t lgw_time_on_air(const struct lgw_pkt_tx_s *packet);
+
+/**
+@brief Compute the time on air of a received packet
+@param packet pointer to a packet returned by lgw_receive
+@return time on air in microseconds, 0 if the modulation parameters are invalid
+
+The preamble length is not reported by the modems: 8 symbols (LoRa) or 5 bytes
+(FSK) are assumed. Explicit header (LoRa) or variable length (FSK) packets are
+assumed, the CRC presence is taken from the packet status.
+*/
+uint32_t lgw_time_on_air_rx(const struct lgw_pkt_rx_s *packet);
+
 /**
 @brief Allow user to check the version/options of the library once compiled
 @return pointer on a human-readable null terminated string
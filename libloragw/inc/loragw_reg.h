@@ -11,6 +11,8 @@ Description:
 	Registers are addressed by name.
 	Multi-bytes registers are handled automatically.
 	Read-modify-write is handled automatically.
+	Each access (page switch included) and each batch is atomic, the
+	registers can be accessed from several threads.
 
 License: Revised BSD License, see LICENSE.TXT file include in the project
 Maintainer: Sylvain Miermont
@@ -34,6 +36,31 @@ Maintainer: Sylvain Miermont
 #define LGW_REG_SUCCESS	 0
 #define LGW_REG_ERROR	-1
 
+#define LGW_REG_BATCH_MAX	128	/* max number of operations in a register batch */
+
+/* SPI trace file, see lgw_reg_trace_start, all fields little endian */
+#define LGW_TRACE_MAGIC		"LGWT"
+#define LGW_TRACE_VERSION	1
+#define LGW_TRACE_HEAD_SIZE	8	/* file header: magic (4), version (1), reserved (3) */
+#define LGW_TRACE_REC_SIZE	9	/* record header: delta_us (4), flags (1), address (1), site (1), size (2), then 'size' data bytes */
+
+/* flags of a trace record */
+#define LGW_TRACE_WRITE			0x01	/* write access, read access otherwise */
+#define LGW_TRACE_BATCH			0x02	/* frame of a batch submission */
+#define LGW_TRACE_BATCH_FIRST	0x04	/* first frame of a batch submission */
+#define LGW_TRACE_ERROR			0x08	/* the SPI layer returned an error */
+
+/* call sites of a trace record, see lgw_reg_trace_site */
+#define LGW_TRACE_SITE_NONE		0	/* register access outside of the HAL functions below */
+#define LGW_TRACE_SITE_START	1	/* lgw_start */
+#define LGW_TRACE_SITE_STOP		2	/* lgw_stop */
+#define LGW_TRACE_SITE_RECEIVE	3	/* lgw_receive */
+#define LGW_TRACE_SITE_SEND		4	/* lgw_send */
+#define LGW_TRACE_SITE_STATUS	5	/* lgw_status */
+#define LGW_TRACE_SITE_TRIGCNT	6	/* lgw_get_trigcnt */
+#define LGW_TRACE_SITE_INSTCNT	7	/* lgw_get_instcnt */
+#define LGW_TRACE_SITE_USER		128	/* first site number free for the application */
+
 /*
 auto generated register mapping for C code : 11-Jul-2013 13:20:40
 this file contains autogenerated C struct used to access the LORA registers
@@ -369,6 +396,27 @@ this file is autogenerated from registers description
 
 #define LGW_TOTALREGS 325
 
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_reg_stats_s
+@brief Count of the SPI accesses made by the register layer
+*/
+struct lgw_reg_stats_s {
+	uint32_t	nb_submit;		/*!> number of SPI submissions (system calls on native SPI) */
+	uint32_t	nb_frame;		/*!> number of chip-select framed accesses */
+	uint32_t	nb_page_switch;	/*!> number of writes to the page register */
+	uint64_t	nb_byte;		/*!> number of bytes on the bus, command bytes included */
+};
+
+/**
+@struct lgw_reg_ctx_s
+@brief Register access state of one concentrator (SPI link, selected page, open
+batch, shadow cache and SPI counters), opaque, see lgw_reg_ctx_new
+*/
+struct lgw_reg_ctx_s;
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
 
@@ -431,6 +479,177 @@ int lgw_reg_wb(uint16_t register_id, uint8_t *data, uint16_t size);
 */
 int lgw_reg_rb(uint16_t register_id, uint8_t *data, uint16_t size);
 
+/**
+@brief Enable or disable the shadow cache of the concentrator register bytes
+When enabled, the bytes written or read are kept in a shadow copy indexed by
+page and address, and read-modify-write of sub-byte registers skip the SPI
+read when the byte is known. Bytes containing a read-only or volatile
+(hardware-updated) register are never cached. Reads always access the hardware.
+The cache starts empty and is invalidated on connection and soft reset.
+@param enable true to enable the cache, false to disable it
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+*/
+int lgw_reg_cache_enable(bool enable);
+
+/**
+@brief Invalidate the whole shadow cache, to be used when the register file was
+modified behind the back of this module
+*/
+void lgw_reg_cache_invalidate(void);
+
+/**
+@brief Open a batch of register operations
+Operations queued until lgw_reg_batch_commit are sent in as few SPI submissions
+as possible: page switches are only inserted when needed, and the bytes needed
+by read-modify-write operations are all fetched in a single submission.
+The batch belongs to the calling thread and is executed atomically: accesses
+from other threads happen before or after it, never in the middle.
+Batches cannot be nested, and hold at most LGW_REG_BATCH_MAX operations: an
+operation beyond that is refused and the whole batch is then dropped at commit.
+@return LGW_REG_ERROR if unconnected or a batch is already open, LGW_REG_SUCCESS otherwise
+*/
+int lgw_reg_batch_begin(void);
+
+/**
+@brief Queue a register write in the open batch
+@param register_id register number in the data structure describing registers
+@param reg_value signed value to write to the register (for u32, use cast)
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+*/
+int lgw_reg_batch_add_w(uint16_t register_id, int32_t reg_value);
+
+/**
+@brief Queue a register read in the open batch
+@param register_id register number in the data structure describing registers
+@param reg_value pointer to a variable where to write register read value, valid after commit
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+*/
+int lgw_reg_batch_add_r(uint16_t register_id, int32_t *reg_value);
+
+/**
+@brief Queue a register burst write in the open batch
+@param register_id register number in the data structure describing registers
+@param data pointer to byte array that will be sent, must stay valid until commit
+@param size size of the transfer, in byte(s)
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+*/
+int lgw_reg_batch_add_wb(uint16_t register_id, uint8_t *data, uint16_t size);
+
+/**
+@brief Queue a register burst read in the open batch
+@param register_id register number in the data structure describing registers
+@param data pointer to byte array that will be written, valid after commit
+@param size size of the transfer, in byte(s)
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+*/
+int lgw_reg_batch_add_rb(uint16_t register_id, uint8_t *data, uint16_t size);
+
+/**
+@brief Execute all the operations of the open batch, in order, and close it
+@return LGW_REG_ERROR if an SPI error occurred or nothing was sent (an operation did not fit), LGW_REG_SUCCESS otherwise
+*/
+int lgw_reg_batch_commit(void);
+
+/**
+@brief Get the count of SPI accesses made since connection or last reset
+@param stats pointer to the structure receiving the counters
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+*/
+int lgw_reg_get_stats(struct lgw_reg_stats_s *stats);
+
+/**
+@brief Reset the count of SPI accesses
+*/
+void lgw_reg_reset_stats(void);
+
+/**
+@brief Set the SPI link parameters used by the next lgw_connect
+@param spi_path device to open, NULL to keep the current one (see lgw_reg_ctx_new)
+@param speed_hz SPI clock, in Hz, 0 for the default
+@param chunk_size max number of data bytes per SPI transfer, 0 for the default
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+
+When a parameter is left to its default, the environment variable LGW_SPI_PATH,
+LGW_SPI_SPEED or LGW_SPI_CHUNK is used if set, the SPI layer default otherwise.
+*/
+int lgw_reg_spi_setconf(const char *spi_path, uint32_t speed_hz, uint16_t chunk_size);
+
+/**
+@brief Get the SPI link parameters in use
+@param speed_hz pointer receiving the SPI clock, in Hz, can be NULL
+@param chunk_size pointer receiving the burst chunk size, in bytes, can be NULL
+@return LGW_REG_ERROR if the concentrator is not connected, LGW_REG_SUCCESS otherwise
+*/
+int lgw_reg_spi_getconf(uint32_t *speed_hz, uint16_t *chunk_size);
+
+/**
+@brief Find the fastest SPI clock the board supports without errors
+@param speed_max highest clock tried, in Hz, 0 for the SX1301 rated maximum (10 MHz)
+@return LGW_REG_ERROR if not connected or if even the slowest clock fails, LGW_REG_SUCCESS otherwise
+
+The burst chunk is raised to the largest the SPI driver accepts (for spidev,
+/sys/module/spidev/parameters/bufsiz minus the command byte), unless it was
+set by lgw_reg_spi_setconf or LGW_SPI_CHUNK. The clock is then increased step
+by step while a pseudo-random pattern written in the RX data buffer reads back
+identical, along with the version register. The clock kept (for the next
+connections too) is one step below the last one that passed if a faster one
+failed or if it exceeds the 10 MHz rating, the last one that passed otherwise.
+Overwrites the RX data buffer: call it after lgw_connect, before the radios are
+started and before other threads access the registers.
+*/
+int lgw_reg_spi_autotune(uint32_t speed_max);
+
+/**
+@brief Allocate the register access state of an additional concentrator
+@param spi_path SPI device of that concentrator (see lgw_spi_open_path), NULL for the default device
+@return pointer to the new context, NULL if it could not be allocated
+*/
+struct lgw_reg_ctx_s *lgw_reg_ctx_new(const char *spi_path);
+
+/**
+@brief Free a register access context, closing its SPI link if still open
+@param rctx context returned by lgw_reg_ctx_new
+*/
+void lgw_reg_ctx_free(struct lgw_reg_ctx_s *rctx);
+
+/**
+@brief Select the concentrator accessed by the register functions called from the calling thread
+@param rctx context returned by lgw_reg_ctx_new, NULL for the default concentrator
+@return context selected before the call (NULL for the default concentrator), to restore it
+
+All the other functions of this module act on the context selected by the
+calling thread. Threads that never call this function use the default
+concentrator, as do new threads.
+*/
+struct lgw_reg_ctx_s *lgw_reg_ctx_select(struct lgw_reg_ctx_s *rctx);
+
+/**
+@brief Start recording every SPI access of the concentrator to a trace file
+@param path file to create, overwritten if it exists
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+
+Each access is appended as a record holding the time elapsed since the previous
+record, the direction, the address, the call site and the data (sent, or
+received for reads). A capture already running is stopped first. When the
+environment variable LGW_SPI_TRACE is set, lgw_connect starts a capture to that
+file for the default concentrator. The capture survives lgw_disconnect and
+stops with lgw_reg_trace_stop or lgw_reg_ctx_free.
+*/
+int lgw_reg_trace_start(const char *path);
+
+/**
+@brief Stop the SPI trace capture and close the file
+@return LGW_REG_ERROR if no capture was running, LGW_REG_SUCCESS otherwise
+*/
+int lgw_reg_trace_stop(void);
+
+/**
+@brief Set the call site recorded with the SPI accesses of the calling thread
+@param site LGW_TRACE_SITE_xxx value, or LGW_TRACE_SITE_USER and above for the application
+@return site set before the call, to restore it
+*/
+uint8_t lgw_reg_trace_site(uint8_t site);
+
 
 #endif
 
@@ -0,0 +1,109 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Dedicated RX fetch thread, draining the LoRa concentrator into a
+	single-producer/single-consumer ring of received packets.
+	Decouples the concentrator FIFO drain from the application processing.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+#ifndef _LORAGW_RING_H
+#define _LORAGW_RING_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+
+#include "config.h"	/* library configuration options (dynamically generated) */
+#include "loragw_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LGW_RING_SUCCESS	 0
+#define LGW_RING_ERROR		-1
+
+#define LGW_RING_SIZE_DEFAULT	256	/* number of packets the ring can hold */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_ring_stats_s
+@brief Counters of the RX fetch thread and packet ring
+*/
+struct lgw_ring_stats_s {
+	uint32_t	nb_fetched;		/*!> packets fetched from the concentrator by the fetch thread */
+	uint32_t	nb_popped;		/*!> packets taken from the ring by the application */
+	uint32_t	nb_overrun;		/*!> packets dropped because the ring was full */
+	uint32_t	nb_fetch_error;	/*!> failed fetches from the concentrator */
+	uint32_t	max_fill;		/*!> highest number of packets waiting in the ring */
+	bool		rt_sched;		/*!> true if the fetch thread runs with the SCHED_FIFO policy */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Start the RX fetch thread (the concentrator must be started)
+@param size number of packets the ring can hold, rounded up to a power of 2 (0 for default)
+@param rt_priority SCHED_FIFO priority of the fetch thread [1, 99], 0 for default scheduling
+@return LGW_RING_ERROR if the thread could not be started, LGW_RING_SUCCESS otherwise
+
+If the real-time priority cannot be obtained (missing privilege), the thread
+is started with default scheduling and rt_sched is false in the statistics.
+While the fetch thread runs, the application must not call lgw_receive itself.
+*/
+int lgw_ring_start(uint32_t size, int rt_priority);
+
+/**
+@brief Stop the RX fetch thread and free the ring, packets still in the ring are lost
+@return LGW_RING_ERROR if the thread was not running, LGW_RING_SUCCESS otherwise
+Must be called before lgw_stop.
+*/
+int lgw_ring_stop(void);
+
+/**
+@brief Non-blocking function taking up to 'max_pkt' packets from the ring
+@param max_pkt maximum number of packets to take (equal to the size of the array of struct)
+@param pkt_data pointer to an array of struct that will receive the packets
+@return LGW_RING_ERROR if the thread is not running, else the number of packets taken
+*/
+int lgw_ring_pop_bulk(uint16_t max_pkt, struct lgw_pkt_rx_s *pkt_data);
+
+/**
+@brief Same as lgw_ring_pop_bulk, but blocks until packets are available or the timeout expires
+@param timeout_ms maximum time to wait in milliseconds, negative to wait forever
+@param max_pkt maximum number of packets to take (equal to the size of the array of struct)
+@param pkt_data pointer to an array of struct that will receive the packets
+@return LGW_RING_ERROR if the thread is not running, else the number of packets taken (0 on timeout)
+*/
+int lgw_ring_pop_wait(int timeout_ms, uint16_t max_pkt, struct lgw_pkt_rx_s *pkt_data);
+
+/**
+@brief Get the file descriptor that becomes readable when packets are pushed in the ring
+@return file descriptor, -1 if the thread is not running
+*/
+int lgw_ring_get_fd(void);
+
+/**
+@brief Get the counters of the fetch thread and ring
+@param stats pointer to the structure receiving the counters
+@return LGW_RING_ERROR if the thread is not running, LGW_RING_SUCCESS otherwise
+*/
+int lgw_ring_get_stats(struct lgw_ring_stats_s *stats);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
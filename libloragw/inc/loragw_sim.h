@@ -0,0 +1,154 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Control of the in-process LoRa concentrator emulator used by the 'sim' SPI
+	physical layer (CFG_SPI = sim).
+	Synthetic packet injection in the RX FIFO, 'packets waiting' event,
+	readback of the transmitted packets and SPI traffic statistics.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+#ifndef _LORAGW_SIM_H
+#define _LORAGW_SIM_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types*/
+
+#include "config.h"	/* library configuration options (dynamically generated) */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LGW_SIM_SUCCESS	 0
+#define LGW_SIM_ERROR	-1
+
+#define LGW_SIM_FIFO_DEPTH	16		/* max number of packets in the emulated RX FIFO */
+#define LGW_SIM_TX_BUF_SIZE	512		/* size of the emulated TX data buffer */
+#define LGW_SIM_DEV_MAX		4		/* max number of emulated concentrators open at the same time */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_sim_rx_s
+@brief Raw content of a packet pushed in the emulated RX FIFO
+*/
+struct lgw_sim_rx_s {
+	uint8_t		if_chain;	/*!> IF chain the packet was received on */
+	uint8_t		status;		/*!> FIFO status code (5: CRC ok, 7: CRC bad, 1: no CRC) */
+	uint8_t		sf;			/*!> LoRa spreading factor (7 to 12), ignored for FSK */
+	uint8_t		cr;			/*!> LoRa coding rate code (1 for 4/5 to 4 for 4/8), ignored for FSK */
+	int8_t		snr;		/*!> average SNR, in 1/4 dB */
+	int8_t		snr_min;	/*!> minimum SNR, in 1/4 dB */
+	int8_t		snr_max;	/*!> maximum SNR, in 1/4 dB */
+	uint8_t		rssi;		/*!> raw RSSI value, before board correction */
+	uint32_t	count_us;	/*!> raw internal timestamp of 'RX finished' event */
+	uint16_t	crc;		/*!> CRC of the payload */
+	uint8_t		size;		/*!> payload size in bytes */
+	uint8_t		payload[256];	/*!> payload */
+};
+
+/**
+@struct lgw_sim_tx_s
+@brief Content of the emulated TX data buffer when a TX was triggered
+*/
+struct lgw_sim_tx_s {
+	uint8_t		trig;		/*!> TX trigger used (1: immediate, 2: delayed, 4: on GPS) */
+	uint32_t	count_us;	/*!> internal counter value when the TX was triggered */
+	uint16_t	size;		/*!> number of bytes written in the TX data buffer */
+	uint8_t		data[LGW_SIM_TX_BUF_SIZE];	/*!> TX metadata + payload */
+};
+
+/**
+@struct lgw_sim_stats_s
+@brief Count of the SPI accesses received by the emulator
+*/
+struct lgw_sim_stats_s {
+	uint32_t	nb_submit;		/*!> number of SPI submissions (system calls on native SPI) */
+	uint32_t	nb_frame;		/*!> number of chip-select framed accesses */
+	uint32_t	nb_read;		/*!> number of read accesses */
+	uint32_t	nb_write;		/*!> number of write accesses */
+	uint32_t	nb_page_switch;	/*!> number of writes to the page register */
+	uint64_t	nb_byte;		/*!> number of bytes on the bus, command bytes included */
+	uint32_t	nb_rx_injected;	/*!> number of packets pushed in the RX FIFO */
+	uint32_t	nb_rx_dropped;	/*!> number of packets dropped because the RX FIFO was full */
+	uint32_t	nb_rx_fetched;	/*!> number of packets removed from the RX FIFO by the host */
+	uint32_t	nb_tx;			/*!> number of TX triggered */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Select the emulated concentrator targeted by the other lgw_sim_ functions
+@param name name given to lgw_spi_open_path when the emulator was open, NULL for the default one
+@return LGW_SIM_ERROR if no emulator of that name is open, LGW_SIM_SUCCESS otherwise
+
+Each lgw_spi_open_path with a different name opens a separate emulated
+concentrator (up to LGW_SIM_DEV_MAX). The last one open is selected.
+*/
+int lgw_sim_select(const char *name);
+
+/**
+@brief Push a synthetic packet in the emulated RX FIFO
+@param pkt pointer to the packet to push
+@return LGW_SIM_ERROR if the emulator is not open or the FIFO is full, LGW_SIM_SUCCESS otherwise
+*/
+int lgw_sim_inject_rx(const struct lgw_sim_rx_s *pkt);
+
+/**
+@brief Get the number of packets waiting in the emulated RX FIFO
+@return number of packets, LGW_SIM_ERROR if the emulator is not open
+*/
+int lgw_sim_rx_pending(void);
+
+/**
+@brief Emulate the DGPIO0 'packets waiting' line on an eventfd
+@param fd eventfd incremented each time a packet is pushed in an empty RX FIFO, -1 to disable
+
+Can be set before the emulator is open, pass the same fd to lgw_rxirq_setfd.
+*/
+void lgw_sim_set_irq_fd(int fd);
+
+/**
+@brief Emulate a board whose SPI link is not reliable above a given clock
+@param speed_hz fastest reliable SPI clock, in Hz, 0 for no limit (default)
+
+Above that clock (see lgw_spi_set_conf), one bit of every 7th byte read is
+flipped, on all the emulators. Can be set before the emulator is open.
+*/
+void lgw_sim_set_spi_limit(uint32_t speed_hz);
+
+/**
+@brief Get the content of the TX data buffer at the last TX trigger
+@param tx pointer to the structure receiving the TX data
+@return LGW_SIM_ERROR if no TX was triggered since the emulator was open, LGW_SIM_SUCCESS otherwise
+*/
+int lgw_sim_get_tx(struct lgw_sim_tx_s *tx);
+
+/**
+@brief Get the SPI access statistics since opening or last reset
+@param stats pointer to the structure receiving the statistics
+@return LGW_SIM_ERROR if the emulator is not open, LGW_SIM_SUCCESS otherwise
+*/
+int lgw_sim_get_stats(struct lgw_sim_stats_s *stats);
+
+/**
+@brief Reset the SPI access statistics
+*/
+void lgw_sim_reset_stats(void);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -25,6 +25,7 @@ Maintainer: Sylvain Miermont
 /* --- DEPENDANCIES --------------------------------------------------------- */
 
 #include <stdint.h>		/* C99 types*/
+#include <stdbool.h>	/* bool type */
 
 #include "config.h"	/* library configuration options (dynamically generated) */
 
@@ -33,7 +34,31 @@ Maintainer: Sylvain Miermont
 
 #define LGW_SPI_SUCCESS	 0
 #define LGW_SPI_ERROR	-1
-#define LGW_BURST_CHUNK	 1024
+#define LGW_BURST_CHUNK	 1024	/* default max number of data bytes per SPI transfer, see lgw_spi_set_conf */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_spi_frame_s
+@brief One chip-select framed SPI access (command byte + data), part of a batch
+*/
+struct lgw_spi_frame_s {
+	uint8_t		address;	/*!> 7-bit register address */
+	bool		write;		/*!> true for a write access, false for a read access */
+	uint8_t		*data;		/*!> data to send, or buffer receiving the data read */
+	uint16_t	size;		/*!> size of the data, in byte(s) */
+};
+
+/**
+@struct lgw_spi_conf_s
+@brief Runtime parameters of an open SPI link
+*/
+struct lgw_spi_conf_s {
+	uint32_t	speed_hz;	/*!> SPI clock, in Hz */
+	uint16_t	chunk_size;	/*!> max number of data bytes per transfer, longer bursts are split */
+	uint16_t	chunk_max;	/*!> largest chunk size the SPI driver accepts (read-only) */
+};
 
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
@@ -46,6 +71,15 @@ Maintainer: Sylvain Miermont
 
 int lgw_spi_open(void **spi_target_ptr);
 
+/**
+@brief LoRa concentrator SPI setup on a given device, to drive several concentrators
+@param spi_target_ptr pointer on a generic pointer to SPI target (implementation dependant)
+@param dev_path device to open (implementation dependant: spidev device path,
+FTDI serial number, emulator name), NULL for the default device
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+*/
+int lgw_spi_open_path(void **spi_target_ptr, const char *dev_path);
+
 /**
 @brief LoRa concentrator SPI close
 @param spi_target generic pointer to SPI target (implementation dependant)
@@ -92,6 +126,35 @@ int lgw_spi_wb(void *spi_target, uint8_t address, uint8_t *data, uint16_t size);
 */
 int lgw_spi_rb(void *spi_target, uint8_t address, uint8_t *data, uint16_t size);
 
+/**
+@brief LoRa concentrator SPI batch of framed accesses, submitted at once if possible
+@param spi_target generic pointer to SPI target (implementation dependant)
+@param frames array of frames, executed in order, chip-select toggled between frames
+@param nb_frames number of frames in the array
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+*/
+int lgw_spi_batch(void *spi_target, struct lgw_spi_frame_s *frames, uint16_t nb_frames);
+
+/**
+@brief Get the runtime parameters of an open SPI link
+@param spi_target generic pointer to SPI target (implementation dependant)
+@param conf pointer to the structure receiving the parameters
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+*/
+int lgw_spi_get_conf(void *spi_target, struct lgw_spi_conf_s *conf);
+
+/**
+@brief Change the clock and burst chunk size of an open SPI link
+@param spi_target generic pointer to SPI target (implementation dependant)
+@param conf new parameters, a null field keeps the current value, chunk_max is ignored
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+
+A link is open with an implementation dependant clock and LGW_BURST_CHUNK byte
+chunks. A chunk size above chunk_max is rejected. The clock is not checked, see
+lgw_reg_spi_autotune to find the fastest one the board supports.
+*/
+int lgw_spi_set_conf(void *spi_target, const struct lgw_spi_conf_s *conf);
+
 #endif
 
 /* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,113 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Just-in-time downlink scheduler: queue of timestamped packets ordered by
+	trigger time, each loaded in the concentrator TX buffer shortly before
+	it must be sent.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+#ifndef _LORAGW_TXQ_H
+#define _LORAGW_TXQ_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+
+#include "config.h"	/* library configuration options (dynamically generated) */
+#include "loragw_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LGW_TXQ_SUCCESS		 0
+#define LGW_TXQ_ERROR		-1
+#define LGW_TXQ_FULL		-2	/* no room left in the queue */
+#define LGW_TXQ_TOO_LATE	-3	/* trigger time too close or in the past */
+#define LGW_TXQ_COLLISION	-4	/* overlaps a packet already queued */
+
+#define LGW_TXQ_SIZE		32	/* max number of packets waiting in the queue */
+#define LGW_TXQ_GAP_MIN_US	5000	/* min delay between the end of a packet and the trigger time of the next one */
+
+/* per-packet state, see lgw_txq_status */
+/* NOTE: arbitrary values */
+#define TXQ_UNKNOWN			0	/* no such packet, or packet too old to be tracked */
+#define TXQ_QUEUED			1	/* waiting in the queue */
+#define TXQ_LOADED			2	/* in the concentrator TX buffer, waiting for its trigger */
+#define TXQ_SENT			3	/* trigger time and time-on-air elapsed, TX modem free */
+#define TXQ_MISSED			4	/* dropped, could not be loaded before its trigger time */
+#define TXQ_FAILED			5	/* dropped, lgw_send returned an error */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_txq_stats_s
+@brief Counters of the downlink scheduler
+*/
+struct lgw_txq_stats_s {
+	uint32_t	nb_queued;		/*!> packets accepted in the queue */
+	uint32_t	nb_sent;		/*!> packets sent */
+	uint32_t	nb_missed;		/*!> packets dropped because they were loaded too late */
+	uint32_t	nb_failed;		/*!> packets dropped because lgw_send failed */
+	uint32_t	nb_rej_full;	/*!> packets rejected because the queue was full */
+	uint32_t	nb_rej_late;	/*!> packets rejected because their trigger time was too close */
+	uint32_t	nb_rej_collision;	/*!> packets rejected because they overlapped a queued packet */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Start the downlink scheduler thread (the concentrator must be started)
+@return LGW_TXQ_ERROR if the scheduler could not be started, LGW_TXQ_SUCCESS otherwise
+While the scheduler runs, the application must not call lgw_send itself.
+*/
+int lgw_txq_start(void);
+
+/**
+@brief Stop the downlink scheduler thread, queued packets are dropped
+@return LGW_TXQ_ERROR if the scheduler was not running, LGW_TXQ_SUCCESS otherwise
+Must be called before lgw_stop.
+*/
+int lgw_txq_stop(void);
+
+/**
+@brief Queue a TIMESTAMPED packet, to be sent at count_us
+@param pkt_data pointer to the packet to send (copied)
+@param id pointer receiving the packet identifier to use with lgw_txq_status, can be NULL
+@return LGW_TXQ_SUCCESS if the packet was queued, else LGW_TXQ_ERROR (invalid packet),
+LGW_TXQ_FULL, LGW_TXQ_TOO_LATE or LGW_TXQ_COLLISION (less than LGW_TXQ_GAP_MIN_US
+between the packet and a queued one)
+*/
+int lgw_txq_enqueue(const struct lgw_pkt_tx_s *pkt_data, uint32_t *id);
+
+/**
+@brief Get the state of a queued packet
+@param id packet identifier returned by lgw_txq_enqueue
+@param state pointer receiving the packet state (TXQ_xxx)
+@return LGW_TXQ_ERROR if the scheduler is not running, LGW_TXQ_SUCCESS otherwise
+The state of the last 128 queued packets is tracked, older ones are TXQ_UNKNOWN.
+*/
+int lgw_txq_status(uint32_t id, uint8_t *state);
+
+/**
+@brief Get the counters of the downlink scheduler
+@param stats pointer to the structure receiving the counters
+@return LGW_TXQ_ERROR if the scheduler is not running, LGW_TXQ_SUCCESS otherwise
+*/
+int lgw_txq_get_stats(struct lgw_txq_stats_s *stats);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -17,10 +17,26 @@ Maintainer: Sylvain Miermont
 /* -------------------------------------------------------------------------- */
 /* --- DEPENDANCIES --------------------------------------------------------- */
 
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+	#define _XOPEN_SOURCE 600
+#else
+	#define _XOPEN_SOURCE 500
+#endif
+
 #include <stdint.h>		/* C99 types */
 #include <stdbool.h>	/* bool type */
 #include <stdio.h>		/* printf fprintf */
-#include <string.h>		/* memcpy */
+#include <stdlib.h>		/* calloc free */
+#include <string.h>		/* memcpy strncpy */
+#include <errno.h>		/* EINTR */
+#include <time.h>		/* clock_gettime */
+#include <poll.h>		/* poll, wait for the 'packets waiting' event */
+#include <fcntl.h>		/* open fcntl */
+#include <unistd.h>		/* read close */
+#include <sys/ioctl.h>	/* ioctl */
+#include <linux/gpio.h>	/* GPIO character device line events */
+#include <pthread.h>	/* mutex, the RX fetch thread shares the concentrator */
 
 #include "loragw_reg.h"
 #include "loragw_hal.h"
@@ -57,6 +73,11 @@ Maintainer: Sylvain Miermont
 
 #define		TX_METADATA_NB		16
 #define		RX_METADATA_NB		16
+#if (LGW_PKT_REC_SLACK < RX_METADATA_NB)
+	#error "LGW_PKT_REC_SLACK must hold the RX metadata read after the payload"
+#endif
+
+#define		RX_POLL_PERIOD_MS	3	/* FIFO polling period of lgw_receive_wait when no 'packets waiting' event is available */
 
 #define		AGC_CMD_WAIT		16
 #define		AGC_CMD_ABORT		17
@@ -65,10 +86,29 @@ Maintainer: Sylvain Miermont
 #define		STD_LORA_PREAMBLE		6
 #define		MIN_FSK_PREAMBLE		3
 #define		STD_FSK_PREAMBLE		5
+#define		RX_LORA_PREAMBLE		8	/* preamble of received packets, not reported by the modems, LoRaWAN value assumed */
+#define		RX_FSK_PREAMBLE			STD_FSK_PREAMBLE
 #define		PLL_LOCK_MAX_ATTEMPTS	5
 
 #define		TX_START_DELAY		1500
 
+#define		CAL_CACHE_MAGIC		0x4C43414C	/* "LACL", start of a calibration cache file */
+
+#define		START_POLL_MIN_US	100		/* first MCU status polling period during start */
+#define		START_POLL_MAX_US	10000	/* the polling period doubles up to that */
+#define		AGC_TIMEOUT_MS		20		/* max time for the AGC firmware to acknowledge a command */
+#define		AGC_CMD_DELAY_US	1000	/* delay between an AGC command and its parameter (no acknowledge) */
+
+/* LoRa RX timestamp correction tables, see tcorr_init */
+#define		TCORR_MULTI		0	/* multi-SF modems, 125 kHz */
+#define		TCORR_STD_125	1	/* stand-alone modem at 125, 250 and 500 kHz */
+#define		TCORR_STD_250	2
+#define		TCORR_STD_500	3
+#define		TCORR_MOD_NB	4
+#define		TCORR_SF_MIN	6
+#define		TCORR_SF_NB		7	/* SF6 to SF12 */
+#define		TCORR_LEN_NB	258	/* payload size + 2 bytes of CRC */
+
 /*
 SX1257 frequency setting :
 F_register(24bit) = F_rf (Hz) / F_step(Hz)
@@ -281,6 +321,8 @@ typedef struct {
 	#define		CFG_SPI_STR		"native"
 #elif (CFG_SPI_FTDI == 1)
 	#define		CFG_SPI_STR		"ftdi"
+#elif (CFG_SPI_SIM == 1)
+	#define		CFG_SPI_STR		"sim"
 #else
 	#define		CFG_SPI_STR		"spi?"
 #endif
@@ -359,29 +401,110 @@ Parameters validity and coherency is verified by the _setconf functions and
 the _start function assumes 
 */
 
-static bool lgw_is_started;
-
-static bool rf_enable[LGW_RF_CHAIN_NB];
-static uint32_t rf_rx_freq[LGW_RF_CHAIN_NB]; /* absolute, in Hz */
-
-static bool if_enable[LGW_IF_CHAIN_NB];
-static bool if_rf_chain[LGW_IF_CHAIN_NB]; /* for each IF, 0 -> radio A, 1 -> radio B */
-static int32_t if_freq[LGW_IF_CHAIN_NB]; /* relative to radio frequency, +/- in Hz */
-
-static uint8_t lora_multi_sfmask[LGW_MULTI_NB]; /* enables SF for LoRa 'multi' modems */
-
-static uint8_t lora_rx_bw; /* bandwidth setting for LoRa standalone modem */
-static uint8_t lora_rx_sf; /* spreading factor setting for LoRa standalone modem */
-static bool lora_rx_ppm_offset;
-
-static uint8_t fsk_rx_bw; /* bandwidth setting of FSK modem */
-static uint32_t fsk_rx_dr; /* FSK modem datarate in bauds */
-
-/* TX I/Q imbalance coefficients for mixer gain = 8 to 15 */
-static int8_t cal_offset_a_i[8]; /* TX I offset for radio A */
-static int8_t cal_offset_a_q[8]; /* TX Q offset for radio A */
-static int8_t cal_offset_b_i[8]; /* TX I offset for radio B */
-static int8_t cal_offset_b_q[8]; /* TX Q offset for radio B */
+/* calibration results saved by lgw_start_ex, to skip the TX calibration on the next start */
+struct cal_cache_s {
+	uint32_t	magic;			/* CAL_CACHE_MAGIC */
+	uint32_t	key;			/* hash of everything the calibration depends on, see cal_cache_key */
+	int64_t		date;			/* calibration date, seconds since the Epoch */
+	uint8_t		status;			/* status returned by the calibration firmware */
+	int8_t		offset[4][8];	/* TX I/Q offsets of radio A, then radio B */
+};
+
+/* state of one concentrator, see lgw_ctx_new */
+struct lgw_ctx_s {
+	struct lgw_reg_ctx_s *reg; /* register access context, NULL for the default concentrator */
+	
+	bool lgw_is_started;
+	
+	/* SPI link, see lgw_board_setconf */
+	char spi_path[64]; /* empty string to keep the device given to lgw_ctx_new */
+	uint32_t spi_speed; /* in Hz, 0 for default, upper bound of the auto-tune */
+	uint16_t spi_chunk; /* in bytes, 0 for default */
+	bool spi_autotune;
+	
+	pthread_mutex_t mx_rx; /* serialize RX FIFO readers, fetching a packet takes several register transactions */
+	
+	bool rf_enable[LGW_RF_CHAIN_NB];
+	uint32_t rf_rx_freq[LGW_RF_CHAIN_NB]; /* absolute, in Hz */
+	
+	bool if_enable[LGW_IF_CHAIN_NB];
+	bool if_rf_chain[LGW_IF_CHAIN_NB]; /* for each IF, 0 -> radio A, 1 -> radio B */
+	int32_t if_freq[LGW_IF_CHAIN_NB]; /* relative to radio frequency, +/- in Hz */
+	
+	uint8_t lora_multi_sfmask[LGW_MULTI_NB]; /* enables SF for LoRa 'multi' modems */
+	
+	uint8_t lora_rx_bw; /* bandwidth setting for LoRa standalone modem */
+	uint8_t lora_rx_sf; /* spreading factor setting for LoRa standalone modem */
+	bool lora_rx_ppm_offset;
+	
+	uint8_t fsk_rx_bw; /* bandwidth setting of FSK modem */
+	uint32_t fsk_rx_dr; /* FSK modem datarate in bauds */
+	
+	/* RX timestamp corrections, set by lgw_start */
+	int tcorr_std; /* row of the LoRa tables for the stand-alone modem, -1 if its bandwidth is invalid */
+	uint32_t tcorr_fsk; /* FSK packets, modulo 2^32 (negative at high datarates) */
+	
+	/* TX I/Q imbalance coefficients for mixer gain = 8 to 15 */
+	int8_t cal_offset_a_i[8]; /* TX I offset for radio A */
+	int8_t cal_offset_a_q[8]; /* TX Q offset for radio A */
+	int8_t cal_offset_b_i[8]; /* TX I offset for radio B */
+	int8_t cal_offset_b_q[8]; /* TX Q offset for radio B */
+	
+	uint8_t cal_status_last; /* calibration status of the last start */
+	bool cal_cached; /* TX calibration results of the last start were taken from the cache */
+	
+	/* MCU status polling during start, see lgw_conf_start_s */
+	uint32_t start_poll_min_us;
+	uint32_t start_poll_max_us;
+	uint32_t agc_timeout_ms;
+	uint32_t agc_cmd_delay_us;
+	struct lgw_start_wait_s start_wait; /* time spent waiting for the MCUs during the last start */
+	
+	/* profile of the last start, see start_mark */
+	struct lgw_start_profile_s start_prof;
+	struct timespec start_prof_time; /* time of the last phase boundary */
+	struct lgw_reg_stats_s start_prof_spi; /* SPI counters at the last phase boundary */
+	bool start_prof_valid;
+	
+	/* 'packets waiting' notification (DGPIO0), see lgw_rxirq_setconf and lgw_rxirq_setfd */
+	char rx_gpio_chip[64]; /* GPIO character device wired to DGPIO0, empty string if none */
+	uint32_t rx_gpio_line; /* line offset of DGPIO0 on that GPIO chip */
+	int rx_gpio_fd; /* line event file descriptor, owned by the HAL */
+	int rx_ext_fd; /* event file descriptor supplied by the user, not owned by the HAL */
+};
+
+/* concentrator driven by the functions without _ctx suffix */
+static struct lgw_ctx_s lgw_ctx_dflt = {
+	.reg = NULL,
+	.lgw_is_started = false,
+	.mx_rx = PTHREAD_MUTEX_INITIALIZER,
+	.start_prof_valid = false,
+	.rx_gpio_fd = -1,
+	.rx_ext_fd = -1
+};
+
+/* time on air, LoRa SF7 to SF12 (columns) at 500, 250 and 125 kHz (rows): duration of a quarter of symbol in us */
+static const uint16_t toa_qsym_us[3][6] = {
+	{64, 128, 256, 512, 1024, 2048},
+	{128, 256, 512, 1024, 2048, 4096},
+	{256, 512, 1024, 2048, 4096, 8192}
+};
+
+/* time on air: payload bits per block of 4 + CR symbols, low datarate optimization ('PPM mode') included */
+static const uint8_t toa_block_bits[3][6] = {
+	{28, 32, 36, 40, 44, 48},
+	{28, 32, 36, 40, 44, 40},
+	{28, 32, 36, 40, 36, 40}
+};
+
+/* LoRa RX timestamp correction: delay between the end of the packet and the
+'RX finished' event, by modem, SF and payload size (CRC included).
+correction = tcorr_base + (4 + CR) * tcorr_cr, CR = 1 (4/5) to 4 (4/8) */
+static uint16_t tcorr_base[TCORR_MOD_NB][TCORR_SF_NB][TCORR_LEN_NB];
+static uint8_t tcorr_cr[TCORR_MOD_NB][TCORR_SF_NB][TCORR_LEN_NB];
+static pthread_once_t tcorr_once = PTHREAD_ONCE_INIT;
+
+static const char *start_phase_name[LGW_START_PHASE_NB] = {"connect", "radio power-up", "radio setup", "calibration", "firmware load", "constant adjust", "modem config", "AGC init", "finish"};
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
@@ -392,10 +515,53 @@ void sx125x_write(uint8_t channel, uint8_t addr, uint8_t data);
 
 uint8_t sx125x_read(uint8_t channel, uint8_t addr);
 
-int setup_sx125x(uint8_t rf_chain, uint32_t freq_hz);
+int setup_sx125x(struct lgw_ctx_s *ctx, uint8_t rf_chain, uint32_t freq_hz);
 
 void lgw_constant_adjust(void);
 
+int rx_gpio_open(struct lgw_ctx_s *ctx);
+
+void rx_fd_drain(int fd);
+
+uint32_t cal_cache_key(struct lgw_ctx_s *ctx, uint8_t cal_cmd);
+
+int cal_cache_load(const char *path, uint32_t key, uint32_t max_age, struct cal_cache_s *cache);
+
+int cal_cache_save(const char *path, const struct cal_cache_s *cache);
+
+void delay_us(uint32_t us);
+
+int agc_wait_status(struct lgw_ctx_s *ctx, uint8_t mask, uint8_t value, uint32_t timeout_ms, int32_t *status, uint32_t *wait_us);
+
+void agc_cmd(struct lgw_ctx_s *ctx, uint8_t param, uint32_t *wait_us);
+
+void start_mark(struct lgw_ctx_s *ctx, int phase);
+
+void tcorr_init(void);
+
+void rx_decode(struct lgw_ctx_s *ctx, int stat_fifo, unsigned sz, const uint8_t *meta, struct lgw_pkt_rec_s *p);
+
+uint32_t toa_lora(uint32_t datarate, uint8_t bandwidth, uint8_t coderate, uint16_t preamble, uint16_t size, bool crc, bool header);
+
+uint32_t toa_fsk(uint32_t datarate, uint16_t preamble, uint16_t size, bool crc, bool header);
+
+/* bodies of the public functions accessing registers, see lgw_start_ctx */
+int hal_start(struct lgw_ctx_s *ctx, const struct lgw_conf_start_s *conf);
+
+int hal_stop(struct lgw_ctx_s *ctx);
+
+int hal_receive(struct lgw_ctx_s *ctx, uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data);
+
+int hal_receive_into(struct lgw_ctx_s *ctx, uint8_t *arena, uint32_t len);
+
+int hal_send(struct lgw_ctx_s *ctx, struct lgw_pkt_tx_s pkt_data);
+
+int hal_status(struct lgw_ctx_s *ctx, uint8_t select, uint8_t *code);
+
+int hal_get_trigcnt(uint32_t* trig_cnt_us);
+
+int hal_get_instcnt(uint32_t* inst_cnt_us);
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
@@ -476,11 +642,13 @@ void sx125x_write(uint8_t channel, uint8_t addr, uint8_t data) {
 	}
 	
 	/* SPI master data write procedure */
-	lgw_reg_w(reg_cs, 0);
-	lgw_reg_w(reg_add, 0x80 | addr); /* MSB at 1 for write operation */
-	lgw_reg_w(reg_dat, data);
-	lgw_reg_w(reg_cs, 1);
-	lgw_reg_w(reg_cs, 0);
+	lgw_reg_batch_begin();
+	lgw_reg_batch_add_w(reg_cs, 0);
+	lgw_reg_batch_add_w(reg_add, 0x80 | addr); /* MSB at 1 for write operation */
+	lgw_reg_batch_add_w(reg_dat, data);
+	lgw_reg_batch_add_w(reg_cs, 1);
+	lgw_reg_batch_add_w(reg_cs, 0);
+	lgw_reg_batch_commit();
 	
 	return;
 }
@@ -489,7 +657,7 @@ void sx125x_write(uint8_t channel, uint8_t addr, uint8_t data) {
 
 uint8_t sx125x_read(uint8_t channel, uint8_t addr) {
 	int reg_add, reg_dat, reg_cs, reg_rb;
-	int32_t read_value;
+	int32_t read_value = 0;
 	
 	/* checking input parameters */
 	if (channel >= LGW_RF_CHAIN_NB) {
@@ -523,19 +691,21 @@ uint8_t sx125x_read(uint8_t channel, uint8_t addr) {
 	}
 	
 	/* SPI master data read procedure */
-	lgw_reg_w(reg_cs, 0);
-	lgw_reg_w(reg_add, addr); /* MSB at 0 for read operation */
-	lgw_reg_w(reg_dat, 0);
-	lgw_reg_w(reg_cs, 1);
-	lgw_reg_w(reg_cs, 0);
-	lgw_reg_r(reg_rb, &read_value);
+	lgw_reg_batch_begin();
+	lgw_reg_batch_add_w(reg_cs, 0);
+	lgw_reg_batch_add_w(reg_add, addr); /* MSB at 0 for read operation */
+	lgw_reg_batch_add_w(reg_dat, 0);
+	lgw_reg_batch_add_w(reg_cs, 1);
+	lgw_reg_batch_add_w(reg_cs, 0);
+	lgw_reg_batch_add_r(reg_rb, &read_value);
+	lgw_reg_batch_commit();
 	
 	return (uint8_t)read_value;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-int setup_sx125x(uint8_t rf_chain, uint32_t freq_hz) {
+int setup_sx125x(struct lgw_ctx_s *ctx, uint8_t rf_chain, uint32_t freq_hz) {
 	uint32_t part_int;
 	uint32_t part_frac;
 	int cpt_attempts = 0;
@@ -562,7 +732,7 @@ int setup_sx125x(uint8_t rf_chain, uint32_t freq_hz) {
 	sx125x_write(rf_chain, 0x28, SX125x_XOSC_GM_STARTUP + SX125x_XOSC_DISABLE*16);
 	#endif
 	
-	if (rf_enable[rf_chain] == true) {
+	if (ctx->rf_enable[rf_chain] == true) {
 		/* Tx gain and trim */
 		sx125x_write(rf_chain, 0x08, SX125x_TX_MIX_GAIN + SX125x_TX_DAC_GAIN*16);
 		sx125x_write(rf_chain, 0x0A, SX125x_TX_ANA_BW + SX125x_TX_PLL_BW*32);
@@ -594,6 +764,7 @@ int setup_sx125x(uint8_t rf_chain, uint32_t freq_hz) {
 			sx125x_write(rf_chain, 0x00, 1); /* enable Xtal oscillator */
 			sx125x_write(rf_chain, 0x00, 3); /* Enable RX (PLL+FE) */
 			++cpt_attempts;
+			ctx->start_prof.pll_attempts[rf_chain] = cpt_attempts;
 			DEBUG_PRINTF("Note: SX125x #%d PLL start (attempt %d)\n", rf_chain, cpt_attempts);
 			wait_ms(1);
 		} while((sx125x_read(rf_chain, 0x11) & 0x02) == 0);
@@ -608,6 +779,9 @@ int setup_sx125x(uint8_t rf_chain, uint32_t freq_hz) {
 
 void lgw_constant_adjust(void) {
 	
+	/* all the writes below are sent in a single batch */
+	lgw_reg_batch_begin();
+	
 	/* I/Q path setup */
 	// lgw_reg_w(LGW_RX_INVERT_IQ,0); /* default 0 */
 	// lgw_reg_w(LGW_MODEM_INVERT_IQ,1); /* default 1 */
@@ -615,14 +789,14 @@ void lgw_constant_adjust(void) {
 	// lgw_reg_w(LGW_RX_EDGE_SELECT,0); /* default 0 */
 	// lgw_reg_w(LGW_MBWSSF_MODEM_INVERT_IQ,0); /* default 0 */
 	// lgw_reg_w(LGW_DC_NOTCH_EN,1); /* default 1 */
-	lgw_reg_w(LGW_RSSI_BB_FILTER_ALPHA,6); /* default 7 */
-	lgw_reg_w(LGW_RSSI_DEC_FILTER_ALPHA,7); /* default 5 */
-	lgw_reg_w(LGW_RSSI_CHANN_FILTER_ALPHA,7); /* default 8 */
-	lgw_reg_w(LGW_RSSI_BB_DEFAULT_VALUE,23); /* default 32 */
-	lgw_reg_w(LGW_RSSI_CHANN_DEFAULT_VALUE,85); /* default 100 */
-	lgw_reg_w(LGW_RSSI_DEC_DEFAULT_VALUE,66); /* default 100 */
-	lgw_reg_w(LGW_DEC_GAIN_OFFSET,7); /* default 8 */
-	lgw_reg_w(LGW_CHAN_GAIN_OFFSET,6); /* default 7 */
+	lgw_reg_batch_add_w(LGW_RSSI_BB_FILTER_ALPHA,6); /* default 7 */
+	lgw_reg_batch_add_w(LGW_RSSI_DEC_FILTER_ALPHA,7); /* default 5 */
+	lgw_reg_batch_add_w(LGW_RSSI_CHANN_FILTER_ALPHA,7); /* default 8 */
+	lgw_reg_batch_add_w(LGW_RSSI_BB_DEFAULT_VALUE,23); /* default 32 */
+	lgw_reg_batch_add_w(LGW_RSSI_CHANN_DEFAULT_VALUE,85); /* default 100 */
+	lgw_reg_batch_add_w(LGW_RSSI_DEC_DEFAULT_VALUE,66); /* default 100 */
+	lgw_reg_batch_add_w(LGW_DEC_GAIN_OFFSET,7); /* default 8 */
+	lgw_reg_batch_add_w(LGW_CHAN_GAIN_OFFSET,6); /* default 7 */
 	
 	/* Correlator setup */
 	// lgw_reg_w(LGW_CORR_DETECT_EN,126); /* default 126 */
@@ -649,10 +823,10 @@ void lgw_constant_adjust(void) {
 	// lgw_reg_w(LGW_FRAME_SYNCH_GAIN,1); /* default 1 */
 	// lgw_reg_w(LGW_SYNCH_DETECT_TH,1); /* default 1 */
 	// lgw_reg_w(LGW_ZERO_PAD,0); /* default 0 */
-	lgw_reg_w(LGW_SNR_AVG_CST,3); /* default 2 */
+	lgw_reg_batch_add_w(LGW_SNR_AVG_CST,3); /* default 2 */
 	#if (CFG_NET_LORAMAC == 1)
-	lgw_reg_w(LGW_FRAME_SYNCH_PEAK1_POS,3); /* default 1 */
-	lgw_reg_w(LGW_FRAME_SYNCH_PEAK2_POS,4); /* default 2 */
+	lgw_reg_batch_add_w(LGW_FRAME_SYNCH_PEAK1_POS,3); /* default 1 */
+	lgw_reg_batch_add_w(LGW_FRAME_SYNCH_PEAK2_POS,4); /* default 2 */
 	#elif (CFG_NET_PRIVATE == 1)
 	//lgw_reg_w(LGW_FRAME_SYNCH_PEAK1_POS,1); /* default 1 */
 	//lgw_reg_w(LGW_FRAME_SYNCH_PEAK2_POS,2); /* default 2 */
@@ -672,8 +846,8 @@ void lgw_constant_adjust(void) {
 	// lgw_reg_w(LGW_MBWSSF_SYNCH_DETECT_TH,1); /* default 1 */
 	// lgw_reg_w(LGW_MBWSSF_ZERO_PAD,0); /* default 0 */
 	#if (CFG_NET_LORAMAC == 1)
-	lgw_reg_w(LGW_MBWSSF_FRAME_SYNCH_PEAK1_POS,3); /* default 1 */
-	lgw_reg_w(LGW_MBWSSF_FRAME_SYNCH_PEAK2_POS,4); /* default 2 */
+	lgw_reg_batch_add_w(LGW_MBWSSF_FRAME_SYNCH_PEAK1_POS,3); /* default 1 */
+	lgw_reg_batch_add_w(LGW_MBWSSF_FRAME_SYNCH_PEAK2_POS,4); /* default 2 */
 	#elif (CFG_NET_PRIVATE == 1)
 	//lgw_reg_w(LGW_MBWSSF_FRAME_SYNCH_PEAK1_POS,1); /* default 1 */
 	//lgw_reg_w(LGW_MBWSSF_FRAME_SYNCH_PEAK2_POS,2); /* default 2 */
@@ -685,34 +859,34 @@ void lgw_constant_adjust(void) {
 	// lgw_reg_w(LGW_MBWSSF_AGC_FREEZE_ON_DETECT,1); /* default 1 */
 	
 	/* FSK datapath setup */
-	lgw_reg_w(LGW_FSK_RX_INVERT,1); /* default 0 */
-	lgw_reg_w(LGW_FSK_MODEM_INVERT_IQ,1); /* default 0 */
+	lgw_reg_batch_add_w(LGW_FSK_RX_INVERT,1); /* default 0 */
+	lgw_reg_batch_add_w(LGW_FSK_MODEM_INVERT_IQ,1); /* default 0 */
 	
 	/* FSK demodulator setup */
-	lgw_reg_w(LGW_FSK_RSSI_LENGTH,4); /* default 0 */
-	lgw_reg_w(LGW_FSK_PKT_MODE,1); /* variable length, default 0 */
-	lgw_reg_w(LGW_FSK_PSIZE,2); /* pattern size-1, default 0 */
-	lgw_reg_w(LGW_FSK_CRC_EN,1); /* default 0 */
-	lgw_reg_w(LGW_FSK_DCFREE_ENC,2); /* default 0 */
+	lgw_reg_batch_add_w(LGW_FSK_RSSI_LENGTH,4); /* default 0 */
+	lgw_reg_batch_add_w(LGW_FSK_PKT_MODE,1); /* variable length, default 0 */
+	lgw_reg_batch_add_w(LGW_FSK_PSIZE,2); /* pattern size-1, default 0 */
+	lgw_reg_batch_add_w(LGW_FSK_CRC_EN,1); /* default 0 */
+	lgw_reg_batch_add_w(LGW_FSK_DCFREE_ENC,2); /* default 0 */
 	// lgw_reg_w(LGW_FSK_CRC_IBM,0); /* default 0 */
-	lgw_reg_w(LGW_FSK_ERROR_OSR_TOL,10); /* default 0 */
-	lgw_reg_w(LGW_FSK_REF_PATTERN_LSB,0x01010101); /* default 0 */
-	lgw_reg_w(LGW_FSK_REF_PATTERN_MSB,0xC194C101); /* default 0 */
-	lgw_reg_w(LGW_FSK_PKT_LENGTH,255); /* max packet length in variable length mode */
+	lgw_reg_batch_add_w(LGW_FSK_ERROR_OSR_TOL,10); /* default 0 */
+	lgw_reg_batch_add_w(LGW_FSK_REF_PATTERN_LSB,0x01010101); /* default 0 */
+	lgw_reg_batch_add_w(LGW_FSK_REF_PATTERN_MSB,0xC194C101); /* default 0 */
+	lgw_reg_batch_add_w(LGW_FSK_PKT_LENGTH,255); /* max packet length in variable length mode */
 	// lgw_reg_w(LGW_FSK_NODE_ADRS,0); /* default 0 */
 	// lgw_reg_w(LGW_FSK_BROADCAST,0); /* default 0 */
 	// lgw_reg_w(LGW_FSK_AUTO_AFC_ON,0); /* default 0 */
-	lgw_reg_w(LGW_FSK_PATTERN_TIMEOUT_CFG,128); /* sync timeout (allow 8 bytes preamble + 8 bytes sync word, default 0 */
+	lgw_reg_batch_add_w(LGW_FSK_PATTERN_TIMEOUT_CFG,128); /* sync timeout (allow 8 bytes preamble + 8 bytes sync word, default 0 */
 	
 	/* TX general parameters */
-	lgw_reg_w(LGW_TX_START_DELAY, TX_START_DELAY); /* default 0 */
+	lgw_reg_batch_add_w(LGW_TX_START_DELAY, TX_START_DELAY); /* default 0 */
 	
 	/* TX LoRa */
 	// lgw_reg_w(LGW_TX_MODE,0); /* default 0 */
-	lgw_reg_w(LGW_TX_SWAP_IQ,1); /* "normal" polarity; default 0 */
+	lgw_reg_batch_add_w(LGW_TX_SWAP_IQ,1); /* "normal" polarity; default 0 */
 	#if (CFG_NET_LORAMAC == 1)
-	lgw_reg_w(LGW_TX_FRAME_SYNCH_PEAK1_POS,3); /* default 1 */
-	lgw_reg_w(LGW_TX_FRAME_SYNCH_PEAK2_POS,4); /* default 2 */
+	lgw_reg_batch_add_w(LGW_TX_FRAME_SYNCH_PEAK1_POS,3); /* default 1 */
+	lgw_reg_batch_add_w(LGW_TX_FRAME_SYNCH_PEAK2_POS,4); /* default 2 */
 	#elif (CFG_NET_PRIVATE == 1)
 	//lgw_reg_w(LGW_TX_FRAME_SYNCH_PEAK1_POS,1); /* default 1 */
 	//lgw_reg_w(LGW_TX_FRAME_SYNCH_PEAK2_POS,2); /* default 2 */
@@ -720,21 +894,455 @@ void lgw_constant_adjust(void) {
 	
 	/* TX FSK */
 	// lgw_reg_w(LGW_FSK_TX_GAUSSIAN_EN,1); /* default 1 */
-	lgw_reg_w(LGW_FSK_TX_GAUSSIAN_SELECT_BT,2); /* Gaussian filter always on TX, default 0 */
-	lgw_reg_w(LGW_FSK_TX_PSIZE,2); /* default 0 */
+	lgw_reg_batch_add_w(LGW_FSK_TX_GAUSSIAN_SELECT_BT,2); /* Gaussian filter always on TX, default 0 */
+	lgw_reg_batch_add_w(LGW_FSK_TX_PSIZE,2); /* default 0 */
 	// lgw_reg_w(LGW_FSK_TX_PATTERN_EN,1); /* default 1 */
 	// lgw_reg_w(LGW_FSK_TX_PREAMBLE_SEQ,0); /* default 0 */
 	
+	lgw_reg_batch_commit();
+	
+	return;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* request rising edge events on the GPIO line wired to DGPIO0 */
+int rx_gpio_open(struct lgw_ctx_s *ctx) {
+	struct gpioevent_request req;
+	int chip_fd;
+	int flags;
+	
+	chip_fd = open(ctx->rx_gpio_chip, O_RDONLY);
+	if (chip_fd < 0) {
+		DEBUG_PRINTF("ERROR: FAILED TO OPEN GPIO CHIP %s\n", ctx->rx_gpio_chip);
+		return LGW_HAL_ERROR;
+	}
+	memset(&req, 0, sizeof(req));
+	req.lineoffset = ctx->rx_gpio_line;
+	req.handleflags = GPIOHANDLE_REQUEST_INPUT;
+	req.eventflags = GPIOEVENT_REQUEST_RISING_EDGE;
+	strncpy(req.consumer_label, "lgw_rx_waiting", sizeof(req.consumer_label) - 1);
+	if (ioctl(chip_fd, GPIO_GET_LINEEVENT_IOCTL, &req) < 0) {
+		DEBUG_PRINTF("ERROR: FAILED TO REQUEST EVENTS ON GPIO LINE %u\n", ctx->rx_gpio_line);
+		close(chip_fd);
+		return LGW_HAL_ERROR;
+	}
+	close(chip_fd); /* the line event fd stays valid */
+	
+	/* events are drained without blocking */
+	flags = fcntl(req.fd, F_GETFL, 0);
+	fcntl(req.fd, F_SETFL, flags | O_NONBLOCK);
+	ctx->rx_gpio_fd = req.fd;
+	return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* consume all pending events, GPIO line events and eventfd counters alike */
+void rx_fd_drain(int fd) {
+	uint8_t buff[64]; /* multiple of both struct gpioevent_data and eventfd counter sizes */
+	struct pollfd pfd;
+	
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	while ((poll(&pfd, 1, 0) > 0) && (pfd.revents & POLLIN)) {
+		if (read(fd, buff, sizeof(buff)) <= 0) {
+			break;
+		}
+	}
 	return;
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* FNV-1a hash of the calibration inputs: command, radio frequencies, firmware and library options */
+uint32_t cal_cache_key(struct lgw_ctx_s *ctx, uint8_t cal_cmd) {
+	uint32_t h = 2166136261u;
+	const char *opt = lgw_version_info();
+	int i;
+	
+	h = (h ^ cal_cmd) * 16777619u;
+	for (i = 0; i < LGW_RF_CHAIN_NB; ++i) {
+		h = (h ^ (0xFF & ctx->rf_rx_freq[i])) * 16777619u;
+		h = (h ^ (0xFF & (ctx->rf_rx_freq[i] >> 8))) * 16777619u;
+		h = (h ^ (0xFF & (ctx->rf_rx_freq[i] >> 16))) * 16777619u;
+		h = (h ^ (0xFF & (ctx->rf_rx_freq[i] >> 24))) * 16777619u;
+	}
+	for (i = 0; i < MCU_AGC_FW_BYTE; ++i) {
+		h = (h ^ cal_firmware[i]) * 16777619u;
+	}
+	for (i = 0; opt[i] != '\0'; ++i) {
+		h = (h ^ (uint8_t)opt[i]) * 16777619u;
+	}
+	return h;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* read a calibration cache file, fails if it is missing, does not match the key or is too old */
+int cal_cache_load(const char *path, uint32_t key, uint32_t max_age, struct cal_cache_s *cache) {
+	FILE *f;
+	size_t n;
+	time_t now = time(NULL);
+	
+	f = fopen(path, "rb");
+	if (f == NULL) {
+		DEBUG_PRINTF("Note: no calibration cache %s\n", path);
+		return LGW_HAL_ERROR;
+	}
+	n = fread(cache, sizeof(struct cal_cache_s), 1, f);
+	fclose(f);
+	if ((n != 1) || (cache->magic != CAL_CACHE_MAGIC)) {
+		DEBUG_PRINTF("WARNING: invalid calibration cache %s\n", path);
+		return LGW_HAL_ERROR;
+	}
+	if (cache->key != key) {
+		DEBUG_MSG("Note: calibration cache made for another configuration\n");
+		return LGW_HAL_ERROR;
+	}
+	if ((max_age != 0) && ((cache->date > (int64_t)now) || ((int64_t)now - cache->date > (int64_t)max_age))) {
+		DEBUG_PRINTF("Note: calibration cache is stale (%lld s old)\n", (long long)now - (long long)cache->date);
+		return LGW_HAL_ERROR;
+	}
+	return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* write a calibration cache file, through a temporary file so that a reader never sees a partial file */
+int cal_cache_save(const char *path, const struct cal_cache_s *cache) {
+	FILE *f;
+	char tmp_path[256];
+	int i;
+	
+	i = snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+	if ((i < 0) || ((size_t)i >= sizeof(tmp_path))) {
+		DEBUG_MSG("ERROR: CALIBRATION CACHE PATH TOO LONG\n");
+		return LGW_HAL_ERROR;
+	}
+	f = fopen(tmp_path, "wb");
+	if (f == NULL) {
+		DEBUG_PRINTF("ERROR: FAILED TO CREATE CALIBRATION CACHE %s\n", tmp_path);
+		return LGW_HAL_ERROR;
+	}
+	i = fwrite(cache, sizeof(struct cal_cache_s), 1, f);
+	if ((fclose(f) != 0) || (i != 1) || (rename(tmp_path, path) != 0)) {
+		DEBUG_PRINTF("ERROR: FAILED TO WRITE CALIBRATION CACHE %s\n", path);
+		remove(tmp_path);
+		return LGW_HAL_ERROR;
+	}
+	return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void delay_us(uint32_t us) {
+	struct timespec dly;
+	
+	dly.tv_sec = us / 1000000;
+	dly.tv_nsec = 1000 * (long)(us % 1000000);
+	while (nanosleep(&dly, &dly) != 0) {
+		if (errno != EINTR) {
+			break;
+		}
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* poll the AGC MCU status until (status & mask) == value, the polling period doubling from
+start_poll_min_us to start_poll_max_us; the time spent is added to wait_us */
+int agc_wait_status(struct lgw_ctx_s *ctx, uint8_t mask, uint8_t value, uint32_t timeout_ms, int32_t *status, uint32_t *wait_us) {
+	struct timespec start, now;
+	uint32_t period_us = ctx->start_poll_min_us;
+	uint32_t elapsed_us;
+	
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (1) {
+		lgw_reg_r(LGW_MCU_AGC_STATUS, status);
+		++ctx->start_wait.nb_poll;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		elapsed_us = (uint32_t)((now.tv_sec - start.tv_sec) * 1000000 + (now.tv_nsec - start.tv_nsec) / 1000);
+		if (((uint8_t)*status & mask) == value) {
+			*wait_us += elapsed_us;
+			return LGW_HAL_SUCCESS;
+		}
+		if (elapsed_us >= 1000 * timeout_ms) {
+			*wait_us += elapsed_us;
+			DEBUG_PRINTF("WARNING: AGC MCU status 0x%02X after %u us, expected 0x%02X\n", (uint8_t)*status, elapsed_us, value);
+			return LGW_HAL_ERROR;
+		}
+		delay_us(period_us);
+		period_us = (2 * period_us < ctx->start_poll_max_us) ? 2 * period_us : ctx->start_poll_max_us;
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* send a command parameter to the AGC firmware, the time spent is added to wait_us */
+void agc_cmd(struct lgw_ctx_s *ctx, uint8_t param, uint32_t *wait_us) {
+	lgw_reg_w(LGW_RADIO_SELECT, AGC_CMD_WAIT); /* start a transaction */
+	delay_us(ctx->agc_cmd_delay_us); /* no acknowledge, give the firmware time to see the command */
+	*wait_us += ctx->agc_cmd_delay_us;
+	lgw_reg_w(LGW_RADIO_SELECT, param);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* end of a start phase: time and SPI traffic since the previous mark are added to that phase */
+void start_mark(struct lgw_ctx_s *ctx, int phase) {
+	struct timespec now;
+	struct lgw_reg_stats_s spi;
+	struct lgw_start_phase_s *p = &ctx->start_prof.phase[phase];
+	uint32_t us;
+	
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	lgw_reg_get_stats(&spi);
+	us = (uint32_t)((now.tv_sec - ctx->start_prof_time.tv_sec) * 1000000 + (now.tv_nsec - ctx->start_prof_time.tv_nsec) / 1000);
+	p->duration_us += us;
+	p->nb_submit += spi.nb_submit - ctx->start_prof_spi.nb_submit;
+	p->nb_frame += spi.nb_frame - ctx->start_prof_spi.nb_frame;
+	p->nb_byte += spi.nb_byte - ctx->start_prof_spi.nb_byte;
+	ctx->start_prof.total_us += us;
+	ctx->start_prof_time = now;
+	ctx->start_prof_spi = spi;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* decode the metadata read after the payload of a received packet */
+void rx_decode(struct lgw_ctx_s *ctx, int stat_fifo, unsigned sz, const uint8_t *meta, struct lgw_pkt_rec_s *p) {
+	int ifmod; /* type of if_chain/modem a packet was received by */
+	uint32_t raw_timestamp; /* timestamp when internal 'RX finished' was triggered */
+	uint32_t timestamp_correction; /* correction to account for processing delay */
+	uint32_t sf, cr, crc_en; /* used to calculate timestamp correction */
+	int tc; /* row of the timestamp correction tables */
+	
+	p->if_chain = meta[0];
+	ifmod = ifmod_config[p->if_chain];
+	DEBUG_PRINTF("[%d %d]\n", p->if_chain, ifmod);
+	p->rssi = (float)meta[5] - RSSI_BOARD_OFFSET;
+	
+	if ((ifmod == IF_LORA_MULTI) || (ifmod == IF_LORA_STD)) {
+		DEBUG_MSG("Note: LoRa packet\n");
+		switch(stat_fifo & 0x07) {
+			case 5:
+				p->status = STAT_CRC_OK;
+				crc_en = 1;
+				break;
+			case 7:
+				p->status = STAT_CRC_BAD;
+				crc_en = 1;
+				break;
+			case 1:
+				p->status = STAT_NO_CRC;
+				crc_en = 0;
+				break;
+			default:
+				p->status = STAT_UNDEFINED;
+				crc_en = 0;
+		}
+		p->modulation = MOD_LORA;
+		p->snr = ((float)((int8_t)meta[2]))/4;
+		p->snr_min = ((float)((int8_t)meta[3]))/4;
+		p->snr_max = ((float)((int8_t)meta[4]))/4;
+		if (ifmod == IF_LORA_MULTI) {
+			p->bandwidth = BW_125KHZ; /* fixed in hardware */
+		} else {
+			p->bandwidth = ctx->lora_rx_bw; /* get the parameter from the config variable */
+		}
+		sf = (meta[1] >> 4) & 0x0F;
+		switch (sf) {
+			case 7: p->datarate = DR_LORA_SF7; break;
+			case 8: p->datarate = DR_LORA_SF8; break;
+			case 9: p->datarate = DR_LORA_SF9; break;
+			case 10: p->datarate = DR_LORA_SF10; break;
+			case 11: p->datarate = DR_LORA_SF11; break;
+			case 12: p->datarate = DR_LORA_SF12; break;
+			default: p->datarate = DR_UNDEFINED;
+		}
+		cr = (meta[1] >> 1) & 0x07;
+		switch (cr) {
+			case 1: p->coderate = CR_LORA_4_5; break;
+			case 2: p->coderate = CR_LORA_4_6; break;
+			case 3: p->coderate = CR_LORA_4_7; break;
+			case 4: p->coderate = CR_LORA_4_8; break;
+			default: p->coderate = CR_UNDEFINED;
+		}
+		
+		/* timestamp correction, precomputed by tcorr_init */
+		tc = (ifmod == IF_LORA_MULTI) ? TCORR_MULTI : ctx->tcorr_std;
+		if ((sf >= TCORR_SF_MIN) && (sf < (TCORR_SF_MIN + TCORR_SF_NB)) && (tc >= 0)) {
+			timestamp_correction = tcorr_base[tc][sf - TCORR_SF_MIN][sz + 2*crc_en] + (4 + cr) * tcorr_cr[tc][sf - TCORR_SF_MIN][sz + 2*crc_en];
+		} else {
+			timestamp_correction = 0;
+			DEBUG_MSG("WARNING: invalid packet, no timestamp correction\n");
+		}
+		
+		/* RSSI correction */
+		if (ifmod == IF_LORA_MULTI) {
+			p->rssi -= RSSI_MULTI_BIAS;
+		}
+		
+	} else if (ifmod == IF_FSK_STD) {
+		DEBUG_MSG("Note: FSK packet\n");
+		switch(stat_fifo & 0x07) {
+			case 5: p->status = STAT_CRC_OK; break;
+			case 7: p->status = STAT_CRC_BAD; break;
+			case 1: p->status = STAT_NO_CRC; break;
+			default: p->status = STAT_UNDEFINED;
+		}
+		p->modulation = MOD_FSK;
+		p->snr = -128.0;
+		p->snr_min = -128.0;
+		p->snr_max = -128.0;
+		p->bandwidth = ctx->fsk_rx_bw;
+		p->datarate = ctx->fsk_rx_dr;
+		p->coderate = CR_UNDEFINED;
+		timestamp_correction = ctx->tcorr_fsk;
+		
+		/* RSSI correction */
+		p->rssi -= RSSI_FSK_BIAS;
+		p->rssi = ((p->rssi - RSSI_FSK_REF) * RSSI_FSK_SLOPE) + RSSI_FSK_REF;
+	} else {
+		DEBUG_MSG("ERROR: UNEXPECTED PACKET ORIGIN\n");
+		p->status = STAT_UNDEFINED;
+		p->modulation = MOD_UNDEFINED;
+		p->rssi = -128.0;
+		p->snr = -128.0;
+		p->snr_min = -128.0;
+		p->snr_max = -128.0;
+		p->bandwidth = BW_UNDEFINED;
+		p->datarate = DR_UNDEFINED;
+		p->coderate = CR_UNDEFINED;
+		timestamp_correction = 0;
+	}
+	
+	raw_timestamp = (uint32_t)meta[6] + ((uint32_t)meta[7] << 8) + ((uint32_t)meta[8] << 16) + ((uint32_t)meta[9] << 24);
+	p->count_us = raw_timestamp - timestamp_correction;
+	p->crc = (uint16_t)meta[10] + ((uint16_t)meta[11] << 8);
+	p->size = (uint16_t)sz;
+	
+	/* get back info from configuration so that application doesn't have to keep track of it */
+	p->rf_chain = (uint8_t)ctx->if_rf_chain[p->if_chain];
+	p->freq_hz = (uint32_t)((int32_t)ctx->rf_rx_freq[p->rf_chain] + ctx->if_freq[p->if_chain]);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* fill the LoRa RX timestamp correction tables, called once */
+void tcorr_init(void) {
+	const uint32_t mod_x[TCORR_MOD_NB] = {114, 64, 32, 16}; /* base delay */
+	const uint32_t mod_bw_pow[TCORR_MOD_NB] = {1, 1, 2, 4};
+	const uint8_t mod_bw[TCORR_MOD_NB] = {BW_125KHZ, BW_125KHZ, BW_250KHZ, BW_500KHZ};
+	uint32_t delay_y, delay_z; /* variable delay */
+	uint32_t sf, bw_pow, ppm, len;
+	uint32_t dr;
+	int m;
+	
+	for (m = 0; m < TCORR_MOD_NB; ++m) {
+		bw_pow = mod_bw_pow[m];
+		for (sf = TCORR_SF_MIN; sf < (TCORR_SF_MIN + TCORR_SF_NB); ++sf) {
+			dr = (sf >= 7) ? (DR_LORA_SF7 << (sf - 7)) : DR_UNDEFINED;
+			ppm = SET_PPM_ON(mod_bw[m], dr) ? 1 : 0;
+			for (len = 0; len < TCORR_LEN_NB; ++len) {
+				/* unsigned arithmetic, only true when 2*len == sf-7 */
+				if ((2*len - (sf-7)) == 0) { /* payload fits entirely in first 8 symbols */
+					delay_y = ( ((1<<(sf-1)) * (sf+1)) + (3 * (1<<(sf-4))) ) / bw_pow;
+					delay_z = 32 * (2*len + 5) / bw_pow;
+					tcorr_base[m][sf - TCORR_SF_MIN][len] = (uint16_t)(mod_x[m] + delay_y + delay_z);
+					tcorr_cr[m][sf - TCORR_SF_MIN][len] = 0;
+				} else {
+					delay_y = ( ((1<<(sf-1)) * (sf+1)) + ((4 - ppm) * (1<<(sf-4))) ) / bw_pow;
+					/* delay_z = (16 + 4*cr) * symbols / bw_pow, exact because bw_pow divides 4 */
+					delay_z = (((2*len-sf+6) % (sf - 2*ppm)) + 1) * 4 / bw_pow;
+					tcorr_base[m][sf - TCORR_SF_MIN][len] = (uint16_t)(mod_x[m] + delay_y);
+					tcorr_cr[m][sf - TCORR_SF_MIN][len] = (uint8_t)delay_z;
+				}
+			}
+		}
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* time on air of a LoRa packet in microseconds, 0 if the modulation parameters are invalid */
+uint32_t toa_lora(uint32_t datarate, uint8_t bandwidth, uint8_t coderate, uint16_t preamble, uint16_t size, bool crc, bool header) {
+	int sf_i, bw_i, bits, n_sym;
+	
+	switch (datarate) {
+		case DR_LORA_SF7: sf_i = 0; break;
+		case DR_LORA_SF8: sf_i = 1; break;
+		case DR_LORA_SF9: sf_i = 2; break;
+		case DR_LORA_SF10: sf_i = 3; break;
+		case DR_LORA_SF11: sf_i = 4; break;
+		case DR_LORA_SF12: sf_i = 5; break;
+		default: return 0;
+	}
+	if (!IS_LORA_BW(bandwidth) || !IS_LORA_CR(coderate)) {
+		return 0;
+	}
+	bw_i = bandwidth - BW_500KHZ;
+	/* 8 symbols for the header block, then blocks of (4 + CR) symbols, CR = 1 to 4 */
+	bits = 8 * size - 4 * (sf_i + 7) + 28 + (crc ? 16 : 0) - (header ? 0 : 20);
+	n_sym = 8;
+	if (bits > 0) {
+		n_sym += ((bits + toa_block_bits[bw_i][sf_i] - 1) / toa_block_bits[bw_i][sf_i]) * (coderate + 4);
+	}
+	/* preamble + 4.25 symbols of synchronization + payload, in quarters of symbol */
+	return (4 * preamble + 17 + 4 * n_sym) * toa_qsym_us[bw_i][sf_i];
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* time on air of an FSK packet in microseconds, 0 if the datarate is invalid */
+uint32_t toa_fsk(uint32_t datarate, uint16_t preamble, uint16_t size, bool crc, bool header) {
+	uint32_t bits;
+	
+	if (!IS_FSK_DR(datarate)) {
+		return 0;
+	}
+	/* preamble, 3-byte sync word, length byte, payload, CRC */
+	bits = 8 * (preamble + 3 + (header ? 1 : 0) + size + (crc ? 2 : 0));
+	return (uint32_t)(((uint64_t)bits * 1000000 + datarate - 1) / datarate);
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
-int lgw_rxrf_setconf(uint8_t rf_chain, struct lgw_conf_rxrf_s conf) {
+int lgw_board_setconf_ctx(lgw_ctx_t *ctx, struct lgw_conf_board_s conf) {
+	CHECK_NULL(ctx);
+	
+	/* check if the concentrator is running */
+	if (ctx->lgw_is_started == true) {
+		DEBUG_MSG("ERROR: CONCENTRATOR IS RUNNING, STOP IT BEFORE TOUCHING CONFIGURATION\n");
+		return LGW_HAL_ERROR;
+	}
+	
+	/* check input parameters */
+	if (memchr(conf.spi_path, '\0', sizeof(ctx->spi_path)) == NULL) {
+		DEBUG_MSG("ERROR: SPI DEVICE PATH NOT TERMINATED\n");
+		return LGW_HAL_ERROR;
+	}
+	
+	/* set internal config according to parameters, applied at start */
+	strcpy(ctx->spi_path, conf.spi_path);
+	ctx->spi_speed = conf.spi_speed;
+	ctx->spi_chunk = conf.spi_chunk;
+	ctx->spi_autotune = conf.spi_autotune;
+	
+	DEBUG_PRINTF("Note: board configuration; spi_path:%s speed:%u chunk:%u autotune:%d\n", ctx->spi_path, ctx->spi_speed, ctx->spi_chunk, ctx->spi_autotune);
+	
+	return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_rxrf_setconf_ctx(lgw_ctx_t *ctx, uint8_t rf_chain, struct lgw_conf_rxrf_s conf) {
+	CHECK_NULL(ctx);
 	
 	/* check if the concentrator is running */
-	if (lgw_is_started == true) {
+	if (ctx->lgw_is_started == true) {
 		DEBUG_MSG("ERROR: CONCENTRATOR IS RUNNING, STOP IT BEFORE TOUCHING CONFIGURATION\n");
 		return LGW_HAL_ERROR;
 	}
@@ -755,19 +1363,21 @@ int lgw_rxrf_setconf(uint8_t rf_chain, struct lgw_conf_rxrf_s conf) {
 	}
 	
 	/* set internal config according to parameters */
-	rf_enable[rf_chain] = conf.enable;
-	rf_rx_freq[rf_chain] = conf.freq_hz;
+	ctx->rf_enable[rf_chain] = conf.enable;
+	ctx->rf_rx_freq[rf_chain] = conf.freq_hz;
 	
-	DEBUG_PRINTF("Note: rf_chain %d configuration; en:%d freq:%d\n", rf_chain, rf_enable[rf_chain], rf_rx_freq[rf_chain]);
+	DEBUG_PRINTF("Note: rf_chain %d configuration; en:%d freq:%d\n", rf_chain, ctx->rf_enable[rf_chain], ctx->rf_rx_freq[rf_chain]);
 	
 	return LGW_HAL_SUCCESS;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-int lgw_rxif_setconf(uint8_t if_chain, struct lgw_conf_rxif_s conf) {
+int lgw_rxif_setconf_ctx(lgw_ctx_t *ctx, uint8_t if_chain, struct lgw_conf_rxif_s conf) {
+	CHECK_NULL(ctx);
+	
 	/* check if the concentrator is running */
-	if (lgw_is_started == true) {
+	if (ctx->lgw_is_started == true) {
 		DEBUG_MSG("ERROR: CONCENTRATOR IS RUNNING, STOP IT BEFORE TOUCHING CONFIGURATION\n");
 		return LGW_HAL_ERROR;
 	}
@@ -780,8 +1390,8 @@ int lgw_rxif_setconf(uint8_t if_chain, struct lgw_conf_rxif_s conf) {
 	
 	/* if chain is disabled, don't care about most parameters */
 	if (conf.enable == false) {
-		if_enable[if_chain] = false;
-		if_freq[if_chain] = 0;
+		ctx->if_enable[if_chain] = false;
+		ctx->if_freq[if_chain] = 0;
 		DEBUG_PRINTF("Note: if_chain %d disabled\n", if_chain);
 		return LGW_HAL_SUCCESS;
 	}
@@ -824,18 +1434,18 @@ int lgw_rxif_setconf(uint8_t if_chain, struct lgw_conf_rxif_s conf) {
 				return LGW_HAL_ERROR;
 			}
 			/* set internal configuration  */
-			if_enable[if_chain] = conf.enable;
-			if_rf_chain[if_chain] = conf.rf_chain;
-			if_freq[if_chain] = conf.freq_hz;
-			lora_rx_bw = conf.bandwidth;
-			lora_rx_sf = (uint8_t)(DR_LORA_MULTI & conf.datarate); /* filter SF out of the 7-12 range */
+			ctx->if_enable[if_chain] = conf.enable;
+			ctx->if_rf_chain[if_chain] = conf.rf_chain;
+			ctx->if_freq[if_chain] = conf.freq_hz;
+			ctx->lora_rx_bw = conf.bandwidth;
+			ctx->lora_rx_sf = (uint8_t)(DR_LORA_MULTI & conf.datarate); /* filter SF out of the 7-12 range */
 			if (SET_PPM_ON(conf.bandwidth, conf.datarate)) {
-				lora_rx_ppm_offset = true;
+				ctx->lora_rx_ppm_offset = true;
 			} else {
-				lora_rx_ppm_offset = false;
+				ctx->lora_rx_ppm_offset = false;
 			}
 			
-			DEBUG_PRINTF("Note: LoRa 'std' if_chain %d configuration; en:%d freq:%d bw:%d dr:%d\n", if_chain, if_enable[if_chain], if_freq[if_chain], lora_rx_bw, lora_rx_sf);
+			DEBUG_PRINTF("Note: LoRa 'std' if_chain %d configuration; en:%d freq:%d bw:%d dr:%d\n", if_chain, ctx->if_enable[if_chain], ctx->if_freq[if_chain], ctx->lora_rx_bw, ctx->lora_rx_sf);
 			break;
 		
 		case IF_LORA_MULTI:
@@ -856,12 +1466,12 @@ int lgw_rxif_setconf(uint8_t if_chain, struct lgw_conf_rxif_s conf) {
 				return LGW_HAL_ERROR;
 			}
 			/* set internal configuration  */
-			if_enable[if_chain] = conf.enable;
-			if_rf_chain[if_chain] = conf.rf_chain;
-			if_freq[if_chain] = conf.freq_hz;
-			lora_multi_sfmask[if_chain] = (uint8_t)(DR_LORA_MULTI & conf.datarate); /* filter SF out of the 7-12 range */
+			ctx->if_enable[if_chain] = conf.enable;
+			ctx->if_rf_chain[if_chain] = conf.rf_chain;
+			ctx->if_freq[if_chain] = conf.freq_hz;
+			ctx->lora_multi_sfmask[if_chain] = (uint8_t)(DR_LORA_MULTI & conf.datarate); /* filter SF out of the 7-12 range */
 			
-			DEBUG_PRINTF("Note: LoRa 'multi' if_chain %d configuration; en:%d freq:%d SF_mask:0x%02x\n", if_chain, if_enable[if_chain], if_freq[if_chain], lora_multi_sfmask[if_chain]);
+			DEBUG_PRINTF("Note: LoRa 'multi' if_chain %d configuration; en:%d freq:%d SF_mask:0x%02x\n", if_chain, ctx->if_enable[if_chain], ctx->if_freq[if_chain], ctx->lora_multi_sfmask[if_chain]);
 			break;
 		
 		case IF_FSK_STD:
@@ -882,12 +1492,12 @@ int lgw_rxif_setconf(uint8_t if_chain, struct lgw_conf_rxif_s conf) {
 				return LGW_HAL_ERROR;
 			}
 			/* set internal configuration  */
-			if_enable[if_chain] = conf.enable;
-			if_rf_chain[if_chain] = conf.rf_chain;
-			if_freq[if_chain] = conf.freq_hz;
-			fsk_rx_bw = conf.bandwidth;
-			fsk_rx_dr = conf.datarate;
-			DEBUG_PRINTF("Note: FSK if_chain %d configuration; en:%d freq:%d bw:%d dr:%d (%d real dr)\n", if_chain, if_enable[if_chain], if_freq[if_chain], fsk_rx_bw, fsk_rx_dr, LGW_XTAL_FREQU/(LGW_XTAL_FREQU/fsk_rx_dr));
+			ctx->if_enable[if_chain] = conf.enable;
+			ctx->if_rf_chain[if_chain] = conf.rf_chain;
+			ctx->if_freq[if_chain] = conf.freq_hz;
+			ctx->fsk_rx_bw = conf.bandwidth;
+			ctx->fsk_rx_dr = conf.datarate;
+			DEBUG_PRINTF("Note: FSK if_chain %d configuration; en:%d freq:%d bw:%d dr:%d (%d real dr)\n", if_chain, ctx->if_enable[if_chain], ctx->if_freq[if_chain], ctx->fsk_rx_bw, ctx->fsk_rx_dr, LGW_XTAL_FREQU/(LGW_XTAL_FREQU/ctx->fsk_rx_dr));
 			break;
 		
 		default:
@@ -900,33 +1510,68 @@ int lgw_rxif_setconf(uint8_t if_chain, struct lgw_conf_rxif_s conf) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-int lgw_start(void) {
+int hal_start(struct lgw_ctx_s *ctx, const struct lgw_conf_start_s *conf) {
 	int i;
 	int reg_stat;
 	unsigned x;
 	uint8_t radio_select;
+	uint8_t mbwssf_bw, mbwssf_sf;
 	int32_t read_val;
-	uint8_t load_val;
+	int32_t cal_val[32]; /* TX DC offsets read from the AGC MCU RAM */
 	
 	uint8_t cal_cmd;
 	uint16_t cal_time;
 	uint8_t cal_status;
+	struct cal_cache_s cache;
 	
-	if (lgw_is_started == true) {
+	if (ctx->lgw_is_started == true) {
 		DEBUG_MSG("Note: LoRa concentrator already started, restarting it now\n");
 	}
 	
+	/* status polling parameters */
+	ctx->start_poll_min_us = ((conf != NULL) && (conf->poll_min_us != 0)) ? conf->poll_min_us : START_POLL_MIN_US;
+	ctx->start_poll_max_us = ((conf != NULL) && (conf->poll_max_us != 0)) ? conf->poll_max_us : START_POLL_MAX_US;
+	if (ctx->start_poll_max_us < ctx->start_poll_min_us) {
+		ctx->start_poll_max_us = ctx->start_poll_min_us;
+	}
+	ctx->agc_timeout_ms = ((conf != NULL) && (conf->agc_timeout_ms != 0)) ? conf->agc_timeout_ms : AGC_TIMEOUT_MS;
+	ctx->agc_cmd_delay_us = ((conf != NULL) && (conf->agc_cmd_delay_us != 0)) ? conf->agc_cmd_delay_us : AGC_CMD_DELAY_US;
+	memset(&ctx->start_wait, 0, sizeof(ctx->start_wait));
+	
+	/* profile, the SPI counters are reset on connection */
+	memset(&ctx->start_prof, 0, sizeof(ctx->start_prof));
+	for (i = 0; i < LGW_START_PHASE_NB; ++i) {
+		ctx->start_prof.phase[i].name = start_phase_name[i];
+	}
+	memset(&ctx->start_prof_spi, 0, sizeof(ctx->start_prof_spi));
+	clock_gettime(CLOCK_MONOTONIC, &ctx->start_prof_time);
+	ctx->start_prof_valid = true;
+	
+	/* SPI link parameters, the auto-tune starts from the default clock */
+	lgw_reg_spi_setconf((ctx->spi_path[0] != '\0') ? ctx->spi_path : NULL, ctx->spi_autotune ? 0 : ctx->spi_speed, ctx->spi_chunk);
 	reg_stat = lgw_connect();
 	if (reg_stat == LGW_REG_ERROR) {
 		DEBUG_MSG("ERROR: FAIL TO CONNECT BOARD\n");
 		return LGW_HAL_ERROR;
 	}
+	if (ctx->spi_autotune == true) {
+		reg_stat = lgw_reg_spi_autotune(ctx->spi_speed);
+		if (reg_stat == LGW_REG_ERROR) {
+			DEBUG_MSG("ERROR: NO RELIABLE SPI CLOCK FOUND\n");
+			lgw_disconnect();
+			return LGW_HAL_ERROR;
+		}
+	}
 	
 	/* reset the registers (also shuts the radios down) */
 	lgw_soft_reset();
 	
+	/* avoid SPI reads on sub-byte register writes, cache starts empty after reset */
+	lgw_reg_cache_enable(true);
+	
 	/* ungate clocks (gated by default) */
 	lgw_reg_w(LGW_GLOBAL_EN, 1);
+	start_mark(ctx, LGW_START_CONNECT);
 	
 	/* switch on and reset the radios (also starts the 32 MHz XTAL) */
 	lgw_reg_w(LGW_RADIO_A_EN,1);
@@ -935,17 +1580,19 @@ int lgw_start(void) {
 	lgw_reg_w(LGW_RADIO_RST,1);
 	wait_ms(5);
 	lgw_reg_w(LGW_RADIO_RST,0);
+	start_mark(ctx, LGW_START_RADIO_POWER);
 	
 	/* setup the radios */
-	setup_sx125x(0, rf_rx_freq[0]);
-	setup_sx125x(1, rf_rx_freq[1]);
+	setup_sx125x(ctx, 0, ctx->rf_rx_freq[0]);
+	setup_sx125x(ctx, 1, ctx->rf_rx_freq[1]);
+	start_mark(ctx, LGW_START_RADIO_SETUP);
 	
 	/* select calibration command */
 	cal_cmd = 0;
-	cal_cmd |= rf_enable[0] ? 0x01 : 0x00; /* Bit 0: Calibrate Rx IQ mismatch compensation on radio A */
-	cal_cmd |= rf_enable[1] ? 0x02 : 0x00; /* Bit 1: Calibrate Rx IQ mismatch compensation on radio B */
-	cal_cmd |= (rf_enable[0] && rf_tx_enable[0]) ? 0x04 : 0x00; /* Bit 2: Calibrate Tx DC offset on radio A */
-	cal_cmd |= (rf_enable[1] && rf_tx_enable[1]) ? 0x08 : 0x00; /* Bit 3: Calibrate Tx DC offset on radio B */
+	cal_cmd |= ctx->rf_enable[0] ? 0x01 : 0x00; /* Bit 0: Calibrate Rx IQ mismatch compensation on radio A */
+	cal_cmd |= ctx->rf_enable[1] ? 0x02 : 0x00; /* Bit 1: Calibrate Rx IQ mismatch compensation on radio B */
+	cal_cmd |= (ctx->rf_enable[0] && rf_tx_enable[0]) ? 0x04 : 0x00; /* Bit 2: Calibrate Tx DC offset on radio A */
+	cal_cmd |= (ctx->rf_enable[1] && rf_tx_enable[1]) ? 0x08 : 0x00; /* Bit 3: Calibrate Tx DC offset on radio B */
 	cal_cmd |= 0x10; /* Bit 4: 0: calibrate with DAC gain=2, 1: with DAC gain=3 (use 3) */
 	
 	#if (CFG_RADIO_1257 == 1)
@@ -965,22 +1612,49 @@ int lgw_start(void) {
 	cal_time = 4200; /* measured between 4.0 and 4.1 sec */
 	#endif
 	
+	/* a matching cache provides the TX DC offsets, skip the TX calibration (the longest part) */
+	memset(&cache, 0, sizeof(cache));
+	cache.magic = CAL_CACHE_MAGIC;
+	cache.key = cal_cache_key(ctx, cal_cmd);
+	ctx->cal_cached = false;
+	if ((conf != NULL) && (conf->cal_cache != NULL) && (conf->cal_refresh == false)) {
+		if (cal_cache_load(conf->cal_cache, cache.key, conf->cal_max_age, &cache) == LGW_HAL_SUCCESS) {
+			ctx->cal_cached = true;
+			cal_cmd &= ~0x0C;
+		}
+	}
+	
 	/* Load the calibration firmware  */
+	start_mark(ctx, LGW_START_CALIBRATION);
 	load_firmware(MCU_AGC, cal_firmware, MCU_AGC_FW_BYTE);
+	start_mark(ctx, LGW_START_FW_LOAD);
 	lgw_reg_w(LGW_FORCE_HOST_RADIO_CTRL,0); /* gives to AGC MCU the control of the radios */
 	lgw_reg_w(LGW_RADIO_SELECT,cal_cmd); /* send calibration configuration word */
 	lgw_reg_w(LGW_MCU_RST_1,0);
 	lgw_reg_w(LGW_PAGE_REG,3); /* Calibration will start on this condition as soon as MCU can talk to concentrator registers */
 	lgw_reg_w(LGW_EMERGENCY_FORCE_HOST_CTRL,0); /* Give control of concentrator registers to MCU */
 	
-	/* Wait for calibration to end */
-	DEBUG_PRINTF("Note: calibration started (time: %u ms)\n", cal_time);
-	wait_ms(cal_time); /* Wait for end of calibration */
+	/* Wait for calibration to end, the 'calibration finished' bit is checked below */
+	if (ctx->cal_cached == false) {
+		DEBUG_PRINTF("Note: calibration started (typical time: %u ms)\n", cal_time);
+	} else {
+		DEBUG_MSG("Note: RX calibration started, TX calibration taken from the cache\n");
+	}
+	if ((conf != NULL) && (conf->cal_timeout_ms != 0)) {
+		agc_wait_status(ctx, 0x80, 0x80, conf->cal_timeout_ms, &read_val, &ctx->start_wait.cal_us);
+	} else {
+		agc_wait_status(ctx, 0x80, 0x80, 2 * cal_time, &read_val, &ctx->start_wait.cal_us);
+	}
+	lgw_reg_cache_invalidate(); /* calibration firmware had control of the registers */
 	lgw_reg_w(LGW_EMERGENCY_FORCE_HOST_CTRL,1); /* Take back control */
 	
 	/* Get calibration status */
 	lgw_reg_r(LGW_MCU_AGC_STATUS, &read_val);
 	cal_status = (uint8_t)read_val;
+	if (ctx->cal_cached == true) {
+		cal_status = (cal_status & ~0x60) | (cache.status & 0x60); /* TX calibration results of the cached run */
+	}
+	ctx->cal_status_last = cal_status;
 	/*
 		bit 7: calibration finished
 		bit 0: could access SX1301 registers
@@ -997,61 +1671,112 @@ int lgw_start(void) {
 	} else {
 		DEBUG_PRINTF("Note: calibration finished (status = %u)\n", cal_status);
 	}
-	if (rf_enable[0] && ((cal_status & 0x02) == 0)) {
+	if (ctx->rf_enable[0] && ((cal_status & 0x02) == 0)) {
 		DEBUG_MSG("WARNING: calibration could not access radio A\n");
 	}
-	if (rf_enable[1] && ((cal_status & 0x04) == 0)) {
+	if (ctx->rf_enable[1] && ((cal_status & 0x04) == 0)) {
 		DEBUG_MSG("WARNING: calibration could not access radio B\n");
 	}
-	if (rf_enable[0] && ((cal_status & 0x08) == 0)) {
+	if (ctx->rf_enable[0] && ((cal_status & 0x08) == 0)) {
 		DEBUG_MSG("WARNING: problem in calibration of radio A for image rejection\n");
 	}
-	if (rf_enable[1] && ((cal_status & 0x10) == 0)) {
+	if (ctx->rf_enable[1] && ((cal_status & 0x10) == 0)) {
 		DEBUG_MSG("WARNING: problem in calibration of radio B for image rejection\n");
 	}
-	if (rf_enable[0] && rf_tx_enable[0] && ((cal_status & 0x20) == 0)) {
+	if (ctx->rf_enable[0] && rf_tx_enable[0] && ((cal_status & 0x20) == 0)) {
 		DEBUG_MSG("WARNING: problem in calibration of radio A for TX imbalance\n");
 	}
-	if (rf_enable[1] && rf_tx_enable[1] && ((cal_status & 0x40) == 0)) {
+	if (ctx->rf_enable[1] && rf_tx_enable[1] && ((cal_status & 0x40) == 0)) {
 		DEBUG_MSG("WARNING: problem in calibration of radio B for TX imbalance\n");
 	}
 	
-	/* Get TX DC offset values */
+	/* Get TX DC offset values, 32 address/data pairs read in a single batch */
+	if (ctx->cal_cached == false) {
+		lgw_reg_batch_begin();
+		for(i=0; i<=7; ++i) {
+			lgw_reg_batch_add_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xA0+i);
+			lgw_reg_batch_add_r(LGW_DBG_AGC_MCU_RAM_DATA, &cal_val[i]);
+			lgw_reg_batch_add_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xA8+i);
+			lgw_reg_batch_add_r(LGW_DBG_AGC_MCU_RAM_DATA, &cal_val[8+i]);
+			lgw_reg_batch_add_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xB0+i);
+			lgw_reg_batch_add_r(LGW_DBG_AGC_MCU_RAM_DATA, &cal_val[16+i]);
+			lgw_reg_batch_add_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xB8+i);
+			lgw_reg_batch_add_r(LGW_DBG_AGC_MCU_RAM_DATA, &cal_val[24+i]);
+		}
+		lgw_reg_batch_commit();
+		for(i=0; i<=7; ++i) {
+			cache.offset[0][i] = (int8_t)cal_val[i];
+			cache.offset[1][i] = (int8_t)cal_val[8+i];
+			cache.offset[2][i] = (int8_t)cal_val[16+i];
+			cache.offset[3][i] = (int8_t)cal_val[24+i];
+		}
+		
+		/* only a fully successful calibration is worth reusing */
+		cache.status = cal_status;
+		cache.date = (int64_t)time(NULL);
+		if ((conf != NULL) && (conf->cal_cache != NULL) && ((cal_status & ((cal_cmd & 0x0F) << 3)) == ((cal_cmd & 0x0F) << 3))) {
+			if (cal_cache_save(conf->cal_cache, &cache) != LGW_HAL_SUCCESS) {
+				DEBUG_PRINTF("WARNING: failed to save the calibration results in %s\n", conf->cal_cache);
+			}
+		}
+	}
 	for(i=0; i<=7; ++i) {
-		lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xA0+i);
-		lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
-		cal_offset_a_i[i] = (int8_t)read_val;
-		lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xA8+i);
-		lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
-		cal_offset_a_q[i] = (int8_t)read_val;
-		lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xB0+i);
-		lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
-		cal_offset_b_i[i] = (int8_t)read_val;
-		lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xB8+i);
-		lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
-		cal_offset_b_q[i] = (int8_t)read_val;
+		ctx->cal_offset_a_i[i] = cache.offset[0][i];
+		ctx->cal_offset_a_q[i] = cache.offset[1][i];
+		ctx->cal_offset_b_i[i] = cache.offset[2][i];
+		ctx->cal_offset_b_q[i] = cache.offset[3][i];
 	}
+	start_mark(ctx, LGW_START_CALIBRATION);
 	
 	/* load adjusted parameters */
 	lgw_constant_adjust();
+	start_mark(ctx, LGW_START_CONST_ADJUST);
+	
+	/* MBWSSF modem register values, computed before the configuration batch is opened */
+	mbwssf_bw = 0;
+	mbwssf_sf = 0;
+	if (ctx->if_enable[8] == true) {
+		switch(ctx->lora_rx_bw) {
+			case BW_125KHZ: mbwssf_bw = 0; break;
+			case BW_250KHZ: mbwssf_bw = 1; break;
+			case BW_500KHZ: mbwssf_bw = 2; break;
+			default:
+				DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", ctx->lora_rx_bw);
+				return LGW_HAL_ERROR;
+		}
+		switch(ctx->lora_rx_sf) {
+			case DR_LORA_SF7: mbwssf_sf = 7; break;
+			case DR_LORA_SF8: mbwssf_sf = 8; break;
+			case DR_LORA_SF9: mbwssf_sf = 9; break;
+			case DR_LORA_SF10: mbwssf_sf = 10; break;
+			case DR_LORA_SF11: mbwssf_sf = 11; break;
+			case DR_LORA_SF12: mbwssf_sf = 12; break;
+			default:
+				DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", ctx->lora_rx_sf);
+				return LGW_HAL_ERROR;
+		}
+	}
+	
+	/* all the modem configuration writes below are sent in a single batch */
+	lgw_reg_batch_begin();
 	
 	/* Freq-to-time-drift calculation */
 	x = (2 * 8192000000) / (uint64_t)(rf_rx_lowfreq[0] + rf_rx_upfreq[0]); /* 64b calculation */
 	if (x > 63) {
 		x = 63;
 	}
-	lgw_reg_w(LGW_FREQ_TO_TIME_DRIFT, x); /* default 9 */
+	lgw_reg_batch_add_w(LGW_FREQ_TO_TIME_DRIFT, x); /* default 9 */
 	x = (2 * 32768000000) / (uint64_t)(rf_rx_lowfreq[0] + rf_rx_upfreq[0]); /* 64b calculation */
 	if (x > 63) {
 		x = 63;
 	}
-	lgw_reg_w(LGW_MBWSSF_FREQ_TO_TIME_DRIFT, x); /* default 36 */
+	lgw_reg_batch_add_w(LGW_MBWSSF_FREQ_TO_TIME_DRIFT, x); /* default 36 */
 	
 	/* configure LoRa 'multi' demodulators aka. LoRa 'sensor' channels (IF0-3) */
 	
 	radio_select = 0; /* IF mapping to radio A/B (per bit, 0=A, 1=B) */
 	for(i=0; i<LGW_MULTI_NB; ++i) {
-		radio_select += (if_rf_chain[i] == 1 ? 1 << i : 0); /* transform bool array into binary word */
+		radio_select += (ctx->if_rf_chain[i] == 1 ? 1 << i : 0); /* transform bool array into binary word */
 	}
 	/*
 	lgw_reg_w(LGW_RADIO_SELECT, radio_select);
@@ -1060,75 +1785,62 @@ int lgw_start(void) {
 	will be loaded in LGW_RADIO_SELECT at the end of start procedure.
 	*/
 	
-	lgw_reg_w(LGW_IF_FREQ_0, IF_HZ_TO_REG(if_freq[0])); /* default -384 */
-	lgw_reg_w(LGW_IF_FREQ_1, IF_HZ_TO_REG(if_freq[1])); /* default -128 */
-	lgw_reg_w(LGW_IF_FREQ_2, IF_HZ_TO_REG(if_freq[2])); /* default 128 */
-	lgw_reg_w(LGW_IF_FREQ_3, IF_HZ_TO_REG(if_freq[3])); /* default 384 */
+	lgw_reg_batch_add_w(LGW_IF_FREQ_0, IF_HZ_TO_REG(ctx->if_freq[0])); /* default -384 */
+	lgw_reg_batch_add_w(LGW_IF_FREQ_1, IF_HZ_TO_REG(ctx->if_freq[1])); /* default -128 */
+	lgw_reg_batch_add_w(LGW_IF_FREQ_2, IF_HZ_TO_REG(ctx->if_freq[2])); /* default 128 */
+	lgw_reg_batch_add_w(LGW_IF_FREQ_3, IF_HZ_TO_REG(ctx->if_freq[3])); /* default 384 */
 	#if (CFG_CHIP_1301 == 1)
-	lgw_reg_w(LGW_IF_FREQ_4, IF_HZ_TO_REG(if_freq[4])); /* default -384 */
-	lgw_reg_w(LGW_IF_FREQ_5, IF_HZ_TO_REG(if_freq[5])); /* default -128 */
-	lgw_reg_w(LGW_IF_FREQ_6, IF_HZ_TO_REG(if_freq[6])); /* default 128 */
-	lgw_reg_w(LGW_IF_FREQ_7, IF_HZ_TO_REG(if_freq[7])); /* default 384 */
+	lgw_reg_batch_add_w(LGW_IF_FREQ_4, IF_HZ_TO_REG(ctx->if_freq[4])); /* default -384 */
+	lgw_reg_batch_add_w(LGW_IF_FREQ_5, IF_HZ_TO_REG(ctx->if_freq[5])); /* default -128 */
+	lgw_reg_batch_add_w(LGW_IF_FREQ_6, IF_HZ_TO_REG(ctx->if_freq[6])); /* default 128 */
+	lgw_reg_batch_add_w(LGW_IF_FREQ_7, IF_HZ_TO_REG(ctx->if_freq[7])); /* default 384 */
 	#endif
 	
-	lgw_reg_w(LGW_CORR0_DETECT_EN, (if_enable[0] == true) ? lora_multi_sfmask[0] : 0); /* default 0 */
-	lgw_reg_w(LGW_CORR1_DETECT_EN, (if_enable[1] == true) ? lora_multi_sfmask[1] : 0); /* default 0 */
-	lgw_reg_w(LGW_CORR2_DETECT_EN, (if_enable[2] == true) ? lora_multi_sfmask[2] : 0); /* default 0 */
-	lgw_reg_w(LGW_CORR3_DETECT_EN, (if_enable[3] == true) ? lora_multi_sfmask[3] : 0); /* default 0 */
+	lgw_reg_batch_add_w(LGW_CORR0_DETECT_EN, (ctx->if_enable[0] == true) ? ctx->lora_multi_sfmask[0] : 0); /* default 0 */
+	lgw_reg_batch_add_w(LGW_CORR1_DETECT_EN, (ctx->if_enable[1] == true) ? ctx->lora_multi_sfmask[1] : 0); /* default 0 */
+	lgw_reg_batch_add_w(LGW_CORR2_DETECT_EN, (ctx->if_enable[2] == true) ? ctx->lora_multi_sfmask[2] : 0); /* default 0 */
+	lgw_reg_batch_add_w(LGW_CORR3_DETECT_EN, (ctx->if_enable[3] == true) ? ctx->lora_multi_sfmask[3] : 0); /* default 0 */
 	#if (CFG_CHIP_1301 == 1)
-	lgw_reg_w(LGW_CORR4_DETECT_EN, (if_enable[4] == true) ? lora_multi_sfmask[4] : 0); /* default 0 */
-	lgw_reg_w(LGW_CORR5_DETECT_EN, (if_enable[5] == true) ? lora_multi_sfmask[5] : 0); /* default 0 */
-	lgw_reg_w(LGW_CORR6_DETECT_EN, (if_enable[6] == true) ? lora_multi_sfmask[6] : 0); /* default 0 */
-	lgw_reg_w(LGW_CORR7_DETECT_EN, (if_enable[7] == true) ? lora_multi_sfmask[7] : 0); /* default 0 */
+	lgw_reg_batch_add_w(LGW_CORR4_DETECT_EN, (ctx->if_enable[4] == true) ? ctx->lora_multi_sfmask[4] : 0); /* default 0 */
+	lgw_reg_batch_add_w(LGW_CORR5_DETECT_EN, (ctx->if_enable[5] == true) ? ctx->lora_multi_sfmask[5] : 0); /* default 0 */
+	lgw_reg_batch_add_w(LGW_CORR6_DETECT_EN, (ctx->if_enable[6] == true) ? ctx->lora_multi_sfmask[6] : 0); /* default 0 */
+	lgw_reg_batch_add_w(LGW_CORR7_DETECT_EN, (ctx->if_enable[7] == true) ? ctx->lora_multi_sfmask[7] : 0); /* default 0 */
 	#endif
 	
-	lgw_reg_w(LGW_PPM_OFFSET, 0x60); /* as the threshold is 16ms, use 0x60 to enable ppm_offset for SF12 and SF11 @125kHz*/
+	lgw_reg_batch_add_w(LGW_PPM_OFFSET, 0x60); /* as the threshold is 16ms, use 0x60 to enable ppm_offset for SF12 and SF11 @125kHz*/
 	
-	lgw_reg_w(LGW_CONCENTRATOR_MODEM_ENABLE,1); /* default 0 */
+	lgw_reg_batch_add_w(LGW_CONCENTRATOR_MODEM_ENABLE,1); /* default 0 */
 	
 	/* configure LoRa 'stand-alone' modem (IF8) */
-	lgw_reg_w(LGW_IF_FREQ_8, IF_HZ_TO_REG(if_freq[8])); /* MBWSSF modem (default 0) */
-	if (if_enable[8] == true) {
-		lgw_reg_w(LGW_MBWSSF_RADIO_SELECT, if_rf_chain[8]);
-		switch(lora_rx_bw) {
-			case BW_125KHZ: lgw_reg_w(LGW_MBWSSF_MODEM_BW,0); break;
-			case BW_250KHZ: lgw_reg_w(LGW_MBWSSF_MODEM_BW,1); break;
-			case BW_500KHZ: lgw_reg_w(LGW_MBWSSF_MODEM_BW,2); break;
-			default:
-				DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", lora_rx_bw);
-				return LGW_HAL_ERROR;
-		}
-		switch(lora_rx_sf) {
-			case DR_LORA_SF7: lgw_reg_w(LGW_MBWSSF_RATE_SF,7); break;
-			case DR_LORA_SF8: lgw_reg_w(LGW_MBWSSF_RATE_SF,8); break;
-			case DR_LORA_SF9: lgw_reg_w(LGW_MBWSSF_RATE_SF,9); break;
-			case DR_LORA_SF10: lgw_reg_w(LGW_MBWSSF_RATE_SF,10); break;
-			case DR_LORA_SF11: lgw_reg_w(LGW_MBWSSF_RATE_SF,11); break;
-			case DR_LORA_SF12: lgw_reg_w(LGW_MBWSSF_RATE_SF,12); break;
-			default:
-				DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", lora_rx_sf);
-				return LGW_HAL_ERROR;
-		}
-		lgw_reg_w(LGW_MBWSSF_PPM_OFFSET, lora_rx_ppm_offset); /* default 0 */
-		lgw_reg_w(LGW_MBWSSF_MODEM_ENABLE, 1); /* default 0 */
+	lgw_reg_batch_add_w(LGW_IF_FREQ_8, IF_HZ_TO_REG(ctx->if_freq[8])); /* MBWSSF modem (default 0) */
+	if (ctx->if_enable[8] == true) {
+		lgw_reg_batch_add_w(LGW_MBWSSF_RADIO_SELECT, ctx->if_rf_chain[8]);
+		lgw_reg_batch_add_w(LGW_MBWSSF_MODEM_BW, mbwssf_bw);
+		lgw_reg_batch_add_w(LGW_MBWSSF_RATE_SF, mbwssf_sf);
+		lgw_reg_batch_add_w(LGW_MBWSSF_PPM_OFFSET, ctx->lora_rx_ppm_offset); /* default 0 */
+		lgw_reg_batch_add_w(LGW_MBWSSF_MODEM_ENABLE, 1); /* default 0 */
 	} else {
-		lgw_reg_w(LGW_MBWSSF_MODEM_ENABLE, 0);
+		lgw_reg_batch_add_w(LGW_MBWSSF_MODEM_ENABLE, 0);
 	}
 	
 	/* configure FSK modem (IF9) */
-	lgw_reg_w(LGW_IF_FREQ_9, IF_HZ_TO_REG(if_freq[9])); /* FSK modem, default 0 */
-	if (if_enable[9] == true) {
-		lgw_reg_w(LGW_FSK_RADIO_SELECT, if_rf_chain[9]);
-		lgw_reg_w(LGW_FSK_BR_RATIO,LGW_XTAL_FREQU/fsk_rx_dr); /* setting the dividing ratio for datarate */
-		lgw_reg_w(LGW_FSK_CH_BW_EXPO,fsk_rx_bw);
-		lgw_reg_w(LGW_FSK_MODEM_ENABLE,1); /* default 0 */
+	lgw_reg_batch_add_w(LGW_IF_FREQ_9, IF_HZ_TO_REG(ctx->if_freq[9])); /* FSK modem, default 0 */
+	if (ctx->if_enable[9] == true) {
+		lgw_reg_batch_add_w(LGW_FSK_RADIO_SELECT, ctx->if_rf_chain[9]);
+		lgw_reg_batch_add_w(LGW_FSK_BR_RATIO,LGW_XTAL_FREQU/ctx->fsk_rx_dr); /* setting the dividing ratio for datarate */
+		lgw_reg_batch_add_w(LGW_FSK_CH_BW_EXPO,ctx->fsk_rx_bw);
+		lgw_reg_batch_add_w(LGW_FSK_MODEM_ENABLE,1); /* default 0 */
 	} else {
-		lgw_reg_w(LGW_FSK_MODEM_ENABLE,0);
+		lgw_reg_batch_add_w(LGW_FSK_MODEM_ENABLE,0);
 	}
 	
+	lgw_reg_batch_commit();
+	
 	/* Load firmware */
+	start_mark(ctx, LGW_START_MODEM_CONFIG);
 	load_firmware(MCU_ARB, arb_firmware, MCU_ARB_FW_BYTE);
 	load_firmware(MCU_AGC, agc_firmware, MCU_AGC_FW_BYTE);
+	start_mark(ctx, LGW_START_FW_LOAD);
 	
 	/* gives the AGC MCU control over radio, RF front-end and filter gain */
 	lgw_reg_w(LGW_FORCE_HOST_RADIO_CTRL,0);
@@ -1141,10 +1853,7 @@ int lgw_start(void) {
 	lgw_reg_w(LGW_MCU_RST_1, 0);
 	
 	DEBUG_MSG("Info: Initialising AGC firmware...\n");
-	wait_ms(1);
-	
-	lgw_reg_r(LGW_MCU_AGC_STATUS, &read_val);
-	if (read_val != 0x20) {
+	if (agc_wait_status(ctx, 0xFF, 0x20, ctx->agc_timeout_ms, &read_val, &ctx->start_wait.agc_boot_us) != LGW_HAL_SUCCESS) {
 		DEBUG_PRINTF("ERROR: AGC FIRMWARE INITIALIZATION FAILURE, STATUS 0x%02X\n", (uint8_t)read_val);
 		return LGW_HAL_ERROR;
 	}
@@ -1154,48 +1863,34 @@ int lgw_start(void) {
 	#if (CUSTOM_TX_POW_TABLE == 1)
 		DEBUG_MSG("Info: loading custom TX gain table\n");
 		for(i=0; i<TX_POW_LUT_SIZE; ++i) {
-			lgw_reg_w(LGW_RADIO_SELECT, AGC_CMD_WAIT); /* start a transaction */
-			wait_ms(1);
-			load_val = tx_pow_table[i].mix_gain + (16 * tx_pow_table[i].dac_gain) + (64 * tx_pow_table[i].pa_gain);
-			lgw_reg_w(LGW_RADIO_SELECT, load_val);
-			wait_ms(1);
-			lgw_reg_r(LGW_MCU_AGC_STATUS, &read_val);
-			if (read_val != (0x30 + i)) {
+			agc_cmd(ctx, tx_pow_table[i].mix_gain + (16 * tx_pow_table[i].dac_gain) + (64 * tx_pow_table[i].pa_gain), &ctx->start_wait.agc_lut_us);
+			if (agc_wait_status(ctx, 0xFF, 0x30 + i, ctx->agc_timeout_ms, &read_val, &ctx->start_wait.agc_lut_us) != LGW_HAL_SUCCESS) {
 				DEBUG_PRINTF("ERROR: AGC FIRMWARE INITIALIZATION FAILURE, STATUS 0x%02X\n", (uint8_t)read_val);
 				return LGW_HAL_ERROR;
 			}
 		}
 	#else
-		lgw_reg_w(LGW_RADIO_SELECT, AGC_CMD_WAIT); /* start a transaction */
-		wait_ms(1);
-		load_val = AGC_CMD_ABORT;
-		lgw_reg_w(LGW_RADIO_SELECT, load_val); 
-		wait_ms(1);
+		agc_cmd(ctx, AGC_CMD_ABORT, &ctx->start_wait.agc_lut_us);
 		DEBUG_MSG("Info: TX gain LUT update skipped, using default LUT\n");
-		lgw_reg_r(LGW_MCU_AGC_STATUS, &read_val);
-		if (read_val != 0x30) {
+		if (agc_wait_status(ctx, 0xFF, 0x30, ctx->agc_timeout_ms, &read_val, &ctx->start_wait.agc_lut_us) != LGW_HAL_SUCCESS) {
 			DEBUG_PRINTF("ERROR: AGC FIRMWARE INITIALIZATION FAILURE, STATUS 0x%02X\n", (uint8_t)read_val);
 			return LGW_HAL_ERROR;
 		}
 	#endif
 	
-	/* Load chan_select firmware option */
-	lgw_reg_w(LGW_RADIO_SELECT, AGC_CMD_WAIT);
-	wait_ms(1);
-	lgw_reg_w(LGW_RADIO_SELECT, 0);
-	wait_ms(1);
+	/* Load chan_select firmware option (no acknowledge, the status does not change) */
+	agc_cmd(ctx, 0, &ctx->start_wait.agc_chan_us);
+	delay_us(ctx->agc_cmd_delay_us);
+	ctx->start_wait.agc_chan_us += ctx->agc_cmd_delay_us;
 	
 	/* End AGC firmware init and check status */
-	lgw_reg_w(LGW_RADIO_SELECT, AGC_CMD_WAIT);
-	wait_ms(1);
-	lgw_reg_w(LGW_RADIO_SELECT, radio_select); /* Load intended value of RADIO_SELECT */
-	wait_ms(1);
+	agc_cmd(ctx, radio_select, &ctx->start_wait.agc_final_us); /* Load intended value of RADIO_SELECT */
 	DEBUG_MSG("Info: putting back original RADIO_SELECT value\n");
-	lgw_reg_r(LGW_MCU_AGC_STATUS, &read_val);
-	if (read_val != 0x40) {
+	if (agc_wait_status(ctx, 0xFF, 0x40, ctx->agc_timeout_ms, &read_val, &ctx->start_wait.agc_final_us) != LGW_HAL_SUCCESS) {
 		DEBUG_PRINTF("ERROR: AGC FIRMWARE INITIALIZATION FAILURE, STATUS 0x%02X\n", (uint8_t)read_val);
 		return LGW_HAL_ERROR;
 	}
+	start_mark(ctx, LGW_START_AGC_INIT);
 	
 	/* enable GPS event capture */
 	lgw_reg_w(LGW_GPS_EN,1);
@@ -1211,36 +1906,95 @@ int lgw_start(void) {
 	DGPIO4 -> TX modem active (either LoRa or FSK)
 	*/
 	
-	lgw_is_started = true;
+	/* get notified on DGPIO0 rising edge, lgw_receive_wait falls back to polling otherwise */
+	if (ctx->rx_gpio_chip[0] != '\0') {
+		if (rx_gpio_open(ctx) != LGW_HAL_SUCCESS) {
+			DEBUG_PRINTF("WARNING: no 'packets waiting' event from %s line %u, RX falls back to polling\n", ctx->rx_gpio_chip, ctx->rx_gpio_line);
+		}
+	}
+	
+	/* RX timestamp corrections */
+	pthread_once(&tcorr_once, tcorr_init);
+	switch (ctx->lora_rx_bw) {
+		case BW_125KHZ: ctx->tcorr_std = TCORR_STD_125; break;
+		case BW_250KHZ: ctx->tcorr_std = TCORR_STD_250; break;
+		case BW_500KHZ: ctx->tcorr_std = TCORR_STD_500; break;
+		default: ctx->tcorr_std = -1;
+	}
+	/* FSK: empirical delay of the FSK demodulator, the same expression as the
+	FSK correction of the later Semtech HAL releases (lgw_receive of lora_gateway
+	v3 and up). 680000 / datarate us is 0.68 bit time, minus a fixed 20 us; both
+	terms were measured on the reference design, not derived from the datasheet.
+	Negative above 34 kbps, applied modulo 2^32 like the LoRa corrections. */
+	ctx->tcorr_fsk = (ctx->fsk_rx_dr > 0) ? (680000 / ctx->fsk_rx_dr) - 20 : 0;
+	
+	start_mark(ctx, LGW_START_FINISH);
+	ctx->start_prof.complete = true;
+	
+	ctx->lgw_is_started = true;
 	return LGW_HAL_SUCCESS;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-int lgw_stop(void) {
+int lgw_start_ctx(lgw_ctx_t *ctx, const struct lgw_conf_start_s *conf) {
+	struct lgw_reg_ctx_s *prev;
+	uint8_t site;
+	int x;
+	
+	CHECK_NULL(ctx);
+	prev = lgw_reg_ctx_select(ctx->reg);
+	site = lgw_reg_trace_site(LGW_TRACE_SITE_START);
+	x = hal_start(ctx, conf);
+	lgw_reg_trace_site(site);
+	lgw_reg_ctx_select(prev);
+	return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int hal_stop(struct lgw_ctx_s *ctx) {
 	lgw_soft_reset();
 	lgw_disconnect();
 	
-	lgw_is_started = false;
+	if (ctx->rx_gpio_fd >= 0) {
+		close(ctx->rx_gpio_fd);
+		ctx->rx_gpio_fd = -1;
+	}
+	
+	ctx->lgw_is_started = false;
 	return LGW_HAL_SUCCESS;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
+int lgw_stop_ctx(lgw_ctx_t *ctx) {
+	struct lgw_reg_ctx_s *prev;
+	uint8_t site;
+	int x;
+	
+	CHECK_NULL(ctx);
+	prev = lgw_reg_ctx_select(ctx->reg);
+	site = lgw_reg_trace_site(LGW_TRACE_SITE_STOP);
+	x = hal_stop(ctx);
+	lgw_reg_trace_site(site);
+	lgw_reg_ctx_select(prev);
+	return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int hal_receive(struct lgw_ctx_s *ctx, uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
 	int nb_pkt_fetch; /* loop variable and return value */
 	struct lgw_pkt_rx_s *p; /* pointer to the current structure in the struct array */
+	struct lgw_pkt_rec_s r; /* decoded metadata of the current packet */
 	uint8_t buff[255+RX_METADATA_NB]; /* buffer to store the result of SPI read bursts */
+	uint8_t fifo[5]; /* RX FIFO status of the packet at the head of the FIFO */
 	unsigned sz; /* size of the payload, uses to address metadata */
-	int ifmod; /* type of if_chain/modem a packet was received by */
 	int stat_fifo; /* the packet status as indicated in the FIFO */
-	uint32_t raw_timestamp; /* timestamp when internal 'RX finished' was triggered */
-	uint32_t delay_x, delay_y, delay_z; /* temporary variable for timestamp offset calculation */
-	uint32_t timestamp_correction; /* correction to account for processing delay */
-	uint32_t sf, cr, bw_pow, crc_en, ppm; /* used to calculate timestamp correction */
 	
 	/* check if the concentrator is running */
-	if (lgw_is_started == false) {
+	if (ctx->lgw_is_started == false) {
 		DEBUG_MSG("ERROR: CONCENTRATOR IS NOT RUNNING, START IT BEFORE RECEIVING\n");
 		return LGW_HAL_ERROR;
 	}
@@ -1252,189 +2006,286 @@ int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
 	}
 	CHECK_NULL(pkt_data);
 	
-	/* iterate max_pkt times at most */
-	for (nb_pkt_fetch = 0; nb_pkt_fetch < max_pkt; ++nb_pkt_fetch) {
-		
+	pthread_mutex_lock(&ctx->mx_rx);
+	
+	/* fetch the RX FIFO data of the first packet */
+	if (lgw_reg_rb(LGW_RX_PACKET_DATA_FIFO_NUM_STORED, fifo, 5) != LGW_REG_SUCCESS) {
+		DEBUG_MSG("ERROR: FAILED TO READ RX FIFO STATUS\n");
+		pthread_mutex_unlock(&ctx->mx_rx);
+		return LGW_HAL_ERROR;
+	}
+	
+	/* iterate max_pkt times at most */
+	for (nb_pkt_fetch = 0; nb_pkt_fetch < max_pkt; ++nb_pkt_fetch) {
+		
 		/* point to the proper struct in the struct array */
 		p = &pkt_data[nb_pkt_fetch];
 		
-		/* fetch all the RX FIFO data */
-		lgw_reg_rb(LGW_RX_PACKET_DATA_FIFO_NUM_STORED, buff, 5);
-		
 		/* how many packets are in the RX buffer ? Break if zero */
-		if (buff[0] == 0) {
+		if (fifo[0] == 0) {
 			break; /* no more packets to fetch, exit out of FOR loop */
 		}
 		
-		DEBUG_PRINTF("FIFO content: %x %x %x %x %x\n",buff[0],buff[1],buff[2],buff[3],buff[4]);
+		DEBUG_PRINTF("FIFO content: %x %x %x %x %x\n",fifo[0],fifo[1],fifo[2],fifo[3],fifo[4]);
 		
-		p->size = buff[4];
-		sz = p->size;
-		stat_fifo = buff[3]; /* will be used later, need to save it before overwriting buff */
+		sz = fifo[4];
+		stat_fifo = fifo[3];
 		
-		/* get payload + metadata */
-		lgw_reg_rb(LGW_RX_DATA_BUF_DATA, buff, sz+RX_METADATA_NB);
+		/* get payload + metadata, advance packet FIFO and fetch the RX FIFO
+		data of the next packet, all in one SPI submission */
+		lgw_reg_batch_begin();
+		lgw_reg_batch_add_rb(LGW_RX_DATA_BUF_DATA, buff, sz+RX_METADATA_NB);
+		lgw_reg_batch_add_w(LGW_RX_PACKET_DATA_FIFO_NUM_STORED, 0);
+		if (nb_pkt_fetch < (max_pkt - 1)) {
+			lgw_reg_batch_add_rb(LGW_RX_PACKET_DATA_FIFO_NUM_STORED, fifo, 5);
+		}
+		if (lgw_reg_batch_commit() != LGW_REG_SUCCESS) {
+			DEBUG_MSG("ERROR: FAILED TO FETCH PACKET FROM RX FIFO\n");
+			pthread_mutex_unlock(&ctx->mx_rx);
+			return LGW_HAL_ERROR;
+		}
 		
 		/* copy payload to result struct */
 		memcpy((void *)p->payload, (void *)buff, sz);
 		
 		/* process metadata */
-		p->if_chain = buff[sz+0];
-		ifmod = ifmod_config[p->if_chain];
-		DEBUG_PRINTF("[%d %d]\n", p->if_chain, ifmod);
-		p->rssi = (float)buff[sz+5] - RSSI_BOARD_OFFSET;
+		rx_decode(ctx, stat_fifo, sz, &buff[sz], &r);
+		p->freq_hz = r.freq_hz;
+		p->if_chain = r.if_chain;
+		p->status = r.status;
+		p->count_us = r.count_us;
+		p->rf_chain = r.rf_chain;
+		p->modulation = r.modulation;
+		p->bandwidth = r.bandwidth;
+		p->datarate = r.datarate;
+		p->coderate = r.coderate;
+		p->rssi = r.rssi;
+		p->snr = r.snr;
+		p->snr_min = r.snr_min;
+		p->snr_max = r.snr_max;
+		p->crc = r.crc;
+		p->size = r.size;
+	}
+	
+	pthread_mutex_unlock(&ctx->mx_rx);
+	return nb_pkt_fetch;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int hal_receive_into(struct lgw_ctx_s *ctx, uint8_t *arena, uint32_t len) {
+	int nb_pkt_fetch = 0; /* return value */
+	struct lgw_pkt_rec_s *r; /* current record in the arena */
+	uint32_t used = 0; /* bytes of the arena taken by the records fetched so far */
+	uint8_t fifo[5]; /* RX FIFO status of the packet at the head of the FIFO */
+	unsigned sz; /* size of the payload, uses to address metadata */
+	int stat_fifo; /* the packet status as indicated in the FIFO */
+	
+	/* check if the concentrator is running */
+	if (ctx->lgw_is_started == false) {
+		DEBUG_MSG("ERROR: CONCENTRATOR IS NOT RUNNING, START IT BEFORE RECEIVING\n");
+		return LGW_HAL_ERROR;
+	}
+	
+	/* check input variables */
+	CHECK_NULL(arena);
+	if (((uintptr_t)arena % LGW_PKT_REC_ALIGN) != 0) {
+		DEBUG_MSG("ERROR: RECORD ARENA IS NOT ALIGNED\n");
+		return LGW_HAL_ERROR;
+	}
+	if (len < (LGW_PKT_REC_SIZE(0) + LGW_PKT_REC_SLACK)) {
+		return 0; /* not even room for an empty packet */
+	}
+	
+	pthread_mutex_lock(&ctx->mx_rx);
+	
+	/* fetch the RX FIFO data of the first packet */
+	if (lgw_reg_rb(LGW_RX_PACKET_DATA_FIFO_NUM_STORED, fifo, 5) != LGW_REG_SUCCESS) {
+		DEBUG_MSG("ERROR: FAILED TO READ RX FIFO STATUS\n");
+		pthread_mutex_unlock(&ctx->mx_rx);
+		return LGW_HAL_ERROR;
+	}
+	
+	/* fetch packets as long as the next one fits */
+	while ((fifo[0] != 0) && ((used + LGW_PKT_REC_SIZE(fifo[4]) + LGW_PKT_REC_SLACK) <= len)) {
+		DEBUG_PRINTF("FIFO content: %x %x %x %x %x\n",fifo[0],fifo[1],fifo[2],fifo[3],fifo[4]);
 		
-		if ((ifmod == IF_LORA_MULTI) || (ifmod == IF_LORA_STD)) {
-			DEBUG_MSG("Note: LoRa packet\n");
-			switch(stat_fifo & 0x07) {
-				case 5:
-					p->status = STAT_CRC_OK;
-					crc_en = 1;
-					break;
-				case 7:
-					p->status = STAT_CRC_BAD;
-					crc_en = 1;
-					break;
-				case 1:
-					p->status = STAT_NO_CRC;
-					crc_en = 0;
-					break;
-				default:
-					p->status = STAT_UNDEFINED;
-					crc_en = 0;
-			}
-			p->modulation = MOD_LORA;
-			p->snr = ((float)((int8_t)buff[sz+2]))/4;
-			p->snr_min = ((float)((int8_t)buff[sz+3]))/4;
-			p->snr_max = ((float)((int8_t)buff[sz+4]))/4;
-			if (ifmod == IF_LORA_MULTI) {
-				p->bandwidth = BW_125KHZ; /* fixed in hardware */
-			} else {
-				p->bandwidth = lora_rx_bw; /* get the parameter from the config variable */
-			}
-			sf = (buff[sz+1] >> 4) & 0x0F;
-			switch (sf) {
-				case 7: p->datarate = DR_LORA_SF7; break;
-				case 8: p->datarate = DR_LORA_SF8; break;
-				case 9: p->datarate = DR_LORA_SF9; break;
-				case 10: p->datarate = DR_LORA_SF10; break;
-				case 11: p->datarate = DR_LORA_SF11; break;
-				case 12: p->datarate = DR_LORA_SF12; break;
-				default: p->datarate = DR_UNDEFINED;
-			}
-			cr = (buff[sz+1] >> 1) & 0x07;
-			switch (cr) {
-				case 1: p->coderate = CR_LORA_4_5; break;
-				case 2: p->coderate = CR_LORA_4_6; break;
-				case 3: p->coderate = CR_LORA_4_7; break;
-				case 4: p->coderate = CR_LORA_4_8; break;
-				default: p->coderate = CR_UNDEFINED;
-			}
-			
-			/* determine if 'PPM mode' is on, needed for timestamp correction */
-			if (SET_PPM_ON(p->bandwidth,p->datarate)) {
-				ppm = 1;
-			} else {
-				ppm = 0;
-			}
-			
-			/* timestamp correction code, base delay */
-			if (ifmod == IF_LORA_STD) { /* if packet was received on the stand-alone LoRa modem */
-				switch (lora_rx_bw) {
-					case BW_125KHZ:
-						delay_x = 64;
-						bw_pow = 1;
-						break;
-					case BW_250KHZ:
-						delay_x = 32;
-						bw_pow = 2;
-						break;
-					case BW_500KHZ:
-						delay_x = 16;
-						bw_pow = 4;
-						break;
-					default:
-						DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", p->bandwidth);	
-						delay_x = 0;
-						bw_pow = 0;
-				}
-			} else { /* packet was received on one of the sensor channels = 125kHz */
-				delay_x = 114;
-				bw_pow = 1;
-			}
-			
-			/* timestamp correction code, variable delay */
-			if ((sf >= 6) && (sf <= 12) && (bw_pow > 0)) {
-				if ((2*(sz + 2*crc_en) - (sf-7)) <= 0) { /* payload fits entirely in first 8 symbols */
-					delay_y = ( ((1<<(sf-1)) * (sf+1)) + (3 * (1<<(sf-4))) ) / bw_pow;
-					delay_z = 32 * (2*(sz+2*crc_en) + 5) / bw_pow;
-				} else {
-					delay_y = ( ((1<<(sf-1)) * (sf+1)) + ((4 - ppm) * (1<<(sf-4))) ) / bw_pow;
-					delay_z = (16 + 4*cr) * (((2*(sz+2*crc_en)-sf+6) % (sf - 2*ppm)) + 1) / bw_pow;
-				}
-				timestamp_correction = delay_x + delay_y + delay_z;
-			} else {
-				timestamp_correction = 0;
-				DEBUG_MSG("WARNING: invalid packet, no timestamp correction\n");
-			}
-			
-			/* RSSI correction */
-			if (ifmod == IF_LORA_MULTI) {
-				p->rssi -= RSSI_MULTI_BIAS;
-			}
-			
-		} else if (ifmod == IF_FSK_STD) {
-			DEBUG_MSG("Note: FSK packet\n");
-			switch(stat_fifo & 0x07) {
-				case 5: p->status = STAT_CRC_OK; break;
-				case 7: p->status = STAT_CRC_BAD; break;
-				case 1: p->status = STAT_NO_CRC; break;
-				default: p->status = STAT_UNDEFINED;
-			}
-			p->modulation = MOD_FSK;
-			p->snr = -128.0;
-			p->snr_min = -128.0;
-			p->snr_max = -128.0;
-			p->bandwidth = fsk_rx_bw;
-			p->datarate = fsk_rx_dr;
-			p->coderate = CR_UNDEFINED;
-			timestamp_correction = 0; // TODO: implement FSK timestamp correction
-			
-			/* RSSI correction */
-			p->rssi -= RSSI_FSK_BIAS;
-			p->rssi = ((p->rssi - RSSI_FSK_REF) * RSSI_FSK_SLOPE) + RSSI_FSK_REF;
+		r = (struct lgw_pkt_rec_s *)(arena + used);
+		sz = fifo[4];
+		stat_fifo = fifo[3];
+		used += LGW_PKT_REC_SIZE(sz);
+		
+		/* get payload + metadata straight into the record (metadata lands in
+		the slack), advance packet FIFO and fetch the RX FIFO data of the next
+		packet if another record may fit, all in one SPI submission */
+		lgw_reg_batch_begin();
+		lgw_reg_batch_add_rb(LGW_RX_DATA_BUF_DATA, r->payload, sz+RX_METADATA_NB);
+		lgw_reg_batch_add_w(LGW_RX_PACKET_DATA_FIFO_NUM_STORED, 0);
+		if ((used + LGW_PKT_REC_SIZE(0) + LGW_PKT_REC_SLACK) <= len) {
+			lgw_reg_batch_add_rb(LGW_RX_PACKET_DATA_FIFO_NUM_STORED, fifo, 5);
 		} else {
-			DEBUG_MSG("ERROR: UNEXPECTED PACKET ORIGIN\n");
-			p->status = STAT_UNDEFINED;
-			p->modulation = MOD_UNDEFINED;
-			p->rssi = -128.0;
-			p->snr = -128.0;
-			p->snr_min = -128.0;
-			p->snr_max = -128.0;
-			p->bandwidth = BW_UNDEFINED;
-			p->datarate = DR_UNDEFINED;
-			p->coderate = CR_UNDEFINED;
-			timestamp_correction = 0;
+			fifo[0] = 0;
+		}
+		if (lgw_reg_batch_commit() != LGW_REG_SUCCESS) {
+			DEBUG_MSG("ERROR: FAILED TO FETCH PACKET FROM RX FIFO\n");
+			pthread_mutex_unlock(&ctx->mx_rx);
+			return LGW_HAL_ERROR;
 		}
 		
-		raw_timestamp = (uint32_t)buff[sz+6] + ((uint32_t)buff[sz+7] << 8) + ((uint32_t)buff[sz+8] << 16) + ((uint32_t)buff[sz+9] << 24);
-		p->count_us = raw_timestamp - timestamp_correction;
-		p->crc = (uint16_t)buff[sz+10] + ((uint16_t)buff[sz+11] << 8);
-		
-		/* get back info from configuration so that application doesn't have to keep track of it */
-		p->rf_chain = (uint8_t)if_rf_chain[p->if_chain];
-		p->freq_hz = (uint32_t)((int32_t)rf_rx_freq[p->rf_chain] + if_freq[p->if_chain]);
-		
-		/* advance packet FIFO */
-		lgw_reg_w(LGW_RX_PACKET_DATA_FIFO_NUM_STORED, 0);
+		/* process metadata, before the next record overwrites it */
+		rx_decode(ctx, stat_fifo, sz, &r->payload[sz], r);
+		++nb_pkt_fetch;
 	}
 	
+	pthread_mutex_unlock(&ctx->mx_rx);
 	return nb_pkt_fetch;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-int lgw_send(struct lgw_pkt_tx_s pkt_data) {
+int lgw_receive_ctx(lgw_ctx_t *ctx, uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
+	struct lgw_reg_ctx_s *prev;
+	uint8_t site;
+	int x;
+	
+	CHECK_NULL(ctx);
+	prev = lgw_reg_ctx_select(ctx->reg);
+	site = lgw_reg_trace_site(LGW_TRACE_SITE_RECEIVE);
+	x = hal_receive(ctx, max_pkt, pkt_data);
+	lgw_reg_trace_site(site);
+	lgw_reg_ctx_select(prev);
+	return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_receive_into_ctx(lgw_ctx_t *ctx, uint8_t *arena, uint32_t len) {
+	struct lgw_reg_ctx_s *prev;
+	uint8_t site;
+	int x;
+	
+	CHECK_NULL(ctx);
+	prev = lgw_reg_ctx_select(ctx->reg);
+	site = lgw_reg_trace_site(LGW_TRACE_SITE_RECEIVE);
+	x = hal_receive_into(ctx, arena, len);
+	lgw_reg_trace_site(site);
+	lgw_reg_ctx_select(prev);
+	return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_rxirq_setconf_ctx(lgw_ctx_t *ctx, const char *gpio_chip, uint32_t line) {
+	CHECK_NULL(ctx);
+	
+	/* check if the concentrator is running */
+	if (ctx->lgw_is_started == true) {
+		DEBUG_MSG("ERROR: CONCENTRATOR IS RUNNING, STOP IT BEFORE TOUCHING CONFIGURATION\n");
+		return LGW_HAL_ERROR;
+	}
+	
+	/* NULL or empty string disables the GPIO notification */
+	if ((gpio_chip == NULL) || (gpio_chip[0] == '\0')) {
+		ctx->rx_gpio_chip[0] = '\0';
+		return LGW_HAL_SUCCESS;
+	}
+	if (strlen(gpio_chip) >= sizeof(ctx->rx_gpio_chip)) {
+		DEBUG_MSG("ERROR: GPIO CHIP PATH TOO LONG\n");
+		return LGW_HAL_ERROR;
+	}
+	strcpy(ctx->rx_gpio_chip, gpio_chip);
+	ctx->rx_gpio_line = line;
+	
+	DEBUG_PRINTF("Note: 'packets waiting' event on %s line %u\n", ctx->rx_gpio_chip, ctx->rx_gpio_line);
+	
+	return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_rxirq_setfd_ctx(lgw_ctx_t *ctx, int fd) {
+	CHECK_NULL(ctx);
+	ctx->rx_ext_fd = (fd >= 0) ? fd : -1;
+	return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_get_rx_fd_ctx(lgw_ctx_t *ctx) {
+	CHECK_NULL(ctx);
+	if (ctx->rx_ext_fd >= 0) {
+		return ctx->rx_ext_fd;
+	} else {
+		return ctx->rx_gpio_fd;
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_receive_wait_ctx(lgw_ctx_t *ctx, int timeout_ms, uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
+	struct pollfd pfd;
+	struct timespec start, now;
+	int elapsed_ms;
+	int wait_ms_max; /* time left before the timeout, -1 if none */
+	int nb_pkt;
+	int i;
+	
+	CHECK_NULL(ctx);
+	
+	pfd.fd = lgw_get_rx_fd_ctx(ctx);
+	pfd.events = POLLIN;
+	
+	/* events that are already pending refer to packets fetched below */
+	if (pfd.fd >= 0) {
+		rx_fd_drain(pfd.fd);
+	}
+	
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (1) {
+		nb_pkt = lgw_receive_ctx(ctx, max_pkt, pkt_data);
+		if (nb_pkt != 0) {
+			return nb_pkt; /* packets or error */
+		}
+		
+		/* nothing in the FIFO, compute how long we may still wait */
+		if (timeout_ms < 0) {
+			wait_ms_max = -1;
+		} else {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			elapsed_ms = (int)((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000);
+			if (elapsed_ms >= timeout_ms) {
+				return 0;
+			}
+			wait_ms_max = timeout_ms - elapsed_ms;
+		}
+		
+		if (pfd.fd < 0) {
+			/* no event source, poll the FIFO */
+			if ((wait_ms_max < 0) || (wait_ms_max > RX_POLL_PERIOD_MS)) {
+				wait_ms(RX_POLL_PERIOD_MS);
+			} else {
+				wait_ms(wait_ms_max);
+			}
+			continue;
+		}
+		
+		i = poll(&pfd, 1, wait_ms_max);
+		if (i < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			DEBUG_MSG("ERROR: FAILED TO WAIT FOR 'PACKETS WAITING' EVENT\n");
+			return LGW_HAL_ERROR;
+		} else if (i == 0) {
+			return 0; /* timeout */
+		}
+		rx_fd_drain(pfd.fd);
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int hal_send(struct lgw_ctx_s *ctx, struct lgw_pkt_tx_s pkt_data) {
 	int i;
 	uint8_t buff[256+TX_METADATA_NB]; /* buffer to prepare the packet to send + metadata before SPI write burst */
 	uint32_t part_int; /* integer part for PLL register value calculation */
@@ -1444,9 +2295,11 @@ int lgw_send(struct lgw_pkt_tx_s pkt_data) {
 	int payload_offset = 0; /* start of the payload content in the databuffer */
 	uint8_t pow_index = 0; /* 4-bit value to set the firmware TX power */
 	uint8_t target_mix_gain = 0; /* used to select the proper I/Q offset correction */
+	int8_t tx_offset_i, tx_offset_q; /* I/Q offset correction for the selected radio */
+	uint16_t tx_trig; /* register triggering the TX in the selected mode */
 	
 	/* check if the concentrator is running */
-	if (lgw_is_started == false) {
+	if (ctx->lgw_is_started == false) {
 		DEBUG_MSG("ERROR: CONCENTRATOR IS NOT RUNNING, START IT BEFORE SENDING\n");
 		return LGW_HAL_ERROR;
 	}
@@ -1462,7 +2315,7 @@ int lgw_send(struct lgw_pkt_tx_s pkt_data) {
 		DEBUG_MSG("ERROR: SELECTED RF_CHAIN IS DISABLED FOR TX ON SELECTED BOARD\n");
 		return LGW_HAL_ERROR;
 	}
-	if (rf_enable[pkt_data.rf_chain] == false) {
+	if (ctx->rf_enable[pkt_data.rf_chain] == false) {
 		DEBUG_MSG("ERROR: SELECTED RF_CHAIN IS DISABLED\n");
 		return LGW_HAL_ERROR;
 	}
@@ -1524,11 +2377,11 @@ int lgw_send(struct lgw_pkt_tx_s pkt_data) {
 	target_mix_gain = (target_mix_gain <  8)?  8 : target_mix_gain;
 	target_mix_gain = (target_mix_gain > 15)? 15 : target_mix_gain;
 	if (pkt_data.rf_chain == 0) { /* use radio A calibration table */
-		lgw_reg_w(LGW_TX_OFFSET_I, cal_offset_a_i[target_mix_gain - 8]);
-		lgw_reg_w(LGW_TX_OFFSET_Q, cal_offset_a_q[target_mix_gain - 8]);
+		tx_offset_i = ctx->cal_offset_a_i[target_mix_gain - 8];
+		tx_offset_q = ctx->cal_offset_a_q[target_mix_gain - 8];
 	} else { /* use radio B calibration table */
-		lgw_reg_w(LGW_TX_OFFSET_I, cal_offset_b_i[target_mix_gain - 8]);
-		lgw_reg_w(LGW_TX_OFFSET_Q, cal_offset_b_q[target_mix_gain - 8]);
+		tx_offset_i = ctx->cal_offset_b_i[target_mix_gain - 8];
+		tx_offset_q = ctx->cal_offset_b_q[target_mix_gain - 8];
 	}
 	
 	/* fixed metadata, useful payload and misc metadata compositing */
@@ -1592,7 +2445,7 @@ int lgw_send(struct lgw_pkt_tx_s pkt_data) {
 			case BW_125KHZ: buff[11] = 0; break;
 			case BW_250KHZ: buff[11] = 1; break;
 			case BW_500KHZ: buff[11] = 2; break;
-			default: DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", pkt_data.bandwidth);
+			default: buff[11] = 0; DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", pkt_data.bandwidth);
 		}
 		if (pkt_data.no_header == true) {
 			buff[11] |= 0x04; /* set 'implicit header' bit */
@@ -1663,28 +2516,18 @@ int lgw_send(struct lgw_pkt_tx_s pkt_data) {
 	/* copy payload from user struct to buffer containing metadata */
 	memcpy((void *)(buff + payload_offset), (void *)(pkt_data.payload), pkt_data.size);
 	
-	/* reset TX command flags */
-	lgw_reg_w(LGW_TX_TRIG_IMMEDIATE, 0);
-	lgw_reg_w(LGW_TX_TRIG_DELAYED, 0);
-	lgw_reg_w(LGW_TX_TRIG_GPS, 0);
-	
-	/* put metadata + payload in the TX data buffer */
-	lgw_reg_w(LGW_TX_DATA_BUF_ADDR, 0);
-	lgw_reg_wb(LGW_TX_DATA_BUF_DATA, buff, transfer_size);
-	DEBUG_ARRAY(i, transfer_size, buff);
-	
-	/* send data */
+	/* select the trigger matching the TX mode */
 	switch(pkt_data.tx_mode) {
 		case IMMEDIATE:
-			lgw_reg_w(LGW_TX_TRIG_IMMEDIATE, 1);
+			tx_trig = LGW_TX_TRIG_IMMEDIATE;
 			break;
 			
 		case TIMESTAMPED:
-			lgw_reg_w(LGW_TX_TRIG_DELAYED, 1);
+			tx_trig = LGW_TX_TRIG_DELAYED;
 			break;
 			
 		case ON_GPS:
-			lgw_reg_w(LGW_TX_TRIG_GPS, 1);
+			tx_trig = LGW_TX_TRIG_GPS;
 			break;
 			
 		default:
@@ -1692,12 +2535,54 @@ int lgw_send(struct lgw_pkt_tx_s pkt_data) {
 			return LGW_HAL_ERROR;
 	}
 	
+	/* whole TX register sequence sent as a single batch, atomic vs. the RX path */
+	lgw_reg_batch_begin();
+	
+	/* load TX imbalance correction */
+	lgw_reg_batch_add_w(LGW_TX_OFFSET_I, tx_offset_i);
+	lgw_reg_batch_add_w(LGW_TX_OFFSET_Q, tx_offset_q);
+	
+	/* reset TX command flags */
+	lgw_reg_batch_add_w(LGW_TX_TRIG_IMMEDIATE, 0);
+	lgw_reg_batch_add_w(LGW_TX_TRIG_DELAYED, 0);
+	lgw_reg_batch_add_w(LGW_TX_TRIG_GPS, 0);
+	
+	/* put metadata + payload in the TX data buffer */
+	lgw_reg_batch_add_w(LGW_TX_DATA_BUF_ADDR, 0);
+	lgw_reg_batch_add_wb(LGW_TX_DATA_BUF_DATA, buff, transfer_size);
+	DEBUG_ARRAY(i, transfer_size, buff);
+	
+	/* send data */
+	lgw_reg_batch_add_w(tx_trig, 1);
+	
+	i = lgw_reg_batch_commit();
+	if (i != LGW_REG_SUCCESS) {
+		DEBUG_MSG("ERROR: FAILED TO SEND PACKET TO THE CONCENTRATOR\n");
+		return LGW_HAL_ERROR;
+	}
+	
 	return LGW_HAL_SUCCESS;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-int lgw_status(uint8_t select, uint8_t *code) {
+int lgw_send_ctx(lgw_ctx_t *ctx, struct lgw_pkt_tx_s pkt_data) {
+	struct lgw_reg_ctx_s *prev;
+	uint8_t site;
+	int x;
+	
+	CHECK_NULL(ctx);
+	prev = lgw_reg_ctx_select(ctx->reg);
+	site = lgw_reg_trace_site(LGW_TRACE_SITE_SEND);
+	x = hal_send(ctx, pkt_data);
+	lgw_reg_trace_site(site);
+	lgw_reg_ctx_select(prev);
+	return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int hal_status(struct lgw_ctx_s *ctx, uint8_t select, uint8_t *code) {
 	int32_t read_value;
 	
 	/* check input variables */
@@ -1705,7 +2590,7 @@ int lgw_status(uint8_t select, uint8_t *code) {
 	
 	if (select == TX_STATUS) {
 		lgw_reg_r(LGW_TX_STATUS, &read_value);
-		if (lgw_is_started == false) {
+		if (ctx->lgw_is_started == false) {
 			*code = TX_OFF;
 		} else if ((read_value & 0x10) == 0) { /* bit 4 @1: TX programmed */
 			*code = TX_FREE;
@@ -1729,7 +2614,23 @@ int lgw_status(uint8_t select, uint8_t *code) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-int lgw_get_trigcnt(uint32_t* trig_cnt_us) {
+int lgw_status_ctx(lgw_ctx_t *ctx, uint8_t select, uint8_t *code) {
+	struct lgw_reg_ctx_s *prev;
+	uint8_t site;
+	int x;
+	
+	CHECK_NULL(ctx);
+	prev = lgw_reg_ctx_select(ctx->reg);
+	site = lgw_reg_trace_site(LGW_TRACE_SITE_STATUS);
+	x = hal_status(ctx, select, code);
+	lgw_reg_trace_site(site);
+	lgw_reg_ctx_select(prev);
+	return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int hal_get_trigcnt(uint32_t* trig_cnt_us) {
 	int i;
 	int32_t val;
 	
@@ -1744,6 +2645,294 @@ int lgw_get_trigcnt(uint32_t* trig_cnt_us) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+int lgw_get_trigcnt_ctx(lgw_ctx_t *ctx, uint32_t* trig_cnt_us) {
+	struct lgw_reg_ctx_s *prev;
+	uint8_t site;
+	int x;
+	
+	CHECK_NULL(ctx);
+	prev = lgw_reg_ctx_select(ctx->reg);
+	site = lgw_reg_trace_site(LGW_TRACE_SITE_TRIGCNT);
+	x = hal_get_trigcnt(trig_cnt_us);
+	lgw_reg_trace_site(site);
+	lgw_reg_ctx_select(prev);
+	return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int hal_get_instcnt(uint32_t* inst_cnt_us) {
+	int i;
+	int32_t val;
+	
+	CHECK_NULL(inst_cnt_us);
+	
+	/* TIMESTAMP follows the internal counter while GPS event capture is disabled,
+	the batch keeps lgw_get_trigcnt from reading it meanwhile */
+	lgw_reg_batch_begin();
+	lgw_reg_batch_add_w(LGW_GPS_EN, 0);
+	lgw_reg_batch_add_r(LGW_TIMESTAMP, &val);
+	lgw_reg_batch_add_w(LGW_GPS_EN, 1);
+	i = lgw_reg_batch_commit();
+	if (i == LGW_REG_SUCCESS) {
+		*inst_cnt_us = (uint32_t)val;
+		return LGW_HAL_SUCCESS;
+	} else {
+		return LGW_HAL_ERROR;
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_get_instcnt_ctx(lgw_ctx_t *ctx, uint32_t* inst_cnt_us) {
+	struct lgw_reg_ctx_s *prev;
+	uint8_t site;
+	int x;
+	
+	CHECK_NULL(ctx);
+	prev = lgw_reg_ctx_select(ctx->reg);
+	site = lgw_reg_trace_site(LGW_TRACE_SITE_INSTCNT);
+	x = hal_get_instcnt(inst_cnt_us);
+	lgw_reg_trace_site(site);
+	lgw_reg_ctx_select(prev);
+	return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_get_cal_info_ctx(lgw_ctx_t *ctx, uint8_t *cal_status, bool *cached) {
+	CHECK_NULL(ctx);
+	CHECK_NULL(cal_status);
+	CHECK_NULL(cached);
+	if (ctx->lgw_is_started == false) {
+		DEBUG_MSG("ERROR: CONCENTRATOR IS NOT RUNNING\n");
+		return LGW_HAL_ERROR;
+	}
+	*cal_status = ctx->cal_status_last;
+	*cached = ctx->cal_cached;
+	return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_get_start_profile_ctx(lgw_ctx_t *ctx, struct lgw_start_profile_s *profile) {
+	CHECK_NULL(ctx);
+	CHECK_NULL(profile);
+	if (ctx->start_prof_valid == false) {
+		DEBUG_MSG("ERROR: CONCENTRATOR WAS NEVER STARTED\n");
+		return LGW_HAL_ERROR;
+	}
+	*profile = ctx->start_prof;
+	return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_get_start_wait_ctx(lgw_ctx_t *ctx, struct lgw_start_wait_s *wait) {
+	CHECK_NULL(ctx);
+	CHECK_NULL(wait);
+	if (ctx->lgw_is_started == false) {
+		DEBUG_MSG("ERROR: CONCENTRATOR IS NOT RUNNING\n");
+		return LGW_HAL_ERROR;
+	}
+	*wait = ctx->start_wait;
+	return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+lgw_ctx_t *lgw_ctx_new(const char *spi_path) {
+	struct lgw_ctx_s *ctx;
+	
+	ctx = calloc(1, sizeof *ctx);
+	if (ctx == NULL) {
+		DEBUG_MSG("ERROR: FAILED TO ALLOCATE HAL CONTEXT\n");
+		return NULL;
+	}
+	ctx->reg = lgw_reg_ctx_new(spi_path);
+	if (ctx->reg == NULL) {
+		free(ctx);
+		return NULL;
+	}
+	pthread_mutex_init(&ctx->mx_rx, NULL);
+	ctx->rx_gpio_fd = -1;
+	ctx->rx_ext_fd = -1;
+	return ctx;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_ctx_free(lgw_ctx_t *ctx) {
+	if (ctx == NULL) {
+		return;
+	}
+	if (ctx->lgw_is_started == true) {
+		lgw_stop_ctx(ctx);
+	}
+	lgw_reg_ctx_free(ctx->reg);
+	pthread_mutex_destroy(&ctx->mx_rx);
+	free(ctx);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* default concentrator, API without context handle */
+
+int lgw_board_setconf(struct lgw_conf_board_s conf) {
+	return lgw_board_setconf_ctx(&lgw_ctx_dflt, conf);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_rxrf_setconf(uint8_t rf_chain, struct lgw_conf_rxrf_s conf) {
+	return lgw_rxrf_setconf_ctx(&lgw_ctx_dflt, rf_chain, conf);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_rxif_setconf(uint8_t if_chain, struct lgw_conf_rxif_s conf) {
+	return lgw_rxif_setconf_ctx(&lgw_ctx_dflt, if_chain, conf);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_start(void) {
+	return lgw_start_ctx(&lgw_ctx_dflt, NULL);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_start_ex(const struct lgw_conf_start_s *conf) {
+	return lgw_start_ctx(&lgw_ctx_dflt, conf);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_stop(void) {
+	return lgw_stop_ctx(&lgw_ctx_dflt);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
+	return lgw_receive_ctx(&lgw_ctx_dflt, max_pkt, pkt_data);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_receive_into(uint8_t *arena, uint32_t len) {
+	return lgw_receive_into_ctx(&lgw_ctx_dflt, arena, len);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_rxirq_setconf(const char *gpio_chip, uint32_t line) {
+	return lgw_rxirq_setconf_ctx(&lgw_ctx_dflt, gpio_chip, line);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_rxirq_setfd(int fd) {
+	return lgw_rxirq_setfd_ctx(&lgw_ctx_dflt, fd);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_get_rx_fd(void) {
+	return lgw_get_rx_fd_ctx(&lgw_ctx_dflt);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_receive_wait(int timeout_ms, uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
+	return lgw_receive_wait_ctx(&lgw_ctx_dflt, timeout_ms, max_pkt, pkt_data);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_send(struct lgw_pkt_tx_s pkt_data) {
+	return lgw_send_ctx(&lgw_ctx_dflt, pkt_data);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_status(uint8_t select, uint8_t *code) {
+	return lgw_status_ctx(&lgw_ctx_dflt, select, code);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_get_trigcnt(uint32_t* trig_cnt_us) {
+	return lgw_get_trigcnt_ctx(&lgw_ctx_dflt, trig_cnt_us);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_get_instcnt(uint32_t* inst_cnt_us) {
+	return lgw_get_instcnt_ctx(&lgw_ctx_dflt, inst_cnt_us);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_get_cal_info(uint8_t *cal_status, bool *cached) {
+	return lgw_get_cal_info_ctx(&lgw_ctx_dflt, cal_status, cached);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_get_start_profile(struct lgw_start_profile_s *profile) {
+	return lgw_get_start_profile_ctx(&lgw_ctx_dflt, profile);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_get_start_wait(struct lgw_start_wait_s *wait) {
+	return lgw_get_start_wait_ctx(&lgw_ctx_dflt, wait);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint32_t lgw_time_on_air(const struct lgw_pkt_tx_s *packet) {
+	uint16_t preamble;
+	
+	if (packet == NULL) {
+		return 0;
+	}
+	preamble = packet->preamble;
+	if (packet->modulation == MOD_LORA) {
+		if (preamble == 0) {
+			preamble = STD_LORA_PREAMBLE;
+		} else if (preamble < MIN_LORA_PREAMBLE) {
+			preamble = MIN_LORA_PREAMBLE;
+		}
+		return toa_lora(packet->datarate, packet->bandwidth, packet->coderate, preamble, packet->size, !packet->no_crc, !packet->no_header);
+	} else if (packet->modulation == MOD_FSK) {
+		if (preamble == 0) {
+			preamble = STD_FSK_PREAMBLE;
+		} else if (preamble < MIN_FSK_PREAMBLE) {
+			preamble = MIN_FSK_PREAMBLE;
+		}
+		return toa_fsk(packet->datarate, preamble, packet->size, !packet->no_crc, !packet->no_header);
+	}
+	return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint32_t lgw_time_on_air_rx(const struct lgw_pkt_rx_s *packet) {
+	if (packet == NULL) {
+		return 0;
+	}
+	if (packet->modulation == MOD_LORA) {
+		return toa_lora(packet->datarate, packet->bandwidth, packet->coderate, RX_LORA_PREAMBLE, packet->size, packet->status != STAT_NO_CRC, true);
+	} else if (packet->modulation == MOD_FSK) {
+		return toa_fsk(packet->datarate, RX_FSK_PREAMBLE, packet->size, packet->status != STAT_NO_CRC, true);
+	}
+	return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 const char* lgw_version_info() {
 	return lgw_version_string;
 }
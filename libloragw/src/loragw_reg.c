@@ -20,9 +20,20 @@ Maintainer: Sylvain Miermont
 /* -------------------------------------------------------------------------- */
 /* --- DEPENDANCIES --------------------------------------------------------- */
 
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+	#define _XOPEN_SOURCE 600
+#else
+	#define _XOPEN_SOURCE 500
+#endif
+
 #include <stdint.h>		/* C99 types */
 #include <stdbool.h>	/* bool type */
-#include <stdio.h>		/* printf fprintf */
+#include <stdio.h>		/* printf fprintf fwrite flockfile */
+#include <stdlib.h>		/* calloc free getenv strtoul */
+#include <string.h>		/* memset memcpy strlen strcpy */
+#include <time.h>		/* clock_gettime */
+#include <pthread.h>	/* mutex, concurrent register accesses */
 
 #include "loragw_spi.h"
 #include "loragw_reg.h"
@@ -41,6 +52,9 @@ Maintainer: Sylvain Miermont
 	#define CHECK_NULL(a)				if(a==NULL){return LGW_REG_ERROR;}
 #endif
 
+/* register access context of the calling thread */
+#define REG_CTX()	((reg_ctx_cur != NULL) ? reg_ctx_cur : &reg_ctx_dflt)
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE TYPES -------------------------------------------------------- */
 
@@ -52,6 +66,18 @@ struct lgw_reg_s {
 	uint8_t		leng;		/*!< number of bits in the register */
 	bool		rdon;		/*!< 1 indicates a read-only register */
 	int32_t		dflt;		/*!< register default value */
+	bool		vola;		/*!< 1 indicates a volatile register (updated by hardware) */
+};
+
+struct lgw_batch_op_s {
+	uint16_t	reg_id;		/*!< register accessed */
+	bool		write;		/*!< 1 for a write, 0 for a read */
+	bool		burst;		/*!< 1 for a burst access (raw bytes, no conversion) */
+	int32_t		value;		/*!< value to write (single register write) */
+	int32_t		*dest;		/*!< where to store the value read (single register read) */
+	uint8_t		*data;		/*!< burst data, must stay valid until commit */
+	uint16_t	size;		/*!< burst size, in byte(s) */
+	uint8_t		buf[4];		/*!< raw register bytes transferred (single register access) */
 };
 
 /* -------------------------------------------------------------------------- */
@@ -60,6 +86,21 @@ struct lgw_reg_s {
 #define PAGE_ADDR		0x00
 #define PAGE_MASK		0x03
 
+#define BATCH_OPS_MAX		LGW_REG_BATCH_MAX	/* max number of operations in a batch */
+#define BATCH_FRAMES_MAX	(2 * BATCH_OPS_MAX)	/* one page switch + one access per operation at most */
+#define REG_SLOTS			5	/* register image slots: 'all pages' + pages 0 to 3 */
+#define REG_SLOT(r)			((r).page + 1)	/* image slot of a register */
+
+/* environment variables overriding the SPI layer defaults, see lgw_reg_spi_setconf */
+#define ENV_SPI_PATH		"LGW_SPI_PATH"
+#define ENV_SPI_SPEED		"LGW_SPI_SPEED"
+#define ENV_SPI_CHUNK		"LGW_SPI_CHUNK"
+#define ENV_SPI_TRACE		"LGW_SPI_TRACE"
+
+#define AUTOTUNE_SIZE		4096	/* bytes of RX data buffer written and read back per pass */
+#define AUTOTUNE_PASSES		4		/* passes required at each clock */
+#define AUTOTUNE_RATED_HZ	10000000	/* max SPI clock of the SX1301 datasheet, default limit of the sweep */
+
 /*
 auto generated register mapping for C code : 11-Jul-2013 13:20:40
 this file contains autogenerated C struct used to access the LoRa register from the Primer firmware
@@ -67,376 +108,745 @@ this file is autogenerated from registers description
 293 registers are defined
 */
 const struct lgw_reg_s loregs[LGW_TOTALREGS] = {
-	{-1,0,0,0,2,0,0},		/* PAGE_REG */
-	{-1,0,7,0,1,0,0},		/* SOFT_RESET */
-	{-1,1,0,0,8,1,103},		/* VERSION */
-	{-1,2,0,0,16,0,0},		/* RX_DATA_BUF_ADDR */
-	{-1,4,0,0,8,0,0},		/* RX_DATA_BUF_DATA */
-	{-1,5,0,0,8,0,0},		/* TX_DATA_BUF_ADDR */
-	{-1,6,0,0,8,0,0},		/* TX_DATA_BUF_DATA */
-	{-1,7,0,0,8,0,0},		/* CAPTURE_RAM_ADDR */
-	{-1,8,0,0,8,1,0},		/* CAPTURE_RAM_DATA */
-	{-1,9,0,0,8,0,0},		/* MCU_PROM_ADDR */
-	{-1,10,0,0,8,0,0},		/* MCU_PROM_DATA */
-	{-1,11,0,0,8,0,0},		/* RX_PACKET_DATA_FIFO_NUM_STORED */
-	{-1,12,0,0,16,1,0},		/* RX_PACKET_DATA_FIFO_ADDR_POINTER */
-	{-1,14,0,0,8,1,0},		/* RX_PACKET_DATA_FIFO_STATUS */
-	{-1,15,0,0,8,1,0},		/* RX_PACKET_DATA_FIFO_PAYLOAD_SIZE */
-	{-1,16,0,0,1,0,0},		/* MBWSSF_MODEM_ENABLE */
-	{-1,16,1,0,1,0,0},		/* CONCENTRATOR_MODEM_ENABLE */
-	{-1,16,2,0,1,0,0},		/* FSK_MODEM_ENABLE */
-	{-1,16,3,0,1,0,0},		/* GLOBAL_EN */
-	{-1,17,0,0,1,0,1},		/* CLK32M_EN */
-	{-1,17,1,0,1,0,1},		/* CLKHS_EN */
-	{-1,18,0,0,1,0,0},		/* START_BIST0 */
-	{-1,18,1,0,1,0,0},		/* START_BIST1 */
-	{-1,18,2,0,1,0,0},		/* CLEAR_BIST0 */
-	{-1,18,3,0,1,0,0},		/* CLEAR_BIST1 */
-	{-1,19,0,0,1,1,0},		/* BIST0_FINISHED */
-	{-1,19,1,0,1,1,0},		/* BIST1_FINISHED */
-	{-1,20,0,0,1,1,0},		/* MCU_AGC_PROG_RAM_BIST_STATUS */
-	{-1,20,1,0,1,1,0},		/* MCU_ARB_PROG_RAM_BIST_STATUS */
-	{-1,20,2,0,1,1,0},		/* CAPTURE_RAM_BIST_STATUS */
-	{-1,20,3,0,1,1,0},		/* CHAN_FIR_RAM0_BIST_STATUS */
-	{-1,20,4,0,1,1,0},		/* CHAN_FIR_RAM1_BIST_STATUS */
-	{-1,21,0,0,1,1,0},		/* CORR0_RAM_BIST_STATUS */
-	{-1,21,1,0,1,1,0},		/* CORR1_RAM_BIST_STATUS */
-	{-1,21,2,0,1,1,0},		/* CORR2_RAM_BIST_STATUS */
-	{-1,21,3,0,1,1,0},		/* CORR3_RAM_BIST_STATUS */
-	{-1,21,4,0,1,1,0},		/* CORR4_RAM_BIST_STATUS */
-	{-1,21,5,0,1,1,0},		/* CORR5_RAM_BIST_STATUS */
-	{-1,21,6,0,1,1,0},		/* CORR6_RAM_BIST_STATUS */
-	{-1,21,7,0,1,1,0},		/* CORR7_RAM_BIST_STATUS */
-	{-1,22,0,0,1,1,0},		/* MODEM0_RAM0_BIST_STATUS */
-	{-1,22,1,0,1,1,0},		/* MODEM1_RAM0_BIST_STATUS */
-	{-1,22,2,0,1,1,0},		/* MODEM2_RAM0_BIST_STATUS */
-	{-1,22,3,0,1,1,0},		/* MODEM3_RAM0_BIST_STATUS */
-	{-1,22,4,0,1,1,0},		/* MODEM4_RAM0_BIST_STATUS */
-	{-1,22,5,0,1,1,0},		/* MODEM5_RAM0_BIST_STATUS */
-	{-1,22,6,0,1,1,0},		/* MODEM6_RAM0_BIST_STATUS */
-	{-1,22,7,0,1,1,0},		/* MODEM7_RAM0_BIST_STATUS */
-	{-1,23,0,0,1,1,0},		/* MODEM0_RAM1_BIST_STATUS */
-	{-1,23,1,0,1,1,0},		/* MODEM1_RAM1_BIST_STATUS */
-	{-1,23,2,0,1,1,0},		/* MODEM2_RAM1_BIST_STATUS */
-	{-1,23,3,0,1,1,0},		/* MODEM3_RAM1_BIST_STATUS */
-	{-1,23,4,0,1,1,0},		/* MODEM4_RAM1_BIST_STATUS */
-	{-1,23,5,0,1,1,0},		/* MODEM5_RAM1_BIST_STATUS */
-	{-1,23,6,0,1,1,0},		/* MODEM6_RAM1_BIST_STATUS */
-	{-1,23,7,0,1,1,0},		/* MODEM7_RAM1_BIST_STATUS */
-	{-1,24,0,0,1,1,0},		/* MODEM0_RAM2_BIST_STATUS */
-	{-1,24,1,0,1,1,0},		/* MODEM1_RAM2_BIST_STATUS */
-	{-1,24,2,0,1,1,0},		/* MODEM2_RAM2_BIST_STATUS */
-	{-1,24,3,0,1,1,0},		/* MODEM3_RAM2_BIST_STATUS */
-	{-1,24,4,0,1,1,0},		/* MODEM4_RAM2_BIST_STATUS */
-	{-1,24,5,0,1,1,0},		/* MODEM5_RAM2_BIST_STATUS */
-	{-1,24,6,0,1,1,0},		/* MODEM6_RAM2_BIST_STATUS */
-	{-1,24,7,0,1,1,0},		/* MODEM7_RAM2_BIST_STATUS */
-	{-1,25,0,0,1,1,0},		/* MODEM_MBWSSF_RAM0_BIST_STATUS */
-	{-1,25,1,0,1,1,0},		/* MODEM_MBWSSF_RAM1_BIST_STATUS */
-	{-1,25,2,0,1,1,0},		/* MODEM_MBWSSF_RAM2_BIST_STATUS */
-	{-1,26,0,0,1,1,0},		/* MCU_AGC_DATA_RAM_BIST0_STATUS */
-	{-1,26,1,0,1,1,0},		/* MCU_AGC_DATA_RAM_BIST1_STATUS */
-	{-1,26,2,0,1,1,0},		/* MCU_ARB_DATA_RAM_BIST0_STATUS */
-	{-1,26,3,0,1,1,0},		/* MCU_ARB_DATA_RAM_BIST1_STATUS */
-	{-1,26,4,0,1,1,0},		/* TX_TOP_RAM_BIST0_STATUS */
-	{-1,26,5,0,1,1,0},		/* TX_TOP_RAM_BIST1_STATUS */
-	{-1,26,6,0,1,1,0},		/* DATA_MNGT_RAM_BIST0_STATUS */
-	{-1,26,7,0,1,1,0},		/* DATA_MNGT_RAM_BIST1_STATUS */
-	{-1,27,0,0,4,0,0},		/* GPIO_SELECT_INPUT */
-	{-1,28,0,0,4,0,0},		/* GPIO_SELECT_OUTPUT */
-	{-1,29,0,0,5,0,0},		/* GPIO_MODE */
-	{-1,30,0,0,5,1,0},		/* GPIO_PIN_REG_IN */
-	{-1,31,0,0,5,0,0},		/* GPIO_PIN_REG_OUT */
-	{-1,32,0,0,8,1,0},		/* MCU_AGC_STATUS */
-	{-1,125,0,0,8,1,0},		/* MCU_ARB_STATUS */
-	{-1,126,0,0,8,1,1},		/* CHIP_ID */
-	{-1,127,0,0,1,0,1},		/* EMERGENCY_FORCE_HOST_CTRL */
-	{0,33,0,0,1,0,0},		/* RX_INVERT_IQ */
-	{0,33,1,0,1,0,1},		/* MODEM_INVERT_IQ */
-	{0,33,2,0,1,0,0},		/* MBWSSF_MODEM_INVERT_IQ */
-	{0,33,3,0,1,0,0},		/* RX_EDGE_SELECT */
-	{0,33,4,0,1,0,0},		/* MISC_RADIO_EN */
-	{0,33,5,0,1,0,0},		/* FSK_MODEM_INVERT_IQ */
-	{0,34,0,0,4,0,7},		/* FILTER_GAIN */
-	{0,35,0,0,8,0,240},		/* RADIO_SELECT */
-	{0,36,0,1,13,0,-384},	/* IF_FREQ_0 */
-	{0,38,0,1,13,0,-128},	/* IF_FREQ_1 */
-	{0,40,0,1,13,0,128},	/* IF_FREQ_2 */
-	{0,42,0,1,13,0,384},	/* IF_FREQ_3 */
-	{0,44,0,1,13,0,-384},	/* IF_FREQ_4 */
-	{0,46,0,1,13,0,-128},	/* IF_FREQ_5 */
-	{0,48,0,1,13,0,128},	/* IF_FREQ_6 */
-	{0,50,0,1,13,0,384},	/* IF_FREQ_7 */
-	{0,52,0,1,13,0,0},		/* IF_FREQ_8 */
-	{0,54,0,1,13,0,0},		/* IF_FREQ_9 */
-	{0,64,0,0,1,0,0},		/* CHANN_OVERRIDE_AGC_GAIN */
-	{0,64,1,0,4,0,7},		/* CHANN_AGC_GAIN */
-	{0,65,0,0,7,0,0},		/* CORR0_DETECT_EN */
-	{0,66,0,0,7,0,0},		/* CORR1_DETECT_EN */
-	{0,67,0,0,7,0,0},		/* CORR2_DETECT_EN */
-	{0,68,0,0,7,0,0},		/* CORR3_DETECT_EN */
-	{0,69,0,0,7,0,0},		/* CORR4_DETECT_EN */
-	{0,70,0,0,7,0,0},		/* CORR5_DETECT_EN */
-	{0,71,0,0,7,0,0},		/* CORR6_DETECT_EN */
-	{0,72,0,0,7,0,0},		/* CORR7_DETECT_EN */
-	{0,73,0,0,1,0,0},		/* CORR_SAME_PEAKS_OPTION_SF6 */
-	{0,73,1,0,1,0,1},		/* CORR_SAME_PEAKS_OPTION_SF7 */
-	{0,73,2,0,1,0,1},		/* CORR_SAME_PEAKS_OPTION_SF8 */
-	{0,73,3,0,1,0,1},		/* CORR_SAME_PEAKS_OPTION_SF9 */
-	{0,73,4,0,1,0,1},		/* CORR_SAME_PEAKS_OPTION_SF10 */
-	{0,73,5,0,1,0,1},		/* CORR_SAME_PEAKS_OPTION_SF11 */
-	{0,73,6,0,1,0,1},		/* CORR_SAME_PEAKS_OPTION_SF12 */
-	{0,74,0,0,4,0,4},		/* CORR_SIG_NOISE_RATIO_SF6 */
-	{0,74,4,0,4,0,4},		/* CORR_SIG_NOISE_RATIO_SF7 */
-	{0,75,0,0,4,0,4},		/* CORR_SIG_NOISE_RATIO_SF8 */
-	{0,75,4,0,4,0,4},		/* CORR_SIG_NOISE_RATIO_SF9 */
-	{0,76,0,0,4,0,4},		/* CORR_SIG_NOISE_RATIO_SF10 */
-	{0,76,4,0,4,0,4},		/* CORR_SIG_NOISE_RATIO_SF11 */
-	{0,77,0,0,4,0,4},		/* CORR_SIG_NOISE_RATIO_SF12 */
-	{0,78,0,0,4,0,4},		/* CORR_NUM_SAME_PEAK */
-	{0,78,4,0,3,0,5},		/* CORR_MAC_GAIN */
-	{0,81,0,0,12,0,0},		/* ADJUST_MODEM_START_OFFSET_RDX4 */
-	{0,83,0,0,12,0,4092},	/* ADJUST_MODEM_START_OFFSET_SF12_RDX4 */
-	{0,85,0,0,8,0,7},		/* DBG_CORR_SELECT_SF */
-	{0,86,0,0,8,0,0},		/* DBG_CORR_SELECT_CHANNEL */
-	{0,87,0,0,8,1,0},		/* DBG_DETECT_CPT */
-	{0,88,0,0,8,1,0},		/* DBG_SYMB_CPT */
-	{0,89,0,0,1,0,1},		/* CHIRP_INVERT_RX */
-	{0,89,1,0,1,0,1},		/* DC_NOTCH_EN */
-	{0,90,0,0,1,0,0},		/* IMPLICIT_CRC_EN */
-	{0,90,1,0,3,0,0},		/* IMPLICIT_CODING_RATE */
-	{0,91,0,0,8,0,0},		/* IMPLICIT_PAYLOAD_LENGHT */
-	{0,92,0,0,8,0,29},		/* FREQ_TO_TIME_INVERT */
-	{0,93,0,0,6,0,9},		/* FREQ_TO_TIME_DRIFT */
-	{0,94,0,0,2,0,2},		/* PAYLOAD_FINE_TIMING_GAIN */
-	{0,94,2,0,2,0,1},		/* PREAMBLE_FINE_TIMING_GAIN */
-	{0,94,4,0,2,0,0},		/* TRACKING_INTEGRAL */
-	{0,95,0,0,4,0,1},		/* FRAME_SYNCH_PEAK1_POS */
-	{0,95,4,0,4,0,2},		/* FRAME_SYNCH_PEAK2_POS */
-	{0,96,0,0,16,0,10},		/* PREAMBLE_SYMB1_NB */
-	{0,98,0,0,1,0,1},		/* FRAME_SYNCH_GAIN */
-	{0,98,1,0,1,0,1},		/* SYNCH_DETECT_TH */
-	{0,99,0,0,4,0,8},		/* LLR_SCALE */
-	{0,99,4,0,2,0,2},		/* SNR_AVG_CST */
-	{0,100,0,0,7,0,0},		/* PPM_OFFSET */
-	{0,101,0,0,8,0,255},	/* MAX_PAYLOAD_LEN */
-	{0,102,0,0,1,0,1},		/* ONLY_CRC_EN */
-	{0,103,0,0,8,0,0},		/* ZERO_PAD */
-	{0,104,0,0,4,0,8},		/* DEC_GAIN_OFFSET */
-	{0,104,4,0,4,0,7},		/* CHAN_GAIN_OFFSET */
-	{0,105,1,0,1,0,1},		/* FORCE_HOST_RADIO_CTRL */
-	{0,105,2,0,1,0,1},		/* FORCE_HOST_FE_CTRL */
-	{0,105,3,0,1,0,1},		/* FORCE_DEC_FILTER_GAIN */
-	{0,106,0,0,1,0,1},		/* MCU_RST_0 */
-	{0,106,1,0,1,0,1},		/* MCU_RST_1 */
-	{0,106,2,0,1,0,0},		/* MCU_SELECT_MUX_0 */
-	{0,106,3,0,1,0,0},		/* MCU_SELECT_MUX_1 */
-	{0,106,4,0,1,1,0},		/* MCU_CORRUPTION_DETECTED_0 */
-	{0,106,5,0,1,1,0},		/* MCU_CORRUPTION_DETECTED_1 */
-	{0,106,6,0,1,0,0},		/* MCU_SELECT_EDGE_0 */
-	{0,106,7,0,1,0,0},		/* MCU_SELECT_EDGE_1 */
-	{0,107,0,0,8,0,1},		/* CHANN_SELECT_RSSI */
-	{0,108,0,0,8,0,32},		/* RSSI_BB_DEFAULT_VALUE */
-	{0,109,0,0,8,0,100},	/* RSSI_DEC_DEFAULT_VALUE */
-	{0,110,0,0,8,0,100},	/* RSSI_CHANN_DEFAULT_VALUE */
-	{0,111,0,0,5,0,7},		/* RSSI_BB_FILTER_ALPHA */
-	{0,112,0,0,5,0,5},		/* RSSI_DEC_FILTER_ALPHA */
-	{0,113,0,0,5,0,8},		/* RSSI_CHANN_FILTER_ALPHA */
-	{0,114,0,0,6,0,0},		/* IQ_MISMATCH_A_AMP_COEFF */
-	{0,115,0,0,6,0,0},		/* IQ_MISMATCH_A_PHI_COEFF */
-	{0,116,0,0,6,0,0},		/* IQ_MISMATCH_B_AMP_COEFF */
-	{0,116,6,0,1,0,0},		/* IQ_MISMATCH_B_SEL_I */
-	{0,117,0,0,6,0,0},		/* IQ_MISMATCH_B_PHI_COEFF */
-	{1,33,0,0,1,0,0},		/* TX_TRIG_IMMEDIATE */
-	{1,33,1,0,1,0,0},		/* TX_TRIG_DELAYED */
-	{1,33,2,0,1,0,0},		/* TX_TRIG_GPS */
-	{1,34,0,0,16,0,0},		/* TX_START_DELAY */
-	{1,36,0,0,4,0,1},		/* TX_FRAME_SYNCH_PEAK1_POS */
-	{1,36,4,0,4,0,2},		/* TX_FRAME_SYNCH_PEAK2_POS */
-	{1,37,0,0,3,0,0},		/* TX_RAMP_DURATION */
-	{1,39,0,1,8,0,0},		/* TX_OFFSET_I */
-	{1,40,0,1,8,0,0},		/* TX_OFFSET_Q */
-	{1,41,0,0,1,0,0},		/* TX_MODE */
-	{1,41,1,0,4,0,0},		/* TX_ZERO_PAD */
-	{1,41,5,0,1,0,0},		/* TX_EDGE_SELECT */
-	{1,41,6,0,1,0,0},		/* TX_EDGE_SELECT_TOP */
-	{1,42,0,0,2,0,0},		/* TX_GAIN */
-	{1,42,2,0,3,0,5},		/* TX_CHIRP_LOW_PASS */
-	{1,42,5,0,2,0,0},		/* TX_FCC_WIDEBAND */
-	{1,42,7,0,1,0,1},		/* TX_SWAP_IQ */
-	{1,43,0,0,1,0,0},		/* MBWSSF_IMPLICIT_HEADER */
-	{1,43,1,0,1,0,0},		/* MBWSSF_IMPLICIT_CRC_EN */
-	{1,43,2,0,3,0,0},		/* MBWSSF_IMPLICIT_CODING_RATE */
-	{1,44,0,0,8,0,0},		/* MBWSSF_IMPLICIT_PAYLOAD_LENGHT */
-	{1,45,0,0,1,0,1},		/* MBWSSF_AGC_FREEZE_ON_DETECT */
-	{1,46,0,0,4,0,1},		/* MBWSSF_FRAME_SYNCH_PEAK1_POS */
-	{1,46,4,0,4,0,2},		/* MBWSSF_FRAME_SYNCH_PEAK2_POS */
-	{1,47,0,0,16,0,10},		/* MBWSSF_PREAMBLE_SYMB1_NB */
-	{1,49,0,0,1,0,1},		/* MBWSSF_FRAME_SYNCH_GAIN */
-	{1,49,1,0,1,0,1},		/* MBWSSF_SYNCH_DETECT_TH */
-	{1,50,0,0,8,0,10},		/* MBWSSF_DETECT_MIN_SINGLE_PEAK */
-	{1,51,0,0,3,0,3},		/* MBWSSF_DETECT_TRIG_SAME_PEAK_NB */
-	{1,52,0,0,8,0,29},		/* MBWSSF_FREQ_TO_TIME_INVERT */
-	{1,53,0,0,6,0,36},		/* MBWSSF_FREQ_TO_TIME_DRIFT */
-	{1,54,0,0,12,0,0},		/* MBWSSF_PPM_CORRECTION */
-	{1,56,0,0,2,0,2},		/* MBWSSF_PAYLOAD_FINE_TIMING_GAIN */
-	{1,56,2,0,2,0,1},		/* MBWSSF_PREAMBLE_FINE_TIMING_GAIN */
-	{1,56,4,0,2,0,0},		/* MBWSSF_TRACKING_INTEGRAL */
-	{1,57,0,0,8,0,0},		/* MBWSSF_ZERO_PAD */
-	{1,58,0,0,2,0,0},		/* MBWSSF_MODEM_BW */
-	{1,58,2,0,1,0,0},		/* MBWSSF_RADIO_SELECT */
-	{1,58,3,0,1,0,1},		/* MBWSSF_RX_CHIRP_INVERT */
-	{1,59,0,0,4,0,8},		/* MBWSSF_LLR_SCALE */
-	{1,59,4,0,2,0,3},		/* MBWSSF_SNR_AVG_CST */
-	{1,59,6,0,1,0,0},		/* MBWSSF_PPM_OFFSET */
-	{1,60,0,0,4,0,7},		/* MBWSSF_RATE_SF */
-	{1,60,4,0,1,0,1},		/* MBWSSF_ONLY_CRC_EN */
-	{1,61,0,0,8,0,255},		/* MBWSSF_MAX_PAYLOAD_LEN */
-	{1,62,0,0,8,1,128},		/* TX_STATUS */
-	{1,63,0,0,3,0,0},		/* FSK_CH_BW_EXPO */
-	{1,63,3,0,3,0,0},		/* FSK_RSSI_LENGTH */
-	{1,63,6,0,1,0,0},		/* FSK_RX_INVERT */
-	{1,63,7,0,1,0,0},		/* FSK_PKT_MODE */
-	{1,64,0,0,3,0,0},		/* FSK_PSIZE */
-	{1,64,3,0,1,0,0},		/* FSK_CRC_EN */
-	{1,64,4,0,2,0,0},		/* FSK_DCFREE_ENC */
-	{1,64,6,0,1,0,0},		/* FSK_CRC_IBM */
-	{1,65,0,0,5,0,0},		/* FSK_ERROR_OSR_TOL */
-	{1,65,7,0,1,0,0},		/* FSK_RADIO_SELECT */
-	{1,66,0,0,16,0,0},		/* FSK_BR_RATIO */
-	{1,68,0,0,32,0,0},		/* FSK_REF_PATTERN_LSB */
-	{1,72,0,0,32,0,0},		/* FSK_REF_PATTERN_MSB */
-	{1,76,0,0,8,0,0},		/* FSK_PKT_LENGTH */
-	{1,77,0,0,1,0,1},		/* FSK_TX_GAUSSIAN_EN */
-	{1,77,1,0,2,0,0},		/* FSK_TX_GAUSSIAN_SELECT_BT */
-	{1,77,3,0,1,0,1},		/* FSK_TX_PATTERN_EN */
-	{1,77,4,0,1,0,0},		/* FSK_TX_PREAMBLE_SEQ */
-	{1,77,5,0,3,0,0},		/* FSK_TX_PSIZE */
-	{1,80,0,0,8,0,0},		/* FSK_NODE_ADRS */
-	{1,81,0,0,8,0,0},		/* FSK_BROADCAST */
-	{1,82,0,0,1,0,1},		/* FSK_AUTO_AFC_ON */
-	{1,83,0,0,10,0,0},		/* FSK_PATTERN_TIMEOUT_CFG */
-	{2,33,0,0,8,0,0},		/* SPI_RADIO_A__DATA */
-	{2,34,0,0,8,1,0},		/* SPI_RADIO_A__DATA_READBACK */
-	{2,35,0,0,8,0,0},		/* SPI_RADIO_A__ADDR */
-	{2,37,0,0,1,0,0},		/* SPI_RADIO_A__CS */
-	{2,38,0,0,8,0,0},		/* SPI_RADIO_B__DATA */
-	{2,39,0,0,8,1,0},		/* SPI_RADIO_B__DATA_READBACK */
-	{2,40,0,0,8,0,0},		/* SPI_RADIO_B__ADDR */
-	{2,42,0,0,1,0,0},		/* SPI_RADIO_B__CS */
-	{2,43,0,0,1,0,0},		/* RADIO_A_EN */
-	{2,43,1,0,1,0,0},		/* RADIO_B_EN */
-	{2,43,2,0,1,0,1},		/* RADIO_RST */
-	{2,43,3,0,1,0,0},		/* LNA_A_EN */
-	{2,43,4,0,1,0,0},		/* PA_A_EN */
-	{2,43,5,0,1,0,0},		/* LNA_B_EN */
-	{2,43,6,0,1,0,0},		/* PA_B_EN */
-	{2,44,0,0,2,0,0},		/* PA_GAIN */
-	{2,45,0,0,4,0,2},		/* LNA_A_CTRL_LUT */
-	{2,45,4,0,4,0,4},		/* PA_A_CTRL_LUT */
-	{2,46,0,0,4,0,2},		/* LNA_B_CTRL_LUT */
-	{2,46,4,0,4,0,4},		/* PA_B_CTRL_LUT */
-	{2,47,0,0,5,0,0},		/* CAPTURE_SOURCE */
-	{2,47,5,0,1,0,0},		/* CAPTURE_START */
-	{2,47,6,0,1,0,0},		/* CAPTURE_FORCE_TRIGGER */
-	{2,47,7,0,1,0,0},		/* CAPTURE_WRAP */
-	{2,48,0,0,16,0,0},		/* CAPTURE_PERIOD */
-	{2,51,0,0,8,1,0},		/* MODEM_STATUS */
-	{2,52,0,0,8,1,0},		/* VALID_HEADER_COUNTER_0 */
-	{2,54,0,0,8,1,0},		/* VALID_PACKET_COUNTER_0 */
-	{2,56,0,0,8,1,0},		/* VALID_HEADER_COUNTER_MBWSSF */
-	{2,57,0,0,8,1,0},		/* VALID_HEADER_COUNTER_FSK */
-	{2,58,0,0,8,1,0},		/* VALID_PACKET_COUNTER_MBWSSF */
-	{2,59,0,0,8,1,0},		/* VALID_PACKET_COUNTER_FSK */
-	{2,60,0,0,8,1,0},		/* CHANN_RSSI */
-	{2,61,0,0,8,1,0},		/* BB_RSSI */
-	{2,62,0,0,8,1,0},		/* DEC_RSSI */
-	{2,63,0,0,8,1,0},		/* DBG_MCU_DATA */
-	{2,64,0,0,8,1,0},		/* DBG_ARB_MCU_RAM_DATA */
-	{2,65,0,0,8,1,0},		/* DBG_AGC_MCU_RAM_DATA */
-	{2,66,0,0,16,1,0},		/* NEXT_PACKET_CNT */
-	{2,68,0,0,16,1,0},		/* ADDR_CAPTURE_COUNT */
-	{2,70,0,0,32,1,0},		/* TIMESTAMP */
-	{2,74,0,0,4,1,0},		/* DBG_CHANN0_GAIN */
-	{2,74,4,0,4,1,0},		/* DBG_CHANN1_GAIN */
-	{2,75,0,0,4,1,0},		/* DBG_CHANN2_GAIN */
-	{2,75,4,0,4,1,0},		/* DBG_CHANN3_GAIN */
-	{2,76,0,0,4,1,0},		/* DBG_CHANN4_GAIN */
-	{2,76,4,0,4,1,0},		/* DBG_CHANN5_GAIN */
-	{2,77,0,0,4,1,0},		/* DBG_CHANN6_GAIN */
-	{2,77,4,0,4,1,0},		/* DBG_CHANN7_GAIN */
-	{2,78,0,0,4,1,0},		/* DBG_DEC_FILT_GAIN */
-	{2,79,0,0,3,1,0},		/* SPI_DATA_FIFO_PTR */
-	{2,79,3,0,3,1,0},		/* PACKET_DATA_FIFO_PTR */
-	{2,80,0,0,8,0,0},		/* DBG_ARB_MCU_RAM_ADDR */
-	{2,81,0,0,8,0,0},		/* DBG_AGC_MCU_RAM_ADDR */
-	{2,82,0,0,1,0,0},		/* SPI_MASTER_CHIP_SELECT_POLARITY */
-	{2,82,1,0,1,0,0},		/* SPI_MASTER_CPOL */
-	{2,82,2,0,1,0,0},		/* SPI_MASTER_CPHA */
-	{2,83,0,0,1,0,0},		/* SIG_GEN_ANALYSER_MUX_SEL */
-	{2,84,0,0,1,0,0},		/* SIG_GEN_EN */
-	{2,84,1,0,1,0,0},		/* SIG_ANALYSER_EN */
-	{2,84,2,0,2,0,0},		/* SIG_ANALYSER_AVG_LEN */
-	{2,84,4,0,3,0,0},		/* SIG_ANALYSER_PRECISION */
-	{2,84,7,0,1,1,0},		/* SIG_ANALYSER_VALID_OUT */
-	{2,85,0,0,8,0,0},		/* SIG_GEN_FREQ */
-	{2,86,0,0,8,0,0},		/* SIG_ANALYSER_FREQ */
-	{2,87,0,0,8,1,0},		/* SIG_ANALYSER_I_OUT */
-	{2,88,0,0,8,1,0},		/* SIG_ANALYSER_Q_OUT */
-	{2,89,0,0,1,0,0},		/* GPS_EN */
-	{2,89,1,0,1,0,1},		/* GPS_POL */
-	{2,90,0,1,8,0,0},		/* SW_TEST_REG1 */
-	{2,91,2,1,6,0,0},		/* SW_TEST_REG2 */
-	{2,92,0,1,16,0,0},		/* SW_TEST_REG3 */
-	{2,94,0,0,4,1,0},		/* DATA_MNGT_STATUS */
-	{2,95,0,0,5,1,0},		/* DATA_MNGT_CPT_FRAME_ALLOCATED */
-	{2,96,0,0,5,1,0},		/* DATA_MNGT_CPT_FRAME_FINISHED */
-	{2,97,0,0,5,1,0}		/* DATA_MNGT_CPT_FRAME_READEN */
+	{-1,0,0,0,2,0,0,1},		/* PAGE_REG */
+	{-1,0,7,0,1,0,0,1},		/* SOFT_RESET */
+	{-1,1,0,0,8,1,103,1},		/* VERSION */
+	{-1,2,0,0,16,0,0,1},		/* RX_DATA_BUF_ADDR */
+	{-1,4,0,0,8,0,0,1},		/* RX_DATA_BUF_DATA */
+	{-1,5,0,0,8,0,0,1},		/* TX_DATA_BUF_ADDR */
+	{-1,6,0,0,8,0,0,1},		/* TX_DATA_BUF_DATA */
+	{-1,7,0,0,8,0,0,1},		/* CAPTURE_RAM_ADDR */
+	{-1,8,0,0,8,1,0,1},		/* CAPTURE_RAM_DATA */
+	{-1,9,0,0,8,0,0,1},		/* MCU_PROM_ADDR */
+	{-1,10,0,0,8,0,0,1},		/* MCU_PROM_DATA */
+	{-1,11,0,0,8,0,0,1},		/* RX_PACKET_DATA_FIFO_NUM_STORED */
+	{-1,12,0,0,16,1,0,1},		/* RX_PACKET_DATA_FIFO_ADDR_POINTER */
+	{-1,14,0,0,8,1,0,1},		/* RX_PACKET_DATA_FIFO_STATUS */
+	{-1,15,0,0,8,1,0,1},		/* RX_PACKET_DATA_FIFO_PAYLOAD_SIZE */
+	{-1,16,0,0,1,0,0,0},		/* MBWSSF_MODEM_ENABLE */
+	{-1,16,1,0,1,0,0,0},		/* CONCENTRATOR_MODEM_ENABLE */
+	{-1,16,2,0,1,0,0,0},		/* FSK_MODEM_ENABLE */
+	{-1,16,3,0,1,0,0,0},		/* GLOBAL_EN */
+	{-1,17,0,0,1,0,1,0},		/* CLK32M_EN */
+	{-1,17,1,0,1,0,1,0},		/* CLKHS_EN */
+	{-1,18,0,0,1,0,0,1},		/* START_BIST0 */
+	{-1,18,1,0,1,0,0,1},		/* START_BIST1 */
+	{-1,18,2,0,1,0,0,1},		/* CLEAR_BIST0 */
+	{-1,18,3,0,1,0,0,1},		/* CLEAR_BIST1 */
+	{-1,19,0,0,1,1,0,1},		/* BIST0_FINISHED */
+	{-1,19,1,0,1,1,0,1},		/* BIST1_FINISHED */
+	{-1,20,0,0,1,1,0,1},		/* MCU_AGC_PROG_RAM_BIST_STATUS */
+	{-1,20,1,0,1,1,0,1},		/* MCU_ARB_PROG_RAM_BIST_STATUS */
+	{-1,20,2,0,1,1,0,1},		/* CAPTURE_RAM_BIST_STATUS */
+	{-1,20,3,0,1,1,0,1},		/* CHAN_FIR_RAM0_BIST_STATUS */
+	{-1,20,4,0,1,1,0,1},		/* CHAN_FIR_RAM1_BIST_STATUS */
+	{-1,21,0,0,1,1,0,1},		/* CORR0_RAM_BIST_STATUS */
+	{-1,21,1,0,1,1,0,1},		/* CORR1_RAM_BIST_STATUS */
+	{-1,21,2,0,1,1,0,1},		/* CORR2_RAM_BIST_STATUS */
+	{-1,21,3,0,1,1,0,1},		/* CORR3_RAM_BIST_STATUS */
+	{-1,21,4,0,1,1,0,1},		/* CORR4_RAM_BIST_STATUS */
+	{-1,21,5,0,1,1,0,1},		/* CORR5_RAM_BIST_STATUS */
+	{-1,21,6,0,1,1,0,1},		/* CORR6_RAM_BIST_STATUS */
+	{-1,21,7,0,1,1,0,1},		/* CORR7_RAM_BIST_STATUS */
+	{-1,22,0,0,1,1,0,1},		/* MODEM0_RAM0_BIST_STATUS */
+	{-1,22,1,0,1,1,0,1},		/* MODEM1_RAM0_BIST_STATUS */
+	{-1,22,2,0,1,1,0,1},		/* MODEM2_RAM0_BIST_STATUS */
+	{-1,22,3,0,1,1,0,1},		/* MODEM3_RAM0_BIST_STATUS */
+	{-1,22,4,0,1,1,0,1},		/* MODEM4_RAM0_BIST_STATUS */
+	{-1,22,5,0,1,1,0,1},		/* MODEM5_RAM0_BIST_STATUS */
+	{-1,22,6,0,1,1,0,1},		/* MODEM6_RAM0_BIST_STATUS */
+	{-1,22,7,0,1,1,0,1},		/* MODEM7_RAM0_BIST_STATUS */
+	{-1,23,0,0,1,1,0,1},		/* MODEM0_RAM1_BIST_STATUS */
+	{-1,23,1,0,1,1,0,1},		/* MODEM1_RAM1_BIST_STATUS */
+	{-1,23,2,0,1,1,0,1},		/* MODEM2_RAM1_BIST_STATUS */
+	{-1,23,3,0,1,1,0,1},		/* MODEM3_RAM1_BIST_STATUS */
+	{-1,23,4,0,1,1,0,1},		/* MODEM4_RAM1_BIST_STATUS */
+	{-1,23,5,0,1,1,0,1},		/* MODEM5_RAM1_BIST_STATUS */
+	{-1,23,6,0,1,1,0,1},		/* MODEM6_RAM1_BIST_STATUS */
+	{-1,23,7,0,1,1,0,1},		/* MODEM7_RAM1_BIST_STATUS */
+	{-1,24,0,0,1,1,0,1},		/* MODEM0_RAM2_BIST_STATUS */
+	{-1,24,1,0,1,1,0,1},		/* MODEM1_RAM2_BIST_STATUS */
+	{-1,24,2,0,1,1,0,1},		/* MODEM2_RAM2_BIST_STATUS */
+	{-1,24,3,0,1,1,0,1},		/* MODEM3_RAM2_BIST_STATUS */
+	{-1,24,4,0,1,1,0,1},		/* MODEM4_RAM2_BIST_STATUS */
+	{-1,24,5,0,1,1,0,1},		/* MODEM5_RAM2_BIST_STATUS */
+	{-1,24,6,0,1,1,0,1},		/* MODEM6_RAM2_BIST_STATUS */
+	{-1,24,7,0,1,1,0,1},		/* MODEM7_RAM2_BIST_STATUS */
+	{-1,25,0,0,1,1,0,1},		/* MODEM_MBWSSF_RAM0_BIST_STATUS */
+	{-1,25,1,0,1,1,0,1},		/* MODEM_MBWSSF_RAM1_BIST_STATUS */
+	{-1,25,2,0,1,1,0,1},		/* MODEM_MBWSSF_RAM2_BIST_STATUS */
+	{-1,26,0,0,1,1,0,1},		/* MCU_AGC_DATA_RAM_BIST0_STATUS */
+	{-1,26,1,0,1,1,0,1},		/* MCU_AGC_DATA_RAM_BIST1_STATUS */
+	{-1,26,2,0,1,1,0,1},		/* MCU_ARB_DATA_RAM_BIST0_STATUS */
+	{-1,26,3,0,1,1,0,1},		/* MCU_ARB_DATA_RAM_BIST1_STATUS */
+	{-1,26,4,0,1,1,0,1},		/* TX_TOP_RAM_BIST0_STATUS */
+	{-1,26,5,0,1,1,0,1},		/* TX_TOP_RAM_BIST1_STATUS */
+	{-1,26,6,0,1,1,0,1},		/* DATA_MNGT_RAM_BIST0_STATUS */
+	{-1,26,7,0,1,1,0,1},		/* DATA_MNGT_RAM_BIST1_STATUS */
+	{-1,27,0,0,4,0,0,0},		/* GPIO_SELECT_INPUT */
+	{-1,28,0,0,4,0,0,0},		/* GPIO_SELECT_OUTPUT */
+	{-1,29,0,0,5,0,0,0},		/* GPIO_MODE */
+	{-1,30,0,0,5,1,0,1},		/* GPIO_PIN_REG_IN */
+	{-1,31,0,0,5,0,0,0},		/* GPIO_PIN_REG_OUT */
+	{-1,32,0,0,8,1,0,1},		/* MCU_AGC_STATUS */
+	{-1,125,0,0,8,1,0,1},		/* MCU_ARB_STATUS */
+	{-1,126,0,0,8,1,1,1},		/* CHIP_ID */
+	{-1,127,0,0,1,0,1,0},		/* EMERGENCY_FORCE_HOST_CTRL */
+	{0,33,0,0,1,0,0,0},		/* RX_INVERT_IQ */
+	{0,33,1,0,1,0,1,0},		/* MODEM_INVERT_IQ */
+	{0,33,2,0,1,0,0,0},		/* MBWSSF_MODEM_INVERT_IQ */
+	{0,33,3,0,1,0,0,0},		/* RX_EDGE_SELECT */
+	{0,33,4,0,1,0,0,0},		/* MISC_RADIO_EN */
+	{0,33,5,0,1,0,0,0},		/* FSK_MODEM_INVERT_IQ */
+	{0,34,0,0,4,0,7,0},		/* FILTER_GAIN */
+	{0,35,0,0,8,0,240,0},		/* RADIO_SELECT */
+	{0,36,0,1,13,0,-384,0},	/* IF_FREQ_0 */
+	{0,38,0,1,13,0,-128,0},	/* IF_FREQ_1 */
+	{0,40,0,1,13,0,128,0},	/* IF_FREQ_2 */
+	{0,42,0,1,13,0,384,0},	/* IF_FREQ_3 */
+	{0,44,0,1,13,0,-384,0},	/* IF_FREQ_4 */
+	{0,46,0,1,13,0,-128,0},	/* IF_FREQ_5 */
+	{0,48,0,1,13,0,128,0},	/* IF_FREQ_6 */
+	{0,50,0,1,13,0,384,0},	/* IF_FREQ_7 */
+	{0,52,0,1,13,0,0,0},		/* IF_FREQ_8 */
+	{0,54,0,1,13,0,0,0},		/* IF_FREQ_9 */
+	{0,64,0,0,1,0,0,0},		/* CHANN_OVERRIDE_AGC_GAIN */
+	{0,64,1,0,4,0,7,0},		/* CHANN_AGC_GAIN */
+	{0,65,0,0,7,0,0,0},		/* CORR0_DETECT_EN */
+	{0,66,0,0,7,0,0,0},		/* CORR1_DETECT_EN */
+	{0,67,0,0,7,0,0,0},		/* CORR2_DETECT_EN */
+	{0,68,0,0,7,0,0,0},		/* CORR3_DETECT_EN */
+	{0,69,0,0,7,0,0,0},		/* CORR4_DETECT_EN */
+	{0,70,0,0,7,0,0,0},		/* CORR5_DETECT_EN */
+	{0,71,0,0,7,0,0,0},		/* CORR6_DETECT_EN */
+	{0,72,0,0,7,0,0,0},		/* CORR7_DETECT_EN */
+	{0,73,0,0,1,0,0,0},		/* CORR_SAME_PEAKS_OPTION_SF6 */
+	{0,73,1,0,1,0,1,0},		/* CORR_SAME_PEAKS_OPTION_SF7 */
+	{0,73,2,0,1,0,1,0},		/* CORR_SAME_PEAKS_OPTION_SF8 */
+	{0,73,3,0,1,0,1,0},		/* CORR_SAME_PEAKS_OPTION_SF9 */
+	{0,73,4,0,1,0,1,0},		/* CORR_SAME_PEAKS_OPTION_SF10 */
+	{0,73,5,0,1,0,1,0},		/* CORR_SAME_PEAKS_OPTION_SF11 */
+	{0,73,6,0,1,0,1,0},		/* CORR_SAME_PEAKS_OPTION_SF12 */
+	{0,74,0,0,4,0,4,0},		/* CORR_SIG_NOISE_RATIO_SF6 */
+	{0,74,4,0,4,0,4,0},		/* CORR_SIG_NOISE_RATIO_SF7 */
+	{0,75,0,0,4,0,4,0},		/* CORR_SIG_NOISE_RATIO_SF8 */
+	{0,75,4,0,4,0,4,0},		/* CORR_SIG_NOISE_RATIO_SF9 */
+	{0,76,0,0,4,0,4,0},		/* CORR_SIG_NOISE_RATIO_SF10 */
+	{0,76,4,0,4,0,4,0},		/* CORR_SIG_NOISE_RATIO_SF11 */
+	{0,77,0,0,4,0,4,0},		/* CORR_SIG_NOISE_RATIO_SF12 */
+	{0,78,0,0,4,0,4,0},		/* CORR_NUM_SAME_PEAK */
+	{0,78,4,0,3,0,5,0},		/* CORR_MAC_GAIN */
+	{0,81,0,0,12,0,0,0},		/* ADJUST_MODEM_START_OFFSET_RDX4 */
+	{0,83,0,0,12,0,4092,0},	/* ADJUST_MODEM_START_OFFSET_SF12_RDX4 */
+	{0,85,0,0,8,0,7,0},		/* DBG_CORR_SELECT_SF */
+	{0,86,0,0,8,0,0,0},		/* DBG_CORR_SELECT_CHANNEL */
+	{0,87,0,0,8,1,0,1},		/* DBG_DETECT_CPT */
+	{0,88,0,0,8,1,0,1},		/* DBG_SYMB_CPT */
+	{0,89,0,0,1,0,1,0},		/* CHIRP_INVERT_RX */
+	{0,89,1,0,1,0,1,0},		/* DC_NOTCH_EN */
+	{0,90,0,0,1,0,0,0},		/* IMPLICIT_CRC_EN */
+	{0,90,1,0,3,0,0,0},		/* IMPLICIT_CODING_RATE */
+	{0,91,0,0,8,0,0,0},		/* IMPLICIT_PAYLOAD_LENGHT */
+	{0,92,0,0,8,0,29,0},		/* FREQ_TO_TIME_INVERT */
+	{0,93,0,0,6,0,9,0},		/* FREQ_TO_TIME_DRIFT */
+	{0,94,0,0,2,0,2,0},		/* PAYLOAD_FINE_TIMING_GAIN */
+	{0,94,2,0,2,0,1,0},		/* PREAMBLE_FINE_TIMING_GAIN */
+	{0,94,4,0,2,0,0,0},		/* TRACKING_INTEGRAL */
+	{0,95,0,0,4,0,1,0},		/* FRAME_SYNCH_PEAK1_POS */
+	{0,95,4,0,4,0,2,0},		/* FRAME_SYNCH_PEAK2_POS */
+	{0,96,0,0,16,0,10,0},		/* PREAMBLE_SYMB1_NB */
+	{0,98,0,0,1,0,1,0},		/* FRAME_SYNCH_GAIN */
+	{0,98,1,0,1,0,1,0},		/* SYNCH_DETECT_TH */
+	{0,99,0,0,4,0,8,0},		/* LLR_SCALE */
+	{0,99,4,0,2,0,2,0},		/* SNR_AVG_CST */
+	{0,100,0,0,7,0,0,0},		/* PPM_OFFSET */
+	{0,101,0,0,8,0,255,0},	/* MAX_PAYLOAD_LEN */
+	{0,102,0,0,1,0,1,0},		/* ONLY_CRC_EN */
+	{0,103,0,0,8,0,0,0},		/* ZERO_PAD */
+	{0,104,0,0,4,0,8,0},		/* DEC_GAIN_OFFSET */
+	{0,104,4,0,4,0,7,0},		/* CHAN_GAIN_OFFSET */
+	{0,105,1,0,1,0,1,0},		/* FORCE_HOST_RADIO_CTRL */
+	{0,105,2,0,1,0,1,0},		/* FORCE_HOST_FE_CTRL */
+	{0,105,3,0,1,0,1,0},		/* FORCE_DEC_FILTER_GAIN */
+	{0,106,0,0,1,0,1,0},		/* MCU_RST_0 */
+	{0,106,1,0,1,0,1,0},		/* MCU_RST_1 */
+	{0,106,2,0,1,0,0,0},		/* MCU_SELECT_MUX_0 */
+	{0,106,3,0,1,0,0,0},		/* MCU_SELECT_MUX_1 */
+	{0,106,4,0,1,1,0,1},		/* MCU_CORRUPTION_DETECTED_0 */
+	{0,106,5,0,1,1,0,1},		/* MCU_CORRUPTION_DETECTED_1 */
+	{0,106,6,0,1,0,0,0},		/* MCU_SELECT_EDGE_0 */
+	{0,106,7,0,1,0,0,0},		/* MCU_SELECT_EDGE_1 */
+	{0,107,0,0,8,0,1,0},		/* CHANN_SELECT_RSSI */
+	{0,108,0,0,8,0,32,0},		/* RSSI_BB_DEFAULT_VALUE */
+	{0,109,0,0,8,0,100,0},	/* RSSI_DEC_DEFAULT_VALUE */
+	{0,110,0,0,8,0,100,0},	/* RSSI_CHANN_DEFAULT_VALUE */
+	{0,111,0,0,5,0,7,0},		/* RSSI_BB_FILTER_ALPHA */
+	{0,112,0,0,5,0,5,0},		/* RSSI_DEC_FILTER_ALPHA */
+	{0,113,0,0,5,0,8,0},		/* RSSI_CHANN_FILTER_ALPHA */
+	{0,114,0,0,6,0,0,0},		/* IQ_MISMATCH_A_AMP_COEFF */
+	{0,115,0,0,6,0,0,0},		/* IQ_MISMATCH_A_PHI_COEFF */
+	{0,116,0,0,6,0,0,0},		/* IQ_MISMATCH_B_AMP_COEFF */
+	{0,116,6,0,1,0,0,0},		/* IQ_MISMATCH_B_SEL_I */
+	{0,117,0,0,6,0,0,0},		/* IQ_MISMATCH_B_PHI_COEFF */
+	{1,33,0,0,1,0,0,0},		/* TX_TRIG_IMMEDIATE */
+	{1,33,1,0,1,0,0,0},		/* TX_TRIG_DELAYED */
+	{1,33,2,0,1,0,0,0},		/* TX_TRIG_GPS */
+	{1,34,0,0,16,0,0,0},		/* TX_START_DELAY */
+	{1,36,0,0,4,0,1,0},		/* TX_FRAME_SYNCH_PEAK1_POS */
+	{1,36,4,0,4,0,2,0},		/* TX_FRAME_SYNCH_PEAK2_POS */
+	{1,37,0,0,3,0,0,0},		/* TX_RAMP_DURATION */
+	{1,39,0,1,8,0,0,0},		/* TX_OFFSET_I */
+	{1,40,0,1,8,0,0,0},		/* TX_OFFSET_Q */
+	{1,41,0,0,1,0,0,0},		/* TX_MODE */
+	{1,41,1,0,4,0,0,0},		/* TX_ZERO_PAD */
+	{1,41,5,0,1,0,0,0},		/* TX_EDGE_SELECT */
+	{1,41,6,0,1,0,0,0},		/* TX_EDGE_SELECT_TOP */
+	{1,42,0,0,2,0,0,0},		/* TX_GAIN */
+	{1,42,2,0,3,0,5,0},		/* TX_CHIRP_LOW_PASS */
+	{1,42,5,0,2,0,0,0},		/* TX_FCC_WIDEBAND */
+	{1,42,7,0,1,0,1,0},		/* TX_SWAP_IQ */
+	{1,43,0,0,1,0,0,0},		/* MBWSSF_IMPLICIT_HEADER */
+	{1,43,1,0,1,0,0,0},		/* MBWSSF_IMPLICIT_CRC_EN */
+	{1,43,2,0,3,0,0,0},		/* MBWSSF_IMPLICIT_CODING_RATE */
+	{1,44,0,0,8,0,0,0},		/* MBWSSF_IMPLICIT_PAYLOAD_LENGHT */
+	{1,45,0,0,1,0,1,0},		/* MBWSSF_AGC_FREEZE_ON_DETECT */
+	{1,46,0,0,4,0,1,0},		/* MBWSSF_FRAME_SYNCH_PEAK1_POS */
+	{1,46,4,0,4,0,2,0},		/* MBWSSF_FRAME_SYNCH_PEAK2_POS */
+	{1,47,0,0,16,0,10,0},		/* MBWSSF_PREAMBLE_SYMB1_NB */
+	{1,49,0,0,1,0,1,0},		/* MBWSSF_FRAME_SYNCH_GAIN */
+	{1,49,1,0,1,0,1,0},		/* MBWSSF_SYNCH_DETECT_TH */
+	{1,50,0,0,8,0,10,0},		/* MBWSSF_DETECT_MIN_SINGLE_PEAK */
+	{1,51,0,0,3,0,3,0},		/* MBWSSF_DETECT_TRIG_SAME_PEAK_NB */
+	{1,52,0,0,8,0,29,0},		/* MBWSSF_FREQ_TO_TIME_INVERT */
+	{1,53,0,0,6,0,36,0},		/* MBWSSF_FREQ_TO_TIME_DRIFT */
+	{1,54,0,0,12,0,0,0},		/* MBWSSF_PPM_CORRECTION */
+	{1,56,0,0,2,0,2,0},		/* MBWSSF_PAYLOAD_FINE_TIMING_GAIN */
+	{1,56,2,0,2,0,1,0},		/* MBWSSF_PREAMBLE_FINE_TIMING_GAIN */
+	{1,56,4,0,2,0,0,0},		/* MBWSSF_TRACKING_INTEGRAL */
+	{1,57,0,0,8,0,0,0},		/* MBWSSF_ZERO_PAD */
+	{1,58,0,0,2,0,0,0},		/* MBWSSF_MODEM_BW */
+	{1,58,2,0,1,0,0,0},		/* MBWSSF_RADIO_SELECT */
+	{1,58,3,0,1,0,1,0},		/* MBWSSF_RX_CHIRP_INVERT */
+	{1,59,0,0,4,0,8,0},		/* MBWSSF_LLR_SCALE */
+	{1,59,4,0,2,0,3,0},		/* MBWSSF_SNR_AVG_CST */
+	{1,59,6,0,1,0,0,0},		/* MBWSSF_PPM_OFFSET */
+	{1,60,0,0,4,0,7,0},		/* MBWSSF_RATE_SF */
+	{1,60,4,0,1,0,1,0},		/* MBWSSF_ONLY_CRC_EN */
+	{1,61,0,0,8,0,255,0},		/* MBWSSF_MAX_PAYLOAD_LEN */
+	{1,62,0,0,8,1,128,1},		/* TX_STATUS */
+	{1,63,0,0,3,0,0,0},		/* FSK_CH_BW_EXPO */
+	{1,63,3,0,3,0,0,0},		/* FSK_RSSI_LENGTH */
+	{1,63,6,0,1,0,0,0},		/* FSK_RX_INVERT */
+	{1,63,7,0,1,0,0,0},		/* FSK_PKT_MODE */
+	{1,64,0,0,3,0,0,0},		/* FSK_PSIZE */
+	{1,64,3,0,1,0,0,0},		/* FSK_CRC_EN */
+	{1,64,4,0,2,0,0,0},		/* FSK_DCFREE_ENC */
+	{1,64,6,0,1,0,0,0},		/* FSK_CRC_IBM */
+	{1,65,0,0,5,0,0,0},		/* FSK_ERROR_OSR_TOL */
+	{1,65,7,0,1,0,0,0},		/* FSK_RADIO_SELECT */
+	{1,66,0,0,16,0,0,0},		/* FSK_BR_RATIO */
+	{1,68,0,0,32,0,0,0},		/* FSK_REF_PATTERN_LSB */
+	{1,72,0,0,32,0,0,0},		/* FSK_REF_PATTERN_MSB */
+	{1,76,0,0,8,0,0,0},		/* FSK_PKT_LENGTH */
+	{1,77,0,0,1,0,1,0},		/* FSK_TX_GAUSSIAN_EN */
+	{1,77,1,0,2,0,0,0},		/* FSK_TX_GAUSSIAN_SELECT_BT */
+	{1,77,3,0,1,0,1,0},		/* FSK_TX_PATTERN_EN */
+	{1,77,4,0,1,0,0,0},		/* FSK_TX_PREAMBLE_SEQ */
+	{1,77,5,0,3,0,0,0},		/* FSK_TX_PSIZE */
+	{1,80,0,0,8,0,0,0},		/* FSK_NODE_ADRS */
+	{1,81,0,0,8,0,0,0},		/* FSK_BROADCAST */
+	{1,82,0,0,1,0,1,0},		/* FSK_AUTO_AFC_ON */
+	{1,83,0,0,10,0,0,0},		/* FSK_PATTERN_TIMEOUT_CFG */
+	{2,33,0,0,8,0,0,0},		/* SPI_RADIO_A__DATA */
+	{2,34,0,0,8,1,0,1},		/* SPI_RADIO_A__DATA_READBACK */
+	{2,35,0,0,8,0,0,0},		/* SPI_RADIO_A__ADDR */
+	{2,37,0,0,1,0,0,0},		/* SPI_RADIO_A__CS */
+	{2,38,0,0,8,0,0,0},		/* SPI_RADIO_B__DATA */
+	{2,39,0,0,8,1,0,1},		/* SPI_RADIO_B__DATA_READBACK */
+	{2,40,0,0,8,0,0,0},		/* SPI_RADIO_B__ADDR */
+	{2,42,0,0,1,0,0,0},		/* SPI_RADIO_B__CS */
+	{2,43,0,0,1,0,0,0},		/* RADIO_A_EN */
+	{2,43,1,0,1,0,0,0},		/* RADIO_B_EN */
+	{2,43,2,0,1,0,1,0},		/* RADIO_RST */
+	{2,43,3,0,1,0,0,0},		/* LNA_A_EN */
+	{2,43,4,0,1,0,0,0},		/* PA_A_EN */
+	{2,43,5,0,1,0,0,0},		/* LNA_B_EN */
+	{2,43,6,0,1,0,0,0},		/* PA_B_EN */
+	{2,44,0,0,2,0,0,0},		/* PA_GAIN */
+	{2,45,0,0,4,0,2,0},		/* LNA_A_CTRL_LUT */
+	{2,45,4,0,4,0,4,0},		/* PA_A_CTRL_LUT */
+	{2,46,0,0,4,0,2,0},		/* LNA_B_CTRL_LUT */
+	{2,46,4,0,4,0,4,0},		/* PA_B_CTRL_LUT */
+	{2,47,0,0,5,0,0,0},		/* CAPTURE_SOURCE */
+	{2,47,5,0,1,0,0,1},		/* CAPTURE_START */
+	{2,47,6,0,1,0,0,1},		/* CAPTURE_FORCE_TRIGGER */
+	{2,47,7,0,1,0,0,0},		/* CAPTURE_WRAP */
+	{2,48,0,0,16,0,0,0},		/* CAPTURE_PERIOD */
+	{2,51,0,0,8,1,0,1},		/* MODEM_STATUS */
+	{2,52,0,0,8,1,0,1},		/* VALID_HEADER_COUNTER_0 */
+	{2,54,0,0,8,1,0,1},		/* VALID_PACKET_COUNTER_0 */
+	{2,56,0,0,8,1,0,1},		/* VALID_HEADER_COUNTER_MBWSSF */
+	{2,57,0,0,8,1,0,1},		/* VALID_HEADER_COUNTER_FSK */
+	{2,58,0,0,8,1,0,1},		/* VALID_PACKET_COUNTER_MBWSSF */
+	{2,59,0,0,8,1,0,1},		/* VALID_PACKET_COUNTER_FSK */
+	{2,60,0,0,8,1,0,1},		/* CHANN_RSSI */
+	{2,61,0,0,8,1,0,1},		/* BB_RSSI */
+	{2,62,0,0,8,1,0,1},		/* DEC_RSSI */
+	{2,63,0,0,8,1,0,1},		/* DBG_MCU_DATA */
+	{2,64,0,0,8,1,0,1},		/* DBG_ARB_MCU_RAM_DATA */
+	{2,65,0,0,8,1,0,1},		/* DBG_AGC_MCU_RAM_DATA */
+	{2,66,0,0,16,1,0,1},		/* NEXT_PACKET_CNT */
+	{2,68,0,0,16,1,0,1},		/* ADDR_CAPTURE_COUNT */
+	{2,70,0,0,32,1,0,1},		/* TIMESTAMP */
+	{2,74,0,0,4,1,0,1},		/* DBG_CHANN0_GAIN */
+	{2,74,4,0,4,1,0,1},		/* DBG_CHANN1_GAIN */
+	{2,75,0,0,4,1,0,1},		/* DBG_CHANN2_GAIN */
+	{2,75,4,0,4,1,0,1},		/* DBG_CHANN3_GAIN */
+	{2,76,0,0,4,1,0,1},		/* DBG_CHANN4_GAIN */
+	{2,76,4,0,4,1,0,1},		/* DBG_CHANN5_GAIN */
+	{2,77,0,0,4,1,0,1},		/* DBG_CHANN6_GAIN */
+	{2,77,4,0,4,1,0,1},		/* DBG_CHANN7_GAIN */
+	{2,78,0,0,4,1,0,1},		/* DBG_DEC_FILT_GAIN */
+	{2,79,0,0,3,1,0,1},		/* SPI_DATA_FIFO_PTR */
+	{2,79,3,0,3,1,0,1},		/* PACKET_DATA_FIFO_PTR */
+	{2,80,0,0,8,0,0,1},		/* DBG_ARB_MCU_RAM_ADDR */
+	{2,81,0,0,8,0,0,1},		/* DBG_AGC_MCU_RAM_ADDR */
+	{2,82,0,0,1,0,0,0},		/* SPI_MASTER_CHIP_SELECT_POLARITY */
+	{2,82,1,0,1,0,0,0},		/* SPI_MASTER_CPOL */
+	{2,82,2,0,1,0,0,0},		/* SPI_MASTER_CPHA */
+	{2,83,0,0,1,0,0,0},		/* SIG_GEN_ANALYSER_MUX_SEL */
+	{2,84,0,0,1,0,0,0},		/* SIG_GEN_EN */
+	{2,84,1,0,1,0,0,0},		/* SIG_ANALYSER_EN */
+	{2,84,2,0,2,0,0,0},		/* SIG_ANALYSER_AVG_LEN */
+	{2,84,4,0,3,0,0,0},		/* SIG_ANALYSER_PRECISION */
+	{2,84,7,0,1,1,0,1},		/* SIG_ANALYSER_VALID_OUT */
+	{2,85,0,0,8,0,0,0},		/* SIG_GEN_FREQ */
+	{2,86,0,0,8,0,0,0},		/* SIG_ANALYSER_FREQ */
+	{2,87,0,0,8,1,0,1},		/* SIG_ANALYSER_I_OUT */
+	{2,88,0,0,8,1,0,1},		/* SIG_ANALYSER_Q_OUT */
+	{2,89,0,0,1,0,0,0},		/* GPS_EN */
+	{2,89,1,0,1,0,1,0},		/* GPS_POL */
+	{2,90,0,1,8,0,0,0},		/* SW_TEST_REG1 */
+	{2,91,2,1,6,0,0,0},		/* SW_TEST_REG2 */
+	{2,92,0,1,16,0,0,0},		/* SW_TEST_REG3 */
+	{2,94,0,0,4,1,0,1},		/* DATA_MNGT_STATUS */
+	{2,95,0,0,5,1,0,1},		/* DATA_MNGT_CPT_FRAME_ALLOCATED */
+	{2,96,0,0,5,1,0,1},		/* DATA_MNGT_CPT_FRAME_FINISHED */
+	{2,97,0,0,5,1,0,1}		/* DATA_MNGT_CPT_FRAME_READEN */
 };
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES ---------------------------------------------------- */
 
-void *lgw_spi_target = NULL; /*! generic pointer to the SPI device */
-static int lgw_regpage = -1; /*! keep the value of the register page selected */
+/* register access state of one concentrator, see lgw_reg_ctx_new */
+struct lgw_reg_ctx_s {
+	char spi_path[64]; /*! SPI device path, empty string for the default device of the SPI layer */
+	uint32_t spi_speed; /*! SPI clock set at connection, 0 for the default */
+	uint16_t spi_chunk; /*! SPI burst chunk size set at connection, 0 for the default */
+	void *spi_target; /*! generic pointer to the SPI device */
+	int regpage; /*! keep the value of the register page selected */
+	bool page_lost; /*! PAGE_REG content uncertain after an SPI error, rewritten by the next paged access */
+	
+	pthread_mutex_t mx_xfer; /*! held for a page switch and the accesses that depend on it, see below */
+	
+	bool cache_on; /*! shadow cache of the register bytes enabled */
+	uint8_t cache_val[REG_SLOTS][128]; /*! shadow copy of the register bytes */
+	bool cache_ok[REG_SLOTS][128]; /*! 1 if the shadow copy of that byte is valid */
+	bool cache_vola[REG_SLOTS][128]; /*! 1 if the byte contains at least one volatile register */
+	
+	struct lgw_reg_stats_s spi_cnt; /*! count of the SPI accesses since connection or last reset */
+	
+	FILE *trace; /*! SPI trace file, NULL when no capture is running */
+	struct timespec trace_t0; /*! start of the capture */
+	uint64_t trace_us; /*! time of the last trace record, in us since the start of the capture */
+};
+
+/* register batch being built by a thread, see lgw_reg_batch_begin */
+struct reg_batch_s {
+	struct lgw_batch_op_s ops[BATCH_OPS_MAX]; /*! operations of the open batch */
+	int nb; /*! number of queued operations, -1 when no batch is open */
+	bool full; /*! an operation did not fit, the batch will not be committed */
+};
+
+static struct lgw_reg_ctx_s reg_ctx_dflt = {.spi_target = NULL, .regpage = -1, .page_lost = false, .mx_xfer = PTHREAD_MUTEX_INITIALIZER, .cache_on = false, .trace = NULL}; /*! context of the default concentrator */
+static __thread struct lgw_reg_ctx_s *reg_ctx_cur = NULL; /*! context selected by the calling thread, NULL for the default one */
+static __thread struct reg_batch_s reg_batch = {.nb = -1}; /*! each thread builds its own batch */
+static __thread uint8_t trace_site = LGW_TRACE_SITE_NONE; /*! call site recorded with the SPI accesses of the thread */
+
+/* SPI clocks tried by lgw_reg_spi_autotune, in increasing order */
+static const uint32_t autotune_speed[] = {1000000, 2000000, 4000000, 6000000, 8000000, 10000000, 12000000, 16000000, 20000000, 25000000, 32000000};
+
+/*
+Several threads may access the registers of the same concentrator (eg. RX
+fetch thread and downlink scheduler). Each public access function is a
+transaction: the page switch, the access itself (both halves of a
+read-modify-write included) and the shadow cache and counters updates are done
+while holding mx_xfer, and a whole batch is committed while holding it. The
+private functions below expect the caller to hold it.
+*/
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
 
-int page_switch(uint8_t target) {
-	lgw_regpage = PAGE_MASK & target;
-	lgw_spi_w(lgw_spi_target, PAGE_ADDR, (uint8_t)lgw_regpage);
+/* account for one SPI submission, command bytes included in nb_bytes */
+void spi_count(uint16_t nb_frames, uint32_t nb_bytes) {
+	struct lgw_reg_ctx_s *rc = REG_CTX();
+	++rc->spi_cnt.nb_submit;
+	rc->spi_cnt.nb_frame += nb_frames;
+	rc->spi_cnt.nb_byte += nb_bytes;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* append one SPI access to the trace file, if a capture is running */
+void trace_rec(uint8_t flags, int spi_stat, uint8_t address, const uint8_t *data, uint16_t size) {
+	struct lgw_reg_ctx_s *rc = REG_CTX();
+	struct timespec now;
+	uint64_t t_us;
+	uint32_t delta;
+	uint8_t head[LGW_TRACE_REC_SIZE];
+	
+	if (rc->trace == NULL) {
+		return;
+	}
+	if (spi_stat != LGW_SPI_SUCCESS) {
+		flags |= LGW_TRACE_ERROR;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	t_us = ((uint64_t)(now.tv_sec - rc->trace_t0.tv_sec) * 1000000) + ((now.tv_nsec - rc->trace_t0.tv_nsec) / 1000);
+	flockfile(rc->trace); /* keep header and data of a record together */
+	delta = (t_us > rc->trace_us) ? (uint32_t)(t_us - rc->trace_us) : 0;
+	rc->trace_us += delta;
+	head[0] = (uint8_t)delta;
+	head[1] = (uint8_t)(delta >> 8);
+	head[2] = (uint8_t)(delta >> 16);
+	head[3] = (uint8_t)(delta >> 24);
+	head[4] = flags;
+	head[5] = address;
+	head[6] = trace_site;
+	head[7] = (uint8_t)size;
+	head[8] = (uint8_t)(size >> 8);
+	fwrite(head, 1, sizeof(head), rc->trace);
+	fwrite(data, 1, size, rc->trace);
+	funlockfile(rc->trace);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* SPI accesses of the register layer, recorded in the trace */
+int spi_w(uint8_t address, uint8_t data) {
+	int spi_stat = lgw_spi_w(REG_CTX()->spi_target, address, data);
+	trace_rec(LGW_TRACE_WRITE, spi_stat, address, &data, 1);
+	return spi_stat;
+}
+
+int spi_r(uint8_t address, uint8_t *data) {
+	int spi_stat = lgw_spi_r(REG_CTX()->spi_target, address, data);
+	trace_rec(0, spi_stat, address, data, 1);
+	return spi_stat;
+}
+
+int spi_wb(uint8_t address, uint8_t *data, uint16_t size) {
+	int spi_stat = lgw_spi_wb(REG_CTX()->spi_target, address, data, size);
+	trace_rec(LGW_TRACE_WRITE, spi_stat, address, data, size);
+	return spi_stat;
+}
+
+int spi_rb(uint8_t address, uint8_t *data, uint16_t size) {
+	int spi_stat = lgw_spi_rb(REG_CTX()->spi_target, address, data, size);
+	trace_rec(0, spi_stat, address, data, size);
+	return spi_stat;
+}
+
+int spi_batch(struct lgw_spi_frame_s *frames, uint16_t nb_frames) {
+	int spi_stat = lgw_spi_batch(REG_CTX()->spi_target, frames, nb_frames);
+	int i;
+	
+	for (i=0; i<nb_frames; ++i) {
+		trace_rec(LGW_TRACE_BATCH | ((i == 0) ? LGW_TRACE_BATCH_FIRST : 0) | (frames[i].write ? LGW_TRACE_WRITE : 0), spi_stat, frames[i].address, frames[i].data, frames[i].size);
+	}
+	return spi_stat;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* SPI parameter given by the API, else by the environment, 0 if none */
+uint32_t spi_param(uint32_t value, const char *env_name) {
+	const char *env;
+	
+	if (value != 0) {
+		return value;
+	}
+	env = getenv(env_name);
+	return (env != NULL) ? (uint32_t)strtoul(env, NULL, 0) : 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* write a pseudo-random pattern in the RX data buffer, read it back with the version register */
+int spi_readback(uint32_t seed) {
+	struct lgw_reg_ctx_s *rc = REG_CTX();
+	uint8_t out[AUTOTUNE_SIZE];
+	uint8_t in[AUTOTUNE_SIZE];
+	uint8_t ptr[2] = {0, 0}; /* RX data buffer address, LSB first */
+	uint8_t u = 0;
+	uint32_t x = seed;
+	int a = 0;
+	int i;
+	
+	for (i=0; i<AUTOTUNE_SIZE; ++i) {
+		x = (x * 1103515245) + 12345;
+		out[i] = (uint8_t)(x >> 16);
+	}
+	memset(in, 0, sizeof(in));
+	
+	pthread_mutex_lock(&rc->mx_xfer);
+	a |= spi_wb(loregs[LGW_RX_DATA_BUF_ADDR].addr, ptr, 2);
+	a |= spi_wb(loregs[LGW_RX_DATA_BUF_DATA].addr, out, AUTOTUNE_SIZE);
+	a |= spi_wb(loregs[LGW_RX_DATA_BUF_ADDR].addr, ptr, 2);
+	a |= spi_rb(loregs[LGW_RX_DATA_BUF_DATA].addr, in, AUTOTUNE_SIZE);
+	a |= spi_r(loregs[LGW_VERSION].addr, &u);
+	spi_count(1, 3);
+	spi_count(1, 1 + AUTOTUNE_SIZE);
+	spi_count(1, 3);
+	spi_count(1, 1 + AUTOTUNE_SIZE);
+	spi_count(1, 2);
+	pthread_mutex_unlock(&rc->mx_xfer);
+	
+	if ((a != LGW_SPI_SUCCESS) || (u != loregs[LGW_VERSION].dflt) || (memcmp(in, out, AUTOTUNE_SIZE) != 0)) {
+		return LGW_REG_ERROR;
+	}
 	return LGW_REG_SUCCESS;
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* true if the register page must be switched before accessing a register of that page */
+bool page_needed(int8_t page) {
+	struct lgw_reg_ctx_s *rc = REG_CTX();
+	return (page != -1) && ((page != rc->regpage) || rc->page_lost);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int page_switch(uint8_t target) {
+	struct lgw_reg_ctx_s *rc = REG_CTX();
+	int spi_stat;
+	
+	rc->regpage = PAGE_MASK & target;
+	spi_stat = spi_w(PAGE_ADDR, (uint8_t)rc->regpage);
+	spi_count(1, 2);
+	++rc->spi_cnt.nb_page_switch;
+	rc->page_lost = (spi_stat != LGW_SPI_SUCCESS);
+	return (spi_stat == LGW_SPI_SUCCESS) ? LGW_REG_SUCCESS : LGW_REG_ERROR;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* get a register byte from the shadow cache, return false if it must be read */
+bool cache_get(struct lgw_reg_s r, uint8_t *byte) {
+	struct lgw_reg_ctx_s *rc = REG_CTX();
+	if ((rc->cache_on == false) || (rc->cache_ok[REG_SLOT(r)][r.addr] == false)) {
+		return false;
+	}
+	*byte = rc->cache_val[REG_SLOT(r)][r.addr];
+	return true;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* update the shadow cache with register bytes written or read */
+void cache_set(struct lgw_reg_s r, uint8_t *bytes, int nb_bytes) {
+	struct lgw_reg_ctx_s *rc = REG_CTX();
+	int i;
+	
+	if (rc->cache_on == false) {
+		return;
+	}
+	for (i=0; (i<nb_bytes) && ((r.addr + i) < 128); ++i) {
+		if (rc->cache_vola[REG_SLOT(r)][r.addr + i] == false) {
+			rc->cache_val[REG_SLOT(r)][r.addr + i] = bytes[i];
+			rc->cache_ok[REG_SLOT(r)][r.addr + i] = true;
+		}
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* drop register bytes from the shadow cache (content unknown) */
+void cache_drop(struct lgw_reg_s r, int nb_bytes) {
+	struct lgw_reg_ctx_s *rc = REG_CTX();
+	int i;
+	
+	for (i=0; (i<nb_bytes) && ((r.addr + i) < 128); ++i) {
+		rc->cache_ok[REG_SLOT(r)][r.addr + i] = false;
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* drop the whole shadow cache */
+void cache_clear(void) {
+	struct lgw_reg_ctx_s *rc = REG_CTX();
+	memset(rc->cache_ok, 0, sizeof(rc->cache_ok));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* transform raw register bytes into a register value (sign extension included) */
+int32_t reg_decode(struct lgw_reg_s r, uint8_t *bufu) {
+	int8_t *bufs = (int8_t *)bufu;
+	int i, size_byte;
+	uint32_t u = 0;
+	
+	if ((r.offs + r.leng) <= 8) {
+		bufu[1] = bufu[0] << (8 - r.leng - r.offs); /* left-align the data */
+		if (r.sign == true) {
+			bufs[2] = bufs[1] >> (8 - r.leng); /* right align the data with sign extension (ARITHMETIC right shift) */
+			return (int32_t)bufs[2]; /* signed pointer -> 32b sign extension */
+		} else {
+			bufu[2] = bufu[1] >> (8 - r.leng); /* right align the data, no sign extension */
+			return (int32_t)bufu[2]; /* unsigned pointer -> no sign extension */
+		}
+	} else {
+		size_byte = (r.leng + 7) / 8; /* add a byte if it's not an exact multiple of 8 */
+		for (i=(size_byte-1); i>=0; --i) {
+			u = (uint32_t)bufu[i] + (u << 8); /* transform a 4-byte array into a 32 bit word */
+		}
+		if (r.sign == true) {
+			u = u << (32 - r.leng); /* left-align the data */
+			return (int32_t)u >> (32 - r.leng); /* right-align the data with sign extension (ARITHMETIC right shift) */
+		} else {
+			return (int32_t)u; /* unsigned value -> return 'as is' */
+		}
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* send all the frames prepared for a batch in a single SPI submission */
+int batch_submit(struct lgw_spi_frame_s *frames, int *nb_frames) {
+	int spi_stat = LGW_SPI_SUCCESS;
+	uint32_t nb_bytes = 0;
+	int i;
+	
+	if (*nb_frames > 0) {
+		spi_stat = spi_batch(frames, *nb_frames);
+		for (i=0; i<*nb_frames; ++i) {
+			nb_bytes += 1 + frames[i].size;
+		}
+		spi_count(*nb_frames, nb_bytes);
+		*nb_frames = 0;
+	}
+	return (spi_stat == LGW_SPI_SUCCESS) ? LGW_REG_SUCCESS : LGW_REG_ERROR;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* add a frame to a batch submission, page switch first if needed */
+int batch_frame(struct lgw_spi_frame_s *frames, int *nb_frames, uint8_t *page_buf, int8_t page, uint8_t addr, bool write, uint8_t *data, uint16_t size) {
+	struct lgw_reg_ctx_s *rc = REG_CTX();
+	int stat = LGW_REG_SUCCESS;
+	
+	/* keep room for a page switch and the access itself */
+	if (*nb_frames > (BATCH_FRAMES_MAX - 2)) {
+		stat = batch_submit(frames, nb_frames);
+	}
+	
+	if (page_needed(page)) {
+		rc->regpage = PAGE_MASK & page;
+		rc->page_lost = false; /* set back by the commit if the submission fails */
+		page_buf[*nb_frames] = (uint8_t)rc->regpage;
+		++rc->spi_cnt.nb_page_switch;
+		frames[*nb_frames].address = PAGE_ADDR;
+		frames[*nb_frames].write = true;
+		frames[*nb_frames].data = &page_buf[*nb_frames];
+		frames[*nb_frames].size = 1;
+		++(*nb_frames);
+	}
+	
+	frames[*nb_frames].address = addr;
+	frames[*nb_frames].write = write;
+	frames[*nb_frames].data = data;
+	frames[*nb_frames].size = size;
+	++(*nb_frames);
+	
+	return stat;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* queue an operation in the open batch */
+struct lgw_batch_op_s *batch_queue(uint16_t register_id) {
+	if (reg_batch.nb < 0) {
+		DEBUG_MSG("ERROR: NO REGISTER BATCH OPEN\n");
+		return NULL;
+	}
+	if (register_id >= LGW_TOTALREGS) {
+		DEBUG_MSG("ERROR: REGISTER NUMBER OUT OF DEFINED RANGE\n");
+		return NULL;
+	}
+	if (reg_batch.nb == BATCH_OPS_MAX) {
+		/* committing part of it would break its atomicity */
+		DEBUG_MSG("ERROR: REGISTER BATCH FULL\n");
+		reg_batch.full = true;
+		return NULL;
+	}
+	memset(&reg_batch.ops[reg_batch.nb], 0, sizeof(struct lgw_batch_op_s));
+	reg_batch.ops[reg_batch.nb].reg_id = register_id;
+	return &reg_batch.ops[reg_batch.nb++];
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
 /* Concentrator connect */
 int lgw_connect(void) {
+	struct lgw_reg_ctx_s *rc = REG_CTX();
+	struct lgw_spi_conf_s spi_conf;
+	const char *spi_path;
 	int spi_stat = LGW_SPI_SUCCESS;
 	uint8_t u = 0;
 	
-	if (lgw_spi_target != NULL) {
+	if (rc->spi_target != NULL) {
 		DEBUG_MSG("WARNING: concentrator was already connected\n");
-		lgw_spi_close(lgw_spi_target);
+		lgw_spi_close(rc->spi_target);
 	}
-	/* open the SPI link */
-	spi_stat = lgw_spi_open(&lgw_spi_target);
+	lgw_reg_cache_invalidate(); /* nothing known about that concentrator yet */
+	lgw_reg_reset_stats();
+	/* open the SPI link, parameters from lgw_reg_spi_setconf, else from the environment */
+	spi_path = (rc->spi_path[0] != '\0') ? rc->spi_path : getenv(ENV_SPI_PATH);
+	spi_stat = lgw_spi_open_path(&rc->spi_target, spi_path);
 	if (spi_stat != LGW_SPI_SUCCESS) {
 		DEBUG_MSG("ERROR CONNECTING CONCENTRATOR\n");
 		return LGW_REG_ERROR;
 	}
+	spi_conf.speed_hz = spi_param(rc->spi_speed, ENV_SPI_SPEED);
+	spi_conf.chunk_size = (uint16_t)spi_param(rc->spi_chunk, ENV_SPI_CHUNK);
+	spi_stat = lgw_spi_set_conf(rc->spi_target, &spi_conf);
+	if (spi_stat != LGW_SPI_SUCCESS) {
+		DEBUG_MSG("ERROR SETTING SPI CLOCK OR CHUNK SIZE\n");
+		lgw_spi_close(rc->spi_target);
+		rc->spi_target = NULL;
+		return LGW_REG_ERROR;
+	}
+	/* SPI trace capture requested by the environment, default concentrator only */
+	if ((rc == &reg_ctx_dflt) && (rc->trace == NULL) && (getenv(ENV_SPI_TRACE) != NULL)) {
+		lgw_reg_trace_start(getenv(ENV_SPI_TRACE));
+	}
 	/* write 0 to the page/reset register */
-	spi_stat = lgw_spi_w(lgw_spi_target, loregs[LGW_PAGE_REG].addr, 0);
+	spi_stat = spi_w(loregs[LGW_PAGE_REG].addr, 0);
+	spi_count(1, 2);
 	if (spi_stat != LGW_SPI_SUCCESS) {
 		DEBUG_MSG("ERROR WRITING PAGE REGISTER\n");
 		return LGW_REG_ERROR;
 	} else {
-		lgw_regpage = 0;
+		rc->regpage = 0;
+		rc->page_lost = false;
 	}
 	/* checking the chip ID */
-	spi_stat = lgw_spi_r(lgw_spi_target, loregs[LGW_CHIP_ID].addr, &u);
+	spi_stat = spi_r(loregs[LGW_CHIP_ID].addr, &u);
+	spi_count(1, 2);
 	if (spi_stat != LGW_SPI_SUCCESS) {
 		DEBUG_MSG("ERROR READING CHIP_ID REGISTER\n");
 		return LGW_REG_ERROR;
@@ -448,7 +858,8 @@ int lgw_connect(void) {
 		return LGW_REG_ERROR;
 	}
 	/* checking the version register */
-	spi_stat = lgw_spi_r(lgw_spi_target, loregs[LGW_VERSION].addr, &u);
+	spi_stat = spi_r(loregs[LGW_VERSION].addr, &u);
+	spi_count(1, 2);
 	if (spi_stat != LGW_SPI_SUCCESS) {
 		DEBUG_MSG("ERROR READING VERSION REGISTER\n");
 		return LGW_REG_ERROR;
@@ -467,9 +878,13 @@ int lgw_connect(void) {
 
 /* Concentrator disconnect */
 int lgw_disconnect(void) {
-	if (lgw_spi_target != NULL) {
-		lgw_spi_close(lgw_spi_target);
-		lgw_spi_target = NULL;
+	struct lgw_reg_ctx_s *rc = REG_CTX();
+	if (rc->spi_target != NULL) {
+		lgw_spi_close(rc->spi_target);
+		rc->spi_target = NULL;
+		if (rc->trace != NULL) {
+			fflush(rc->trace);
+		}
 		DEBUG_MSG("Note: success disconnecting the concentrator\n");
 		return LGW_REG_SUCCESS;
 	} else {
@@ -482,13 +897,19 @@ int lgw_disconnect(void) {
 
 /* soft-reset function */
 int lgw_soft_reset(void) {
+	struct lgw_reg_ctx_s *rc = REG_CTX();
 	/* check if SPI is initialised */
-	if ((lgw_spi_target == NULL) || (lgw_regpage < 0)) {
+	if ((rc->spi_target == NULL) || (rc->regpage < 0)) {
 		DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
 		return LGW_REG_ERROR;
 	}
-	lgw_spi_w(lgw_spi_target, 0, 0x80); /* 1 -> SOFT_RESET bit */
-	lgw_regpage = 0; /* reset the paging static variable */
+	pthread_mutex_lock(&rc->mx_xfer);
+	spi_w(0, 0x80); /* 1 -> SOFT_RESET bit */
+	spi_count(1, 2);
+	rc->regpage = 0; /* reset the paging static variable */
+	rc->page_lost = false;
+	cache_clear(); /* all registers back to their reset value */
+	pthread_mutex_unlock(&rc->mx_xfer);
 	return LGW_REG_SUCCESS;
 }
 
@@ -496,6 +917,7 @@ int lgw_soft_reset(void) {
 
 /* register verification */
 int lgw_reg_check(FILE *f) {
+	struct lgw_reg_ctx_s *rc = REG_CTX();
 	struct lgw_reg_s r;
 	int32_t read_value;
 	char ok_msg[] = "+++MATCH+++";
@@ -504,7 +926,7 @@ int lgw_reg_check(FILE *f) {
 	int i;
 	
 	/* check if SPI is initialised */
-	if ((lgw_spi_target == NULL) || (lgw_regpage < 0)) {
+	if ((rc->spi_target == NULL) || (rc->regpage < 0)) {
 		DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
 		fprintf(f, "ERROR: CONCENTRATOR UNCONNECTED\n");
 		return LGW_REG_ERROR;
@@ -529,6 +951,7 @@ int lgw_reg_check(FILE *f) {
 
 /* Write to a register addressed by name */
 int lgw_reg_w(uint16_t register_id, int32_t reg_value) {
+	struct lgw_reg_ctx_s *rc = REG_CTX();
 	int spi_stat = LGW_SPI_SUCCESS;
 	struct lgw_reg_s r;
 	uint8_t buf[4] = "\x00\x00\x00\x00";
@@ -541,14 +964,16 @@ int lgw_reg_w(uint16_t register_id, int32_t reg_value) {
 	}
 	
 	/* check if SPI is initialised */
-	if ((lgw_spi_target == NULL) || (lgw_regpage < 0)) {
+	if ((rc->spi_target == NULL) || (rc->regpage < 0)) {
 		DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
 		return LGW_REG_ERROR;
 	}
 	
 	/* intercept direct access to PAGE_REG & SOFT_RESET */
 	if (register_id == LGW_PAGE_REG) {
+		pthread_mutex_lock(&rc->mx_xfer);
 		page_switch(reg_value);
+		pthread_mutex_unlock(&rc->mx_xfer);
 		return LGW_REG_SUCCESS;
 	} else if (register_id == LGW_SOFT_RESET) {
 		/* only reset if lsb is 1 */
@@ -566,22 +991,39 @@ int lgw_reg_w(uint16_t register_id, int32_t reg_value) {
 		return LGW_REG_ERROR;
 	}
 	
+	/* register spanning multiple memory bytes but with an offset */
+	if (((r.offs + r.leng) > 8) && ((r.offs != 0) || (r.leng > 32))) {
+		DEBUG_MSG("ERROR: REGISTER SIZE AND OFFSET ARE NOT SUPPORTED\n");
+		return LGW_REG_ERROR;
+	}
+	
+	pthread_mutex_lock(&rc->mx_xfer);
+	
 	/* select proper register page if needed */
-	if ((r.page != -1) && (r.page != lgw_regpage)) {
+	if (page_needed(r.page)) {
 		spi_stat += page_switch(r.page);
 	}
 	
 	if ((r.leng == 8) && (r.offs == 0)) {
 		/* direct write */
-		spi_stat += lgw_spi_w(lgw_spi_target, r.addr, (uint8_t)reg_value);
+		buf[0] = (uint8_t)reg_value;
+		spi_stat += spi_w(r.addr, buf[0]);
+		spi_count(1, 2);
+		cache_set(r, buf, 1);
 	} else if ((r.offs + r.leng) <= 8) {
 		/* single-byte read-modify-write, offs:[0-7], leng:[1-7] */
-		spi_stat += lgw_spi_r(lgw_spi_target, r.addr, &buf[0]);
+		/* the read is skipped when the byte is in the shadow cache */
+		if (cache_get(r, &buf[0]) == false) {
+			spi_stat += spi_r(r.addr, &buf[0]);
+			spi_count(1, 2);
+		}
 		buf[1] = ((1 << r.leng) - 1) << r.offs; /* bit mask */
 		buf[2] = ((uint8_t)reg_value) << r.offs; /* new data offsetted */
 		buf[3] = (~buf[1] & buf[0]) | (buf[1] & buf[2]); /* mixing old & new data */
-		spi_stat += lgw_spi_w(lgw_spi_target, r.addr, buf[3]);
-	} else if ((r.offs == 0) && (r.leng > 0) && (r.leng <= 32)) {
+		spi_stat += spi_w(r.addr, buf[3]);
+		spi_count(1, 2);
+		cache_set(r, &buf[3], 1);
+	} else {
 		/* multi-byte direct write routine */
 		size_byte = (r.leng + 7) / 8; /* add a byte if it's not an exact multiple of 8 */ 
 		for (i=0; i<size_byte; ++i) {
@@ -590,12 +1032,15 @@ int lgw_reg_w(uint16_t register_id, int32_t reg_value) {
 			buf[i] = (uint8_t)(0x000000FF & reg_value);
 			reg_value = (reg_value >> 8);
 		}
-		spi_stat += lgw_spi_wb(lgw_spi_target, r.addr, buf, size_byte); /* write the register in one burst */
-	} else {
-		/* register spanning multiple memory bytes but with an offset */
-		DEBUG_MSG("ERROR: REGISTER SIZE AND OFFSET ARE NOT SUPPORTED\n");
-		return LGW_REG_ERROR;
+		spi_stat += spi_wb(r.addr, buf, size_byte); /* write the register in one burst */
+		spi_count(1, 1 + size_byte);
+		cache_set(r, buf, size_byte);
+	}
+	
+	if (spi_stat != LGW_SPI_SUCCESS) {
+		cache_clear(); /* register file content uncertain */
 	}
+	pthread_mutex_unlock(&rc->mx_xfer);
 	
 	if (spi_stat != LGW_SPI_SUCCESS) {
 		DEBUG_MSG("ERROR: SPI ERROR DURING REGISTER WRITE\n");
@@ -609,12 +1054,11 @@ int lgw_reg_w(uint16_t register_id, int32_t reg_value) {
 
 /* Read to a register addressed by name */
 int lgw_reg_r(uint16_t register_id, int32_t *reg_value) {
+	struct lgw_reg_ctx_s *rc = REG_CTX();
 	int spi_stat = LGW_SPI_SUCCESS;
 	struct lgw_reg_s r;
 	uint8_t bufu[4] = "\x00\x00\x00\x00";
-	int8_t *bufs = (int8_t *)bufu;
-	int i, size_byte;
-	uint32_t u = 0;
+	int size_byte;
 	
 	/* check input parameters */
 	CHECK_NULL(reg_value);
@@ -624,7 +1068,7 @@ int lgw_reg_r(uint16_t register_id, int32_t *reg_value) {
 	}
 	
 	/* check if SPI is initialised */
-	if ((lgw_spi_target == NULL) || (lgw_regpage < 0)) {
+	if ((rc->spi_target == NULL) || (rc->regpage < 0)) {
 		DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
 		return LGW_REG_ERROR;
 	}
@@ -632,40 +1076,33 @@ int lgw_reg_r(uint16_t register_id, int32_t *reg_value) {
 	/* get register struct from the struct array */
 	r = loregs[register_id];
 	
+	/* register spanning multiple memory bytes but with an offset */
+	if (((r.offs + r.leng) > 8) && ((r.offs != 0) || (r.leng > 32))) {
+		DEBUG_MSG("ERROR: REGISTER SIZE AND OFFSET ARE NOT SUPPORTED\n");
+		return LGW_REG_ERROR;
+	}
+	
+	pthread_mutex_lock(&rc->mx_xfer);
+	
 	/* select proper register page if needed */
-	if ((r.page != -1) && (r.page != lgw_regpage)) {
+	if (page_needed(r.page)) {
 		spi_stat += page_switch(r.page);
 	}
 	
 	if ((r.offs + r.leng) <= 8) {
 		/* read one byte, then shift and mask bits to get reg value with sign extension if needed */
-		spi_stat += lgw_spi_r(lgw_spi_target, r.addr, &bufu[0]);
-		bufu[1] = bufu[0] << (8 - r.leng - r.offs); /* left-align the data */
-		if (r.sign == true) {
-			bufs[2] = bufs[1] >> (8 - r.leng); /* right align the data with sign extension (ARITHMETIC right shift) */
-			*reg_value = (int32_t)bufs[2]; /* signed pointer -> 32b sign extension */
-		} else {
-			bufu[2] = bufu[1] >> (8 - r.leng); /* right align the data, no sign extension */
-			*reg_value = (int32_t)bufu[2]; /* unsigned pointer -> no sign extension */
-		}
-	} else if ((r.offs == 0) && (r.leng > 0) && (r.leng <= 32)) {
-		size_byte = (r.leng + 7) / 8; /* add a byte if it's not an exact multiple of 8 */ 
-		spi_stat += lgw_spi_rb(lgw_spi_target, r.addr, bufu, size_byte);
-		u = 0;
-		for (i=(size_byte-1); i>=0; --i) {
-			u = (uint32_t)bufu[i] + (u << 8); /* transform a 4-byte array into a 32 bit word */
-		}
-		if (r.sign == true) {
-			u = u << (32 - r.leng); /* left-align the data */
-			*reg_value = (int32_t)u >> (32 - r.leng); /* right-align the data with sign extension (ARITHMETIC right shift) */
-		} else {
-			*reg_value = (int32_t)u; /* unsigned value -> return 'as is' */
-		}
+		spi_stat += spi_r(r.addr, &bufu[0]);
+		spi_count(1, 2);
 	} else {
-		/* register spanning multiple memory bytes but with an offset */
-		DEBUG_MSG("ERROR: REGISTER SIZE AND OFFSET ARE NOT SUPPORTED\n");
-		return LGW_REG_ERROR;
+		size_byte = (r.leng + 7) / 8; /* add a byte if it's not an exact multiple of 8 */ 
+		spi_stat += spi_rb(r.addr, bufu, size_byte);
+		spi_count(1, 1 + size_byte);
+	}
+	if (spi_stat == LGW_SPI_SUCCESS) {
+		cache_set(r, bufu, ((r.offs + r.leng) <= 8) ? 1 : (r.leng + 7) / 8);
 	}
+	pthread_mutex_unlock(&rc->mx_xfer);
+	*reg_value = reg_decode(r, bufu);
 	
 	if (spi_stat != LGW_SPI_SUCCESS) {
 		DEBUG_MSG("ERROR: SPI ERROR DURING REGISTER WRITE\n");
@@ -679,6 +1116,7 @@ int lgw_reg_r(uint16_t register_id, int32_t *reg_value) {
 
 /* Point to a register by name and do a burst write */
 int lgw_reg_wb(uint16_t register_id, uint8_t *data, uint16_t size) {
+	struct lgw_reg_ctx_s *rc = REG_CTX();
 	int spi_stat;
 	struct lgw_reg_s r;
 	
@@ -694,7 +1132,7 @@ int lgw_reg_wb(uint16_t register_id, uint8_t *data, uint16_t size) {
 	}
 	
 	/* check if SPI is initialised */
-	if ((lgw_spi_target == NULL) || (lgw_regpage < 0)) {
+	if ((rc->spi_target == NULL) || (rc->regpage < 0)) {
 		DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
 		return LGW_REG_ERROR;
 	}
@@ -708,13 +1146,20 @@ int lgw_reg_wb(uint16_t register_id, uint8_t *data, uint16_t size) {
 		return LGW_REG_ERROR;
 	}
 	
+	pthread_mutex_lock(&rc->mx_xfer);
+	
 	/* select proper register page if needed */
-	if ((r.page != -1) && (r.page != lgw_regpage)) {
+	spi_stat = LGW_SPI_SUCCESS;
+	if (page_needed(r.page)) {
 		spi_stat += page_switch(r.page);
 	}
 	
 	/* do the burst write */
-	spi_stat = lgw_spi_wb(lgw_spi_target, r.addr, data, size);
+	spi_stat += spi_wb(r.addr, data, size);
+	spi_count(1, 1 + size);
+	cache_drop(r, size);
+	
+	pthread_mutex_unlock(&rc->mx_xfer);
 	
 	if (spi_stat != LGW_SPI_SUCCESS) {
 		DEBUG_MSG("ERROR: SPI ERROR DURING REGISTER BURST WRITE\n");
@@ -728,6 +1173,7 @@ int lgw_reg_wb(uint16_t register_id, uint8_t *data, uint16_t size) {
 
 /* Point to a register by name and do a burst read */
 int lgw_reg_rb(uint16_t register_id, uint8_t *data, uint16_t size) {
+	struct lgw_reg_ctx_s *rc = REG_CTX();
 	int spi_stat;
 	struct lgw_reg_s r;
 	
@@ -743,7 +1189,7 @@ int lgw_reg_rb(uint16_t register_id, uint8_t *data, uint16_t size) {
 	}
 	
 	/* check if SPI is initialised */
-	if ((lgw_spi_target == NULL) || (lgw_regpage < 0)) {
+	if ((rc->spi_target == NULL) || (rc->regpage < 0)) {
 		DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
 		return LGW_REG_ERROR;
 	}
@@ -751,13 +1197,19 @@ int lgw_reg_rb(uint16_t register_id, uint8_t *data, uint16_t size) {
 	/* get register struct from the struct array */
 	r = loregs[register_id];
 	
+	pthread_mutex_lock(&rc->mx_xfer);
+	
 	/* select proper register page if needed */
-	if ((r.page != -1) && (r.page != lgw_regpage)) {
+	spi_stat = LGW_SPI_SUCCESS;
+	if (page_needed(r.page)) {
 		spi_stat += page_switch(r.page);
 	}
 	
 	/* do the burst read */
-	spi_stat = lgw_spi_rb(lgw_spi_target, r.addr, data, size);
+	spi_stat += spi_rb(r.addr, data, size);
+	spi_count(1, 1 + size);
+	
+	pthread_mutex_unlock(&rc->mx_xfer);
 	
 	if (spi_stat != LGW_SPI_SUCCESS) {
 		DEBUG_MSG("ERROR: SPI ERROR DURING REGISTER BURST READ\n");
@@ -767,4 +1219,574 @@ int lgw_reg_rb(uint16_t register_id, uint8_t *data, uint16_t size) {
 	}
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Enable or disable the shadow cache of the register bytes */
+int lgw_reg_cache_enable(bool enable) {
+	struct lgw_reg_ctx_s *rc = REG_CTX();
+	struct lgw_reg_s r;
+	int i, j, size_byte;
+	
+	pthread_mutex_lock(&rc->mx_xfer);
+	
+	/* flag the bytes containing read-only or hardware-updated registers */
+	memset(rc->cache_vola, 0, sizeof(rc->cache_vola));
+	for (i=0; i<LGW_TOTALREGS; ++i) {
+		r = loregs[i];
+		if ((r.vola == 0) && (r.rdon == 0)) {
+			continue;
+		}
+		size_byte = ((r.offs + r.leng) <= 8) ? 1 : (r.leng + 7) / 8;
+		for (j=0; (j<size_byte) && ((r.addr + j) < 128); ++j) {
+			rc->cache_vola[REG_SLOT(r)][r.addr + j] = true;
+		}
+	}
+	
+	cache_clear();
+	rc->cache_on = enable;
+	pthread_mutex_unlock(&rc->mx_xfer);
+	DEBUG_PRINTF("Note: register shadow cache %s\n", enable ? "enabled" : "disabled");
+	return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Invalidate the whole shadow cache */
+void lgw_reg_cache_invalidate(void) {
+	struct lgw_reg_ctx_s *rc = REG_CTX();
+	pthread_mutex_lock(&rc->mx_xfer);
+	cache_clear();
+	pthread_mutex_unlock(&rc->mx_xfer);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Open a batch of register operations */
+int lgw_reg_batch_begin(void) {
+	struct lgw_reg_ctx_s *rc = REG_CTX();
+	/* check if SPI is initialised */
+	if ((rc->spi_target == NULL) || (rc->regpage < 0)) {
+		DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
+		return LGW_REG_ERROR;
+	}
+	if (reg_batch.nb >= 0) {
+		DEBUG_MSG("ERROR: A REGISTER BATCH IS ALREADY OPEN\n");
+		return LGW_REG_ERROR; /* the inner commit would close the outer batch */
+	}
+	reg_batch.nb = 0;
+	reg_batch.full = false;
+	return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Queue a register write in the open batch */
+int lgw_reg_batch_add_w(uint16_t register_id, int32_t reg_value) {
+	struct lgw_batch_op_s *op;
+	struct lgw_reg_s r;
+	
+	/* soft reset invalidates the whole register file, it cannot be batched */
+	if (register_id == LGW_SOFT_RESET) {
+		DEBUG_MSG("ERROR: SOFT_RESET CANNOT BE PART OF A REGISTER BATCH\n");
+		return LGW_REG_ERROR;
+	}
+	
+	op = batch_queue(register_id);
+	if (op == NULL) {
+		return LGW_REG_ERROR;
+	}
+	r = loregs[register_id];
+	if (r.rdon == 1) {
+		DEBUG_MSG("ERROR: TRYING TO WRITE A READ-ONLY REGISTER\n");
+		--reg_batch.nb;
+		return LGW_REG_ERROR;
+	}
+	if (((r.offs + r.leng) > 8) && ((r.offs != 0) || (r.leng > 32))) {
+		DEBUG_MSG("ERROR: REGISTER SIZE AND OFFSET ARE NOT SUPPORTED\n");
+		--reg_batch.nb;
+		return LGW_REG_ERROR;
+	}
+	op->write = true;
+	op->value = reg_value;
+	return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Queue a register read in the open batch, value available after commit */
+int lgw_reg_batch_add_r(uint16_t register_id, int32_t *reg_value) {
+	struct lgw_batch_op_s *op;
+	struct lgw_reg_s r;
+	
+	CHECK_NULL(reg_value);
+	op = batch_queue(register_id);
+	if (op == NULL) {
+		return LGW_REG_ERROR;
+	}
+	r = loregs[register_id];
+	if (((r.offs + r.leng) > 8) && ((r.offs != 0) || (r.leng > 32))) {
+		DEBUG_MSG("ERROR: REGISTER SIZE AND OFFSET ARE NOT SUPPORTED\n");
+		--reg_batch.nb;
+		return LGW_REG_ERROR;
+	}
+	op->write = false;
+	op->dest = reg_value;
+	return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Queue a burst write in the open batch */
+int lgw_reg_batch_add_wb(uint16_t register_id, uint8_t *data, uint16_t size) {
+	struct lgw_batch_op_s *op;
+	
+	CHECK_NULL(data);
+	if (size == 0) {
+		DEBUG_MSG("ERROR: BURST OF NULL LENGTH\n");
+		return LGW_REG_ERROR;
+	}
+	op = batch_queue(register_id);
+	if (op == NULL) {
+		return LGW_REG_ERROR;
+	}
+	if (loregs[register_id].rdon == 1) {
+		DEBUG_MSG("ERROR: TRYING TO BURST WRITE A READ-ONLY REGISTER\n");
+		--reg_batch.nb;
+		return LGW_REG_ERROR;
+	}
+	op->write = true;
+	op->burst = true;
+	op->data = data;
+	op->size = size;
+	return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Queue a burst read in the open batch, data available after commit */
+int lgw_reg_batch_add_rb(uint16_t register_id, uint8_t *data, uint16_t size) {
+	struct lgw_batch_op_s *op;
+	
+	CHECK_NULL(data);
+	if (size == 0) {
+		DEBUG_MSG("ERROR: BURST OF NULL LENGTH\n");
+		return LGW_REG_ERROR;
+	}
+	op = batch_queue(register_id);
+	if (op == NULL) {
+		return LGW_REG_ERROR;
+	}
+	op->write = false;
+	op->burst = true;
+	op->data = data;
+	op->size = size;
+	return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Execute all the operations of the open batch and close it */
+int lgw_reg_batch_commit(void) {
+	struct lgw_reg_ctx_s *rc = REG_CTX();
+	struct lgw_spi_frame_s frames[BATCH_FRAMES_MAX];
+	uint8_t page_buf[BATCH_FRAMES_MAX]; /* values written by page switch frames */
+	uint8_t img[REG_SLOTS][128]; /* image of the register bytes touched by the batch */
+	uint8_t img_state[REG_SLOTS][128]; /* 0: unknown, 1: read before the batch, 2: written by the batch */
+	int nb_frames = 0;
+	int stat = LGW_REG_SUCCESS;
+	struct lgw_batch_op_s *op;
+	struct lgw_reg_s r;
+	int slot, size_byte;
+	int32_t v;
+	uint8_t mask;
+	int i, j;
+	
+	if (reg_batch.nb < 0) {
+		DEBUG_MSG("ERROR: NO REGISTER BATCH OPEN\n");
+		return LGW_REG_ERROR;
+	}
+	
+	/* check if SPI is initialised */
+	if ((rc->spi_target == NULL) || (rc->regpage < 0)) {
+		DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
+		reg_batch.nb = -1;
+		return LGW_REG_ERROR;
+	}
+	
+	/* an incomplete batch is dropped, nothing is sent */
+	if (reg_batch.full == true) {
+		DEBUG_PRINTF("ERROR: REGISTER BATCH OVER %d OPERATIONS, NOT COMMITTED\n", BATCH_OPS_MAX);
+		reg_batch.nb = -1;
+		return LGW_REG_ERROR;
+	}
+	
+	/* both submissions in one transaction, the RMW reads stay valid */
+	pthread_mutex_lock(&rc->mx_xfer);
+	
+	/* 1st submission: read the bytes needed by read-modify-write operations */
+	memset(img_state, 0, sizeof(img_state));
+	for (i=0; i<reg_batch.nb; ++i) {
+		op = &reg_batch.ops[i];
+		r = loregs[op->reg_id];
+		if ((op->write == false) || (op->burst == true) || (op->reg_id == LGW_PAGE_REG)) {
+			continue;
+		}
+		slot = r.page + 1;
+		if ((r.leng == 8) && (r.offs == 0)) {
+			if (img_state[slot][r.addr] == 0) {
+				img_state[slot][r.addr] = 2; /* fully written, no read needed */
+			}
+		} else if ((r.offs + r.leng) <= 8) {
+			if (img_state[slot][r.addr] == 0) {
+				img_state[slot][r.addr] = 1;
+				if (cache_get(r, &img[slot][r.addr]) == false) {
+					stat |= batch_frame(frames, &nb_frames, page_buf, r.page, r.addr, false, &img[slot][r.addr], 1);
+				}
+			}
+		} else {
+			size_byte = (r.leng + 7) / 8;
+			for (j=0; (j<size_byte) && ((r.addr + j) < 128); ++j) {
+				if (img_state[slot][r.addr + j] == 0) {
+					img_state[slot][r.addr + j] = 2; /* fully written, no read needed */
+				}
+			}
+		}
+	}
+	stat |= batch_submit(frames, &nb_frames);
+	
+	/* 2nd submission: all the operations, in order */
+	for (i=0; (i<reg_batch.nb) && (stat == LGW_REG_SUCCESS); ++i) {
+		op = &reg_batch.ops[i];
+		r = loregs[op->reg_id];
+		slot = r.page + 1;
+		if (op->burst == true) {
+			stat |= batch_frame(frames, &nb_frames, page_buf, r.page, r.addr, op->write, op->data, op->size);
+			if (op->write == true) {
+				cache_drop(r, op->size);
+			}
+		} else if (op->write == false) {
+			size_byte = ((r.offs + r.leng) <= 8) ? 1 : (r.leng + 7) / 8;
+			stat |= batch_frame(frames, &nb_frames, page_buf, r.page, r.addr, false, op->buf, size_byte);
+		} else if (op->reg_id == LGW_PAGE_REG) {
+			/* explicit page switch, always sent */
+			op->buf[0] = PAGE_MASK & (uint8_t)op->value;
+			stat |= batch_frame(frames, &nb_frames, page_buf, -1, PAGE_ADDR, true, op->buf, 1);
+			rc->regpage = op->buf[0];
+			rc->page_lost = false;
+		} else if ((r.leng == 8) && (r.offs == 0)) {
+			/* direct write */
+			op->buf[0] = (uint8_t)op->value;
+			img[slot][r.addr] = op->buf[0];
+			cache_set(r, op->buf, 1);
+			stat |= batch_frame(frames, &nb_frames, page_buf, r.page, r.addr, true, op->buf, 1);
+		} else if ((r.offs + r.leng) <= 8) {
+			/* single-byte read-modify-write, using the byte image */
+			mask = ((1 << r.leng) - 1) << r.offs;
+			op->buf[0] = (~mask & img[slot][r.addr]) | (mask & (((uint8_t)op->value) << r.offs));
+			img[slot][r.addr] = op->buf[0];
+			cache_set(r, op->buf, 1);
+			stat |= batch_frame(frames, &nb_frames, page_buf, r.page, r.addr, true, op->buf, 1);
+		} else {
+			/* multi-byte direct write, LSB first */
+			size_byte = (r.leng + 7) / 8;
+			v = op->value;
+			for (j=0; j<size_byte; ++j) {
+				op->buf[j] = (uint8_t)(0x000000FF & v);
+				v = (v >> 8);
+				if ((r.addr + j) < 128) {
+					img[slot][r.addr + j] = op->buf[j];
+				}
+			}
+			cache_set(r, op->buf, size_byte);
+			stat |= batch_frame(frames, &nb_frames, page_buf, r.page, r.addr, true, op->buf, size_byte);
+		}
+	}
+	stat |= batch_submit(frames, &nb_frames);
+	
+	/* convert the values read */
+	for (i=0; (i<reg_batch.nb) && (stat == LGW_REG_SUCCESS); ++i) {
+		op = &reg_batch.ops[i];
+		if ((op->write == false) && (op->burst == false)) {
+			r = loregs[op->reg_id];
+			cache_set(r, op->buf, ((r.offs + r.leng) <= 8) ? 1 : (r.leng + 7) / 8);
+			*(op->dest) = reg_decode(r, op->buf);
+		}
+	}
+	
+	if (stat != LGW_REG_SUCCESS) {
+		cache_clear(); /* register file content uncertain */
+		rc->page_lost = true; /* page switches of the batch may not have been written */
+	}
+	pthread_mutex_unlock(&rc->mx_xfer);
+	
+	reg_batch.nb = -1;
+	if (stat != LGW_REG_SUCCESS) {
+		DEBUG_MSG("ERROR: SPI ERROR DURING REGISTER BATCH\n");
+		return LGW_REG_ERROR;
+	} else {
+		return LGW_REG_SUCCESS;
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Count of the SPI accesses */
+int lgw_reg_get_stats(struct lgw_reg_stats_s *stats) {
+	struct lgw_reg_ctx_s *rc = REG_CTX();
+	CHECK_NULL(stats);
+	pthread_mutex_lock(&rc->mx_xfer);
+	*stats = rc->spi_cnt;
+	pthread_mutex_unlock(&rc->mx_xfer);
+	return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_reg_reset_stats(void) {
+	struct lgw_reg_ctx_s *rc = REG_CTX();
+	pthread_mutex_lock(&rc->mx_xfer);
+	memset(&rc->spi_cnt, 0, sizeof(rc->spi_cnt));
+	pthread_mutex_unlock(&rc->mx_xfer);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* SPI link parameters of the next connection */
+int lgw_reg_spi_setconf(const char *spi_path, uint32_t speed_hz, uint16_t chunk_size) {
+	struct lgw_reg_ctx_s *rc = REG_CTX();
+	
+	if ((spi_path != NULL) && (strlen(spi_path) >= sizeof(rc->spi_path))) {
+		DEBUG_MSG("ERROR: SPI DEVICE PATH TOO LONG\n");
+		return LGW_REG_ERROR;
+	}
+	if (spi_path != NULL) {
+		strcpy(rc->spi_path, spi_path);
+	}
+	rc->spi_speed = speed_hz;
+	rc->spi_chunk = chunk_size;
+	return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* SPI link parameters in use */
+int lgw_reg_spi_getconf(uint32_t *speed_hz, uint16_t *chunk_size) {
+	struct lgw_reg_ctx_s *rc = REG_CTX();
+	struct lgw_spi_conf_s spi_conf;
+	int spi_stat;
+	
+	if (rc->spi_target == NULL) {
+		DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
+		return LGW_REG_ERROR;
+	}
+	pthread_mutex_lock(&rc->mx_xfer);
+	spi_stat = lgw_spi_get_conf(rc->spi_target, &spi_conf);
+	pthread_mutex_unlock(&rc->mx_xfer);
+	if (spi_stat != LGW_SPI_SUCCESS) {
+		return LGW_REG_ERROR;
+	}
+	if (speed_hz != NULL) {
+		*speed_hz = spi_conf.speed_hz;
+	}
+	if (chunk_size != NULL) {
+		*chunk_size = spi_conf.chunk_size;
+	}
+	return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Fastest SPI clock passing a readback test with one step of margin, largest burst chunk */
+int lgw_reg_spi_autotune(uint32_t speed_max) {
+	struct lgw_reg_ctx_s *rc = REG_CTX();
+	struct lgw_spi_conf_s spi_conf;
+	uint32_t speed_ok = 0;
+	int i_ok = -1;
+	bool ok = true;
+	int i, j;
+	
+	if (rc->spi_target == NULL) {
+		DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
+		return LGW_REG_ERROR;
+	}
+	
+	/* largest chunk the SPI driver accepts, unless the user chose one */
+	pthread_mutex_lock(&rc->mx_xfer);
+	lgw_spi_get_conf(rc->spi_target, &spi_conf);
+	spi_conf.speed_hz = 0;
+	if (spi_param(rc->spi_chunk, ENV_SPI_CHUNK) == 0) {
+		spi_conf.chunk_size = spi_conf.chunk_max;
+		lgw_spi_set_conf(rc->spi_target, &spi_conf);
+	}
+	pthread_mutex_unlock(&rc->mx_xfer);
+	
+	/* increase the clock until a readback fails, up to the rated clock unless the caller asks for more */
+	if (speed_max == 0) {
+		speed_max = AUTOTUNE_RATED_HZ;
+	}
+	for (i=0; i<(int)ARRAY_SIZE(autotune_speed); ++i) {
+		if (autotune_speed[i] > speed_max) {
+			break;
+		}
+		spi_conf.speed_hz = autotune_speed[i];
+		spi_conf.chunk_size = 0;
+		pthread_mutex_lock(&rc->mx_xfer);
+		ok = (lgw_spi_set_conf(rc->spi_target, &spi_conf) == LGW_SPI_SUCCESS);
+		pthread_mutex_unlock(&rc->mx_xfer);
+		for (j=0; ok && (j < AUTOTUNE_PASSES); ++j) {
+			ok = (spi_readback(autotune_speed[i] + j) == LGW_REG_SUCCESS);
+		}
+		DEBUG_PRINTF("Note: SPI readback at %u Hz: %s\n", autotune_speed[i], ok ? "ok" : "FAILED");
+		if (!ok) {
+			break;
+		}
+		i_ok = i;
+	}
+	
+	/* step back from a clock that passed just below a failing one or beyond the rating */
+	if ((i_ok > 0) && (!ok || (autotune_speed[i_ok] > AUTOTUNE_RATED_HZ))) {
+		DEBUG_PRINTF("Note: SPI clock backed off from %u Hz for margin\n", autotune_speed[i_ok]);
+		i_ok -= 1;
+	}
+	if (i_ok >= 0) {
+		speed_ok = autotune_speed[i_ok];
+	}
+	
+	/* settle on that clock, kept for the next connections */
+	spi_conf.speed_hz = (speed_ok != 0) ? speed_ok : autotune_speed[0];
+	spi_conf.chunk_size = 0;
+	pthread_mutex_lock(&rc->mx_xfer);
+	lgw_spi_set_conf(rc->spi_target, &spi_conf);
+	lgw_spi_get_conf(rc->spi_target, &spi_conf);
+	pthread_mutex_unlock(&rc->mx_xfer);
+	if (speed_ok == 0) {
+		DEBUG_MSG("ERROR: SPI READBACK FAILS EVEN AT THE SLOWEST CLOCK\n");
+		return LGW_REG_ERROR;
+	}
+	rc->spi_speed = spi_conf.speed_hz;
+	rc->spi_chunk = spi_conf.chunk_size;
+	return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Allocate a register access context */
+struct lgw_reg_ctx_s *lgw_reg_ctx_new(const char *spi_path) {
+	struct lgw_reg_ctx_s *rctx;
+	
+	if ((spi_path != NULL) && (strlen(spi_path) >= sizeof(rctx->spi_path))) {
+		DEBUG_MSG("ERROR: SPI DEVICE PATH TOO LONG\n");
+		return NULL;
+	}
+	rctx = calloc(1, sizeof(struct lgw_reg_ctx_s));
+	if (rctx == NULL) {
+		DEBUG_MSG("ERROR: MALLOC FAIL\n");
+		return NULL;
+	}
+	if (spi_path != NULL) {
+		strcpy(rctx->spi_path, spi_path);
+	}
+	rctx->spi_target = NULL;
+	rctx->regpage = -1;
+	rctx->page_lost = false;
+	pthread_mutex_init(&rctx->mx_xfer, NULL);
+	rctx->cache_on = false;
+	rctx->trace = NULL;
+	return rctx;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Free a register access context, disconnecting its concentrator if needed */
+void lgw_reg_ctx_free(struct lgw_reg_ctx_s *rctx) {
+	if ((rctx == NULL) || (rctx == &reg_ctx_dflt)) {
+		return;
+	}
+	if (rctx->spi_target != NULL) {
+		lgw_spi_close(rctx->spi_target);
+	}
+	if (rctx->trace != NULL) {
+		fclose(rctx->trace);
+	}
+	if (reg_ctx_cur == rctx) {
+		reg_ctx_cur = NULL;
+	}
+	pthread_mutex_destroy(&rctx->mx_xfer);
+	free(rctx);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Select the register access context of the calling thread */
+struct lgw_reg_ctx_s *lgw_reg_ctx_select(struct lgw_reg_ctx_s *rctx) {
+	struct lgw_reg_ctx_s *prev = reg_ctx_cur;
+	
+	reg_ctx_cur = rctx;
+	return prev;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Start an SPI trace capture */
+int lgw_reg_trace_start(const char *path) {
+	struct lgw_reg_ctx_s *rc = REG_CTX();
+	uint8_t head[LGW_TRACE_HEAD_SIZE] = {0};
+	FILE *f;
+	
+	CHECK_NULL(path);
+	f = fopen(path, "wb");
+	if (f == NULL) {
+		DEBUG_MSG("ERROR: FAILED TO CREATE SPI TRACE FILE\n");
+		return LGW_REG_ERROR;
+	}
+	setvbuf(f, NULL, _IOFBF, 65536); /* records are small, let stdio group the writes */
+	memcpy(head, LGW_TRACE_MAGIC, 4);
+	head[4] = LGW_TRACE_VERSION;
+	if (fwrite(head, 1, sizeof(head), f) != sizeof(head)) {
+		DEBUG_MSG("ERROR: FAILED TO WRITE SPI TRACE HEADER\n");
+		fclose(f);
+		return LGW_REG_ERROR;
+	}
+	
+	pthread_mutex_lock(&rc->mx_xfer);
+	if (rc->trace != NULL) {
+		fclose(rc->trace);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &rc->trace_t0);
+	rc->trace_us = 0;
+	rc->trace = f;
+	pthread_mutex_unlock(&rc->mx_xfer);
+	DEBUG_PRINTF("Note: SPI trace capture started, file %s\n", path);
+	return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Stop the SPI trace capture */
+int lgw_reg_trace_stop(void) {
+	struct lgw_reg_ctx_s *rc = REG_CTX();
+	FILE *f;
+	
+	pthread_mutex_lock(&rc->mx_xfer);
+	f = rc->trace;
+	rc->trace = NULL;
+	pthread_mutex_unlock(&rc->mx_xfer);
+	if (f == NULL) {
+		DEBUG_MSG("WARNING: NO SPI TRACE CAPTURE RUNNING\n");
+		return LGW_REG_ERROR;
+	}
+	fclose(f);
+	return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Set the call site recorded in the SPI trace */
+uint8_t lgw_reg_trace_site(uint8_t site) {
+	uint8_t prev = trace_site;
+	
+	trace_site = site;
+	return prev;
+}
+
 /* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,331 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Dedicated RX fetch thread, draining the LoRa concentrator into a
+	single-producer/single-consumer ring of received packets.
+	The fetch thread is the only writer of the ring head and the application
+	the only writer of the ring tail, so no lock is needed between them.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+	#define _XOPEN_SOURCE 600
+#else
+	#define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+#include <stdio.h>		/* fprintf */
+#include <stdlib.h>		/* malloc free */
+#include <string.h>		/* memcpy */
+#include <errno.h>		/* EINTR */
+#include <pthread.h>	/* fetch thread */
+#include <sched.h>		/* SCHED_FIFO */
+#include <poll.h>		/* poll */
+#include <unistd.h>		/* read write close */
+#include <sys/eventfd.h>	/* consumer notification */
+
+#include "loragw_hal.h"
+#include "loragw_aux.h"
+#include "loragw_ring.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#if DEBUG_RING == 1
+	#define DEBUG_MSG(str)				fprintf(stderr, str)
+	#define DEBUG_PRINTF(fmt, args...)	fprintf(stderr,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+	#define CHECK_NULL(a)				if(a==NULL){fprintf(stderr,"%s:%d: ERROR: NULL POINTER AS ARGUMENT\n", __FUNCTION__, __LINE__);return LGW_RING_ERROR;}
+#else
+	#define DEBUG_MSG(str)
+	#define DEBUG_PRINTF(fmt, args...)
+	#define CHECK_NULL(a)				if(a==NULL){return LGW_RING_ERROR;}
+#endif
+
+/* indexes shared between the fetch thread and the application */
+#define LOAD_ACQ(v)			__atomic_load_n(&(v), __ATOMIC_ACQUIRE)
+#define STORE_REL(v, x)		__atomic_store_n(&(v), (x), __ATOMIC_RELEASE)
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define RING_SIZE_MAX		65536	/* max number of packets in the ring */
+#define RING_WAIT_MS		100		/* max sleep of the fetch thread, bounds the stop latency */
+#define RING_FETCH_MAX		16		/* max number of packets fetched in one call */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static struct lgw_pkt_rx_s *ring_buf = NULL; /* packet slots, NULL when the thread is not running */
+static uint32_t ring_mask; /* number of slots - 1 */
+static uint32_t ring_head; /* next slot written, only written by the fetch thread */
+static uint32_t ring_tail; /* next slot read, only written by the application */
+static int ring_efd = -1; /* eventfd signalled when packets are pushed */
+static bool ring_quit; /* stop request for the fetch thread */
+static pthread_t ring_thread;
+
+static struct lgw_ring_stats_s ring_stats; /* counters are only written by one side each */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+void *ring_fetch(void *arg);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* fetch thread: drain the concentrator straight into the free slots of the ring */
+void *ring_fetch(void *arg) {
+	struct lgw_pkt_rx_s drop[RING_FETCH_MAX]; /* landing area when the ring is full */
+	uint32_t head, tail, fill, room;
+	uint64_t one = 1;
+	int nb_pkt;
+	
+	(void)arg;
+	head = ring_head;
+	while (LOAD_ACQ(ring_quit) == false) {
+		tail = LOAD_ACQ(ring_tail);
+		fill = head - tail;
+		
+		/* contiguous free slots, up to the end of the buffer */
+		room = ring_mask + 1 - fill;
+		if (room > (ring_mask + 1 - (head & ring_mask))) {
+			room = ring_mask + 1 - (head & ring_mask);
+		}
+		if (room > RING_FETCH_MAX) {
+			room = RING_FETCH_MAX;
+		}
+		
+		if (room > 0) {
+			nb_pkt = lgw_receive_wait(RING_WAIT_MS, (uint8_t)room, &ring_buf[head & ring_mask]);
+		} else {
+			/* ring full, keep draining the concentrator and count the losses */
+			nb_pkt = lgw_receive_wait(RING_WAIT_MS, RING_FETCH_MAX, drop);
+		}
+		if (nb_pkt < 0) {
+			__atomic_add_fetch(&ring_stats.nb_fetch_error, 1, __ATOMIC_RELAXED);
+			wait_ms(RING_WAIT_MS);
+			continue;
+		} else if (nb_pkt == 0) {
+			continue;
+		}
+		__atomic_add_fetch(&ring_stats.nb_fetched, nb_pkt, __ATOMIC_RELAXED);
+		if (room == 0) {
+			__atomic_add_fetch(&ring_stats.nb_overrun, nb_pkt, __ATOMIC_RELAXED);
+			DEBUG_PRINTF("WARNING: RX ring full, %d packets dropped\n", nb_pkt);
+			continue;
+		}
+		
+		/* publish the packets, then wake up the application */
+		head += nb_pkt;
+		STORE_REL(ring_head, head);
+		if ((fill + nb_pkt) > __atomic_load_n(&ring_stats.max_fill, __ATOMIC_RELAXED)) {
+			__atomic_store_n(&ring_stats.max_fill, fill + nb_pkt, __ATOMIC_RELAXED);
+		}
+		if (write(ring_efd, &one, sizeof(one)) < 0) {
+			DEBUG_MSG("WARNING: FAILED TO SIGNAL RX RING EVENT\n");
+		}
+	}
+	return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int lgw_ring_start(uint32_t size, int rt_priority) {
+	pthread_attr_t attr;
+	struct sched_param param;
+	uint32_t nb_slots = 1;
+	int i;
+	
+	if (ring_buf != NULL) {
+		DEBUG_MSG("ERROR: RX FETCH THREAD ALREADY RUNNING\n");
+		return LGW_RING_ERROR;
+	}
+	if ((rt_priority < 0) || (rt_priority > 99)) {
+		DEBUG_PRINTF("ERROR: %d = INVALID REAL-TIME PRIORITY\n", rt_priority);
+		return LGW_RING_ERROR;
+	}
+	
+	/* ring size is a power of 2, indexes are free-running */
+	if (size == 0) {
+		size = LGW_RING_SIZE_DEFAULT;
+	} else if (size > RING_SIZE_MAX) {
+		size = RING_SIZE_MAX;
+	}
+	while (nb_slots < size) {
+		nb_slots <<= 1;
+	}
+	ring_buf = malloc(nb_slots * sizeof(struct lgw_pkt_rx_s));
+	if (ring_buf == NULL) {
+		DEBUG_MSG("ERROR: FAILED TO ALLOCATE RX RING\n");
+		return LGW_RING_ERROR;
+	}
+	ring_efd = eventfd(0, EFD_NONBLOCK);
+	if (ring_efd < 0) {
+		DEBUG_MSG("ERROR: FAILED TO CREATE RX RING EVENT\n");
+		free(ring_buf);
+		ring_buf = NULL;
+		return LGW_RING_ERROR;
+	}
+	ring_mask = nb_slots - 1;
+	ring_head = 0;
+	ring_tail = 0;
+	ring_quit = false;
+	memset(&ring_stats, 0, sizeof(ring_stats));
+	
+	/* try real-time scheduling first, fall back to default scheduling */
+	i = -1;
+	if (rt_priority > 0) {
+		pthread_attr_init(&attr);
+		pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+		param.sched_priority = rt_priority;
+		pthread_attr_setschedparam(&attr, &param);
+		i = pthread_create(&ring_thread, &attr, ring_fetch, NULL);
+		pthread_attr_destroy(&attr);
+		if (i == 0) {
+			ring_stats.rt_sched = true;
+		} else {
+			DEBUG_PRINTF("WARNING: SCHED_FIFO priority %d refused for the RX fetch thread, using default scheduling\n", rt_priority);
+		}
+	}
+	if (i != 0) {
+		i = pthread_create(&ring_thread, NULL, ring_fetch, NULL);
+	}
+	if (i != 0) {
+		DEBUG_MSG("ERROR: FAILED TO START RX FETCH THREAD\n");
+		close(ring_efd);
+		ring_efd = -1;
+		free(ring_buf);
+		ring_buf = NULL;
+		return LGW_RING_ERROR;
+	}
+	
+	DEBUG_PRINTF("Note: RX fetch thread started, %u slots\n", nb_slots);
+	return LGW_RING_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ring_stop(void) {
+	if (ring_buf == NULL) {
+		DEBUG_MSG("WARNING: RX FETCH THREAD WAS NOT RUNNING\n");
+		return LGW_RING_ERROR;
+	}
+	STORE_REL(ring_quit, true);
+	pthread_join(ring_thread, NULL);
+	close(ring_efd);
+	ring_efd = -1;
+	free(ring_buf);
+	ring_buf = NULL;
+	return LGW_RING_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ring_pop_bulk(uint16_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
+	uint32_t head, tail;
+	uint32_t nb, first;
+	
+	CHECK_NULL(pkt_data);
+	if (ring_buf == NULL) {
+		DEBUG_MSG("ERROR: RX FETCH THREAD IS NOT RUNNING\n");
+		return LGW_RING_ERROR;
+	}
+	
+	head = LOAD_ACQ(ring_head);
+	tail = ring_tail;
+	nb = head - tail;
+	if (nb > max_pkt) {
+		nb = max_pkt;
+	}
+	if (nb == 0) {
+		return 0;
+	}
+	
+	/* copy in up to two parts, the ring may wrap */
+	first = ring_mask + 1 - (tail & ring_mask);
+	if (first > nb) {
+		first = nb;
+	}
+	memcpy(pkt_data, &ring_buf[tail & ring_mask], first * sizeof(struct lgw_pkt_rx_s));
+	if (nb > first) {
+		memcpy(&pkt_data[first], ring_buf, (nb - first) * sizeof(struct lgw_pkt_rx_s));
+	}
+	
+	/* hand the slots back to the fetch thread */
+	STORE_REL(ring_tail, tail + nb);
+	__atomic_add_fetch(&ring_stats.nb_popped, nb, __ATOMIC_RELAXED);
+	return (int)nb;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ring_pop_wait(int timeout_ms, uint16_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
+	struct pollfd pfd;
+	uint64_t cnt;
+	int nb_pkt;
+	int i;
+	
+	nb_pkt = lgw_ring_pop_bulk(max_pkt, pkt_data);
+	if (nb_pkt != 0) {
+		return nb_pkt; /* packets or error */
+	}
+	
+	/* the event counter is cleared before checking the ring again, a push
+	between the check and the poll still leaves the eventfd readable */
+	if (read(ring_efd, &cnt, sizeof(cnt)) < 0) {
+		cnt = 0; /* EAGAIN, no event pending */
+	}
+	nb_pkt = lgw_ring_pop_bulk(max_pkt, pkt_data);
+	if (nb_pkt != 0) {
+		return nb_pkt;
+	}
+	pfd.fd = ring_efd;
+	pfd.events = POLLIN;
+	i = poll(&pfd, 1, timeout_ms);
+	if ((i < 0) && (errno != EINTR)) {
+		DEBUG_MSG("ERROR: FAILED TO WAIT FOR RX RING EVENT\n");
+		return LGW_RING_ERROR;
+	}
+	return lgw_ring_pop_bulk(max_pkt, pkt_data);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ring_get_fd(void) {
+	return ring_efd;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ring_get_stats(struct lgw_ring_stats_s *stats) {
+	CHECK_NULL(stats);
+	if (ring_buf == NULL) {
+		return LGW_RING_ERROR;
+	}
+	stats->nb_fetched = __atomic_load_n(&ring_stats.nb_fetched, __ATOMIC_RELAXED);
+	stats->nb_popped = __atomic_load_n(&ring_stats.nb_popped, __ATOMIC_RELAXED);
+	stats->nb_overrun = __atomic_load_n(&ring_stats.nb_overrun, __ATOMIC_RELAXED);
+	stats->nb_fetch_error = __atomic_load_n(&ring_stats.nb_fetch_error, __ATOMIC_RELAXED);
+	stats->max_fill = __atomic_load_n(&ring_stats.max_fill, __ATOMIC_RELAXED);
+	stats->rt_sched = ring_stats.rt_sched;
+	return LGW_RING_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -10,6 +10,11 @@ Description:
 	Host specific functions to address the LoRa concentrator registers through
 	a SPI interface.
 	Single-byte read/write and burst read/write.
+	Every access is built in a transfer buffer owned by the SPI target, no
+	memory is allocated after lgw_spi_open.
+	Batches of frames are coalesced in a single MPSSE command buffer, sent
+	with one USB write (and read back with one USB read if needed).
+	Large burst writes are sent from the caller buffer, without copy.
 	Does not handle pagination.
 	Could be used with multiple SPI ports in parallel (explicit file descriptor)
 
@@ -54,25 +59,215 @@ Maintainer: Sylvain Miermont
 #define VID		0x0403
 #define PID		0x6010
 
+/* MPSSE opcodes used to build command buffers (see FTDI AN_108) */
+#define MPSSE_SET_BITS_LOW		0x80	/* followed by pin values and directions */
+#define MPSSE_SEND_IMMEDIATE	0x87	/* flush the chip buffer back to the host */
+
+/* limits of a USB transfer */
+#define BATCH_BUF_SIZE		4096	/* bytes of MPSSE commands per USB write */
+#define BATCH_READ_BYTES	2048	/* bytes read back per USB transfer, must fit in the 4kB FT2232H buffer */
+#define BATCH_READ_NB		64		/* read segments per USB transfer */
+#define BATCH_READ_RETRY	100		/* empty USB reads tolerated before giving up */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* pending USB transfer: MPSSE commands and destinations of the data read back */
+struct batch_xfer_s {
+	uint8_t		buf[BATCH_BUF_SIZE];	/* MPSSE command buffer */
+	int			size;					/* bytes of commands in the buffer */
+	struct {
+		uint8_t	*data;
+		int		size;
+	}			rd[BATCH_READ_NB];		/* read segments, in order */
+	int			nb_rd;					/* number of read segments */
+	int			rd_bytes;				/* total bytes expected back */
+};
+
+/* SPI target: libmpsse context and its transfer buffer */
+struct ftdi_spi_s {
+	struct mpsse_context	*mpsse;
+	struct batch_xfer_s		x;
+	uint16_t				chunk_size;	/* max data bytes per clock command */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+/* drop the pending commands and read segments */
+static void batch_reset(struct batch_xfer_s *x) {
+	x->size = 0;
+	x->nb_rd = 0;
+	x->rd_bytes = 0;
+}
+
+/* send the pending commands in one USB write, then read back all the data the reads produce */
+static int batch_flush(struct mpsse_context *mpsse, struct batch_xfer_s *x) {
+	int n, r, retry;
+	int i;
+	
+	if (x->size == 0) {
+		return LGW_SPI_SUCCESS;
+	}
+	if (x->nb_rd > 0) {
+		x->buf[x->size++] = MPSSE_SEND_IMMEDIATE; /* do not wait for the latency timer */
+	}
+	
+	r = ftdi_write_data(&mpsse->ftdi, x->buf, x->size);
+	DEBUG_PRINTF("BATCH: %d command bytes, %d read segments, %d bytes to read\n", x->size, x->nb_rd, x->rd_bytes);
+	if (r != x->size) {
+		DEBUG_MSG("ERROR: USB WRITE FAILURE\n");
+		batch_reset(x);
+		return LGW_SPI_ERROR;
+	}
+	
+	/* data comes back in command order, read it directly in the caller buffers */
+	for (i=0; i<x->nb_rd; ++i) {
+		for (n=0, retry=0; n < x->rd[i].size; n += r) {
+			r = ftdi_read_data(&mpsse->ftdi, x->rd[i].data + n, x->rd[i].size - n);
+			if ((r < 0) || ((r == 0) && (++retry > BATCH_READ_RETRY))) {
+				DEBUG_MSG("ERROR: USB READ FAILURE\n");
+				batch_reset(x);
+				return LGW_SPI_ERROR;
+			}
+		}
+	}
+	
+	batch_reset(x);
+	return LGW_SPI_SUCCESS;
+}
+
+/* make room for 'size' command bytes (and 'rd_size' bytes read back) in the pending transfer */
+static int batch_room(struct mpsse_context *mpsse, struct batch_xfer_s *x, int size, int rd_size) {
+	/* one byte always kept for the final SEND_IMMEDIATE */
+	if ((x->size + size + 1 > BATCH_BUF_SIZE) || ((rd_size > 0) && ((x->nb_rd == BATCH_READ_NB) || (x->rd_bytes + rd_size > BATCH_READ_BYTES)))) {
+		return batch_flush(mpsse, x);
+	}
+	return LGW_SPI_SUCCESS;
+}
+
+/* append a command setting the low byte pins (chip select is one of them) */
+static void batch_pins(struct batch_xfer_s *x, uint8_t pins, uint8_t tris) {
+	x->buf[x->size++] = MPSSE_SET_BITS_LOW;
+	x->buf[x->size++] = pins;
+	x->buf[x->size++] = tris;
+}
+
+/* append a clock data command (length coded size-1, little endian), followed by data if any */
+static void batch_clock(struct batch_xfer_s *x, uint8_t opcode, uint8_t *data, int size) {
+	x->buf[x->size++] = opcode;
+	x->buf[x->size++] = (uint8_t)((size - 1) & 0xFF);
+	x->buf[x->size++] = (uint8_t)(((size - 1) >> 8) & 0xFF);
+	if (data != NULL) {
+		memcpy(x->buf + x->size, data, size);
+		x->size += size;
+	}
+}
+
+/* queue the frames in the transfer buffer, flush it as needed and at the end */
+static int batch_frames(struct ftdi_spi_s *spi, struct lgw_spi_frame_s *frames, uint16_t nb_frames) {
+	struct mpsse_context *mpsse = spi->mpsse;
+	struct batch_xfer_s *x = &spi->x;
+	uint8_t command;
+	int chunk_size, offset;
+	int room;
+	int a = LGW_SPI_SUCCESS;
+	int i;
+	
+	batch_reset(x);
+	for (i=0; i<nb_frames; ++i) {
+		/* chip select low, then command byte */
+		command = (frames[i].write ? WRITE_ACCESS : READ_ACCESS) | (frames[i].address & 0x7F);
+		a = batch_room(mpsse, x, 3 + 4, 0);
+		if (a != LGW_SPI_SUCCESS) {
+			break;
+		}
+		batch_pins(x, mpsse->pstart, mpsse->tris);
+		batch_clock(x, mpsse->tx, &command, 1);
+		
+		/* data, split in chunks like in burst functions */
+		for (offset = 0; offset < frames[i].size; offset += chunk_size) {
+			chunk_size = frames[i].size - offset;
+			chunk_size = (chunk_size < spi->chunk_size) ? chunk_size : spi->chunk_size;
+			if (frames[i].write) {
+				/* fill the transfer buffer up, the chunk is split where it is full (chip select stays low) */
+				a = batch_room(mpsse, x, 3 + 1, 0);
+				if (a != LGW_SPI_SUCCESS) {
+					break;
+				}
+				room = BATCH_BUF_SIZE - 1 - 3 - x->size;
+				chunk_size = (chunk_size < room) ? chunk_size : room;
+				batch_clock(x, mpsse->tx, frames[i].data + offset, chunk_size);
+			} else {
+				a = batch_room(mpsse, x, 3, chunk_size);
+				if (a != LGW_SPI_SUCCESS) {
+					break;
+				}
+				batch_clock(x, mpsse->rx, NULL, chunk_size);
+				x->rd[x->nb_rd].data = frames[i].data + offset;
+				x->rd[x->nb_rd].size = chunk_size;
+				x->nb_rd += 1;
+				x->rd_bytes += chunk_size;
+			}
+		}
+		if (a != LGW_SPI_SUCCESS) {
+			break;
+		}
+		
+		/* chip select high */
+		a = batch_room(mpsse, x, 3, 0);
+		if (a != LGW_SPI_SUCCESS) {
+			break;
+		}
+		batch_pins(x, mpsse->pidle, mpsse->tris);
+	}
+	
+	/* send what is left, read back if needed */
+	if (a == LGW_SPI_SUCCESS) {
+		a = batch_flush(mpsse, x);
+	} else {
+		batch_reset(x);
+	}
+	return a;
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
-/* SPI initialization and configuration */
+/* SPI initialization and configuration, first FTDI device */
 int lgw_spi_open(void **spi_target_ptr) {
+	return lgw_spi_open_path(spi_target_ptr, NULL);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* SPI initialization and configuration, FTDI device selected by serial number */
+int lgw_spi_open_path(void **spi_target_ptr, const char *dev_path) {
+	struct ftdi_spi_s *spi = NULL;
 	struct mpsse_context *mpsse = NULL;
 	int a, b;
 	
 	/* check input variables */
 	CHECK_NULL(spi_target_ptr); /* cannot be null, must point on a void pointer (*spi_target_ptr can be null) */
 	
-	/* try to open the first available FTDI device matching VID/PID parameters */
-	mpsse = OpenIndex(VID,PID,SPI0, SIX_MHZ, MSB, IFACE_A, NULL, NULL, 0);
+	/* allocate the SPI target and its transfer buffer, once for all */
+	spi = malloc(sizeof(struct ftdi_spi_s));
+	if (spi == NULL) {
+		DEBUG_MSG("ERROR: MALLOC FAIL\n");
+		return LGW_SPI_ERROR;
+	}
+	
+	/* try to open the first available FTDI device matching VID/PID parameters (and serial number, if any) */
+	mpsse = OpenIndex(VID,PID,SPI0, SIX_MHZ, MSB, IFACE_A, NULL, (char *)dev_path, 0);
 	if (mpsse == NULL) {
 		DEBUG_MSG("ERROR: MPSSE OPEN FUNCTION RETURNED NULL\n");
+		free(spi);
 		return LGW_SPI_ERROR;
 	}
 	if (mpsse->open != 1) {
 		DEBUG_MSG("ERROR: MPSSE OPEN FUNCTION FAILED\n");
+		Close(mpsse);
+		free(spi);
 		return LGW_SPI_ERROR;
 	}
 	
@@ -82,11 +277,16 @@ int lgw_spi_open(void **spi_target_ptr) {
 	b = PinLow(mpsse, GPIOL1);
 	if ((a != MPSSE_OK) || (b != MPSSE_OK)) {
 		DEBUG_MSG("ERROR: IMPOSSIBLE TO TOGGLE GPIOL1/ADBUS5\n");
+		Close(mpsse);
+		free(spi);
 		return LGW_SPI_ERROR;
 	}
 	
 	DEBUG_PRINTF("SPI port opened and configured ok\ndesc: %s\nPID: 0x%04X\nVID: 0x%04X\nclock: %d\nLibmpsse version: 0x%02X\n", GetDescription(mpsse), GetPid(mpsse), GetVid(mpsse), GetClock(mpsse), Version());
-	*spi_target_ptr = (void *)mpsse;
+	spi->mpsse = mpsse;
+	spi->chunk_size = LGW_BURST_CHUNK;
+	batch_reset(&spi->x);
+	*spi_target_ptr = (void *)spi;
 	return LGW_SPI_SUCCESS;
 }
 
@@ -94,12 +294,13 @@ int lgw_spi_open(void **spi_target_ptr) {
 
 /* SPI release */
 int lgw_spi_close(void *spi_target) {
-	struct mpsse_context *mpsse = spi_target;
+	struct ftdi_spi_s *spi = spi_target;
 	
 	/* check input variables */
 	CHECK_NULL(spi_target);
 	
-	Close(mpsse);
+	Close(spi->mpsse);
+	free(spi);
 	
 	/* close return no status, assume success (0_o) */
 	return LGW_SPI_SUCCESS;
@@ -108,11 +309,10 @@ int lgw_spi_close(void *spi_target) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 /* Simple write */
-/* transaction time: .6 to 1 ms typically */
+/* one USB write, chip select toggles included */
 int lgw_spi_w(void *spi_target, uint8_t address, uint8_t data) {
-	struct mpsse_context *mpsse = spi_target;
-	uint8_t out_buf[2];
-	int a, b, c;
+	struct lgw_spi_frame_s frame;
+	int a;
 	
 	/* check input variables */
 	CHECK_NULL(spi_target);
@@ -120,17 +320,15 @@ int lgw_spi_w(void *spi_target, uint8_t address, uint8_t data) {
 		DEBUG_MSG("WARNING: SPI address > 127\n");
 	}
 	
-	/* prepare frame to be sent */
-	out_buf[0] = WRITE_ACCESS | (address & 0x7F);
-	out_buf[1] = data;
-	
 	/* MPSSE transaction */
-	a = Start(mpsse);
-	b = FastWrite(mpsse, (char *)out_buf, 2);
-	c = Stop(mpsse);
+	frame.address = address;
+	frame.write = true;
+	frame.data = &data;
+	frame.size = 1;
+	a = batch_frames(spi_target, &frame, 1);
 	
 	/* determine return code */
-	if ((a != MPSSE_OK) || (b != MPSSE_OK) || (c != MPSSE_OK)) {
+	if (a != LGW_SPI_SUCCESS) {
 		DEBUG_MSG("ERROR: SPI WRITE FAILURE\n");
 		return LGW_SPI_ERROR;
 	} else {
@@ -141,13 +339,11 @@ int lgw_spi_w(void *spi_target, uint8_t address, uint8_t data) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-/* Simple read (using Transfer function) */
-/* transaction time: 1.1 to 2 ms typically */
+/* Simple read */
+/* one USB write, one USB read */
 int lgw_spi_r(void *spi_target, uint8_t address, uint8_t *data) {
-	struct mpsse_context *mpsse = spi_target;
-	uint8_t out_buf[2];
-	uint8_t *in_buf = NULL;
-	int a, b;
+	struct lgw_spi_frame_s frame;
+	int a;
 	
 	/* check input variables */
 	CHECK_NULL(spi_target);
@@ -156,26 +352,19 @@ int lgw_spi_r(void *spi_target, uint8_t address, uint8_t *data) {
 	}
 	CHECK_NULL(data);
 	
-	/* prepare frame to be sent */
-	out_buf[0] = READ_ACCESS | (address & 0x7F);
-	out_buf[1] = 0x00;
-	
 	/* MPSSE transaction */
-	a = Start(mpsse);
-	in_buf = (uint8_t *)Transfer(mpsse, (char *)out_buf, 2);
-	b = Stop(mpsse);
+	frame.address = address;
+	frame.write = false;
+	frame.data = data;
+	frame.size = 1;
+	a = batch_frames(spi_target, &frame, 1);
 	
 	/* determine return code */
-	if ((in_buf == NULL) || (a != MPSSE_OK) || (b != MPSSE_OK)) {
+	if (a != LGW_SPI_SUCCESS) {
 		DEBUG_MSG("ERROR: SPI READ FAILURE\n");
-		if (in_buf != NULL) {
-			free(in_buf);
-		}
 		return LGW_SPI_ERROR;
 	} else {
 		DEBUG_MSG("Note: SPI read success\n");
-		*data = in_buf[1];
-		free(in_buf);
 		return LGW_SPI_SUCCESS;
 	}
 }
@@ -183,15 +372,10 @@ int lgw_spi_r(void *spi_target, uint8_t address, uint8_t *data) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 /* Burst (multiple-byte) write */
-/* transaction time: 3.7ms for 2500 data bytes @6MHz, 1kB chunks */
-/* transaction time: 0.5ms for 16 data bytes @6MHz, 1kB chunks */
+/* copied in the transfer buffer, one USB write per 4kB */
 int lgw_spi_wb(void *spi_target, uint8_t address, uint8_t *data, uint16_t size) {
-	struct mpsse_context *mpsse = spi_target;
-	uint8_t command;
-	uint8_t *out_buf = NULL;
-	int size_to_do, buf_size, chunk_size, offset;
-	int a=0, b=0, c=0;
-	int i;
+	struct lgw_spi_frame_s frame;
+	int a;
 	
 	/* check input parameters */
 	CHECK_NULL(spi_target);
@@ -204,41 +388,15 @@ int lgw_spi_wb(void *spi_target, uint8_t address, uint8_t *data, uint16_t size)
 		return LGW_SPI_ERROR;
 	}
 	
-	/* prepare command byte */
-	command = WRITE_ACCESS | (address & 0x7F);
-	size_to_do = size + 1; /* add a byte for the address */
-	
-	/* allocate data buffer */
-	buf_size = (size_to_do < LGW_BURST_CHUNK) ? size_to_do : LGW_BURST_CHUNK;
-	out_buf = malloc(buf_size);
-	if (out_buf == NULL) {
-		DEBUG_MSG("ERROR: MALLOC FAIL\n");
-		return LGW_SPI_ERROR;
-	}
-	
-	/* start MPSSE transaction */
-	a = Start(mpsse);
-	for (i=0; size_to_do > 0; ++i) {
-		chunk_size = (size_to_do < LGW_BURST_CHUNK) ? size_to_do : LGW_BURST_CHUNK;
-		if (i == 0) {
-			/* first chunk, need to append the address */
-			out_buf[0] = command;
-			memcpy(out_buf+1, data, chunk_size-1);
-		} else {
-			/* following chunks, just copy the data */
-			offset = (i * LGW_BURST_CHUNK) - 1;
-			memcpy(out_buf, data + offset, chunk_size);
-		}
-		b = FastWrite(mpsse, (char *)out_buf, chunk_size);
-		size_to_do -= chunk_size; /* subtract the quantity of data already transferred */
-	}
-	c = Stop(mpsse);
-	
-	/* deallocate data buffer */
-	free(out_buf);
+	/* MPSSE transaction */
+	frame.address = address;
+	frame.write = true;
+	frame.data = data;
+	frame.size = size;
+	a = batch_frames(spi_target, &frame, 1);
 	
-	/* determine return code (only the last FastWrite is checked) */
-	if ((a != MPSSE_OK) || (b != MPSSE_OK) || (c != MPSSE_OK)) {
+	/* determine return code */
+	if (a != LGW_SPI_SUCCESS) {
 		DEBUG_MSG("ERROR: SPI BURST WRITE FAILURE\n");
 		return LGW_SPI_ERROR;
 	} else {
@@ -249,15 +407,11 @@ int lgw_spi_wb(void *spi_target, uint8_t address, uint8_t *data, uint16_t size)
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-/* Burst (multiple-byte) read (using FastWrite & FastRead functions) */
-/* transaction time: 7-12ms for 2500 data bytes @6MHz, 1kB chunks */
-/* transaction time: 2ms for 16 data bytes @6MHz, 1kB chunks */
+/* Burst (multiple-byte) read */
+/* data read back directly in the caller buffer, one USB write and read per 2kB */
 int lgw_spi_rb(void *spi_target, uint8_t address, uint8_t *data, uint16_t size) {
-	struct mpsse_context *mpsse = spi_target;
-	uint8_t command;
-	int size_to_do, chunk_size, offset;
-	int a=0, b=0, c=0, d=0;
-	int i;
+	struct lgw_spi_frame_s frame;
+	int a;
 	
 	/* check input parameters */
 	CHECK_NULL(spi_target);
@@ -270,23 +424,15 @@ int lgw_spi_rb(void *spi_target, uint8_t address, uint8_t *data, uint16_t size)
 		return LGW_SPI_ERROR;
 	}
 	
-	/* prepare command byte */
-	command = READ_ACCESS | (address & 0x7F);
-	size_to_do = size;
-	
-	/* start MPSSE transaction */
-	a = Start(mpsse);
-	b = FastWrite(mpsse, (char *)&command, 1);
-	for (i=0; size_to_do > 0; ++i) {
-		chunk_size = (size_to_do < LGW_BURST_CHUNK) ? size_to_do : LGW_BURST_CHUNK;
-		offset = i * LGW_BURST_CHUNK;
-		c = FastRead(mpsse, (char *)(data + offset), chunk_size);
-		size_to_do -= chunk_size; /* subtract the quantity of data already transferred */
-	}
-	d = Stop(mpsse);
+	/* MPSSE transaction */
+	frame.address = address;
+	frame.write = false;
+	frame.data = data;
+	frame.size = size;
+	a = batch_frames(spi_target, &frame, 1);
 	
-	/* determine return code (only the last FastRead is checked) */
-	if ((a != MPSSE_OK) || (b != MPSSE_OK) || (c != MPSSE_OK) || (d != MPSSE_OK)) {
+	/* determine return code */
+	if (a != LGW_SPI_SUCCESS) {
 		DEBUG_MSG("ERROR: SPI BURST READ FAILURE\n");
 		return LGW_SPI_ERROR;
 	} else {
@@ -295,4 +441,79 @@ int lgw_spi_rb(void *spi_target, uint8_t address, uint8_t *data, uint16_t size)
 	}
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Batch of framed accesses, coalesced in as few USB transfers as possible */
+/* chip select toggles are part of the MPSSE command buffer, data is read back only once all commands are sent */
+int lgw_spi_batch(void *spi_target, struct lgw_spi_frame_s *frames, uint16_t nb_frames) {
+	int a;
+	int i;
+	
+	/* check input parameters */
+	CHECK_NULL(spi_target);
+	CHECK_NULL(frames);
+	for (i=0; i<nb_frames; ++i) {
+		CHECK_NULL(frames[i].data);
+		if (frames[i].size == 0) {
+			DEBUG_MSG("ERROR: BURST OF NULL LENGTH\n");
+			return LGW_SPI_ERROR;
+		}
+		if ((frames[i].address & 0x80) != 0) {
+			DEBUG_MSG("WARNING: SPI address > 127\n");
+		}
+	}
+	
+	a = batch_frames(spi_target, frames, nb_frames);
+	
+	/* determine return code */
+	if (a != LGW_SPI_SUCCESS) {
+		DEBUG_MSG("ERROR: SPI BATCH FAILURE\n");
+		return LGW_SPI_ERROR;
+	} else {
+		DEBUG_MSG("Note: SPI batch success\n");
+		return LGW_SPI_SUCCESS;
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Runtime parameters of the link */
+int lgw_spi_get_conf(void *spi_target, struct lgw_spi_conf_s *conf) {
+	struct ftdi_spi_s *spi = spi_target;
+	
+	/* check input parameters */
+	CHECK_NULL(spi_target);
+	CHECK_NULL(conf);
+	
+	conf->speed_hz = (uint32_t)GetClock(spi->mpsse);
+	conf->chunk_size = spi->chunk_size;
+	conf->chunk_max = BATCH_READ_BYTES; /* a read chunk comes back in a single USB transfer */
+	return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Change the clock and burst chunk size */
+int lgw_spi_set_conf(void *spi_target, const struct lgw_spi_conf_s *conf) {
+	struct ftdi_spi_s *spi = spi_target;
+	
+	/* check input parameters */
+	CHECK_NULL(spi_target);
+	CHECK_NULL(conf);
+	if (conf->chunk_size > BATCH_READ_BYTES) {
+		DEBUG_PRINTF("ERROR: CHUNK SIZE %u DOES NOT FIT IN A USB TRANSFER (MAX %u)\n", conf->chunk_size, BATCH_READ_BYTES);
+		return LGW_SPI_ERROR;
+	}
+	
+	if ((conf->speed_hz != 0) && (SetClock(spi->mpsse, conf->speed_hz) != MPSSE_OK)) {
+		DEBUG_MSG("ERROR: MPSSE FAIL TO SET CLOCK\n");
+		return LGW_SPI_ERROR;
+	}
+	if (conf->chunk_size != 0) {
+		spi->chunk_size = conf->chunk_size;
+	}
+	DEBUG_PRINTF("Note: SPI clock %d Hz, burst chunk %u bytes\n", GetClock(spi->mpsse), spi->chunk_size);
+	return LGW_SPI_SUCCESS;
+}
+
 /* --- EOF ------------------------------------------------------------------ */
@@ -55,13 +55,58 @@ Maintainer: Sylvain Miermont
 #define SPI_SPEED		8000000
 #define SPI_DEV_PATH	"/dev/spidev0.0"
 //#define SPI_DEV_PATH	"/dev/spidev32766.0"
+#define BATCH_XFER_MAX	64	/* max number of transfers in a single SPI message (2 per frame) */
+
+/* spidev limits the total size of a SPI message to a module parameter */
+#define SPIDEV_BUFSIZ_PATH	"/sys/module/spidev/parameters/bufsiz"
+#define SPIDEV_BUFSIZ_DFLT	4096	/* when the parameter cannot be read */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* SPI target: spidev file descriptor and link parameters */
+struct native_spi_s {
+	int			fd;
+	uint32_t	speed_hz;	/* clock of all the transfers */
+	uint16_t	chunk_size;	/* max data bytes per transfer */
+	uint16_t	chunk_max;	/* a chunk and its command byte must fit in the spidev buffer */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+/* largest burst chunk accepted by spidev: message buffer minus the command byte */
+static uint16_t spidev_chunk_max(void) {
+	FILE *f;
+	long bufsiz = 0;
+	
+	f = fopen(SPIDEV_BUFSIZ_PATH, "r");
+	if (f != NULL) {
+		if (fscanf(f, "%ld", &bufsiz) != 1) {
+			bufsiz = 0;
+		}
+		fclose(f);
+	}
+	if (bufsiz < 2) {
+		DEBUG_MSG("WARNING: SPIDEV BUFFER SIZE UNKNOWN, DEFAULT ASSUMED\n");
+		bufsiz = SPIDEV_BUFSIZ_DFLT;
+	}
+	return (bufsiz > 65536) ? 65535 : (uint16_t)(bufsiz - 1);
+}
 
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
-/* SPI initialization and configuration */
+/* SPI initialization and configuration, default device */
 int lgw_spi_open(void **spi_target_ptr) {
-	int *spi_device = NULL;
+	return lgw_spi_open_path(spi_target_ptr, NULL);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* SPI initialization and configuration, given spidev device */
+int lgw_spi_open_path(void **spi_target_ptr, const char *dev_path) {
+	struct native_spi_s *spi_device = NULL;
 	int dev;
 	int a=0, b=0;
 	int i;
@@ -70,16 +115,17 @@ int lgw_spi_open(void **spi_target_ptr) {
 	CHECK_NULL(spi_target_ptr); /* cannot be null, must point on a void pointer (*spi_target_ptr can be null) */
 	
 	/* allocate memory for the device descriptor */
-	spi_device = malloc(sizeof(int));
+	spi_device = malloc(sizeof(struct native_spi_s));
 	if (spi_device == NULL) {
 		DEBUG_MSG("ERROR: MALLOC FAIL\n");
 		return LGW_SPI_ERROR;
 	}
 	
 	/* open SPI device */
-	dev = open(SPI_DEV_PATH, O_RDWR);
+	dev = open((dev_path != NULL) ? dev_path : SPI_DEV_PATH, O_RDWR);
 	if (dev < 0) {
 		DEBUG_MSG("SPI port fail to open\n");
+		free(spi_device);
 		return LGW_SPI_ERROR;
 	}
 	
@@ -123,10 +169,14 @@ int lgw_spi_open(void **spi_target_ptr) {
 	if ((a < 0) || (b < 0)) {
 		DEBUG_MSG("ERROR: SPI PORT FAIL TO SET 8 BITS-PER-WORD\n");
 		close(dev);
+		free(spi_device);
 		return LGW_SPI_ERROR;
 	}
 	
-	*spi_device = dev;
+	spi_device->fd = dev;
+	spi_device->speed_hz = SPI_SPEED;
+	spi_device->chunk_max = spidev_chunk_max();
+	spi_device->chunk_size = (LGW_BURST_CHUNK < spi_device->chunk_max) ? LGW_BURST_CHUNK : spi_device->chunk_max;
 	*spi_target_ptr = (void *)spi_device;
 	DEBUG_MSG("Note: SPI port opened and configured ok\n");	
 	return LGW_SPI_SUCCESS;
@@ -143,7 +193,7 @@ int lgw_spi_close(void *spi_target) {
 	CHECK_NULL(spi_target);
 	
 	/* close file & deallocate file descriptor */
-	spi_device = *(int *)spi_target; /* must check that spi_target is not null beforehand */
+	spi_device = ((struct native_spi_s *)spi_target)->fd; /* must check that spi_target is not null beforehand */
 	a = close(spi_device);
 	free(spi_target);
 	
@@ -172,7 +222,7 @@ int lgw_spi_w(void *spi_target, uint8_t address, uint8_t data) {
 		DEBUG_MSG("WARNING: SPI address > 127\n");
 	}
 	
-	spi_device = *(int *)spi_target; /* must check that spi_target is not null beforehand */
+	spi_device = ((struct native_spi_s *)spi_target)->fd; /* must check that spi_target is not null beforehand */
 	
 	/* prepare frame to be sent */
 	out_buf[0] = WRITE_ACCESS | (address & 0x7F);
@@ -182,7 +232,7 @@ int lgw_spi_w(void *spi_target, uint8_t address, uint8_t data) {
 	memset(&k, 0, sizeof(k)); /* clear k */
 	k.tx_buf = (unsigned long) out_buf;
 	k.len = ARRAY_SIZE(out_buf);
-	k.speed_hz = SPI_SPEED;
+	k.speed_hz = ((struct native_spi_s *)spi_target)->speed_hz;
 	k.cs_change = 0;
 	k.bits_per_word = 8;
 	a = ioctl(spi_device, SPI_IOC_MESSAGE(1), &k);
@@ -214,7 +264,7 @@ int lgw_spi_r(void *spi_target, uint8_t address, uint8_t *data) {
 	}
 	CHECK_NULL(data);
 	
-	spi_device = *(int *)spi_target; /* must check that spi_target is not null beforehand */
+	spi_device = ((struct native_spi_s *)spi_target)->fd; /* must check that spi_target is not null beforehand */
 	
 	/* prepare frame to be sent */
 	out_buf[0] = READ_ACCESS | (address & 0x7F);
@@ -244,6 +294,7 @@ int lgw_spi_r(void *spi_target, uint8_t address, uint8_t *data) {
 /* Burst (multiple-byte) write */
 int lgw_spi_wb(void *spi_target, uint8_t address, uint8_t *data, uint16_t size) {
 	int spi_device;
+	int burst_chunk;
 	uint8_t command;
 	struct spi_ioc_transfer k[2];
 	int size_to_do, chunk_size, offset;
@@ -261,7 +312,8 @@ int lgw_spi_wb(void *spi_target, uint8_t address, uint8_t *data, uint16_t size)
 		return LGW_SPI_ERROR;
 	}
 	
-	spi_device = *(int *)spi_target; /* must check that spi_target is not null beforehand */
+	spi_device = ((struct native_spi_s *)spi_target)->fd; /* must check that spi_target is not null beforehand */
+	burst_chunk = ((struct native_spi_s *)spi_target)->chunk_size;
 	
 	/* prepare command byte */
 	command = WRITE_ACCESS | (address & 0x7F);
@@ -274,8 +326,8 @@ int lgw_spi_wb(void *spi_target, uint8_t address, uint8_t *data, uint16_t size)
 	k[0].cs_change = 0;
 	k[1].cs_change = 1;
 	for (i=0; size_to_do > 0; ++i) {
-		chunk_size = (size_to_do < LGW_BURST_CHUNK) ? size_to_do : LGW_BURST_CHUNK;
-		offset = i * LGW_BURST_CHUNK;
+		chunk_size = (size_to_do < burst_chunk) ? size_to_do : burst_chunk;
+		offset = i * burst_chunk;
 		k[1].tx_buf = (unsigned long)(data + offset);
 		k[1].len = chunk_size;
 		byte_transfered += (ioctl(spi_device, SPI_IOC_MESSAGE(2), &k) - 1 );
@@ -298,6 +350,7 @@ int lgw_spi_wb(void *spi_target, uint8_t address, uint8_t *data, uint16_t size)
 /* Burst (multiple-byte) read */
 int lgw_spi_rb(void *spi_target, uint8_t address, uint8_t *data, uint16_t size) {
 	int spi_device;
+	int burst_chunk;
 	uint8_t command;
 	struct spi_ioc_transfer k[2];
 	int size_to_do, chunk_size, offset;
@@ -315,7 +368,8 @@ int lgw_spi_rb(void *spi_target, uint8_t address, uint8_t *data, uint16_t size)
 		return LGW_SPI_ERROR;
 	}
 	
-	spi_device = *(int *)spi_target; /* must check that spi_target is not null beforehand */
+	spi_device = ((struct native_spi_s *)spi_target)->fd; /* must check that spi_target is not null beforehand */
+	burst_chunk = ((struct native_spi_s *)spi_target)->chunk_size;
 	
 	/* prepare command byte */
 	command = READ_ACCESS | (address & 0x7F);
@@ -328,8 +382,8 @@ int lgw_spi_rb(void *spi_target, uint8_t address, uint8_t *data, uint16_t size)
 	k[0].cs_change = 0;
 	k[1].cs_change = 1;
 	for (i=0; size_to_do > 0; ++i) {
-		chunk_size = (size_to_do < LGW_BURST_CHUNK) ? size_to_do : LGW_BURST_CHUNK;
-		offset = i * LGW_BURST_CHUNK;
+		chunk_size = (size_to_do < burst_chunk) ? size_to_do : burst_chunk;
+		offset = i * burst_chunk;
 		k[1].rx_buf = (unsigned long)(data + offset);
 		k[1].len = chunk_size;
 		byte_transfered += (ioctl(spi_device, SPI_IOC_MESSAGE(2), &k) - 1 );
@@ -347,4 +401,145 @@ int lgw_spi_rb(void *spi_target, uint8_t address, uint8_t *data, uint16_t size)
 	}
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Batch of framed accesses, packed in as few SPI messages as possible */
+int lgw_spi_batch(void *spi_target, struct lgw_spi_frame_s *frames, uint16_t nb_frames) {
+	int spi_device;
+	int burst_chunk;
+	uint8_t command[BATCH_XFER_MAX / 2];
+	struct spi_ioc_transfer k[BATCH_XFER_MAX];
+	int nb_xfer = 0; /* number of transfers in the pending message */
+	int msg_size = 0; /* number of bytes in the pending message */
+	int byte_expected = 0;
+	int byte_transfered = 0;
+	int chunk_size, offset;
+	int a, i;
+	
+	/* check input parameters */
+	CHECK_NULL(spi_target);
+	CHECK_NULL(frames);
+	
+	spi_device = ((struct native_spi_s *)spi_target)->fd; /* must check that spi_target is not null beforehand */
+	burst_chunk = ((struct native_spi_s *)spi_target)->chunk_size;
+	
+	for (i=0; i<nb_frames; ++i) {
+		CHECK_NULL(frames[i].data);
+		if (frames[i].size == 0) {
+			DEBUG_MSG("ERROR: BURST OF NULL LENGTH\n");
+			return LGW_SPI_ERROR;
+		}
+		if ((frames[i].address & 0x80) != 0) {
+			DEBUG_MSG("WARNING: SPI address > 127\n");
+		}
+	}
+	
+	memset(&k, 0, sizeof(k)); /* clear k */
+	for (i=0; i<nb_frames; ++i) {
+		/* frames longer than a burst chunk are split, like in burst functions */
+		for (offset = 0; offset < frames[i].size; offset += chunk_size) {
+			chunk_size = frames[i].size - offset;
+			chunk_size = (chunk_size < burst_chunk) ? chunk_size : burst_chunk;
+			
+			/* send the pending message if that chunk does not fit in it, nothing more if it fails (it may hold the page switch) */
+			if ((nb_xfer == BATCH_XFER_MAX) || ((nb_xfer > 0) && (msg_size + 1 + chunk_size > burst_chunk + 1))) {
+				k[nb_xfer - 1].cs_change = 0; /* release chip select at the end of the message */
+				a = ioctl(spi_device, SPI_IOC_MESSAGE(nb_xfer), &k);
+				DEBUG_PRINTF("BATCH: %d transfers, %d bytes, %d transferred\n", nb_xfer, msg_size, a);
+				if (a != msg_size) {
+					DEBUG_PRINTF("ERROR: SPI BATCH FAILURE AFTER %d OF %d BYTES\n", byte_transfered, byte_expected);
+					return LGW_SPI_ERROR;
+				}
+				byte_transfered += a;
+				memset(&k, 0, sizeof(k));
+				nb_xfer = 0;
+				msg_size = 0;
+			}
+			
+			/* command byte, then data, chip select toggled after the data */
+			command[nb_xfer / 2] = (frames[i].write ? WRITE_ACCESS : READ_ACCESS) | (frames[i].address & 0x7F);
+			k[nb_xfer].tx_buf = (unsigned long)&command[nb_xfer / 2];
+			k[nb_xfer].len = 1;
+			k[nb_xfer].cs_change = 0;
+			if (frames[i].write) {
+				k[nb_xfer + 1].tx_buf = (unsigned long)(frames[i].data + offset);
+			} else {
+				k[nb_xfer + 1].rx_buf = (unsigned long)(frames[i].data + offset);
+			}
+			k[nb_xfer + 1].len = chunk_size;
+			k[nb_xfer + 1].cs_change = 1;
+			nb_xfer += 2;
+			msg_size += 1 + chunk_size;
+			byte_expected += 1 + chunk_size;
+		}
+	}
+	
+	/* send the last message */
+	if (nb_xfer > 0) {
+		k[nb_xfer - 1].cs_change = 0;
+		a = ioctl(spi_device, SPI_IOC_MESSAGE(nb_xfer), &k);
+		byte_transfered += (a > 0) ? a : 0;
+		DEBUG_PRINTF("BATCH: %d transfers, %d bytes, %d transferred\n", nb_xfer, msg_size, a);
+	}
+	
+	/* determine return code */
+	if (byte_transfered != byte_expected) {
+		DEBUG_MSG("ERROR: SPI BATCH FAILURE\n");
+		return LGW_SPI_ERROR;
+	} else {
+		DEBUG_MSG("Note: SPI batch success\n");
+		return LGW_SPI_SUCCESS;
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Runtime parameters of the link */
+int lgw_spi_get_conf(void *spi_target, struct lgw_spi_conf_s *conf) {
+	struct native_spi_s *spi = spi_target;
+	
+	/* check input parameters */
+	CHECK_NULL(spi_target);
+	CHECK_NULL(conf);
+	
+	conf->speed_hz = spi->speed_hz;
+	conf->chunk_size = spi->chunk_size;
+	conf->chunk_max = spi->chunk_max;
+	return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Change the clock and burst chunk size */
+int lgw_spi_set_conf(void *spi_target, const struct lgw_spi_conf_s *conf) {
+	struct native_spi_s *spi = spi_target;
+	uint32_t speed;
+	int a, b;
+	
+	/* check input parameters */
+	CHECK_NULL(spi_target);
+	CHECK_NULL(conf);
+	if (conf->chunk_size > spi->chunk_max) {
+		DEBUG_PRINTF("ERROR: CHUNK SIZE %u DOES NOT FIT IN SPIDEV BUFFER (MAX %u)\n", conf->chunk_size, spi->chunk_max);
+		return LGW_SPI_ERROR;
+	}
+	
+	/* max clk of the device, also used by the transfers that do not set it */
+	if (conf->speed_hz != 0) {
+		speed = conf->speed_hz;
+		a = ioctl(spi->fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed);
+		b = ioctl(spi->fd, SPI_IOC_RD_MAX_SPEED_HZ, &speed);
+		if ((a < 0) || (b < 0)) {
+			DEBUG_MSG("ERROR: SPI PORT FAIL TO SET MAX SPEED\n");
+			return LGW_SPI_ERROR;
+		}
+		spi->speed_hz = conf->speed_hz;
+	}
+	if (conf->chunk_size != 0) {
+		spi->chunk_size = conf->chunk_size;
+	}
+	DEBUG_PRINTF("Note: SPI clock %u Hz, burst chunk %u bytes\n", spi->speed_hz, spi->chunk_size);
+	return LGW_SPI_SUCCESS;
+}
+
 /* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,860 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	In-process emulation of the LoRa concentrator register file, behind the
+	same functions as the SPI physical layers.
+	Models the 4 register pages, the RX FIFO and data buffer, the TX data
+	buffer, the MCU program RAM, the SPI masters to the radios and the AGC MCU
+	status handshakes used by lgw_start. No hardware needed.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+	#define _XOPEN_SOURCE 600
+#else
+	#define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+#include <stdio.h>		/* printf fprintf */
+#include <stdlib.h>		/* calloc free */
+#include <string.h>		/* memset memcpy strncmp */
+#include <time.h>		/* clock_gettime */
+#include <pthread.h>	/* mutex, packets can be injected from another thread */
+#include <unistd.h>		/* write */
+
+#include "loragw_spi.h"
+#include "loragw_sim.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#if DEBUG_SPI == 1
+	#define DEBUG_MSG(str)				fprintf(stderr, str)
+	#define DEBUG_PRINTF(fmt, args...)	fprintf(stderr,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+	#define CHECK_NULL(a)				if(a==NULL){fprintf(stderr,"%s:%d: ERROR: NULL POINTER AS ARGUMENT\n", __FUNCTION__, __LINE__);return LGW_SPI_ERROR;}
+#else
+	#define DEBUG_MSG(str)
+	#define DEBUG_PRINTF(fmt, args...)
+	#define CHECK_NULL(a)				if(a==NULL){return LGW_SPI_ERROR;}
+#endif
+
+#define IS_COMMON(addr)		(((addr) < 33) || ((addr) > 124))	/* registers present on all pages */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define SIM_RX_BUF_SIZE		4096	/* size of the emulated RX data buffer */
+#define SIM_RX_METADATA_NB	16		/* metadata bytes appended to each packet */
+#define SIM_CAL_RX_US		20000	/* emulated duration of the RX calibration of a radio */
+#define SIM_CAL_TX_US		200000	/* emulated duration of the TX calibration of a radio */
+
+/* register addresses with a side effect in the emulator */
+#define ADDR_PAGE_RESET		0		/* all pages */
+#define ADDR_RX_BUF_ADDR	2
+#define ADDR_RX_BUF_DATA	4
+#define ADDR_TX_BUF_ADDR	5
+#define ADDR_TX_BUF_DATA	6
+#define ADDR_CAPTURE_DATA	8
+#define ADDR_PROM_ADDR		9
+#define ADDR_PROM_DATA		10
+#define ADDR_FIFO_NUM		11
+#define ADDR_FIFO_PTR		12
+#define ADDR_FIFO_STATUS	14
+#define ADDR_FIFO_SIZE		15
+#define ADDR_AGC_STATUS		32
+#define ADDR_RADIO_SELECT	35		/* page 0 */
+#define ADDR_MCU_RST		106		/* page 0 */
+#define ADDR_TX_TRIG		33		/* page 1 */
+#define ADDR_RADIO_A_DATA	33		/* page 2 */
+#define ADDR_RADIO_A_RB		34		/* page 2 */
+#define ADDR_RADIO_A_ADDR	35		/* page 2 */
+#define ADDR_RADIO_A_CS		37		/* page 2 */
+#define ADDR_RADIO_B_DATA	38		/* page 2 */
+#define ADDR_RADIO_B_RB		39		/* page 2 */
+#define ADDR_RADIO_B_ADDR	40		/* page 2 */
+#define ADDR_RADIO_B_CS		42		/* page 2 */
+#define ADDR_ARB_RAM_DATA	64		/* page 2 */
+#define ADDR_AGC_RAM_DATA	65		/* page 2 */
+#define ADDR_TIMESTAMP		70		/* page 2 */
+#define ADDR_ARB_RAM_ADDR	80		/* page 2 */
+#define ADDR_AGC_RAM_ADDR	81		/* page 2 */
+
+/* AGC firmware commands, as sent by the HAL through RADIO_SELECT */
+#define AGC_CMD_WAIT		16
+#define AGC_CMD_ABORT		17
+#define AGC_LUT_SIZE		16
+
+#define SIM_DEFAULT_NAME	"sim"	/* name of the emulator open by lgw_spi_open */
+#define SIM_SPI_SPEED		8000000	/* clock reported after opening, same as native SPI */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+enum sim_agc_e {
+	AGC_IDLE,		/* MCU in reset, or running the calibration firmware */
+	AGC_LUT,		/* AGC firmware waiting for TX gain LUT entries */
+	AGC_CHAN,		/* AGC firmware waiting for the chan_select option */
+	AGC_FINAL,		/* AGC firmware waiting for the final RADIO_SELECT value */
+	AGC_RUN			/* AGC firmware initialized */
+};
+
+struct sim_fifo_s {
+	uint16_t	addr;		/* start of the packet in the RX data buffer */
+	uint8_t		size;		/* payload size */
+	uint8_t		status;		/* FIFO status code */
+};
+
+struct sim_dev_s {
+	pthread_mutex_t	mx;
+	char		name[32];		/* name given at opening, see lgw_sim_select */
+	uint8_t		regs[4][128];	/* register bytes, bytes common to all pages are stored in page 0 */
+	uint8_t		page;			/* selected page */
+	uint8_t		rx_buf[SIM_RX_BUF_SIZE];
+	uint16_t	rx_ptr;			/* RX data buffer read pointer */
+	uint16_t	rx_wr;			/* RX data buffer write pointer */
+	uint16_t	rx_used;		/* bytes of the RX data buffer used by packets in the FIFO */
+	struct sim_fifo_s fifo[LGW_SIM_FIFO_DEPTH];
+	int			fifo_head;
+	int			fifo_nb;
+	uint8_t		tx_buf[LGW_SIM_TX_BUF_SIZE];
+	uint16_t	tx_ptr;			/* TX data buffer write pointer */
+	uint16_t	tx_max;			/* highest TX data buffer byte written */
+	struct lgw_sim_tx_s last_tx;
+	bool		tx_done;
+	uint16_t	prom_ptr;		/* MCU program RAM pointer */
+	uint8_t		arb_ram[256];
+	uint8_t		agc_ram[256];
+	uint8_t		radio[2][128];	/* registers of the two radios */
+	uint8_t		agc_status;
+	enum sim_agc_e agc_state;
+	bool		agc_wait;		/* AGC_CMD_WAIT received, next RADIO_SELECT write is a parameter */
+	int			agc_lut;		/* number of TX gain LUT entries received */
+	struct timespec t0;			/* time origin of the emulated timestamp counter */
+	uint32_t	ts_latch;		/* timestamp latched on the first byte read */
+	uint32_t	cal_end;		/* counter value at the end of the running calibration */
+	struct lgw_sim_stats_s stats;
+	uint32_t	speed_hz;		/* SPI clock set by the host, see lgw_sim_set_spi_limit */
+	uint16_t	chunk_size;		/* max data bytes per submission */
+};
+
+struct sim_dflt_s {
+	int8_t		page;
+	uint8_t		addr;
+	uint8_t		val;
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+/* non-null register bytes after reset, built from the register defaults */
+static const struct sim_dflt_s sim_dflt[] = {
+	{-1,1,103}, {-1,17,3}, {-1,126,1}, {-1,127,1}, {0,33,2}, {0,34,7}, {0,35,240}, {0,36,128},
+	{0,37,30}, {0,38,128}, {0,39,31}, {0,40,128}, {0,42,128}, {0,43,1}, {0,44,128}, {0,45,30},
+	{0,46,128}, {0,47,31}, {0,48,128}, {0,50,128}, {0,51,1}, {0,64,14}, {0,73,126}, {0,74,68},
+	{0,75,68}, {0,76,68}, {0,77,4}, {0,78,84}, {0,83,252}, {0,84,15}, {0,85,7}, {0,89,3},
+	{0,92,29}, {0,93,9}, {0,94,6}, {0,95,33}, {0,96,10}, {0,98,3}, {0,99,40}, {0,101,255},
+	{0,102,1}, {0,104,120}, {0,105,14}, {0,106,3}, {0,107,1}, {0,108,32}, {0,109,100}, {0,110,100},
+	{0,111,7}, {0,112,5}, {0,113,8}, {1,36,33}, {1,42,148}, {1,45,1}, {1,46,33}, {1,47,10},
+	{1,49,3}, {1,50,10}, {1,51,3}, {1,52,29}, {1,53,36}, {1,56,6}, {1,58,8}, {1,59,56},
+	{1,60,23}, {1,61,255}, {1,62,128}, {1,77,9}, {1,82,1}, {2,43,4}, {2,45,66}, {2,46,66},
+	{2,89,2}
+};
+
+static pthread_mutex_t mx_sim_devs = PTHREAD_MUTEX_INITIALIZER; /* protects the emulator table and selection */
+static struct sim_dev_s *sim_devs[LGW_SIM_DEV_MAX]; /* emulator instances open */
+static struct sim_dev_s *sim_dev = NULL; /* emulator instance targeted by the lgw_sim_ functions */
+static int sim_irq_fd = -1; /* eventfd standing for the DGPIO0 'packets waiting' line */
+static uint32_t sim_spi_limit = 0; /* SPI clock above which the data read is corrupted, 0 for none */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+void sim_reset(struct sim_dev_s *d);
+
+uint8_t *sim_reg(struct sim_dev_s *d, uint8_t addr);
+
+uint32_t sim_counter(struct sim_dev_s *d);
+
+uint8_t sim_read(struct sim_dev_s *d, uint8_t addr);
+
+void sim_write(struct sim_dev_s *d, uint8_t addr, uint8_t data);
+
+void sim_access(struct sim_dev_s *d, uint8_t address, bool write, uint8_t *data, uint16_t size);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* soft reset: register defaults, empty buffers, MCUs in reset */
+void sim_reset(struct sim_dev_s *d) {
+	unsigned i;
+	
+	memset(d->regs, 0, sizeof(d->regs));
+	for (i=0; i<(sizeof(sim_dflt)/sizeof(sim_dflt[0])); ++i) {
+		d->regs[(sim_dflt[i].page < 0) ? 0 : sim_dflt[i].page][sim_dflt[i].addr] = sim_dflt[i].val;
+	}
+	d->page = 0;
+	d->rx_ptr = 0;
+	d->rx_wr = 0;
+	d->rx_used = 0;
+	d->fifo_head = 0;
+	d->fifo_nb = 0;
+	d->tx_ptr = 0;
+	d->tx_max = 0;
+	d->prom_ptr = 0;
+	d->agc_status = 0;
+	d->agc_state = AGC_IDLE;
+	d->agc_wait = false;
+	d->agc_lut = 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* storage of a register byte in the selected page */
+uint8_t *sim_reg(struct sim_dev_s *d, uint8_t addr) {
+	return IS_COMMON(addr) ? &(d->regs[0][addr]) : &(d->regs[d->page][addr]);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* current value of the free-running 1 MHz timestamp counter */
+uint32_t sim_counter(struct sim_dev_s *d) {
+	struct timespec t;
+	
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint32_t)((t.tv_sec - d->t0.tv_sec) * 1000000 + (t.tv_nsec - d->t0.tv_nsec) / 1000);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* one byte read, with the side effects of the hardware */
+uint8_t sim_read(struct sim_dev_s *d, uint8_t addr) {
+	struct sim_fifo_s *f = &(d->fifo[d->fifo_head]);
+	uint8_t v;
+	
+	switch (addr) {
+		case ADDR_PAGE_RESET:
+			return d->page;
+		case ADDR_RX_BUF_DATA:
+			v = d->rx_buf[d->rx_ptr];
+			d->rx_ptr = (d->rx_ptr + 1) % SIM_RX_BUF_SIZE;
+			return v;
+		case ADDR_TX_BUF_DATA:
+			v = d->tx_buf[d->tx_ptr];
+			d->tx_ptr = (d->tx_ptr + 1) % LGW_SIM_TX_BUF_SIZE;
+			return v;
+		case ADDR_PROM_DATA:
+			++(d->prom_ptr);
+			return 0;
+		case ADDR_FIFO_NUM:
+			return (uint8_t)d->fifo_nb;
+		case ADDR_FIFO_PTR:
+			return (d->fifo_nb > 0) ? (uint8_t)(0xFF & f->addr) : 0;
+		case ADDR_FIFO_PTR + 1:
+			return (d->fifo_nb > 0) ? (uint8_t)(f->addr >> 8) : 0;
+		case ADDR_FIFO_STATUS:
+			return (d->fifo_nb > 0) ? f->status : 0;
+		case ADDR_FIFO_SIZE:
+			return (d->fifo_nb > 0) ? f->size : 0;
+		case ADDR_AGC_STATUS:
+			if ((d->agc_status == 0x7F) && ((int32_t)(sim_counter(d) - d->cal_end) >= 0)) {
+				d->agc_status = 0xFF; /* calibration finished */
+			}
+			return d->agc_status;
+	}
+	if (d->page == 2) {
+		switch (addr) {
+			case ADDR_ARB_RAM_DATA:
+				return d->arb_ram[d->regs[2][ADDR_ARB_RAM_ADDR]];
+			case ADDR_AGC_RAM_DATA:
+				return d->agc_ram[d->regs[2][ADDR_AGC_RAM_ADDR]];
+			case ADDR_TIMESTAMP:
+				/* free-running 1 MHz counter, latched when the LSB is read */
+				d->ts_latch = sim_counter(d);
+				return (uint8_t)(0xFF & d->ts_latch);
+			case ADDR_TIMESTAMP + 1:
+			case ADDR_TIMESTAMP + 2:
+			case ADDR_TIMESTAMP + 3:
+				return (uint8_t)(0xFF & (d->ts_latch >> (8 * (addr - ADDR_TIMESTAMP))));
+		}
+	}
+	return *sim_reg(d, addr);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* one byte write, with the side effects of the hardware */
+void sim_write(struct sim_dev_s *d, uint8_t addr, uint8_t data) {
+	uint8_t old = *sim_reg(d, addr);
+	int ch;
+	uint8_t *r;
+	
+	switch (addr) {
+		case ADDR_PAGE_RESET:
+			if ((data & 0x80) != 0) {
+				sim_reset(d);
+			} else {
+				d->page = data & 0x03;
+				++(d->stats.nb_page_switch);
+			}
+			return;
+		case ADDR_RX_BUF_ADDR:
+		case ADDR_RX_BUF_ADDR + 1:
+			d->regs[0][addr] = data;
+			d->rx_ptr = (d->regs[0][ADDR_RX_BUF_ADDR] + (d->regs[0][ADDR_RX_BUF_ADDR + 1] << 8)) % SIM_RX_BUF_SIZE;
+			return;
+		case ADDR_RX_BUF_DATA:
+			/* writable by the host too, the SPI stress tests use it */
+			d->rx_buf[d->rx_ptr] = data;
+			d->rx_ptr = (d->rx_ptr + 1) % SIM_RX_BUF_SIZE;
+			return;
+		case ADDR_TX_BUF_ADDR:
+			d->regs[0][addr] = data;
+			d->tx_ptr = data;
+			d->tx_max = data;
+			return;
+		case ADDR_TX_BUF_DATA:
+			d->tx_buf[d->tx_ptr] = data;
+			d->tx_ptr = (d->tx_ptr + 1) % LGW_SIM_TX_BUF_SIZE;
+			d->tx_max = (d->tx_ptr > d->tx_max) ? d->tx_ptr : d->tx_max;
+			return;
+		case ADDR_PROM_ADDR:
+			d->regs[0][addr] = data;
+			d->prom_ptr = data;
+			return;
+		case ADDR_PROM_DATA:
+			++(d->prom_ptr);
+			return;
+		case ADDR_FIFO_NUM:
+			/* any write advances the FIFO */
+			if (d->fifo_nb > 0) {
+				d->rx_used -= d->fifo[d->fifo_head].size + SIM_RX_METADATA_NB;
+				d->fifo_head = (d->fifo_head + 1) % LGW_SIM_FIFO_DEPTH;
+				--(d->fifo_nb);
+				++(d->stats.nb_rx_fetched);
+				if (d->fifo_nb > 0) {
+					d->rx_ptr = d->fifo[d->fifo_head].addr;
+				}
+			}
+			return;
+		case ADDR_FIFO_PTR:
+		case ADDR_FIFO_PTR + 1:
+		case ADDR_FIFO_STATUS:
+		case ADDR_FIFO_SIZE:
+		case ADDR_AGC_STATUS:
+			return; /* read-only */
+	}
+	
+	*sim_reg(d, addr) = data;
+	
+	if (d->page == 0) {
+		if ((addr == ADDR_MCU_RST) && ((old & 0x02) != 0) && ((data & 0x02) == 0)) {
+			/* AGC MCU released from reset */
+			if (d->regs[0][ADDR_RADIO_SELECT] != 0) {
+				/* calibration firmware: all calibrations ok, finished after a time depending on the command */
+				d->agc_status = 0x7F;
+				d->agc_state = AGC_IDLE;
+				r = d->regs[0];
+				d->cal_end = sim_counter(d) + SIM_CAL_RX_US * (((r[ADDR_RADIO_SELECT] & 0x01) != 0) + ((r[ADDR_RADIO_SELECT] & 0x02) != 0)) + SIM_CAL_TX_US * (((r[ADDR_RADIO_SELECT] & 0x04) != 0) + ((r[ADDR_RADIO_SELECT] & 0x08) != 0));
+			} else {
+				/* AGC firmware: ready for the initialization handshakes */
+				d->agc_status = 0x20;
+				d->agc_state = AGC_LUT;
+				d->agc_wait = false;
+				d->agc_lut = 0;
+			}
+		} else if ((addr == ADDR_MCU_RST) && ((data & 0x02) != 0)) {
+			d->agc_state = AGC_IDLE;
+		} else if ((addr == ADDR_RADIO_SELECT) && (d->agc_state != AGC_IDLE) && (d->agc_state != AGC_RUN)) {
+			if (d->agc_wait == false) {
+				d->agc_wait = (data == AGC_CMD_WAIT);
+			} else {
+				d->agc_wait = false;
+				switch (d->agc_state) {
+					case AGC_LUT:
+						if (data == AGC_CMD_ABORT) {
+							d->agc_status = 0x30;
+							d->agc_state = AGC_CHAN;
+						} else {
+							d->agc_status = 0x30 + d->agc_lut;
+							if (++(d->agc_lut) == AGC_LUT_SIZE) {
+								d->agc_state = AGC_CHAN;
+							}
+						}
+						break;
+					case AGC_CHAN:
+						d->agc_state = AGC_FINAL;
+						break;
+					default:
+						d->agc_status = 0x40;
+						d->agc_state = AGC_RUN;
+				}
+			}
+		}
+	} else if (d->page == 1) {
+		if ((addr == ADDR_TX_TRIG) && ((data & ~old & 0x07) != 0)) {
+			/* TX triggered, keep a copy of the TX data buffer */
+			d->last_tx.trig = data & ~old & 0x07;
+			d->last_tx.count_us = sim_counter(d);
+			d->last_tx.size = d->tx_max;
+			memcpy(d->last_tx.data, d->tx_buf, d->tx_max);
+			d->tx_done = true;
+			++(d->stats.nb_tx);
+		}
+	} else if (d->page == 2) {
+		if (((addr == ADDR_RADIO_A_CS) || (addr == ADDR_RADIO_B_CS)) && ((old & 0x01) == 0) && ((data & 0x01) != 0)) {
+			/* SPI master transaction with a radio, on CS rising edge */
+			ch = (addr == ADDR_RADIO_A_CS) ? 0 : 1;
+			r = d->regs[2];
+			if ((r[(ch == 0) ? ADDR_RADIO_A_ADDR : ADDR_RADIO_B_ADDR] & 0x80) != 0) {
+				d->radio[ch][r[(ch == 0) ? ADDR_RADIO_A_ADDR : ADDR_RADIO_B_ADDR] & 0x7F] = r[(ch == 0) ? ADDR_RADIO_A_DATA : ADDR_RADIO_B_DATA];
+			} else {
+				r[(ch == 0) ? ADDR_RADIO_A_RB : ADDR_RADIO_B_RB] = d->radio[ch][r[(ch == 0) ? ADDR_RADIO_A_ADDR : ADDR_RADIO_B_ADDR] & 0x7F];
+			}
+		} else if (addr == ADDR_ARB_RAM_DATA) {
+			d->arb_ram[d->regs[2][ADDR_ARB_RAM_ADDR]] = data;
+		} else if (addr == ADDR_AGC_RAM_DATA) {
+			d->agc_ram[d->regs[2][ADDR_AGC_RAM_ADDR]] = data;
+		}
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* one chip-select framed access, data ports do not increment the address */
+void sim_access(struct sim_dev_s *d, uint8_t address, bool write, uint8_t *data, uint16_t size) {
+	uint8_t a = address & 0x7F;
+	bool port;
+	int i;
+	
+	port = (a == ADDR_RX_BUF_DATA) || (a == ADDR_TX_BUF_DATA) || (a == ADDR_CAPTURE_DATA) || (a == ADDR_PROM_DATA);
+	port = port || ((d->page == 2) && ((a == ADDR_ARB_RAM_DATA) || (a == ADDR_AGC_RAM_DATA)));
+	for (i=0; i<size; ++i) {
+		if (write) {
+			sim_write(d, a, data[i]);
+		} else {
+			data[i] = sim_read(d, a);
+			if ((sim_spi_limit != 0) && (d->speed_hz > sim_spi_limit) && ((i % 7) == 6)) {
+				data[i] ^= 0x01; /* sampled too late, one bit of a few bytes is wrong */
+			}
+		}
+		if (!port) {
+			a = (a + 1) & 0x7F;
+		}
+	}
+	
+	++(d->stats.nb_frame);
+	if (write) {
+		++(d->stats.nb_write);
+	} else {
+		++(d->stats.nb_read);
+	}
+	d->stats.nb_byte += 1 + size;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+/* SPI initialization and configuration, default emulator */
+int lgw_spi_open(void **spi_target_ptr) {
+	return lgw_spi_open_path(spi_target_ptr, NULL);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* SPI initialization and configuration, emulator selected by name */
+int lgw_spi_open_path(void **spi_target_ptr, const char *dev_path) {
+	struct sim_dev_s *d;
+	const char *name = (dev_path != NULL) ? dev_path : SIM_DEFAULT_NAME;
+	int i, slot = -1;
+	
+	/* check input variables */
+	CHECK_NULL(spi_target_ptr); /* cannot be null, must point on a void pointer (*spi_target_ptr can be null) */
+	
+	pthread_mutex_lock(&mx_sim_devs);
+	for (i=0; i<LGW_SIM_DEV_MAX; ++i) {
+		if (sim_devs[i] == NULL) {
+			slot = (slot < 0) ? i : slot;
+		} else if (strncmp(sim_devs[i]->name, name, sizeof(sim_devs[i]->name)) == 0) {
+			pthread_mutex_unlock(&mx_sim_devs);
+			DEBUG_MSG("ERROR: EMULATOR ALREADY OPEN\n");
+			return LGW_SPI_ERROR;
+		}
+	}
+	if (slot < 0) {
+		pthread_mutex_unlock(&mx_sim_devs);
+		DEBUG_MSG("ERROR: TOO MANY EMULATORS OPEN\n");
+		return LGW_SPI_ERROR;
+	}
+	
+	/* allocate memory for the emulator state */
+	d = calloc(1, sizeof(struct sim_dev_s));
+	if (d == NULL) {
+		pthread_mutex_unlock(&mx_sim_devs);
+		DEBUG_MSG("ERROR: MALLOC FAIL\n");
+		return LGW_SPI_ERROR;
+	}
+	pthread_mutex_init(&(d->mx), NULL);
+	strncpy(d->name, name, sizeof(d->name) - 1);
+	sim_reset(d);
+	d->radio[0][0x07] = 0x21; /* radio version */
+	d->radio[1][0x07] = 0x21;
+	d->radio[0][0x11] = 0x03; /* PLL locked */
+	d->radio[1][0x11] = 0x03;
+	clock_gettime(CLOCK_MONOTONIC, &(d->t0));
+	d->speed_hz = SIM_SPI_SPEED;
+	d->chunk_size = LGW_BURST_CHUNK;
+	
+	sim_devs[slot] = d;
+	sim_dev = d;
+	pthread_mutex_unlock(&mx_sim_devs);
+	*spi_target_ptr = (void *)d;
+	DEBUG_MSG("Note: concentrator emulator opened\n");
+	return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* SPI release */
+int lgw_spi_close(void *spi_target) {
+	int i;
+	
+	/* check input variables */
+	CHECK_NULL(spi_target);
+	
+	pthread_mutex_lock(&mx_sim_devs);
+	for (i=0; i<LGW_SIM_DEV_MAX; ++i) {
+		if (sim_devs[i] == (struct sim_dev_s *)spi_target) {
+			sim_devs[i] = NULL;
+		}
+	}
+	if (spi_target == (void *)sim_dev) {
+		sim_dev = NULL;
+	}
+	pthread_mutex_unlock(&mx_sim_devs);
+	pthread_mutex_destroy(&(((struct sim_dev_s *)spi_target)->mx));
+	free(spi_target);
+	DEBUG_MSG("Note: concentrator emulator closed\n");
+	return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Simple write */
+int lgw_spi_w(void *spi_target, uint8_t address, uint8_t data) {
+	struct sim_dev_s *d = (struct sim_dev_s *)spi_target;
+	
+	/* check input variables */
+	CHECK_NULL(spi_target);
+	if ((address & 0x80) != 0) {
+		DEBUG_MSG("WARNING: SPI address > 127\n");
+	}
+	
+	pthread_mutex_lock(&(d->mx));
+	++(d->stats.nb_submit);
+	sim_access(d, address, true, &data, 1);
+	pthread_mutex_unlock(&(d->mx));
+	return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Simple read */
+int lgw_spi_r(void *spi_target, uint8_t address, uint8_t *data) {
+	struct sim_dev_s *d = (struct sim_dev_s *)spi_target;
+	
+	/* check input variables */
+	CHECK_NULL(spi_target);
+	if ((address & 0x80) != 0) {
+		DEBUG_MSG("WARNING: SPI address > 127\n");
+	}
+	CHECK_NULL(data);
+	
+	pthread_mutex_lock(&(d->mx));
+	++(d->stats.nb_submit);
+	sim_access(d, address, false, data, 1);
+	pthread_mutex_unlock(&(d->mx));
+	return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Burst (multiple-byte) write */
+int lgw_spi_wb(void *spi_target, uint8_t address, uint8_t *data, uint16_t size) {
+	struct sim_dev_s *d = (struct sim_dev_s *)spi_target;
+	int offset, chunk_size;
+	
+	/* check input parameters */
+	CHECK_NULL(spi_target);
+	if ((address & 0x80) != 0) {
+		DEBUG_MSG("WARNING: SPI address > 127\n");
+	}
+	CHECK_NULL(data);
+	if (size == 0) {
+		DEBUG_MSG("ERROR: BURST OF NULL LENGTH\n");
+		return LGW_SPI_ERROR;
+	}
+	
+	/* same chunking as the hardware physical layers, one submission per chunk */
+	pthread_mutex_lock(&(d->mx));
+	for (offset = 0; offset < size; offset += chunk_size) {
+		chunk_size = ((size - offset) < d->chunk_size) ? (size - offset) : d->chunk_size;
+		++(d->stats.nb_submit);
+		sim_access(d, address, true, data + offset, chunk_size);
+	}
+	pthread_mutex_unlock(&(d->mx));
+	return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Burst (multiple-byte) read */
+int lgw_spi_rb(void *spi_target, uint8_t address, uint8_t *data, uint16_t size) {
+	struct sim_dev_s *d = (struct sim_dev_s *)spi_target;
+	int offset, chunk_size;
+	
+	/* check input parameters */
+	CHECK_NULL(spi_target);
+	if ((address & 0x80) != 0) {
+		DEBUG_MSG("WARNING: SPI address > 127\n");
+	}
+	CHECK_NULL(data);
+	if (size == 0) {
+		DEBUG_MSG("ERROR: BURST OF NULL LENGTH\n");
+		return LGW_SPI_ERROR;
+	}
+	
+	pthread_mutex_lock(&(d->mx));
+	for (offset = 0; offset < size; offset += chunk_size) {
+		chunk_size = ((size - offset) < d->chunk_size) ? (size - offset) : d->chunk_size;
+		++(d->stats.nb_submit);
+		sim_access(d, address, false, data + offset, chunk_size);
+	}
+	pthread_mutex_unlock(&(d->mx));
+	return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Batch of framed accesses, counted as a single submission */
+int lgw_spi_batch(void *spi_target, struct lgw_spi_frame_s *frames, uint16_t nb_frames) {
+	struct sim_dev_s *d = (struct sim_dev_s *)spi_target;
+	int i;
+	
+	/* check input parameters */
+	CHECK_NULL(spi_target);
+	CHECK_NULL(frames);
+	for (i=0; i<nb_frames; ++i) {
+		CHECK_NULL(frames[i].data);
+		if (frames[i].size == 0) {
+			DEBUG_MSG("ERROR: BURST OF NULL LENGTH\n");
+			return LGW_SPI_ERROR;
+		}
+	}
+	
+	pthread_mutex_lock(&(d->mx));
+	++(d->stats.nb_submit);
+	for (i=0; i<nb_frames; ++i) {
+		sim_access(d, frames[i].address, frames[i].write, frames[i].data, frames[i].size);
+	}
+	pthread_mutex_unlock(&(d->mx));
+	return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Runtime parameters of the link, only the burst chunk size has an effect */
+int lgw_spi_get_conf(void *spi_target, struct lgw_spi_conf_s *conf) {
+	struct sim_dev_s *d = (struct sim_dev_s *)spi_target;
+	
+	/* check input parameters */
+	CHECK_NULL(spi_target);
+	CHECK_NULL(conf);
+	
+	pthread_mutex_lock(&(d->mx));
+	conf->speed_hz = d->speed_hz;
+	conf->chunk_size = d->chunk_size;
+	conf->chunk_max = 0xFFFF;
+	pthread_mutex_unlock(&(d->mx));
+	return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Change the clock and burst chunk size */
+int lgw_spi_set_conf(void *spi_target, const struct lgw_spi_conf_s *conf) {
+	struct sim_dev_s *d = (struct sim_dev_s *)spi_target;
+	
+	/* check input parameters */
+	CHECK_NULL(spi_target);
+	CHECK_NULL(conf);
+	
+	pthread_mutex_lock(&(d->mx));
+	if (conf->speed_hz != 0) {
+		d->speed_hz = conf->speed_hz;
+	}
+	if (conf->chunk_size != 0) {
+		d->chunk_size = conf->chunk_size;
+	}
+	pthread_mutex_unlock(&(d->mx));
+	return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Select the emulator targeted by the lgw_sim_ functions */
+int lgw_sim_select(const char *name) {
+	int i;
+	
+	if (name == NULL) {
+		name = SIM_DEFAULT_NAME;
+	}
+	pthread_mutex_lock(&mx_sim_devs);
+	for (i=0; i<LGW_SIM_DEV_MAX; ++i) {
+		if ((sim_devs[i] != NULL) && (strncmp(sim_devs[i]->name, name, sizeof(sim_devs[i]->name)) == 0)) {
+			sim_dev = sim_devs[i];
+			pthread_mutex_unlock(&mx_sim_devs);
+			return LGW_SIM_SUCCESS;
+		}
+	}
+	pthread_mutex_unlock(&mx_sim_devs);
+	return LGW_SIM_ERROR;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Push a synthetic packet in the RX FIFO */
+int lgw_sim_inject_rx(const struct lgw_sim_rx_s *pkt) {
+	struct sim_dev_s *d = sim_dev;
+	struct sim_fifo_s *f;
+	uint8_t meta[SIM_RX_METADATA_NB];
+	uint64_t one = 1; /* eventfd increment */
+	int i;
+	
+	if ((d == NULL) || (pkt == NULL)) {
+		return LGW_SIM_ERROR;
+	}
+	
+	/* metadata appended to the payload, as read by lgw_receive */
+	memset(meta, 0, sizeof(meta));
+	meta[0] = pkt->if_chain;
+	meta[1] = (uint8_t)(((pkt->sf & 0x0F) << 4) | ((pkt->cr & 0x07) << 1));
+	meta[2] = (uint8_t)pkt->snr;
+	meta[3] = (uint8_t)pkt->snr_min;
+	meta[4] = (uint8_t)pkt->snr_max;
+	meta[5] = pkt->rssi;
+	meta[6] = (uint8_t)(0xFF & pkt->count_us);
+	meta[7] = (uint8_t)(0xFF & (pkt->count_us >> 8));
+	meta[8] = (uint8_t)(0xFF & (pkt->count_us >> 16));
+	meta[9] = (uint8_t)(0xFF & (pkt->count_us >> 24));
+	meta[10] = (uint8_t)(0xFF & pkt->crc);
+	meta[11] = (uint8_t)(0xFF & (pkt->crc >> 8));
+	
+	pthread_mutex_lock(&(d->mx));
+	if ((d->fifo_nb == LGW_SIM_FIFO_DEPTH) || ((d->rx_used + pkt->size + SIM_RX_METADATA_NB) > SIM_RX_BUF_SIZE)) {
+		++(d->stats.nb_rx_dropped);
+		pthread_mutex_unlock(&(d->mx));
+		return LGW_SIM_ERROR;
+	}
+	f = &(d->fifo[(d->fifo_head + d->fifo_nb) % LGW_SIM_FIFO_DEPTH]);
+	f->addr = d->rx_wr;
+	f->size = pkt->size;
+	f->status = pkt->status;
+	for (i=0; i<(pkt->size + SIM_RX_METADATA_NB); ++i) {
+		d->rx_buf[d->rx_wr] = (i < pkt->size) ? pkt->payload[i] : meta[i - pkt->size];
+		d->rx_wr = (d->rx_wr + 1) % SIM_RX_BUF_SIZE;
+	}
+	d->rx_used += pkt->size + SIM_RX_METADATA_NB;
+	if (d->fifo_nb == 0) {
+		d->rx_ptr = f->addr; /* data buffer pointer follows the FIFO head */
+		if (sim_irq_fd >= 0) {
+			write(sim_irq_fd, &one, sizeof(one)); /* rising edge of 'packets waiting' */
+		}
+	}
+	++(d->fifo_nb);
+	++(d->stats.nb_rx_injected);
+	pthread_mutex_unlock(&(d->mx));
+	return LGW_SIM_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Signal the FIFO empty -> not empty transitions on an eventfd */
+void lgw_sim_set_irq_fd(int fd) {
+	sim_irq_fd = (fd >= 0) ? fd : -1;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Emulate a board whose SPI link is not reliable above a given clock */
+void lgw_sim_set_spi_limit(uint32_t speed_hz) {
+	sim_spi_limit = speed_hz;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Number of packets waiting in the RX FIFO */
+int lgw_sim_rx_pending(void) {
+	int n;
+	
+	if (sim_dev == NULL) {
+		return LGW_SIM_ERROR;
+	}
+	pthread_mutex_lock(&(sim_dev->mx));
+	n = sim_dev->fifo_nb;
+	pthread_mutex_unlock(&(sim_dev->mx));
+	return n;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Content of the TX data buffer at the last TX trigger */
+int lgw_sim_get_tx(struct lgw_sim_tx_s *tx) {
+	if ((sim_dev == NULL) || (tx == NULL) || (sim_dev->tx_done == false)) {
+		return LGW_SIM_ERROR;
+	}
+	pthread_mutex_lock(&(sim_dev->mx));
+	memcpy(tx, &(sim_dev->last_tx), sizeof(struct lgw_sim_tx_s));
+	pthread_mutex_unlock(&(sim_dev->mx));
+	return LGW_SIM_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* SPI access statistics */
+int lgw_sim_get_stats(struct lgw_sim_stats_s *stats) {
+	if ((sim_dev == NULL) || (stats == NULL)) {
+		return LGW_SIM_ERROR;
+	}
+	pthread_mutex_lock(&(sim_dev->mx));
+	memcpy(stats, &(sim_dev->stats), sizeof(struct lgw_sim_stats_s));
+	pthread_mutex_unlock(&(sim_dev->mx));
+	return LGW_SIM_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_sim_reset_stats(void) {
+	if (sim_dev == NULL) {
+		return;
+	}
+	pthread_mutex_lock(&(sim_dev->mx));
+	memset(&(sim_dev->stats), 0, sizeof(struct lgw_sim_stats_s));
+	pthread_mutex_unlock(&(sim_dev->mx));
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,361 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Just-in-time downlink scheduler: queue of timestamped packets ordered by
+	trigger time, each loaded in the concentrator TX buffer shortly before
+	it must be sent, since the concentrator can only hold one packet.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+	#define _XOPEN_SOURCE 600
+#else
+	#define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+#include <stdio.h>		/* fprintf */
+#include <string.h>		/* memcpy memmove */
+#include <time.h>		/* clock_gettime */
+#include <pthread.h>	/* scheduler thread */
+
+#include "loragw_hal.h"
+#include "loragw_txq.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#if DEBUG_TXQ == 1
+	#define DEBUG_MSG(str)				fprintf(stderr, str)
+	#define DEBUG_PRINTF(fmt, args...)	fprintf(stderr,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+	#define CHECK_NULL(a)				if(a==NULL){fprintf(stderr,"%s:%d: ERROR: NULL POINTER AS ARGUMENT\n", __FUNCTION__, __LINE__);return LGW_TXQ_ERROR;}
+#else
+	#define DEBUG_MSG(str)
+	#define DEBUG_PRINTF(fmt, args...)
+	#define CHECK_NULL(a)				if(a==NULL){return LGW_TXQ_ERROR;}
+#endif
+
+#define TIME_DIFF(a, b)		((int32_t)((uint32_t)(a) - (uint32_t)(b)))	/* a - b, counter roll-over safe */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define TXQ_LEAD_US			20000	/* a packet is loaded when its trigger is closer than that */
+#define TXQ_LEAD_MIN_US		3000	/* below that, a packet cannot be loaded in time (SPI + TX start delay) */
+#define TXQ_WAKE_US			2000	/* scheduler wake-up, counter and TX status reads after the end of a packet */
+#define TXQ_GUARD_US		LGW_TXQ_GAP_MIN_US	/* min gap between packets, to load the next one */
+
+#if (LGW_TXQ_GAP_MIN_US < (TXQ_LEAD_MIN_US + TXQ_WAKE_US))
+	#error "LGW_TXQ_GAP_MIN_US too short to load a packet after the end of the previous one"
+#endif
+#define TXQ_TICK_MIN_US		500		/* min sleep of the scheduler thread */
+#define TXQ_TICK_MAX_US		100000	/* max sleep of the scheduler thread, bounds the stop latency */
+#define TXQ_TRACK_NB		128		/* number of packet states kept for lgw_txq_status */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+struct txq_entry_s {
+	struct lgw_pkt_tx_s	pkt;
+	uint32_t			id;
+	uint32_t			toa_us;	/* time on air */
+};
+
+struct txq_track_s {
+	uint32_t	id;
+	uint8_t		state;
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static pthread_mutex_t txq_mx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t txq_cond; /* wakes the scheduler up on new packet or stop request */
+static pthread_t txq_thread;
+static bool txq_running = false;
+static bool txq_quit;
+
+static struct txq_entry_s txq[LGW_TXQ_SIZE]; /* queued packets, earliest first */
+static int txq_nb; /* number of queued packets */
+static bool txq_busy; /* a packet is in the concentrator TX buffer */
+static struct txq_entry_s txq_loaded; /* packet in the concentrator TX buffer */
+static uint32_t txq_next_id;
+
+static struct txq_track_s txq_track[TXQ_TRACK_NB]; /* state of the recent packets, indexed by id */
+static struct lgw_txq_stats_s txq_stats;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+bool txq_overlap(const struct txq_entry_s *a, const struct txq_entry_s *b);
+
+void txq_set_state(uint32_t id, uint8_t state);
+
+void txq_pop(void);
+
+void *txq_run(void *arg);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* true if two packets are on air at the same time, or too close to load the second one */
+bool txq_overlap(const struct txq_entry_s *a, const struct txq_entry_s *b) {
+	uint32_t a_end = a->pkt.count_us + a->toa_us + TXQ_GUARD_US;
+	uint32_t b_end = b->pkt.count_us + b->toa_us + TXQ_GUARD_US;
+
+	return (TIME_DIFF(a->pkt.count_us, b_end) < 0) && (TIME_DIFF(b->pkt.count_us, a_end) < 0);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void txq_set_state(uint32_t id, uint8_t state) {
+	txq_track[id % TXQ_TRACK_NB].id = id;
+	txq_track[id % TXQ_TRACK_NB].state = state;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* remove the earliest packet from the queue */
+void txq_pop(void) {
+	--txq_nb;
+	memmove(&txq[0], &txq[1], txq_nb * sizeof(struct txq_entry_s));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* scheduler thread: load the earliest packet when its trigger time approaches */
+void *txq_run(void *arg) {
+	struct timespec ts;
+	uint32_t now;
+	uint8_t tx_stat;
+	int32_t wait_us;
+
+	(void)arg;
+	pthread_mutex_lock(&txq_mx);
+	while (txq_quit == false) {
+		if (lgw_get_instcnt(&now) != LGW_HAL_SUCCESS) {
+			DEBUG_MSG("ERROR: FAILED TO READ CONCENTRATOR COUNTER\n");
+			wait_us = TXQ_TICK_MAX_US;
+		} else {
+			/* completion of the packet in the TX buffer */
+			if ((txq_busy == true) && (TIME_DIFF(now, txq_loaded.pkt.count_us + txq_loaded.toa_us) >= 0)) {
+				lgw_status(TX_STATUS, &tx_stat);
+				if ((tx_stat != TX_SCHEDULED) && (tx_stat != TX_EMITTING)) {
+					txq_set_state(txq_loaded.id, TXQ_SENT);
+					++txq_stats.nb_sent;
+					txq_busy = false;
+				}
+			}
+
+			/* load the next packet when its trigger time approaches */
+			while ((txq_busy == false) && (txq_nb > 0)) {
+				wait_us = TIME_DIFF(txq[0].pkt.count_us, now);
+				if (wait_us > TXQ_LEAD_US) {
+					break;
+				}
+				if (wait_us < TXQ_LEAD_MIN_US) {
+					DEBUG_PRINTF("WARNING: TX packet %u missed its trigger time (%d us left)\n", txq[0].id, wait_us);
+					txq_set_state(txq[0].id, TXQ_MISSED);
+					++txq_stats.nb_missed;
+				} else if (lgw_send(txq[0].pkt) != LGW_HAL_SUCCESS) {
+					DEBUG_PRINTF("ERROR: FAILED TO LOAD TX PACKET %u\n", txq[0].id);
+					txq_set_state(txq[0].id, TXQ_FAILED);
+					++txq_stats.nb_failed;
+				} else {
+					txq_set_state(txq[0].id, TXQ_LOADED);
+					txq_loaded = txq[0];
+					txq_busy = true;
+				}
+				txq_pop();
+			}
+
+			/* sleep until the next event */
+			if (txq_busy == true) {
+				wait_us = TIME_DIFF(txq_loaded.pkt.count_us + txq_loaded.toa_us, now);
+			} else if (txq_nb > 0) {
+				wait_us = TIME_DIFF(txq[0].pkt.count_us - TXQ_LEAD_US, now);
+			} else {
+				wait_us = TXQ_TICK_MAX_US;
+			}
+		}
+		if (wait_us < TXQ_TICK_MIN_US) {
+			wait_us = TXQ_TICK_MIN_US;
+		} else if (wait_us > TXQ_TICK_MAX_US) {
+			wait_us = TXQ_TICK_MAX_US;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		ts.tv_nsec += 1000 * (long)wait_us;
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_sec += 1;
+			ts.tv_nsec -= 1000000000;
+		}
+		pthread_cond_timedwait(&txq_cond, &txq_mx, &ts);
+	}
+	pthread_mutex_unlock(&txq_mx);
+	return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int lgw_txq_start(void) {
+	pthread_condattr_t attr;
+
+	if (txq_running == true) {
+		DEBUG_MSG("ERROR: DOWNLINK SCHEDULER ALREADY RUNNING\n");
+		return LGW_TXQ_ERROR;
+	}
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&txq_cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	txq_nb = 0;
+	txq_busy = false;
+	txq_quit = false;
+	memset(txq_track, 0, sizeof(txq_track));
+	memset(&txq_stats, 0, sizeof(txq_stats));
+	if (pthread_create(&txq_thread, NULL, txq_run, NULL) != 0) {
+		DEBUG_MSG("ERROR: FAILED TO START DOWNLINK SCHEDULER THREAD\n");
+		pthread_cond_destroy(&txq_cond);
+		return LGW_TXQ_ERROR;
+	}
+	txq_running = true;
+	return LGW_TXQ_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_txq_stop(void) {
+	if (txq_running == false) {
+		DEBUG_MSG("WARNING: DOWNLINK SCHEDULER WAS NOT RUNNING\n");
+		return LGW_TXQ_ERROR;
+	}
+	pthread_mutex_lock(&txq_mx);
+	txq_quit = true;
+	pthread_cond_signal(&txq_cond);
+	pthread_mutex_unlock(&txq_mx);
+	pthread_join(txq_thread, NULL);
+	pthread_cond_destroy(&txq_cond);
+	txq_running = false;
+	return LGW_TXQ_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_txq_enqueue(const struct lgw_pkt_tx_s *pkt_data, uint32_t *id) {
+	struct txq_entry_s e;
+	uint32_t now;
+	int i;
+
+	CHECK_NULL(pkt_data);
+	if (txq_running == false) {
+		DEBUG_MSG("ERROR: DOWNLINK SCHEDULER IS NOT RUNNING\n");
+		return LGW_TXQ_ERROR;
+	}
+	if (pkt_data->tx_mode != TIMESTAMPED) {
+		DEBUG_MSG("ERROR: ONLY TIMESTAMPED PACKETS CAN BE QUEUED\n");
+		return LGW_TXQ_ERROR;
+	}
+	e.pkt = *pkt_data;
+	e.toa_us = lgw_time_on_air(pkt_data);
+	if (e.toa_us == 0) {
+		DEBUG_MSG("ERROR: INVALID MODULATION PARAMETERS\n");
+		return LGW_TXQ_ERROR;
+	}
+	if (lgw_get_instcnt(&now) != LGW_HAL_SUCCESS) {
+		return LGW_TXQ_ERROR;
+	}
+
+	pthread_mutex_lock(&txq_mx);
+	if (TIME_DIFF(e.pkt.count_us, now) < TXQ_LEAD_MIN_US) {
+		DEBUG_PRINTF("WARNING: TX trigger time %u too close, counter is %u\n", e.pkt.count_us, now);
+		++txq_stats.nb_rej_late;
+		pthread_mutex_unlock(&txq_mx);
+		return LGW_TXQ_TOO_LATE;
+	}
+	e.id = txq_next_id;
+	if ((txq_nb == LGW_TXQ_SIZE) || (txq_track[e.id % TXQ_TRACK_NB].state == TXQ_QUEUED) || (txq_track[e.id % TXQ_TRACK_NB].state == TXQ_LOADED)) {
+		++txq_stats.nb_rej_full;
+		pthread_mutex_unlock(&txq_mx);
+		return LGW_TXQ_FULL;
+	}
+	if ((txq_busy == true) && txq_overlap(&e, &txq_loaded)) {
+		++txq_stats.nb_rej_collision;
+		pthread_mutex_unlock(&txq_mx);
+		return LGW_TXQ_COLLISION;
+	}
+	for (i = 0; i < txq_nb; ++i) {
+		if (txq_overlap(&e, &txq[i])) {
+			++txq_stats.nb_rej_collision;
+			pthread_mutex_unlock(&txq_mx);
+			return LGW_TXQ_COLLISION;
+		}
+	}
+
+	/* insert, keeping the queue ordered by trigger time */
+	for (i = txq_nb; (i > 0) && (TIME_DIFF(txq[i-1].pkt.count_us, e.pkt.count_us) > 0); --i) {
+		txq[i] = txq[i-1];
+	}
+	txq[i] = e;
+	++txq_nb;
+	++txq_next_id;
+	txq_set_state(e.id, TXQ_QUEUED);
+	++txq_stats.nb_queued;
+	if (i == 0) {
+		pthread_cond_signal(&txq_cond); /* new earliest packet, the scheduler may sleep too long */
+	}
+	pthread_mutex_unlock(&txq_mx);
+
+	if (id != NULL) {
+		*id = e.id;
+	}
+	return LGW_TXQ_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_txq_status(uint32_t id, uint8_t *state) {
+	CHECK_NULL(state);
+	if (txq_running == false) {
+		return LGW_TXQ_ERROR;
+	}
+	pthread_mutex_lock(&txq_mx);
+	if ((txq_track[id % TXQ_TRACK_NB].id == id) && (TIME_DIFF(txq_next_id, id) > 0)) {
+		*state = txq_track[id % TXQ_TRACK_NB].state;
+	} else {
+		*state = TXQ_UNKNOWN;
+	}
+	pthread_mutex_unlock(&txq_mx);
+	return LGW_TXQ_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_txq_get_stats(struct lgw_txq_stats_s *stats) {
+	CHECK_NULL(stats);
+	if (txq_running == false) {
+		return LGW_TXQ_ERROR;
+	}
+	pthread_mutex_lock(&txq_mx);
+	*stats = txq_stats;
+	pthread_mutex_unlock(&txq_mx);
+	return LGW_TXQ_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,1087 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Test program for the loragw_hal 'library' running on the concentrator
+	emulator (CFG_SPI = sim).
+	Starts the concentrator, injects synthetic packets, checks what is
+	received and sent, and measures the throughput and SPI access count of
+	lgw_receive and lgw_send.
+	Also checks that lgw_receive_wait sleeps on the 'packets waiting' event,
+	and the RX fetch thread and packet ring.
+	Then checks that the downlink scheduler loads each queued packet just
+	before its trigger time.
+	Then restarts the concentrator with the calibration results cached by the
+	first start.
+	Then checks that lgw_receive_into writes the same packets as compact
+	records in a caller-supplied buffer, and measures its throughput.
+	Then checks the RX timestamp correction of every LoRa modem, SF, coding
+	rate, CRC and payload size against the reference formula, and the FSK
+	correction, then restarts the concentrator to check the stand-alone modem
+	at 125 and 500 kHz too.
+	Then checks the SPI link parameters set by the environment and by
+	lgw_board_setconf, and the auto-tune on a board unreliable above 10 MHz.
+	Last, drives two emulated concentrators at the same time through HAL
+	context handles, one thread per concentrator, and checks that their
+	packets do not mix.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+	#define _XOPEN_SOURCE 600
+#else
+	#define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+#include <stdio.h>		/* printf */
+#include <stdlib.h>		/* setenv unsetenv */
+#include <string.h>		/* memset */
+#include <time.h>		/* clock_gettime nanosleep */
+#include <pthread.h>	/* packet injection from another thread */
+#include <unistd.h>		/* close */
+#include <sys/eventfd.h>	/* stand-in for the DGPIO0 line */
+
+#include "loragw_hal.h"
+#include "loragw_reg.h"
+#include "loragw_ring.h"
+#include "loragw_txq.h"
+#include "loragw_sim.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#if ((CFG_BAND_868 == 1) || ((CFG_BAND_FULL == 1) && (CFG_RADIO_1257 == 1)))
+	#define	F_RX_0	868500000
+	#define	F_RX_1	869500000
+	#define	F_TX	869000000
+#elif (CFG_BAND_915 == 1)
+	#define	F_RX_0	914500000
+	#define	F_RX_1	915500000
+	#define	F_TX	915000000
+#elif ((CFG_BAND_470 == 1) || ((CFG_BAND_FULL == 1) && (CFG_RADIO_1255 == 1)))
+	#define	F_RX_0	471500000
+	#define	F_RX_1	472500000
+	#define	F_TX	472000000
+#elif (CFG_BAND_433 == 1)
+	#define	F_RX_0	433500000
+	#define	F_RX_1	434500000
+	#define	F_TX	434000000
+#else
+	#error "Please set CFG_BAND in library.cfg"
+#endif
+
+#define NB_RX_PKT		20000	/* number of packets pushed through lgw_receive */
+#define NB_TX_PKT		2000	/* number of packets pushed through lgw_send */
+#define NB_WAIT_PKT		200		/* number of packets received through lgw_receive_wait */
+#define WAIT_GAP_US		500		/* delay between packets injected by the RX thread */
+#define RING_SIZE		64		/* size of the RX packet ring under test */
+#define RING_PRIO		10		/* SCHED_FIFO priority of the RX fetch thread */
+#define NB_TXQ_PKT		20		/* number of packets sent through the downlink scheduler */
+#define TXQ_SPACING_US	80000	/* delay between the trigger times of queued packets */
+#define PAYLOAD_SIZE	24
+#define CAL_CACHE		"/tmp/test_loragw_sim.cal"
+#define NB_BOARD		2		/* number of concentrators driven through context handles */
+#define NB_BOARD_PKT	400		/* number of packets received and sent by each of them */
+#define SPI_LIMIT_HZ	11000000	/* emulated board corrupts reads above that SPI clock */
+#define SPI_TRACE		"/tmp/test_loragw_sim.trace"
+#define ARENA_SIZE		4096	/* bytes of the buffer receiving compact RX records */
+#define FSK_DR			64000	/* datarate of the FSK channel */
+#define NB_TCORR_PKT	(2 * 7 * 4 * 2 * 256)	/* LoRa modems x SF x CR x CRC x payload size */
+#define NB_TCORR_STD_PKT	(NB_TCORR_PKT / 2)	/* stand-alone modem alone */
+#define TCORR_LEN		258		/* payload size + 2 bytes of CRC, index of the correction tables */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* concentrator driven through a context handle by its own thread */
+struct board_s {
+	const char *name; /* emulator instance */
+	lgw_ctx_t *ctx;
+	uint32_t freq_hz; /* frequency of radio A, radio B is 1 MHz above */
+	uint8_t marker; /* first payload byte of all packets of that board */
+	int nb_rx;
+	int nb_tx;
+	int nb_err;
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static pthread_mutex_t mx_sim = PTHREAD_MUTEX_INITIALIZER; /* lgw_sim_select and the lgw_sim_ call that follows */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+/* count the records of an SPI trace per call site, return -1 if the file is not a valid trace */
+int count_trace(const char *path, uint32_t *nb_rec, int nb_site) {
+	uint8_t head[LGW_TRACE_REC_SIZE];
+	uint8_t data[0x10000];
+	uint16_t size;
+	FILE *f;
+	int x = 0;
+	
+	memset(nb_rec, 0, nb_site * sizeof(nb_rec[0]));
+	f = fopen(path, "rb");
+	if (f == NULL) {
+		return -1;
+	}
+	if ((fread(head, 1, LGW_TRACE_HEAD_SIZE, f) != LGW_TRACE_HEAD_SIZE) || (memcmp(head, LGW_TRACE_MAGIC, 4) != 0) || (head[4] != LGW_TRACE_VERSION)) {
+		x = -1;
+	}
+	while ((x == 0) && (fread(head, 1, LGW_TRACE_REC_SIZE, f) == LGW_TRACE_REC_SIZE)) {
+		size = head[7] | (head[8] << 8);
+		if ((head[6] >= nb_site) || ((head[4] & LGW_TRACE_ERROR) != 0) || (fread(data, 1, size, f) != size)) {
+			x = -1;
+		} else {
+			++nb_rec[head[6]];
+		}
+	}
+	fclose(f);
+	return x;
+}
+
+/* LoRa RX timestamp correction, reference formula the HAL lookup tables are built from */
+uint32_t ref_tcorr(bool multi, uint8_t bw, uint32_t sf, uint32_t cr, uint32_t sz, uint32_t crc_en) {
+	uint32_t delay_x, delay_y, delay_z;
+	uint32_t bw_pow, ppm;
+	
+	if (multi) {
+		delay_x = 114;
+		bw_pow = 1;
+	} else if (bw == BW_125KHZ) {
+		delay_x = 64;
+		bw_pow = 1;
+	} else if (bw == BW_250KHZ) {
+		delay_x = 32;
+		bw_pow = 2;
+	} else if (bw == BW_500KHZ) {
+		delay_x = 16;
+		bw_pow = 4;
+	} else {
+		return 0;
+	}
+	if ((sf < 6) || (sf > 12)) {
+		return 0;
+	}
+	ppm = (((multi || (bw == BW_125KHZ)) && (sf >= 11)) || ((bw == BW_250KHZ) && (sf == 12))) ? 1 : 0;
+	if ((2*(sz + 2*crc_en) - (sf-7)) <= 0) {
+		delay_y = ( ((1<<(sf-1)) * (sf+1)) + (3 * (1<<(sf-4))) ) / bw_pow;
+		delay_z = 32 * (2*(sz+2*crc_en) + 5) / bw_pow;
+	} else {
+		delay_y = ( ((1<<(sf-1)) * (sf+1)) + ((4 - ppm) * (1<<(sf-4))) ) / bw_pow;
+		delay_z = (16 + 4*cr) * (((2*(sz+2*crc_en)-sf+6) % (sf - 2*ppm)) + 1) / bw_pow;
+	}
+	return delay_x + delay_y + delay_z;
+}
+
+/* stand-alone modem (IF 8) at bandwidth bw: every SF, CR, CRC and size, return the number of wrong or missing timestamps */
+int check_tcorr_std(uint8_t bw) {
+	struct lgw_pkt_rx_s rxpkt[8];
+	struct lgw_sim_rx_s sim_rx;
+	uint32_t tcorr_exp[8];
+	int nb_rx = 0, nb_err = 0;
+	int i, j, k, nb_pkt;
+	
+	memset(&sim_rx, 0, sizeof(sim_rx));
+	sim_rx.if_chain = 8;
+	for (i = 0; i < NB_TCORR_STD_PKT; i += 8) {
+		for (j = 0; j < 8; ++j) {
+			k = i + j;
+			sim_rx.size = (uint8_t)(k % 256);
+			sim_rx.status = ((k / 256) % 2) ? 1 : 5;
+			sim_rx.cr = 1 + ((k / 512) % 4);
+			sim_rx.sf = 6 + ((k / 2048) % 7);
+			sim_rx.count_us = 0x40000000 + 16 * k;
+			tcorr_exp[j] = sim_rx.count_us - ref_tcorr(false, bw, sim_rx.sf, sim_rx.cr, sim_rx.size, (sim_rx.status == 5) ? 1 : 0);
+			lgw_sim_inject_rx(&sim_rx);
+		}
+		nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
+		for (j = 0; j < nb_pkt; ++j) {
+			if ((rxpkt[j].bandwidth != bw) || (rxpkt[j].count_us != tcorr_exp[j])) {
+				printf("ERROR: IF 8 at bandwidth 0x%02X, SF %u, CR %u, status %u, %u bytes: timestamp %u instead of %u\n", bw, (unsigned)(6 + (((i + j) / 2048) % 7)), (unsigned)(1 + (((i + j) / 512) % 4)), rxpkt[j].status, rxpkt[j].size, rxpkt[j].count_us, tcorr_exp[j]);
+				++nb_err;
+			}
+		}
+		nb_rx += nb_pkt;
+	}
+	return nb_err + (NB_TCORR_STD_PKT - nb_rx);
+}
+
+/* return 0 if a compact RX record holds the same packet as an RX structure */
+int cmp_rec(const struct lgw_pkt_rx_s *p, const struct lgw_pkt_rec_s *r) {
+	if ((p->freq_hz != r->freq_hz) || (p->if_chain != r->if_chain) || (p->status != r->status) || (p->count_us != r->count_us) || (p->rf_chain != r->rf_chain)) {
+		return -1;
+	}
+	if ((p->modulation != r->modulation) || (p->bandwidth != r->bandwidth) || (p->datarate != r->datarate) || (p->coderate != r->coderate)) {
+		return -1;
+	}
+	if ((p->rssi != r->rssi) || (p->snr != r->snr) || (p->snr_min != r->snr_min) || (p->snr_max != r->snr_max) || (p->crc != r->crc) || (p->size != r->size)) {
+		return -1;
+	}
+	return memcmp(p->payload, r->payload, p->size);
+}
+
+double elapsed_s(struct timespec *start) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)(now.tv_sec - start->tv_sec) + 1e-9 * (double)(now.tv_nsec - start->tv_nsec);
+}
+
+/* print the SPI cost seen by the emulator, return -1 if the host side count differs */
+int print_stats(const char *name, int nb_op, double duration) {
+	struct lgw_sim_stats_s s;
+	struct lgw_reg_stats_s h;
+	
+	lgw_sim_get_stats(&s);
+	lgw_reg_get_stats(&h);
+	printf("%s: %d packets in %.3f s (%.0f pkt/s)\n", name, nb_op, duration, nb_op / duration);
+	printf("  %.2f SPI submissions/pkt, %.2f frames/pkt, %.2f page switches/pkt, %.1f bytes/pkt\n", (double)s.nb_submit / nb_op, (double)s.nb_frame / nb_op, (double)s.nb_page_switch / nb_op, (double)s.nb_byte / nb_op);
+	if ((h.nb_submit != s.nb_submit) || (h.nb_frame != s.nb_frame) || (h.nb_page_switch != s.nb_page_switch) || (h.nb_byte != s.nb_byte)) {
+		printf("ERROR: host counted %u submissions, %u frames, %u page switches, %llu bytes\n", h.nb_submit, h.nb_frame, h.nb_page_switch, (unsigned long long)h.nb_byte);
+		return -1;
+	}
+	return 0;
+}
+
+/* print the time spent waiting for the MCUs during start, return -1 if it exceeds the emulated times */
+int print_start_wait(struct lgw_start_wait_s *w) {
+	lgw_get_start_wait(w);
+	printf("  MCU waits: calibration %u us, AGC boot %u us, LUT %u us, chan_select %u us, final %u us, %u status reads\n", w->cal_us, w->agc_boot_us, w->agc_lut_us, w->agc_chan_us, w->agc_final_us, w->nb_poll);
+	if ((w->cal_us > 500000) || (w->agc_boot_us > 1000)) {
+		printf("ERROR: MCU waits longer than the emulated MCU answer times\n");
+		return -1;
+	}
+	return 0;
+}
+
+/* print the start profile, return -1 if the phases do not add up to the whole start */
+int print_start_profile(void) {
+	struct lgw_start_profile_s p;
+	struct lgw_reg_stats_s h;
+	uint32_t sum_us = 0, sum_submit = 0;
+	int i;
+	
+	lgw_get_start_profile(&p);
+	lgw_reg_get_stats(&h);
+	for (i = 0; i < LGW_START_PHASE_NB; ++i) {
+		printf("  %-16s %8.3f ms, %5u submissions, %5u frames, %7llu bytes\n", p.phase[i].name, p.phase[i].duration_us / 1000.0, p.phase[i].nb_submit, p.phase[i].nb_frame, (unsigned long long)p.phase[i].nb_byte);
+		sum_us += p.phase[i].duration_us;
+		sum_submit += p.phase[i].nb_submit;
+	}
+	if ((p.complete == false) || (sum_us != p.total_us) || (sum_submit != h.nb_submit)) {
+		printf("ERROR: start profile incomplete or inconsistent (%u us / %u us, %u / %u submissions)\n", sum_us, p.total_us, sum_submit, h.nb_submit);
+		return -1;
+	}
+	return 0;
+}
+
+void reset_stats(void) {
+	lgw_sim_reset_stats();
+	lgw_reg_reset_stats();
+}
+
+/* inject packets one by one, as if received over the air */
+void *thread_inject(void *arg) {
+	struct lgw_sim_rx_s sim_rx;
+	struct timespec gap = {0, 1000 * WAIT_GAP_US};
+	int i;
+	
+	(void)arg;
+	memset(&sim_rx, 0, sizeof(sim_rx));
+	sim_rx.status = 5;
+	sim_rx.sf = 7;
+	sim_rx.cr = 1;
+	sim_rx.size = PAYLOAD_SIZE;
+	for (i = 0; i < NB_WAIT_PKT; ++i) {
+		nanosleep(&gap, NULL);
+		sim_rx.count_us = i;
+		memset(sim_rx.payload, (uint8_t)i, PAYLOAD_SIZE);
+		while (lgw_sim_inject_rx(&sim_rx) != LGW_SIM_SUCCESS) {
+			nanosleep(&gap, NULL); /* FIFO full */
+		}
+	}
+	return NULL;
+}
+
+/* start a board, then inject, receive and send packets, checking that they belong to it */
+void *thread_board(void *arg) {
+	struct board_s *b = (struct board_s *)arg;
+	struct lgw_conf_rxrf_s rfconf;
+	struct lgw_conf_rxif_s ifconf;
+	struct lgw_pkt_rx_s rxpkt[8];
+	struct lgw_pkt_tx_s txpkt;
+	struct lgw_sim_rx_s sim_rx;
+	struct lgw_sim_tx_s sim_tx;
+	int nb_pkt;
+	int i, j, x;
+	
+	/* 2 radios, 8 multi-SF LoRa channels */
+	memset(&rfconf, 0, sizeof(rfconf));
+	rfconf.enable = true;
+	rfconf.freq_hz = b->freq_hz;
+	lgw_rxrf_setconf_ctx(b->ctx, 0, rfconf);
+	rfconf.freq_hz = b->freq_hz + 1000000;
+	lgw_rxrf_setconf_ctx(b->ctx, 1, rfconf);
+	memset(&ifconf, 0, sizeof(ifconf));
+	for (i = 0; i < 8; ++i) {
+		ifconf.enable = true;
+		ifconf.rf_chain = i % 2;
+		ifconf.freq_hz = -300000 + 200000 * (i / 2);
+		ifconf.datarate = DR_LORA_MULTI;
+		lgw_rxif_setconf_ctx(b->ctx, i, ifconf);
+	}
+	if (lgw_start_ctx(b->ctx, NULL) != LGW_HAL_SUCCESS) {
+		++b->nb_err;
+		return NULL;
+	}
+	
+	memset(&sim_rx, 0, sizeof(sim_rx));
+	sim_rx.status = 5;
+	sim_rx.sf = 7;
+	sim_rx.cr = 1;
+	sim_rx.size = PAYLOAD_SIZE;
+	memset(&txpkt, 0, sizeof(txpkt));
+	txpkt.freq_hz = b->freq_hz + 500000;
+	txpkt.tx_mode = IMMEDIATE;
+	txpkt.rf_power = 10;
+	txpkt.modulation = MOD_LORA;
+	txpkt.bandwidth = BW_125KHZ;
+	txpkt.datarate = DR_LORA_SF9;
+	txpkt.coderate = CR_LORA_4_5;
+	txpkt.preamble = 8;
+	txpkt.size = PAYLOAD_SIZE;
+	txpkt.payload[0] = b->marker;
+	for (i = 0; i < NB_BOARD_PKT; i += 8) {
+		pthread_mutex_lock(&mx_sim);
+		lgw_sim_select(b->name);
+		for (j = 0; j < 8; ++j) {
+			sim_rx.if_chain = j;
+			sim_rx.payload[0] = b->marker;
+			sim_rx.payload[1] = (uint8_t)(i + j);
+			lgw_sim_inject_rx(&sim_rx);
+		}
+		pthread_mutex_unlock(&mx_sim);
+		
+		do {
+			nb_pkt = lgw_receive_ctx(b->ctx, ARRAY_SIZE(rxpkt), rxpkt);
+			for (j = 0; j < nb_pkt; ++j) {
+				if ((rxpkt[j].payload[0] != b->marker) || (rxpkt[j].payload[1] != (uint8_t)b->nb_rx) || (rxpkt[j].freq_hz != b->freq_hz + (rxpkt[j].if_chain % 2) * 1000000 - 300000 + 200000 * (rxpkt[j].if_chain / 2))) {
+					++b->nb_err;
+				}
+				++b->nb_rx;
+			}
+		} while (nb_pkt > 0);
+		
+		txpkt.payload[1] = (uint8_t)b->nb_tx;
+		x = lgw_send_ctx(b->ctx, txpkt);
+		pthread_mutex_lock(&mx_sim);
+		lgw_sim_select(b->name);
+		if ((x != LGW_HAL_SUCCESS) || (lgw_sim_get_tx(&sim_tx) != LGW_SIM_SUCCESS) || (sim_tx.data[16] != b->marker) || (sim_tx.data[17] != (uint8_t)b->nb_tx)) {
+			++b->nb_err;
+		}
+		pthread_mutex_unlock(&mx_sim);
+		++b->nb_tx;
+	}
+	
+	lgw_stop_ctx(b->ctx);
+	return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main()
+{
+	struct lgw_conf_rxrf_s rfconf;
+	struct lgw_conf_rxif_s ifconf;
+	struct lgw_pkt_rx_s rxpkt[16];
+	struct lgw_pkt_tx_s txpkt;
+	struct lgw_sim_rx_s sim_rx;
+	struct lgw_sim_tx_s sim_tx;
+	struct timespec start;
+	struct timespec pause = {0, 200000000}; /* 200 ms */
+	struct timespec poll = {0, 2000000}; /* 2 ms */
+	struct lgw_conf_start_s startconf;
+	struct lgw_conf_board_s boardconf;
+	struct lgw_start_wait_s sw_cold, sw_warm;
+	struct lgw_ring_stats_s rs;
+	struct lgw_txq_stats_s qs;
+	struct lgw_reg_stats_s regstats;
+	uint32_t trace_cnt[LGW_TRACE_SITE_INSTCNT + 1];
+	uint32_t now, tx_cnt, last_cnt;
+	uint32_t tcorr_exp[8];
+	uint16_t lut_base[7][TCORR_LEN]; /* same layout as the HAL correction tables, stand-alone modem at 250 kHz */
+	uint8_t lut_cr[7][TCORR_LEN];
+	uint32_t sum_lut;
+	uint8_t tcorr_bw[2] = {BW_125KHZ, BW_500KHZ};
+	uint32_t arena[ARENA_SIZE / 4]; /* 32-bit words, records are aligned */
+	struct lgw_pkt_rec_s *rec;
+	uint32_t spi_speed = 0;
+	uint16_t spi_chunk = 0;
+	uint32_t txq_id[NB_TXQ_PKT];
+	int32_t lead, lead_min = INT32_MAX, lead_max = INT32_MIN;
+	uint8_t state, cal_status;
+	bool cal_cached;
+	pthread_t thrid;
+	pthread_t board_thrid[NB_BOARD];
+	struct board_s board[NB_BOARD] = {
+		{.name = "sim0", .freq_hz = F_RX_0 - 1000000, .marker = 0xA0},
+		{.name = "sim1", .freq_hz = F_RX_0, .marker = 0xB0}
+	};
+	int irq_fd;
+	int nb_pkt, nb_rx = 0, nb_err = 0, nb_wake = 0;
+	int i, j, k;
+	double t;
+	
+	printf("Beginning of test for loragw_hal.c on the concentrator emulator\n");
+	printf("*** Library version information ***\n%s\n\n", lgw_version_info());
+	
+	/* time on air, reference values of the LoRa and FSK modem datasheets formulas */
+	memset(&txpkt, 0, sizeof(txpkt));
+	txpkt.modulation = MOD_LORA;
+	txpkt.bandwidth = BW_125KHZ;
+	txpkt.datarate = DR_LORA_SF7;
+	txpkt.coderate = CR_LORA_4_5;
+	txpkt.preamble = 8;
+	txpkt.size = 20;
+	if (lgw_time_on_air(&txpkt) != 56576) {
+		++nb_err;
+	}
+	txpkt.datarate = DR_LORA_SF12;
+	txpkt.size = 51;
+	if (lgw_time_on_air(&txpkt) != 2465792) {
+		++nb_err;
+	}
+	txpkt.modulation = MOD_FSK;
+	txpkt.datarate = 50000;
+	txpkt.preamble = 0;
+	txpkt.size = 20;
+	if (lgw_time_on_air(&txpkt) != 4960) {
+		++nb_err;
+	}
+	txpkt.datarate = 0;
+	if (lgw_time_on_air(&txpkt) != 0) {
+		++nb_err;
+	}
+	memset(&rxpkt[0], 0, sizeof(rxpkt[0]));
+	rxpkt[0].modulation = MOD_LORA;
+	rxpkt[0].bandwidth = BW_125KHZ;
+	rxpkt[0].datarate = DR_LORA_SF7;
+	rxpkt[0].coderate = CR_LORA_4_5;
+	rxpkt[0].status = STAT_CRC_OK;
+	rxpkt[0].size = 20;
+	if (lgw_time_on_air_rx(&rxpkt[0]) != 56576) {
+		++nb_err;
+	}
+	txpkt.modulation = MOD_LORA;
+	txpkt.bandwidth = BW_125KHZ;
+	txpkt.coderate = CR_LORA_4_8;
+	txpkt.preamble = 8;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0, j = 0; i < 1000000; ++i) {
+		txpkt.datarate = DR_LORA_SF7 << (i % 6);
+		txpkt.size = i & 0xFF;
+		j += (lgw_time_on_air(&txpkt) == 0);
+	}
+	t = elapsed_s(&start);
+	printf("lgw_time_on_air: %.0f ns per call\n", t * 1e3);
+	if ((nb_err != 0) || (j != 0)) {
+		printf("ERROR: wrong time on air (%d errors, %d invalid)\n", nb_err, j);
+		return -1;
+	}
+	
+	/* 2 radios, 8 multi-SF LoRa channels, 1 LoRa standard channel, 1 FSK channel */
+	memset(&rfconf, 0, sizeof(rfconf));
+	rfconf.enable = true;
+	rfconf.freq_hz = F_RX_0;
+	lgw_rxrf_setconf(0, rfconf);
+	rfconf.freq_hz = F_RX_1;
+	lgw_rxrf_setconf(1, rfconf);
+	memset(&ifconf, 0, sizeof(ifconf));
+	for (i = 0; i < 8; ++i) {
+		ifconf.enable = true;
+		ifconf.rf_chain = i % 2;
+		ifconf.freq_hz = -300000 + 200000 * (i / 2);
+		ifconf.datarate = DR_LORA_MULTI;
+		lgw_rxif_setconf(i, ifconf);
+	}
+	ifconf.rf_chain = 0;
+	ifconf.freq_hz = 0;
+	ifconf.bandwidth = BW_250KHZ;
+	ifconf.datarate = DR_LORA_SF10;
+	lgw_rxif_setconf(8, ifconf);
+	ifconf.rf_chain = 1;
+	ifconf.bandwidth = BW_250KHZ;
+	ifconf.datarate = FSK_DR;
+	lgw_rxif_setconf(9, ifconf);
+	
+	/* eventfd emulating the 'packets waiting' line */
+	irq_fd = eventfd(0, EFD_NONBLOCK);
+	if (irq_fd < 0) {
+		printf("ERROR: failed to create eventfd\n");
+		return -1;
+	}
+	lgw_sim_set_irq_fd(irq_fd);
+	lgw_rxirq_setfd(irq_fd);
+	
+	/* cold start, the calibration results are saved in the cache */
+	memset(&startconf, 0, sizeof(startconf));
+	startconf.cal_cache = CAL_CACHE;
+	remove(CAL_CACHE);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (lgw_start_ex(&startconf) != LGW_HAL_SUCCESS) {
+		printf("ERROR: failed to start the emulated concentrator\n");
+		return -1;
+	}
+	t = elapsed_s(&start);
+	lgw_get_cal_info(&cal_status, &cal_cached);
+	printf("Concentrator started in %.3f s (calibration status 0x%02X, %s)\n", t, cal_status, cal_cached ? "cached" : "full");
+	if ((print_start_profile() != 0) || (print_start_wait(&sw_cold) != 0)) {
+		lgw_stop();
+		return -1;
+	}
+	if (cal_cached == true) {
+		printf("ERROR: calibration cache used on a cold start\n");
+		lgw_stop();
+		return -1;
+	}
+	
+	/* RX: inject packets 8 at a time and fetch them */
+	reset_stats();
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	memset(&sim_rx, 0, sizeof(sim_rx));
+	for (i = 0; i < NB_RX_PKT; i += 8) {
+		for (j = 0; j < 8; ++j) {
+			sim_rx.if_chain = (i + j) % 10;
+			sim_rx.status = 5;
+			sim_rx.sf = 7 + ((i + j) % 6);
+			sim_rx.cr = 1;
+			sim_rx.snr = 20;
+			sim_rx.rssi = 100;
+			sim_rx.count_us = 1000000 + i + j;
+			sim_rx.crc = 0xBEEF;
+			sim_rx.size = PAYLOAD_SIZE;
+			memset(sim_rx.payload, (uint8_t)(i + j), PAYLOAD_SIZE);
+			lgw_sim_inject_rx(&sim_rx);
+		}
+		do {
+			nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
+			for (j = 0; j < nb_pkt; ++j) {
+				if ((rxpkt[j].size != PAYLOAD_SIZE) || (rxpkt[j].payload[0] != (uint8_t)nb_rx) || (rxpkt[j].if_chain != (nb_rx % 10)) || (rxpkt[j].status != STAT_CRC_OK) || (rxpkt[j].crc != 0xBEEF)) {
+					++nb_err;
+				}
+				++nb_rx;
+			}
+		} while (nb_pkt > 0);
+	}
+	if (print_stats("lgw_receive", nb_rx, elapsed_s(&start)) != 0) {
+		++nb_err;
+	}
+	if ((nb_rx != NB_RX_PKT) || (nb_err != 0)) {
+		printf("ERROR: %d packets received instead of %d, %d packets with wrong content\n", nb_rx, NB_RX_PKT, nb_err);
+		lgw_stop();
+		return -1;
+	}
+	
+	/* RX compact records: same packets as lgw_receive, then throughput and partial fetch */
+	memset(&sim_rx, 0, sizeof(sim_rx));
+	for (i = 0; i < 512; i += 8) {
+		for (k = 0; k < 2; ++k) {
+			for (j = 0; j < 8; ++j) {
+				sim_rx.if_chain = (i + j) % 10;
+				sim_rx.status = (j % 3) ? 5 : 1;
+				sim_rx.sf = 7 + ((i + j) % 6);
+				sim_rx.cr = 1 + (j % 4);
+				sim_rx.snr = (int8_t)(i - j);
+				sim_rx.rssi = (uint8_t)(80 + j);
+				sim_rx.count_us = 1000000 * i + j;
+				sim_rx.crc = (uint16_t)(i * j);
+				sim_rx.size = (uint8_t)(37 * (i + j));
+				memset(sim_rx.payload, (uint8_t)(i + j), sim_rx.size);
+				lgw_sim_inject_rx(&sim_rx);
+			}
+			if (k == 0) {
+				nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
+			} else {
+				nb_rx = lgw_receive_into((uint8_t *)arena, sizeof(arena));
+			}
+		}
+		if ((nb_pkt != 8) || (nb_rx != 8)) {
+			++nb_err;
+			continue;
+		}
+		for (j = 0, rec = (struct lgw_pkt_rec_s *)arena; j < 8; ++j, rec = LGW_PKT_REC_NEXT(rec)) {
+			if (cmp_rec(&rxpkt[j], rec) != 0) {
+				++nb_err;
+			}
+		}
+	}
+	if (nb_err != 0) {
+		printf("ERROR: %d compact records differ from lgw_receive\n", nb_err);
+		lgw_stop();
+		return -1;
+	}
+	reset_stats();
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	sim_rx.status = 5;
+	sim_rx.size = PAYLOAD_SIZE;
+	for (i = 0, nb_rx = 0; i < NB_RX_PKT; i += 8) {
+		for (j = 0; j < 8; ++j) {
+			sim_rx.if_chain = (i + j) % 10;
+			memset(sim_rx.payload, (uint8_t)(i + j), PAYLOAD_SIZE);
+			lgw_sim_inject_rx(&sim_rx);
+		}
+		do {
+			nb_pkt = lgw_receive_into((uint8_t *)arena, sizeof(arena));
+			for (j = 0, rec = (struct lgw_pkt_rec_s *)arena; j < nb_pkt; ++j, rec = LGW_PKT_REC_NEXT(rec)) {
+				if ((rec->size != PAYLOAD_SIZE) || (rec->payload[0] != (uint8_t)nb_rx) || (rec->payload[PAYLOAD_SIZE - 1] != (uint8_t)nb_rx)) {
+					++nb_err;
+				}
+				++nb_rx;
+			}
+		} while (nb_pkt > 0);
+	}
+	if (print_stats("lgw_receive_into", nb_rx, elapsed_s(&start)) != 0) {
+		++nb_err;
+	}
+	printf("  %u bytes per record of %u payload bytes (lgw_pkt_rx_s: %u bytes)\n", (unsigned)LGW_PKT_REC_SIZE(PAYLOAD_SIZE), PAYLOAD_SIZE, (unsigned)sizeof(struct lgw_pkt_rx_s));
+	sim_rx.payload[0] = 1;
+	lgw_sim_inject_rx(&sim_rx);
+	sim_rx.payload[0] = 2;
+	lgw_sim_inject_rx(&sim_rx);
+	j = LGW_PKT_REC_SIZE(PAYLOAD_SIZE) + LGW_PKT_REC_SLACK; /* room for a single record */
+	rec = (struct lgw_pkt_rec_s *)arena;
+	if ((lgw_receive_into((uint8_t *)arena, j - 1) != 0) || (lgw_receive_into((uint8_t *)arena, j) != 1) || (rec->payload[0] != 1) || (lgw_receive_into((uint8_t *)arena, j) != 1) || (rec->payload[0] != 2) || (lgw_receive_into((uint8_t *)arena, j) != 0)) {
+		printf("ERROR: wrong partial fetch with a small record buffer\n");
+		++nb_err;
+	}
+	if ((nb_rx != NB_RX_PKT) || (nb_err != 0)) {
+		printf("ERROR: %d packets received instead of %d, %d packets with wrong content\n", nb_rx, NB_RX_PKT, nb_err);
+		lgw_stop();
+		return -1;
+	}
+	
+	/* RX timestamp correction: every LoRa modem (IF 0 multi-SF, IF 8 stand-alone at 250 kHz), SF, CR, CRC and size, 125 and 500 kHz checked after the TX tests */
+	reset_stats();
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	memset(&sim_rx, 0, sizeof(sim_rx));
+	for (i = 0, nb_rx = 0; i < NB_TCORR_PKT; i += 8) {
+		for (j = 0; j < 8; ++j) {
+			k = i + j;
+			sim_rx.size = (uint8_t)(k % 256);
+			sim_rx.status = ((k / 256) % 2) ? 1 : 5;
+			sim_rx.cr = 1 + ((k / 512) % 4);
+			sim_rx.sf = 6 + ((k / 2048) % 7);
+			sim_rx.if_chain = (k < (NB_TCORR_PKT / 2)) ? 0 : 8;
+			sim_rx.count_us = 0x40000000 + 16 * k;
+			tcorr_exp[j] = sim_rx.count_us - ref_tcorr(sim_rx.if_chain == 0, BW_250KHZ, sim_rx.sf, sim_rx.cr, sim_rx.size, (sim_rx.status == 5) ? 1 : 0);
+			lgw_sim_inject_rx(&sim_rx);
+		}
+		nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
+		for (j = 0; j < nb_pkt; ++j) {
+			if (rxpkt[j].count_us != tcorr_exp[j]) {
+				printf("ERROR: IF %u, SF %u, CR %u, status %u, %u bytes: timestamp %u instead of %u\n", rxpkt[j].if_chain, (unsigned)(6 + (((i + j) / 2048) % 7)), (unsigned)(1 + (((i + j) / 512) % 4)), rxpkt[j].status, rxpkt[j].size, rxpkt[j].count_us, tcorr_exp[j]);
+				++nb_err;
+			}
+		}
+		nb_rx += nb_pkt;
+	}
+	t = elapsed_s(&start);
+	if (print_stats("lgw_receive, timestamp sweep", nb_rx, t) != 0) {
+		++nb_err;
+	}
+	printf("  %.0f ns per packet (metadata decode, payload copy and emulated SPI)\n", t * 1e9 / nb_rx);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0, now = 0; i < 1000000; ++i) {
+		now += ref_tcorr(false, BW_250KHZ, 6 + (i % 7), 1 + ((i / 7) % 4), i & 0xFF, 1);
+	}
+	printf("  reference formula alone: %.1f ns per packet (checksum %u)\n", elapsed_s(&start) * 1e3, now);
+	/* the lookup of lgw_receive alone, on tables built here the way tcorr_init builds them: correction = base + (4 + CR) * cr term */
+	for (j = 0; j < 7; ++j) {
+		for (k = 0; k < TCORR_LEN; ++k) {
+			lut_cr[j][k] = (uint8_t)(ref_tcorr(false, BW_250KHZ, 6 + j, 2, k, 0) - ref_tcorr(false, BW_250KHZ, 6 + j, 1, k, 0));
+			lut_base[j][k] = (uint16_t)(ref_tcorr(false, BW_250KHZ, 6 + j, 1, k, 0) - 5 * lut_cr[j][k]);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0, sum_lut = 0; i < 1000000; ++i) {
+		sum_lut += lut_base[i % 7][(i & 0xFF) + 2] + (4 + 1 + ((i / 7) % 4)) * lut_cr[i % 7][(i & 0xFF) + 2];
+	}
+	printf("  table lookup alone: %.1f ns per packet (checksum %u)\n", elapsed_s(&start) * 1e3, sum_lut);
+	if (sum_lut != now) {
+		printf("ERROR: correction tables do not match the reference formula\n");
+		++nb_err;
+	}
+	/* FSK: fixed correction for the configured datarate */
+	sim_rx.if_chain = 9;
+	sim_rx.status = 5;
+	sim_rx.size = PAYLOAD_SIZE;
+	sim_rx.count_us = 1000;
+	lgw_sim_inject_rx(&sim_rx);
+	if ((lgw_receive(1, rxpkt) != 1) || (rxpkt[0].modulation != MOD_FSK) || (rxpkt[0].count_us != 1000 - ((680000 / FSK_DR) - 20))) {
+		printf("ERROR: wrong FSK timestamp correction\n");
+		++nb_err;
+	}
+	if ((nb_rx != NB_TCORR_PKT) || (nb_err != 0)) {
+		printf("ERROR: %d packets received instead of %d, %d wrong timestamps\n", nb_rx, NB_TCORR_PKT, nb_err);
+		lgw_stop();
+		return -1;
+	}
+	
+	/* RX wait: timeout with an empty FIFO, then wake up on each injected packet */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	nb_pkt = lgw_receive_wait(50, ARRAY_SIZE(rxpkt), rxpkt);
+	t = elapsed_s(&start);
+	printf("lgw_receive_wait: empty FIFO, returned %d after %.3f s (50 ms timeout)\n", nb_pkt, t);
+	if ((nb_pkt != 0) || (t < 0.045)) {
+		printf("ERROR: lgw_receive_wait did not time out as expected\n");
+		lgw_stop();
+		return -1;
+	}
+	reset_stats();
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pthread_create(&thrid, NULL, thread_inject, NULL);
+	for (nb_rx = 0; nb_rx < NB_WAIT_PKT; ) {
+		nb_pkt = lgw_receive_wait(1000, ARRAY_SIZE(rxpkt), rxpkt);
+		if (nb_pkt <= 0) {
+			break;
+		}
+		++nb_wake;
+		for (j = 0; j < nb_pkt; ++j) {
+			if ((rxpkt[j].size != PAYLOAD_SIZE) || (rxpkt[j].payload[0] != (uint8_t)nb_rx)) {
+				++nb_err;
+			}
+			++nb_rx;
+		}
+	}
+	pthread_join(thrid, NULL);
+	t = elapsed_s(&start);
+	if (print_stats("lgw_receive_wait", nb_rx, t) != 0) {
+		++nb_err;
+	}
+	printf("  %d wake-ups, %.0f us injection period\n", nb_wake, 1e6 * t / NB_WAIT_PKT);
+	if ((nb_rx != NB_WAIT_PKT) || (nb_err != 0)) {
+		printf("ERROR: %d packets received instead of %d, %d packets with wrong content\n", nb_rx, NB_WAIT_PKT, nb_err);
+		lgw_stop();
+		return -1;
+	}
+	
+	/* RX ring: packets fetched by the dedicated thread, then a stalled consumer */
+	if (lgw_ring_start(RING_SIZE, RING_PRIO) != LGW_RING_SUCCESS) {
+		printf("ERROR: failed to start the RX fetch thread\n");
+		lgw_stop();
+		return -1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pthread_create(&thrid, NULL, thread_inject, NULL);
+	for (nb_rx = 0; nb_rx < NB_WAIT_PKT; ) {
+		nb_pkt = lgw_ring_pop_wait(1000, ARRAY_SIZE(rxpkt), rxpkt);
+		if (nb_pkt <= 0) {
+			break;
+		}
+		for (j = 0; j < nb_pkt; ++j) {
+			if ((rxpkt[j].size != PAYLOAD_SIZE) || (rxpkt[j].payload[0] != (uint8_t)nb_rx)) {
+				++nb_err;
+			}
+			++nb_rx;
+		}
+	}
+	pthread_join(thrid, NULL);
+	t = elapsed_s(&start);
+	pthread_create(&thrid, NULL, thread_inject, NULL); /* nobody pops, the ring overruns */
+	pthread_join(thrid, NULL);
+	nanosleep(&pause, NULL);
+	while ((nb_pkt = lgw_ring_pop_bulk(ARRAY_SIZE(rxpkt), rxpkt)) > 0) {
+		nb_rx += nb_pkt;
+	}
+	lgw_ring_get_stats(&rs);
+	lgw_ring_stop();
+	printf("lgw_ring: %d packets in %.3f s, %s scheduling\n", NB_WAIT_PKT, t, rs.rt_sched ? "SCHED_FIFO" : "default");
+	printf("  stalled consumer: %u fetched, %u popped, %u overruns, %u max fill\n", rs.nb_fetched, rs.nb_popped, rs.nb_overrun, rs.max_fill);
+	if ((nb_err != 0) || (rs.nb_fetched != 2 * NB_WAIT_PKT) || (rs.nb_popped != (uint32_t)nb_rx) || (rs.nb_overrun != (2 * NB_WAIT_PKT - RING_SIZE - NB_WAIT_PKT)) || (rs.max_fill != RING_SIZE) || (rs.nb_fetch_error != 0)) {
+		printf("ERROR: unexpected RX ring counters or content (%d errors)\n", nb_err);
+		lgw_stop();
+		return -1;
+	}
+	
+	/* TX: send LoRa packets and check the content of the TX buffer */
+	memset(&txpkt, 0, sizeof(txpkt));
+	txpkt.freq_hz = F_TX;
+	txpkt.tx_mode = IMMEDIATE;
+	txpkt.rf_power = 10;
+	txpkt.modulation = MOD_LORA;
+	txpkt.bandwidth = BW_125KHZ;
+	txpkt.datarate = DR_LORA_SF9;
+	txpkt.coderate = CR_LORA_4_5;
+	txpkt.preamble = 8;
+	txpkt.size = PAYLOAD_SIZE;
+	reset_stats();
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < NB_TX_PKT; ++i) {
+		memset(txpkt.payload, (uint8_t)i, PAYLOAD_SIZE);
+		if ((lgw_send(txpkt) != LGW_HAL_SUCCESS) || (lgw_sim_get_tx(&sim_tx) != LGW_SIM_SUCCESS)) {
+			++nb_err;
+		} else if ((sim_tx.trig != 1) || (sim_tx.size != (16 + PAYLOAD_SIZE)) || (sim_tx.data[10] != PAYLOAD_SIZE) || (sim_tx.data[16] != (uint8_t)i)) {
+			++nb_err;
+		}
+	}
+	if (print_stats("lgw_send", NB_TX_PKT, elapsed_s(&start)) != 0) {
+		++nb_err;
+	}
+	if (nb_err != 0) {
+		printf("ERROR: %d packets sent with wrong content\n", nb_err);
+		lgw_stop();
+		return -1;
+	}
+	
+	/* TX queue: timestamped packets queued out of order, each loaded just before its trigger */
+	if (lgw_txq_start() != LGW_TXQ_SUCCESS) {
+		printf("ERROR: failed to start the downlink scheduler\n");
+		lgw_stop();
+		return -1;
+	}
+	txpkt.tx_mode = TIMESTAMPED;
+	txpkt.datarate = DR_LORA_SF7;
+	lgw_get_instcnt(&now);
+	txpkt.count_us = now + 1000;
+	if (lgw_txq_enqueue(&txpkt, NULL) != LGW_TXQ_TOO_LATE) {
+		++nb_err;
+	}
+	now += 100000; /* time to queue everything */
+	for (i = NB_TXQ_PKT - 1; i >= 0; --i) {
+		txpkt.count_us = now + i * TXQ_SPACING_US;
+		memset(txpkt.payload, (uint8_t)i, PAYLOAD_SIZE);
+		if (lgw_txq_enqueue(&txpkt, &txq_id[i]) != LGW_TXQ_SUCCESS) {
+			++nb_err;
+		}
+	}
+	txpkt.count_us = now + TXQ_SPACING_US / 2;
+	if (lgw_txq_enqueue(&txpkt, NULL) != LGW_TXQ_COLLISION) {
+		++nb_err;
+	}
+	last_cnt = now - 1;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; (i < NB_TXQ_PKT) && (elapsed_s(&start) < 10.0); ) {
+		if ((lgw_sim_get_tx(&sim_tx) == LGW_SIM_SUCCESS) && (sim_tx.trig == 2)) {
+			tx_cnt = ((uint32_t)sim_tx.data[3] << 24) | ((uint32_t)sim_tx.data[4] << 16) | ((uint32_t)sim_tx.data[5] << 8) | sim_tx.data[6];
+			if (tx_cnt != last_cnt) {
+				lead = (int32_t)(tx_cnt - sim_tx.count_us);
+				lead_min = (lead < lead_min) ? lead : lead_min;
+				lead_max = (lead > lead_max) ? lead : lead_max;
+				if ((tx_cnt != now + i * TXQ_SPACING_US) || (sim_tx.data[16] != (uint8_t)i)) {
+					++nb_err;
+				}
+				last_cnt = tx_cnt;
+				++i;
+			}
+		}
+		nanosleep(&poll, NULL);
+	}
+	nanosleep(&pause, NULL); /* let the last packet go on air */
+	for (j = 0; j < NB_TXQ_PKT; ++j) {
+		if ((lgw_txq_status(txq_id[j], &state) != LGW_TXQ_SUCCESS) || (state != TXQ_SENT)) {
+			++nb_err;
+		}
+	}
+	lgw_txq_get_stats(&qs);
+	lgw_txq_stop();
+	printf("lgw_txq: %d packets loaded %.1f to %.1f ms before their trigger time\n", i, lead_min / 1000.0, lead_max / 1000.0);
+	printf("  %u queued, %u sent, %u missed, %u rejected late, %u rejected collision\n", qs.nb_queued, qs.nb_sent, qs.nb_missed, qs.nb_rej_late, qs.nb_rej_collision);
+	if ((nb_err != 0) || (i != NB_TXQ_PKT) || (qs.nb_sent != NB_TXQ_PKT) || (qs.nb_missed != 0) || (qs.nb_rej_late != 1) || (qs.nb_rej_collision != 1) || (lead_min < 3000) || (lead_max > 20000)) {
+		printf("ERROR: unexpected downlink scheduler behaviour (%d errors)\n", nb_err);
+		lgw_stop();
+		return -1;
+	}
+	
+	/* TX queue: packets at the min accepted gap, the next one is loaded after the end of the previous one */
+	lgw_txq_start();
+	lgw_get_instcnt(&now);
+	txpkt.count_us = now + 100000;
+	for (i = 0; i < 2; ++i) {
+		if (lgw_txq_enqueue(&txpkt, &txq_id[i]) != LGW_TXQ_SUCCESS) {
+			++nb_err;
+		}
+		txpkt.count_us += lgw_time_on_air(&txpkt) + LGW_TXQ_GAP_MIN_US;
+	}
+	txpkt.count_us -= 1; /* 1 us short of the gap */
+	if (lgw_txq_enqueue(&txpkt, NULL) != LGW_TXQ_COLLISION) {
+		++nb_err;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do {
+		nanosleep(&poll, NULL);
+		lgw_txq_status(txq_id[1], &state);
+	} while (((state == TXQ_QUEUED) || (state == TXQ_LOADED)) && (elapsed_s(&start) < 2.0));
+	lgw_txq_get_stats(&qs);
+	lgw_txq_stop();
+	printf("lgw_txq: packets %u us apart, %u sent, %u missed\n", LGW_TXQ_GAP_MIN_US, qs.nb_sent, qs.nb_missed);
+	if ((nb_err != 0) || (qs.nb_sent != 2) || (qs.nb_missed != 0) || (qs.nb_rej_collision != 1)) {
+		printf("ERROR: packets at the min gap not sent (%d errors)\n", nb_err);
+		lgw_stop();
+		return -1;
+	}
+	
+	/* RX timestamp correction of the stand-alone modem at the other bandwidths, restarting from the calibration cache */
+	for (i = 0; i < (int)ARRAY_SIZE(tcorr_bw); ++i) {
+		lgw_stop();
+		ifconf.rf_chain = 0;
+		ifconf.freq_hz = 0;
+		ifconf.bandwidth = tcorr_bw[i];
+		ifconf.datarate = DR_LORA_SF10;
+		lgw_rxif_setconf(8, ifconf);
+		if (lgw_start_ex(&startconf) != LGW_HAL_SUCCESS) {
+			printf("ERROR: failed to restart the emulated concentrator\n");
+			return -1;
+		}
+		nb_err = check_tcorr_std(tcorr_bw[i]);
+		printf("RX timestamp correction, stand-alone modem at %u kHz: %d packets, %d errors\n", (tcorr_bw[i] == BW_125KHZ) ? 125 : 500, NB_TCORR_STD_PKT, nb_err);
+		if (nb_err != 0) {
+			lgw_stop();
+			return -1;
+		}
+	}
+	ifconf.bandwidth = BW_250KHZ;
+	lgw_rxif_setconf(8, ifconf);
+	
+	lgw_stop();
+	
+	/* warm start, the TX calibration results come from the cache */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (lgw_start_ex(&startconf) != LGW_HAL_SUCCESS) {
+		printf("ERROR: failed to restart the emulated concentrator\n");
+		return -1;
+	}
+	t = elapsed_s(&start);
+	lgw_get_cal_info(&cal_status, &cal_cached);
+	printf("Concentrator restarted in %.3f s (calibration status 0x%02X, %s)\n", t, cal_status, cal_cached ? "cached" : "full");
+	i = print_start_wait(&sw_warm);
+	lgw_stop();
+	remove(CAL_CACHE);
+	if ((i != 0) || (cal_cached == false) || (cal_status != 0xFF) || (sw_warm.cal_us > sw_cold.cal_us / 2)) {
+		printf("ERROR: calibration cache not used on a warm start\n");
+		return -1;
+	}
+	
+	lgw_sim_set_irq_fd(-1);
+	close(irq_fd);
+	
+	/* SPI link: chunk size from the environment, clock from the board configuration */
+	setenv("LGW_SPI_CHUNK", "256", 1);
+	memset(&boardconf, 0, sizeof(boardconf));
+	boardconf.spi_speed = 4000000;
+	lgw_board_setconf(boardconf);
+	i = lgw_start();
+	lgw_reg_spi_getconf(&spi_speed, &spi_chunk);
+	lgw_stop();
+	unsetenv("LGW_SPI_CHUNK");
+	printf("SPI link: %u Hz, %u byte chunks\n", spi_speed, spi_chunk);
+	if ((i != LGW_HAL_SUCCESS) || (spi_speed != 4000000) || (spi_chunk != 256)) {
+		printf("ERROR: SPI link parameters not applied\n");
+		return -1;
+	}
+	
+	/* SPI auto-tune: sweep capped at the SX1301 rated clock, largest chunk */
+	lgw_sim_set_spi_limit(SPI_LIMIT_HZ);
+	boardconf.spi_speed = 0;
+	boardconf.spi_autotune = true;
+	lgw_board_setconf(boardconf);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	i = lgw_start();
+	t = elapsed_s(&start);
+	lgw_reg_spi_getconf(&spi_speed, &spi_chunk);
+	lgw_stop();
+	lgw_sim_set_spi_limit(0);
+	memset(&boardconf, 0, sizeof(boardconf));
+	lgw_board_setconf(boardconf);
+	printf("SPI auto-tune: %u Hz, %u byte chunks, start in %.3f s\n", spi_speed, spi_chunk, t);
+	if ((i != LGW_HAL_SUCCESS) || (spi_speed != 10000000) || (spi_chunk != 0xFFFF)) {
+		printf("ERROR: SPI auto-tune did not stop at the rated clock\n");
+		return -1;
+	}
+	
+	/* SPI auto-tune beyond the rating: one step below the last clock passing before the emulated limit */
+	lgw_sim_set_spi_limit(SPI_LIMIT_HZ);
+	boardconf.spi_speed = 32000000;
+	boardconf.spi_autotune = true;
+	lgw_board_setconf(boardconf);
+	i = lgw_start();
+	lgw_reg_spi_getconf(&spi_speed, &spi_chunk);
+	lgw_stop();
+	lgw_sim_set_spi_limit(0);
+	memset(&boardconf, 0, sizeof(boardconf));
+	lgw_board_setconf(boardconf);
+	printf("SPI auto-tune up to 32 MHz: %u Hz\n", spi_speed);
+	if ((i != LGW_HAL_SUCCESS) || (spi_speed != 8000000)) {
+		printf("ERROR: SPI auto-tune kept no margin below the emulated limit\n");
+		return -1;
+	}
+	
+	/* SPI trace: every access recorded, tagged with the HAL function that made it */
+	setenv("LGW_SPI_TRACE", SPI_TRACE, 1);
+	i = lgw_start();
+	lgw_status(TX_STATUS, &state);
+	lgw_reg_get_stats(&regstats);
+	lgw_stop();
+	unsetenv("LGW_SPI_TRACE");
+	lgw_reg_trace_stop();
+	j = count_trace(SPI_TRACE, trace_cnt, ARRAY_SIZE(trace_cnt));
+	remove(SPI_TRACE);
+	printf("SPI trace: %u accesses in lgw_start, %u in lgw_status, %u in lgw_stop (%u counted)\n", trace_cnt[LGW_TRACE_SITE_START], trace_cnt[LGW_TRACE_SITE_STATUS], trace_cnt[LGW_TRACE_SITE_STOP], regstats.nb_frame);
+	if ((i != LGW_HAL_SUCCESS) || (j != 0) || (trace_cnt[LGW_TRACE_SITE_NONE] != 0) || (trace_cnt[LGW_TRACE_SITE_STATUS] == 0) || (trace_cnt[LGW_TRACE_SITE_STOP] == 0) || (trace_cnt[LGW_TRACE_SITE_START] + trace_cnt[LGW_TRACE_SITE_STATUS] != regstats.nb_frame)) {
+		printf("ERROR: SPI trace incomplete or call sites wrong\n");
+		return -1;
+	}
+	
+	/* several concentrators: one context handle and one thread per emulator instance */
+	for (i = 0; i < NB_BOARD; ++i) {
+		board[i].ctx = lgw_ctx_new(board[i].name);
+		if (board[i].ctx == NULL) {
+			printf("ERROR: failed to create the context of %s\n", board[i].name);
+			return -1;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < NB_BOARD; ++i) {
+		pthread_create(&board_thrid[i], NULL, thread_board, &board[i]);
+	}
+	for (i = 0; i < NB_BOARD; ++i) {
+		pthread_join(board_thrid[i], NULL);
+	}
+	t = elapsed_s(&start);
+	for (i = 0; i < NB_BOARD; ++i) {
+		printf("lgw_ctx %s: %d packets received, %d sent, %d errors\n", board[i].name, board[i].nb_rx, board[i].nb_tx, board[i].nb_err);
+		if ((board[i].nb_rx != NB_BOARD_PKT) || (board[i].nb_tx != NB_BOARD_PKT / 8) || (board[i].nb_err != 0)) {
+			++nb_err;
+		}
+		lgw_ctx_free(board[i].ctx);
+	}
+	printf("  %d concentrators started and driven in parallel in %.3f s\n", NB_BOARD, t);
+	if (nb_err != 0) {
+		printf("ERROR: packets of a concentrator lost or seen by another one\n");
+		return -1;
+	}
+	
+	printf("End of test for loragw_hal.c on the concentrator emulator\n");
+	return 0;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
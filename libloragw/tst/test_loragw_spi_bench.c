@@ -0,0 +1,130 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Microbenchmark of the loragw_spi burst functions.
+	Measures the latency of burst writes and reads of 16 B, 256 B and 8 kB,
+	for the SPI physical layer selected in library.cfg.
+	Only the TX data buffer and the RX data buffer address are accessed.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+	#define _XOPEN_SOURCE 600
+#else
+	#define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>		/* C99 types */
+#include <stdio.h>		/* printf */
+#include <time.h>		/* clock_gettime */
+
+#include "loragw_spi.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+/* page-independent registers, see loragw_reg.c */
+#define ADDR_RX_BUF_DATA	4
+#define ADDR_TX_BUF_ADDR	5
+#define ADDR_TX_BUF_DATA	6
+
+#define BENCH_MAX_SIZE	8192
+#define BENCH_REPEAT	200	/* bursts measured per size and direction */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static const uint16_t bench_size[] = {16, 256, BENCH_MAX_SIZE};
+
+static uint8_t dataout[BENCH_MAX_SIZE];
+static uint8_t datain[BENCH_MAX_SIZE];
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+double elapsed_us(struct timespec *start, struct timespec *end) {
+	return (1E6 * (end->tv_sec - start->tv_sec)) + (1E-3 * (end->tv_nsec - start->tv_nsec));
+}
+
+/* run BENCH_REPEAT bursts, print min/avg/max latency, return the number of failed bursts */
+int bench(void *spi_target, uint16_t size, int write) {
+	struct timespec start, end;
+	double t, t_min = 0, t_max = 0, t_sum = 0;
+	int nb_fail = 0;
+	int i, x;
+
+	for (i = 0; i < BENCH_REPEAT; ++i) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (write) {
+			x = lgw_spi_wb(spi_target, ADDR_TX_BUF_DATA, dataout, size);
+		} else {
+			x = lgw_spi_rb(spi_target, ADDR_RX_BUF_DATA, datain, size);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		if (x != LGW_SPI_SUCCESS) {
+			++nb_fail;
+		}
+		t = elapsed_us(&start, &end);
+		t_min = ((i == 0) || (t < t_min)) ? t : t_min;
+		t_max = ((i == 0) || (t > t_max)) ? t : t_max;
+		t_sum += t;
+	}
+	printf("  %s %5u B: min %9.1f us, avg %9.1f us, max %9.1f us, %6.2f MB/s", write ? "write" : "read ", size, t_min, t_sum / BENCH_REPEAT, t_max, (size * BENCH_REPEAT) / t_sum);
+	if (nb_fail > 0) {
+		printf(", %d FAILED", nb_fail);
+	}
+	printf("\n");
+	return nb_fail;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main()
+{
+	void *spi_target = NULL;
+	int nb_fail = 0;
+	int i;
+
+	for (i = 0; i < BENCH_MAX_SIZE; ++i) {
+		dataout[i] = (uint8_t)i;
+	}
+
+	printf("Beginning of SPI burst benchmark for loragw_spi.c\n");
+	if (lgw_spi_open(&spi_target) != LGW_SPI_SUCCESS) {
+		printf("ERROR: failed to open SPI link\n");
+		return -1;
+	}
+	lgw_spi_w(spi_target, ADDR_TX_BUF_ADDR, 0);
+
+	printf("%d bursts per size, latency seen by the caller:\n", BENCH_REPEAT);
+	for (i = 0; i < (int)ARRAY_SIZE(bench_size); ++i) {
+		nb_fail += bench(spi_target, bench_size[i], 1);
+		nb_fail += bench(spi_target, bench_size[i], 0);
+	}
+
+	lgw_spi_close(spi_target);
+	printf("End of SPI burst benchmark for loragw_spi.c\n");
+
+	return (nb_fail == 0) ? 0 : -1;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,301 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Conversion of the binary packet logs of util_pkt_logger (see pktlog.h)
+	to the CSV log format, or to JSON lines
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+	#define _XOPEN_SOURCE 600
+#else
+	#define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+#include <stdio.h>		/* printf fprintf fopen fread */
+#include <string.h>		/* memcpy */
+#include <unistd.h>		/* getopt */
+#include <stdlib.h>		/* malloc free */
+
+#include "pktlog.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define MSG(args...)	fprintf(stderr, args) /* message that is destined to the user */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define		OUT_CSV		0
+#define		OUT_JSON	1
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+void usage (void);
+
+uint8_t *load_log(const char *path, long *size);
+
+void print_json(FILE *out, const char *gateway_id, const char *timestamp, const struct lgw_pkt_rx_s *p);
+
+int convert(FILE *out, int format, const char *path);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* describe command line options */
+void usage(void) {
+	MSG( "Usage: util_pkt_convert [options] <binary log file>...\n");
+	MSG( "Available options:\n");
+	MSG( " -h print this help\n");
+	MSG( " -j write JSON lines instead of CSV\n");
+	MSG( " -o <path> output file (default: standard output)\n");
+}
+
+/* read a whole log file in memory */
+uint8_t *load_log(const char *path, long *size) {
+	FILE *f;
+	uint8_t *buf;
+	
+	f = fopen(path, "rb");
+	if (f == NULL) {
+		MSG("ERROR: failed to open %s\n", path);
+		return NULL;
+	}
+	fseek(f, 0, SEEK_END);
+	*size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	buf = malloc((*size > 0) ? *size : 1);
+	if (buf == NULL) {
+		MSG("ERROR: failed to allocate %li bytes\n", *size);
+		fclose(f);
+		return NULL;
+	}
+	if (fread(buf, 1, *size, f) != (size_t)*size) {
+		MSG("ERROR: failed to read %s\n", path);
+		free(buf);
+		fclose(f);
+		return NULL;
+	}
+	fclose(f);
+	return buf;
+}
+
+/* one packet as a JSON object on one line, same fields as a CSV line */
+void print_json(FILE *out, const char *gateway_id, const char *timestamp, const struct lgw_pkt_rx_s *p) {
+	const char *str;
+	int j;
+	
+	fprintf(out, "{\"gateway\":\"%s\",\"time\":\"%s\",\"tmst\":%u,\"freq\":%u,\"rfch\":%u,\"chan\":%u,", gateway_id, timestamp, p->count_us, p->freq_hz, p->rf_chain, p->if_chain);
+	
+	switch(p->status) {
+		case STAT_CRC_OK:	str = "CRC_OK"; break;
+		case STAT_CRC_BAD:	str = "CRC_BAD"; break;
+		case STAT_NO_CRC:	str = "NO_CRC"; break;
+		case STAT_UNDEFINED:str = "UNDEF"; break;
+		default: str = "ERR";
+	}
+	fprintf(out, "\"stat\":\"%s\",\"size\":%u,", str, p->size);
+	
+	switch(p->modulation) {
+		case MOD_LORA:	str = "LORA"; break;
+		case MOD_FSK:	str = "FSK"; break;
+		default: str = "ERR";
+	}
+	fprintf(out, "\"modu\":\"%s\",", str);
+	
+	switch(p->bandwidth) {
+		case BW_500KHZ:	j = 500000; break;
+		case BW_250KHZ:	j = 250000; break;
+		case BW_125KHZ:	j = 125000; break;
+		case BW_62K5HZ:	j = 62500; break;
+		case BW_31K2HZ:	j = 31200; break;
+		case BW_15K6HZ:	j = 15600; break;
+		case BW_7K8HZ:	j = 7800; break;
+		case BW_UNDEFINED: j = 0; break;
+		default: j = -1;
+	}
+	fprintf(out, "\"bw\":%d,", j);
+	
+	/* LoRa datarate as a string, FSK datarate in bps */
+	if (p->modulation == MOD_FSK) {
+		fprintf(out, "\"datr\":%u,", p->datarate);
+	} else {
+		switch (p->datarate) {
+			case DR_LORA_SF7:	str = "SF7"; break;
+			case DR_LORA_SF8:	str = "SF8"; break;
+			case DR_LORA_SF9:	str = "SF9"; break;
+			case DR_LORA_SF10:	str = "SF10"; break;
+			case DR_LORA_SF11:	str = "SF11"; break;
+			case DR_LORA_SF12:	str = "SF12"; break;
+			default: str = "ERR";
+		}
+		fprintf(out, "\"datr\":\"%s\",", (p->modulation == MOD_LORA) ? str : "ERR");
+	}
+	
+	switch (p->coderate) {
+		case CR_LORA_4_5:	str = "4/5"; break;
+		case CR_LORA_4_6:	str = "2/3"; break;
+		case CR_LORA_4_7:	str = "4/7"; break;
+		case CR_LORA_4_8:	str = "1/2"; break;
+		case CR_UNDEFINED:	str = ""; break;
+		default: str = "ERR";
+	}
+	fprintf(out, "\"codr\":\"%s\",\"rssi\":%.0f,\"lsnr\":%.1f,\"data\":\"", str, p->rssi, p->snr);
+	for (j = 0; j < p->size; ++j) {
+		fprintf(out, "%02X", p->payload[j]);
+	}
+	fputs("\"}\n", out);
+}
+
+/* convert one binary log, skipping the damaged parts up to the next sync marker or file header */
+int convert(FILE *out, int format, const char *path) {
+	uint8_t *buf;
+	long size, pos = 0;
+	long skip_pos = -1; /* start of the bytes being skipped, -1 if none */
+	unsigned long nb_pkt = 0, nb_skip = 0;
+	struct pktlog_head_s head;
+	struct lgw_pkt_rx_s pkt;
+	char gateway_id[17];
+	char timestamp[PKTLOG_TIMESTAMP_LEN];
+	bool head_ok = false; /* a file header was read, packet records can be decoded */
+	bool synced = false; /* the time base of the next packet records is known */
+	uint64_t base_ms = 0;
+	uint64_t t_ms;
+	uint32_t offset_ms;
+	int n;
+	
+	buf = load_log(path, &size);
+	if (buf == NULL) {
+		return -1;
+	}
+	
+	while (pos < size) {
+		if (((size - pos) >= PKTLOG_HEAD_SIZE) && (pktlog_bin_get_head(buf + pos, &head) == 0)) {
+			/* a log file (re)opened by the logger */
+			if (head.version > PKTLOG_VERSION) {
+				MSG("WARNING: %s: log of version %u, only the version %u fields are converted\n", path, head.version, PKTLOG_VERSION);
+			}
+			sprintf(gateway_id, "%08X%08X", (uint32_t)(head.gateway_mac >> 32), (uint32_t)(head.gateway_mac & 0xFFFFFFFF));
+			if (format == OUT_CSV) {
+				pktlog_csv_head(out);
+			}
+			head_ok = true;
+			synced = false;
+			n = head.head_size;
+		} else if (((size - pos) >= PKTLOG_SYNC_SIZE) && (pktlog_bin_get_sync(buf + pos, &base_ms) == 0)) {
+			synced = head_ok;
+			n = PKTLOG_SYNC_SIZE;
+		} else if (synced && ((size - pos) >= head.rec_size) && ((n = pktlog_bin_get_pkt(buf + pos, head.rec_size, &offset_ms, &pkt)) > 0) && (n <= (size - pos))) {
+			memcpy(pkt.payload, buf + pos + head.rec_size, pkt.size);
+			t_ms = base_ms + offset_ms;
+			pktlog_timestamp(timestamp, (time_t)(t_ms / 1000), (long)(t_ms % 1000));
+			if (format == OUT_JSON) {
+				print_json(out, gateway_id, timestamp, &pkt);
+			} else {
+				pktlog_csv(out, gateway_id, timestamp, &pkt);
+			}
+			++nb_pkt;
+		} else {
+			/* damaged or truncated, look for the next sync marker or file header */
+			if (skip_pos < 0) {
+				skip_pos = pos;
+			}
+			synced = false;
+			++nb_skip;
+			++pos;
+			continue;
+		}
+		if (skip_pos >= 0) {
+			MSG("WARNING: %s: %li byte(s) skipped at offset %li\n", path, pos - skip_pos, skip_pos);
+			skip_pos = -1;
+		}
+		pos += n;
+	}
+	if (skip_pos >= 0) {
+		MSG("WARNING: %s: %li byte(s) skipped at offset %li (truncated log)\n", path, pos - skip_pos, skip_pos);
+	}
+	if (!head_ok) {
+		MSG("ERROR: %s is not a binary packet log\n", path);
+	} else {
+		MSG("INFO: %s: %lu packet(s) converted, %lu byte(s) skipped\n", path, nb_pkt, nb_skip);
+	}
+	free(buf);
+	return head_ok ? 0 : -1;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+	int i;
+	int format = OUT_CSV;
+	const char *out_path = NULL;
+	FILE *out = stdout;
+	int err = 0;
+	
+	/* parse command line options */
+	while ((i = getopt (argc, argv, "hjo:")) != -1) {
+		switch (i) {
+			case 'h':
+				usage();
+				return EXIT_FAILURE;
+				break;
+			
+			case 'j':
+				format = OUT_JSON;
+				break;
+			
+			case 'o':
+				out_path = optarg;
+				break;
+			
+			default:
+				MSG("ERROR: argument parsing use -h option for help\n");
+				usage();
+				return EXIT_FAILURE;
+		}
+	}
+	if (optind >= argc) {
+		usage();
+		return EXIT_FAILURE;
+	}
+	
+	if (out_path != NULL) {
+		out = fopen(out_path, "w");
+		if (out == NULL) {
+			MSG("ERROR: impossible to create %s\n", out_path);
+			return EXIT_FAILURE;
+		}
+	}
+	
+	for (i = optind; i < argc; ++i) {
+		if (convert(out, format, argv[i]) != 0) {
+			err = 1;
+		}
+	}
+	
+	if (out != stdout) {
+		fclose(out);
+	}
+	return err ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
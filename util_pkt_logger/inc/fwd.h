@@ -0,0 +1,125 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Packet forwarding stage: one persistent, non-blocking TCP connection per
+	sink, with reconnect backoff and a bounded outbound queue.
+	Each packet is sent as a frame: payload size on 2 bytes (big endian)
+	followed by the payload, so that several packets go in one write.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+#ifndef _FWD_H
+#define _FWD_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+/* return status code */
+#define FWD_SUCCESS			0
+#define FWD_ERROR			-1
+
+#define FWD_QUEUE_DEFAULT	256		/* packets queued per sink while it is slow or disconnected */
+#define FWD_BACKOFF_MIN_MS	100		/* delay before the first reconnect attempt, doubled on each failure */
+#define FWD_BACKOFF_MAX_MS	30000	/* max delay between reconnect attempts */
+#define FWD_FRAME_HEAD		2		/* size of the frame header (payload size, big endian) */
+#define FWD_PAYLOAD_MAX		255		/* max payload size of a frame */
+
+/* what to do with a packet when the queue of a sink is full */
+#define FWD_DROP_NEWEST		0		/* keep the queued packets, drop the new one */
+#define FWD_DROP_OLDEST		1		/* drop the oldest queued packet not yet partly sent, keep the new one */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@brief Opaque handle on a forwarding sink, see fwd_open
+*/
+typedef struct fwd_sink_s fwd_sink_t;
+
+/**
+@struct fwd_conf_s
+@brief Configuration of a forwarding sink
+*/
+struct fwd_conf_s {
+	char		host[64];	/*!> IPv4 address or host name of the sink */
+	uint16_t	port;		/*!> TCP port of the sink */
+	uint32_t	queue_size;	/*!> max number of queued packets, 0 for FWD_QUEUE_DEFAULT */
+	uint8_t		policy;		/*!> FWD_DROP_NEWEST or FWD_DROP_OLDEST */
+};
+
+/**
+@struct fwd_stats_s
+@brief Counters of a forwarding sink, since it was opened
+*/
+struct fwd_stats_s {
+	bool		connected;	/*!> connection currently established */
+	uint32_t	nb_queued;	/*!> packets accepted in the queue */
+	uint32_t	nb_sent;	/*!> packets completely written to the connection */
+	uint32_t	nb_dropped;	/*!> packets dropped because the queue was full */
+	uint32_t	nb_connect;	/*!> connections established */
+	uint32_t	nb_lost;	/*!> connections lost or refused */
+	uint32_t	nb_write;	/*!> gather writes (one per batch of packets) */
+	uint32_t	queue_max;	/*!> max number of packets seen in the queue */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Create a sink, resolve its address and start connecting to it (non-blocking)
+@param conf configuration of the sink
+@return handle on the sink, NULL if the address cannot be resolved or allocation failed
+*/
+fwd_sink_t *fwd_open(const struct fwd_conf_s *conf);
+
+/**
+@brief Try once more to send the queued packets, then close the connection and free the sink
+@param sink handle returned by fwd_open, NULL is ignored
+*/
+void fwd_close(fwd_sink_t *sink);
+
+/**
+@brief Queue a packet for a sink, applying the queue policy if it is full
+@param sink handle returned by fwd_open
+@param payload bytes to forward
+@param size number of bytes, FWD_PAYLOAD_MAX at most
+@return FWD_ERROR if the packet was dropped, FWD_SUCCESS else
+*/
+int fwd_push(fwd_sink_t *sink, const uint8_t *payload, uint16_t size);
+
+/**
+@brief Make the connection progress and send as many queued packets as the socket accepts, never blocks
+@param sink handle returned by fwd_open
+@return FWD_ERROR if the connection is down (packets stay queued), FWD_SUCCESS else
+
+Call it after each batch of fwd_push, and regularly so that a lost connection is
+re-established after its backoff delay.
+*/
+int fwd_service(fwd_sink_t *sink);
+
+/**
+@brief Get the counters of a sink
+@param sink handle returned by fwd_open
+@param stats pointer to the structure receiving the counters
+@return FWD_ERROR if a pointer is NULL, FWD_SUCCESS else
+*/
+int fwd_get_stats(fwd_sink_t *sink, struct fwd_stats_s *stats);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,112 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Packet log writer thread: formats the received packets and writes them
+	to the log file in large chunks, so that the RX path never waits for
+	the storage.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+#ifndef _LOG_WRITER_H
+#define _LOG_WRITER_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+#include <time.h>		/* struct timespec */
+
+#include "loragw_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+/* return status code */
+#define LOGW_SUCCESS		0
+#define LOGW_ERROR			-1
+
+#define LOGW_QUEUE_DEFAULT	1024	/* packets waiting to be written */
+#define LOGW_CHUNK_DEFAULT	65536	/* bytes buffered before a write to the file */
+#define LOGW_FLUSH_DEFAULT	1000	/* max delay in ms before buffered packets are written */
+
+/* log file formats */
+#define LOGW_FORMAT_CSV		0		/* text, one line per packet, pktlog_<gateway ID>.csv */
+#define LOGW_FORMAT_BIN		1		/* binary records, see pktlog.h, pktlog_<gateway ID>.bin */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct logw_conf_s
+@brief Configuration of the log writer
+*/
+struct logw_conf_s {
+	uint64_t	gateway_mac;	/*!> LoRa gateway MAC address, names the log file */
+	uint8_t		format;			/*!> LOGW_FORMAT_CSV or LOGW_FORMAT_BIN */
+	int			rotate_s;		/*!> new log file every N seconds, -1 to disable rotation */
+	uint32_t	queue_size;		/*!> max number of packets waiting for the writer, 0 for LOGW_QUEUE_DEFAULT */
+	uint32_t	chunk_size;		/*!> bytes buffered before a write, 0 for LOGW_CHUNK_DEFAULT */
+	uint32_t	flush_ms;		/*!> max delay before buffered packets are written, 0 for LOGW_FLUSH_DEFAULT */
+	uint32_t	sync_s;			/*!> fdatasync the log file every N seconds, 0 to leave it to the system */
+};
+
+/**
+@struct logw_stats_s
+@brief Counters of the log writer
+*/
+struct logw_stats_s {
+	uint32_t	nb_queued;		/*!> packets queued by the RX path */
+	uint32_t	nb_dropped;		/*!> packets dropped because the queue was full */
+	uint32_t	nb_written;		/*!> packets formatted into the log file */
+	uint32_t	nb_flush;		/*!> flushes of the log file buffer (size, time, rotation) */
+	uint32_t	nb_sync;		/*!> fdatasync calls */
+	uint32_t	max_fill;		/*!> highest number of packets waiting in the queue */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Open the first log file and start the writer thread
+@param conf configuration of the writer
+@return LOGW_ERROR if the file could not be opened or the thread started, LOGW_SUCCESS otherwise
+*/
+int logw_start(const struct logw_conf_s *conf);
+
+/**
+@brief Write the packets still queued, close the log file and stop the writer thread
+@return LOGW_ERROR if the writer was not running, LOGW_SUCCESS otherwise
+*/
+int logw_stop(void);
+
+/**
+@brief Queue packets for the writer, never blocks
+@param nb_pkt number of packets
+@param pkt_data array of packets
+@param fetch_time time the packets were fetched (CLOCK_REALTIME)
+@return number of packets queued, the others were dropped (queue full)
+
+Only called by one thread (the RX path).
+*/
+int logw_push(int nb_pkt, const struct lgw_pkt_rx_s *pkt_data, const struct timespec *fetch_time);
+
+/**
+@brief Get the counters of the log writer
+@param stats pointer to the structure receiving the counters
+@return LOGW_ERROR if the pointer is NULL, LOGW_SUCCESS otherwise
+*/
+int logw_get_stats(struct logw_stats_s *stats);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
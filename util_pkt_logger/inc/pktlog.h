@@ -0,0 +1,166 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Packet log formats: CSV lines and compact binary records.
+
+	Binary log, all fields little endian:
+	- file header (PKTLOG_HEAD_SIZE bytes), at the start of each log file:
+	  magic (8), version (2), header size (2), record metadata size (2),
+	  sync interval (2), gateway MAC address (8), log start time in s (8)
+	- sync marker (PKTLOG_SYNC_SIZE bytes), after each header and every
+	  'sync interval' packets: pattern (8), time base in ms since the epoch (8)
+	- packet record: metadata (PKTLOG_REC_SIZE bytes) then 'size' payload bytes
+	  tag 'P' (1), status (1), size (2), fetch time in ms after the time base (4),
+	  count_us (4), freq_hz (4), datarate (4), rssi (2), snr (2), if_chain (1),
+	  rf_chain (1), modulation (1), bandwidth (1), coderate (1), reserved (1),
+	  crc (2)
+	  rssi and snr are signed, in 0.01 dB.
+	A reader that lost track of the records (truncated or corrupted file)
+	resumes at the next sync marker or file header.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+#ifndef _PKTLOG_H
+#define _PKTLOG_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+#include <stdio.h>		/* FILE */
+#include <time.h>		/* time_t */
+
+#include "loragw_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define PKTLOG_VERSION		1
+
+#define PKTLOG_HEAD_SIZE	32		/* file header */
+#define PKTLOG_SYNC_SIZE	16		/* sync marker */
+#define PKTLOG_REC_SIZE		32		/* metadata of a packet record, before the payload */
+#define PKTLOG_REC_MAX		(PKTLOG_REC_SIZE + 256)	/* largest packet record */
+#define PKTLOG_SYNC_INTERVAL	256	/* packets between two sync markers */
+#define PKTLOG_TIMESTAMP_LEN	30	/* CSV timestamp string, with terminating null */
+#define PKTLOG_CSV_LINE_MAX	1024	/* CSV line, see pktlog_csv_line */
+
+#define PKTLOG_TAG_PKT		'P'		/* first byte of a packet record */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct pktlog_head_s
+@brief Content of a binary log file header
+*/
+struct pktlog_head_s {
+	uint16_t	version;		/*!> format version */
+	uint16_t	head_size;		/*!> size of the file header */
+	uint16_t	rec_size;		/*!> size of the metadata of a packet record */
+	uint16_t	sync_interval;	/*!> packets between two sync markers */
+	uint64_t	gateway_mac;	/*!> LoRa gateway MAC address */
+	uint64_t	start_time;		/*!> log start time, in seconds since the epoch */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Format a fetch time as in the CSV log (ISO 8601, millisecond resolution, UTC)
+@param buf output string, PKTLOG_TIMESTAMP_LEN bytes
+@param sec seconds since the epoch
+@param ms milliseconds
+*/
+void pktlog_timestamp(char *buf, time_t sec, long ms);
+
+/**
+@brief Write the header line of a CSV log
+@param f log file
+@return negative value if the write failed
+*/
+int pktlog_csv_head(FILE *f);
+
+/**
+@brief Format one line of a CSV log, without stdio nor allocation
+@param line output, PKTLOG_CSV_LINE_MAX bytes, not null-terminated
+@param gateway_id gateway MAC address in hexadecimal (16 characters)
+@param timestamp fetch time, see pktlog_timestamp
+@param p received packet
+@return number of characters of the line, end of line included
+*/
+int pktlog_csv_line(char *line, const char *gateway_id, const char *timestamp, const struct lgw_pkt_rx_s *p);
+
+/**
+@brief Write one line of a CSV log, see pktlog_csv_line
+@param f log file
+@param gateway_id gateway MAC address in hexadecimal
+@param timestamp fetch time, see pktlog_timestamp
+@param p received packet
+*/
+void pktlog_csv(FILE *f, const char *gateway_id, const char *timestamp, const struct lgw_pkt_rx_s *p);
+
+/**
+@brief Encode a binary log file header
+@param buf output, PKTLOG_HEAD_SIZE bytes
+@param gateway_mac LoRa gateway MAC address
+@param start_time log start time
+@return number of bytes encoded
+*/
+int pktlog_bin_head(uint8_t *buf, uint64_t gateway_mac, time_t start_time);
+
+/**
+@brief Encode a binary log sync marker
+@param buf output, PKTLOG_SYNC_SIZE bytes
+@param base_ms time base of the next packet records, in ms since the epoch
+@return number of bytes encoded
+*/
+int pktlog_bin_sync(uint8_t *buf, uint64_t base_ms);
+
+/**
+@brief Encode a binary log packet record
+@param buf output, PKTLOG_REC_SIZE + size bytes
+@param offset_ms fetch time of the packet, in ms after the time base of the last sync marker
+@param p received packet
+@return number of bytes encoded
+*/
+int pktlog_bin_pkt(uint8_t *buf, uint32_t offset_ms, const struct lgw_pkt_rx_s *p);
+
+/**
+@brief Check and decode a binary log file header
+@param buf input, at least PKTLOG_HEAD_SIZE bytes
+@param head decoded header
+@return -1 if buf does not start with a file header of a known version, 0 otherwise
+*/
+int pktlog_bin_get_head(const uint8_t *buf, struct pktlog_head_s *head);
+
+/**
+@brief Check and decode a binary log sync marker
+@param buf input, at least PKTLOG_SYNC_SIZE bytes
+@param base_ms decoded time base
+@return -1 if buf does not start with a sync marker, 0 otherwise
+*/
+int pktlog_bin_get_sync(const uint8_t *buf, uint64_t *base_ms);
+
+/**
+@brief Decode the metadata of a binary log packet record, the payload is not copied
+@param buf input, at least rec_size bytes
+@param rec_size size of the record metadata, from the file header
+@param offset_ms decoded fetch time, in ms after the time base
+@param p decoded packet
+@return -1 if buf does not start with a valid packet record, record size (with payload) otherwise
+*/
+int pktlog_bin_get_pkt(const uint8_t *buf, uint16_t rec_size, uint32_t *offset_ms, struct lgw_pkt_rx_s *p);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,132 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Uplink of the Semtech UDP packet forwarder protocol (version 1): the
+	received packets are sent to the network server as PUSH_DATA datagrams
+	carrying a JSON "rxpk" array, one datagram per batch of packets, and the
+	gateway statistics are sent periodically as "stat" PUSH_DATA datagrams.
+	Each PUSH_DATA is expected to be acknowledged by a PUSH_ACK with the same
+	token, acknowledgements are tracked without ever waiting for them.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+#ifndef _UDP_FWD_H
+#define _UDP_FWD_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+
+#include "loragw_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+/* return status code */
+#define UDP_FWD_SUCCESS			0
+#define UDP_FWD_ERROR			-1
+
+#define UDP_FWD_PORT_DEFAULT	1680	/* network server uplink port */
+#define UDP_FWD_STAT_DEFAULT	30		/* seconds between two stat datagrams */
+#define UDP_FWD_ACK_DEFAULT		100		/* ms waited for a PUSH_ACK before the datagram counts as not acknowledged */
+#define UDP_FWD_DGRAM_MAX		9216	/* max size of a datagram, a batch is split above */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@brief Opaque handle on the uplink to a network server, see udp_fwd_open
+*/
+typedef struct udp_fwd_s udp_fwd_t;
+
+/**
+@struct udp_fwd_conf_s
+@brief Configuration of the uplink to a network server
+*/
+struct udp_fwd_conf_s {
+	char		host[64];		/*!> IPv4 address or host name of the network server */
+	uint16_t	port_up;		/*!> UDP port of the network server, 0 for UDP_FWD_PORT_DEFAULT */
+	uint64_t	gateway_id;		/*!> gateway MAC address, sent in each datagram */
+	uint32_t	stat_s;			/*!> seconds between two stat datagrams, 0 for UDP_FWD_STAT_DEFAULT */
+	uint32_t	ack_ms;			/*!> PUSH_ACK timeout in ms, 0 for UDP_FWD_ACK_DEFAULT */
+	bool		fwd_crc_valid;	/*!> forward the packets with a valid CRC */
+	bool		fwd_crc_error;	/*!> forward the packets with a CRC error */
+	bool		fwd_no_crc;		/*!> forward the packets without CRC */
+};
+
+/**
+@struct udp_fwd_stats_s
+@brief Counters of the uplink, since it was opened
+*/
+struct udp_fwd_stats_s {
+	uint32_t	nb_rx;			/*!> packets pushed */
+	uint32_t	nb_rxpk;		/*!> packets forwarded in a rxpk array */
+	uint32_t	nb_push;		/*!> PUSH_DATA datagrams sent (rxpk and stat) */
+	uint32_t	nb_stat;		/*!> stat datagrams sent */
+	uint32_t	nb_ack;			/*!> PUSH_ACK received in time */
+	uint32_t	nb_no_ack;		/*!> PUSH_DATA not acknowledged in time */
+	uint32_t	nb_send_error;	/*!> datagrams that could not be sent */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Resolve the network server address and open the uplink socket
+@param conf configuration of the uplink
+@return handle on the uplink, NULL if the address cannot be resolved or the socket not opened
+*/
+udp_fwd_t *udp_fwd_open(const struct udp_fwd_conf_s *conf);
+
+/**
+@brief Send what is pending and close the uplink
+@param fwd handle returned by udp_fwd_open, NULL is ignored
+*/
+void udp_fwd_close(udp_fwd_t *fwd);
+
+/**
+@brief Add a received packet to the rxpk array of the next datagram, if the CRC filters let it through
+@param fwd handle returned by udp_fwd_open
+@param p received packet
+@return UDP_FWD_ERROR if the packet was not added (filtered out or invalid), UDP_FWD_SUCCESS else
+*/
+int udp_fwd_push(udp_fwd_t *fwd, const struct lgw_pkt_rx_s *p);
+
+/**
+@brief Send the packets pushed since the last call in one PUSH_DATA datagram, never blocks
+@param fwd handle returned by udp_fwd_open
+@return UDP_FWD_ERROR if the datagram could not be sent, UDP_FWD_SUCCESS else (or nothing to send)
+*/
+int udp_fwd_send(udp_fwd_t *fwd);
+
+/**
+@brief Read the PUSH_ACK received, expire the ones not received in time and send the stat datagram when due, never blocks
+@param fwd handle returned by udp_fwd_open
+@return UDP_FWD_ERROR if a stat datagram could not be sent, UDP_FWD_SUCCESS else
+
+Call it regularly, at least every few hundred ms.
+*/
+int udp_fwd_service(udp_fwd_t *fwd);
+
+/**
+@brief Get the counters of the uplink
+@param fwd handle returned by udp_fwd_open
+@param stats pointer to the structure receiving the counters
+@return UDP_FWD_ERROR if a pointer is NULL, UDP_FWD_SUCCESS else
+*/
+int udp_fwd_get_stats(udp_fwd_t *fwd, struct udp_fwd_stats_s *stats);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,351 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Packet forwarding stage: one persistent, non-blocking TCP connection per
+	sink, with reconnect backoff and a bounded outbound queue.
+	Queued frames are kept in fixed slots of a circular queue and sent with
+	one gather write per fwd_service call.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+	#define _XOPEN_SOURCE 600
+#else
+	#define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+#include <stdio.h>		/* snprintf */
+#include <stdlib.h>		/* calloc free */
+#include <string.h>		/* memcpy */
+#include <errno.h>		/* EINPROGRESS EAGAIN */
+#include <time.h>		/* clock_gettime */
+#include <poll.h>		/* poll */
+#include <fcntl.h>		/* fcntl */
+#include <unistd.h>		/* close */
+#include <netdb.h>		/* getaddrinfo */
+#include <sys/socket.h>	/* socket connect sendmsg */
+#include <sys/uio.h>	/* struct iovec */
+
+#include "fwd.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define FWD_SLOT_SIZE		(FWD_FRAME_HEAD + FWD_PAYLOAD_MAX)
+#define FWD_IOV_NB			64		/* max frames per gather write */
+#define FWD_QUEUE_MAX		65536	/* max number of packets queued per sink */
+
+/* connection state */
+#define FWD_STATE_IDLE			0	/* not connected, waiting for the next attempt */
+#define FWD_STATE_CONNECTING	1	/* non-blocking connect in progress */
+#define FWD_STATE_CONNECTED		2
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+struct fwd_sink_s {
+	struct fwd_conf_s conf;
+	struct sockaddr_storage addr; /* resolved address of the sink */
+	socklen_t addr_len;
+	int fd; /* -1 when not connected */
+	int state;
+	uint64_t retry_ms; /* monotonic time of the next connect attempt */
+	uint32_t backoff_ms; /* delay before the attempt after the next failure */
+	
+	/* circular queue of frames, a frame is its header followed by the payload */
+	uint8_t (*slot)[FWD_SLOT_SIZE];
+	uint32_t size; /* number of slots */
+	uint32_t head; /* oldest frame */
+	uint32_t nb; /* number of frames queued */
+	uint16_t head_sent; /* bytes of the oldest frame already written */
+	
+	struct fwd_stats_s stats;
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+uint64_t now_ms(void);
+
+uint16_t frame_len(const uint8_t *frame);
+
+void fwd_connect(fwd_sink_t *sink);
+
+void fwd_lost(fwd_sink_t *sink);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+uint64_t now_ms(void) {
+	struct timespec t;
+	
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
+
+/* size of a queued frame, header included */
+uint16_t frame_len(const uint8_t *frame) {
+	return FWD_FRAME_HEAD + ((frame[0] << 8) | frame[1]);
+}
+
+/* start a non-blocking connection attempt */
+void fwd_connect(fwd_sink_t *sink) {
+	int flags;
+	
+	sink->fd = socket(sink->addr.ss_family, SOCK_STREAM, 0);
+	if (sink->fd < 0) {
+		fwd_lost(sink);
+		return;
+	}
+	flags = fcntl(sink->fd, F_GETFL, 0);
+	fcntl(sink->fd, F_SETFL, flags | O_NONBLOCK);
+	if (connect(sink->fd, (struct sockaddr *)&sink->addr, sink->addr_len) == 0) {
+		sink->state = FWD_STATE_CONNECTED;
+	} else if (errno == EINPROGRESS) {
+		sink->state = FWD_STATE_CONNECTING;
+		return;
+	} else {
+		fwd_lost(sink);
+		return;
+	}
+	
+	/* connected at once (typ. loopback) */
+	sink->backoff_ms = FWD_BACKOFF_MIN_MS;
+	sink->head_sent = 0; /* a partly sent frame is sent again from its start */
+	sink->stats.connected = true;
+	++sink->stats.nb_connect;
+}
+
+/* drop the connection (or the failed attempt), the next attempt is delayed by the backoff */
+void fwd_lost(fwd_sink_t *sink) {
+	if (sink->fd >= 0) {
+		close(sink->fd);
+		sink->fd = -1;
+	}
+	sink->state = FWD_STATE_IDLE;
+	sink->stats.connected = false;
+	++sink->stats.nb_lost;
+	sink->retry_ms = now_ms() + sink->backoff_ms;
+	sink->backoff_ms *= 2;
+	if (sink->backoff_ms > FWD_BACKOFF_MAX_MS) {
+		sink->backoff_ms = FWD_BACKOFF_MAX_MS;
+	}
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+fwd_sink_t *fwd_open(const struct fwd_conf_s *conf) {
+	fwd_sink_t *sink;
+	struct addrinfo hints;
+	struct addrinfo *res;
+	char port_str[8];
+	
+	if (conf == NULL) {
+		return NULL;
+	}
+	sink = calloc(1, sizeof *sink);
+	if (sink == NULL) {
+		return NULL;
+	}
+	sink->conf = *conf;
+	sink->conf.host[sizeof(sink->conf.host) - 1] = '\0';
+	sink->size = (conf->queue_size == 0) ? FWD_QUEUE_DEFAULT : conf->queue_size;
+	if (sink->size > FWD_QUEUE_MAX) {
+		sink->size = FWD_QUEUE_MAX;
+	}
+	sink->slot = malloc(sink->size * sizeof sink->slot[0]);
+	if (sink->slot == NULL) {
+		free(sink);
+		return NULL;
+	}
+	
+	/* resolve the address once, reconnections reuse it */
+	memset(&hints, 0, sizeof hints);
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	snprintf(port_str, sizeof port_str, "%u", conf->port);
+	if ((getaddrinfo(sink->conf.host, port_str, &hints, &res) != 0) || (res == NULL)) {
+		free(sink->slot);
+		free(sink);
+		return NULL;
+	}
+	memcpy(&sink->addr, res->ai_addr, res->ai_addrlen);
+	sink->addr_len = res->ai_addrlen;
+	freeaddrinfo(res);
+	
+	sink->fd = -1;
+	sink->backoff_ms = FWD_BACKOFF_MIN_MS;
+	fwd_connect(sink);
+	return sink;
+}
+
+void fwd_close(fwd_sink_t *sink) {
+	if (sink == NULL) {
+		return;
+	}
+	if (sink->state == FWD_STATE_CONNECTED) {
+		fwd_service(sink);
+	}
+	if (sink->fd >= 0) {
+		close(sink->fd);
+	}
+	free(sink->slot);
+	free(sink);
+}
+
+int fwd_push(fwd_sink_t *sink, const uint8_t *payload, uint16_t size) {
+	uint32_t next;
+	
+	if ((sink == NULL) || (payload == NULL) || (size > FWD_PAYLOAD_MAX)) {
+		return FWD_ERROR;
+	}
+	
+	/* queue full, apply the policy */
+	if (sink->nb == sink->size) {
+		++sink->stats.nb_dropped;
+		if ((sink->conf.policy != FWD_DROP_OLDEST) || (sink->size < 2)) {
+			return FWD_ERROR;
+		}
+		if (sink->head_sent > 0) {
+			/* the oldest frame is partly written, it must be completed to
+			keep the stream framed: move it over the next one, which is dropped */
+			next = (sink->head + 1) % sink->size;
+			memcpy(sink->slot[next], sink->slot[sink->head], frame_len(sink->slot[sink->head]));
+		}
+		sink->head = (sink->head + 1) % sink->size;
+		--sink->nb;
+	}
+	
+	next = (sink->head + sink->nb) % sink->size;
+	sink->slot[next][0] = (uint8_t)(size >> 8);
+	sink->slot[next][1] = (uint8_t)size;
+	memcpy(&sink->slot[next][FWD_FRAME_HEAD], payload, size);
+	++sink->nb;
+	++sink->stats.nb_queued;
+	if (sink->nb > sink->stats.queue_max) {
+		sink->stats.queue_max = sink->nb;
+	}
+	return FWD_SUCCESS;
+}
+
+int fwd_service(fwd_sink_t *sink) {
+	struct iovec iov[FWD_IOV_NB];
+	struct msghdr msg;
+	struct pollfd pfd;
+	uint8_t scratch[64];
+	socklen_t len;
+	ssize_t n;
+	uint16_t rem;
+	int err;
+	int i;
+	
+	if (sink == NULL) {
+		return FWD_ERROR;
+	}
+	
+	/* connection management */
+	if (sink->state == FWD_STATE_IDLE) {
+		if (now_ms() < sink->retry_ms) {
+			return FWD_ERROR;
+		}
+		fwd_connect(sink);
+	}
+	if (sink->state == FWD_STATE_CONNECTING) {
+		pfd.fd = sink->fd;
+		pfd.events = POLLOUT;
+		if (poll(&pfd, 1, 0) <= 0) {
+			return FWD_ERROR; /* still in progress */
+		}
+		err = 0;
+		len = sizeof err;
+		if ((getsockopt(sink->fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0) || (err != 0)) {
+			fwd_lost(sink);
+			return FWD_ERROR;
+		}
+		sink->state = FWD_STATE_CONNECTED;
+		sink->backoff_ms = FWD_BACKOFF_MIN_MS;
+		sink->head_sent = 0; /* a partly sent frame is sent again from its start */
+		sink->stats.connected = true;
+		++sink->stats.nb_connect;
+	}
+	if (sink->nb == 0) {
+		return FWD_SUCCESS;
+	}
+	
+	/* the sink never talks, readable means closed (or garbage to discard) */
+	pfd.fd = sink->fd;
+	pfd.events = POLLIN;
+	if (poll(&pfd, 1, 0) > 0) {
+		n = recv(sink->fd, scratch, sizeof scratch, 0);
+		if ((n == 0) || ((n < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))) {
+			fwd_lost(sink);
+			return FWD_ERROR;
+		}
+	}
+	
+	/* gather writes until the queue is empty or the socket is full */
+	while (sink->nb > 0) {
+		for (i = 0; (i < FWD_IOV_NB) && ((uint32_t)i < sink->nb); ++i) {
+			iov[i].iov_base = sink->slot[(sink->head + i) % sink->size];
+			iov[i].iov_len = frame_len(iov[i].iov_base);
+		}
+		iov[0].iov_base = (uint8_t *)iov[0].iov_base + sink->head_sent;
+		iov[0].iov_len -= sink->head_sent;
+		memset(&msg, 0, sizeof msg);
+		msg.msg_iov = iov;
+		msg.msg_iovlen = i;
+		n = sendmsg(sink->fd, &msg, MSG_NOSIGNAL); /* writev, without SIGPIPE on a closed connection */
+		if (n < 0) {
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) {
+				return FWD_SUCCESS;
+			}
+			fwd_lost(sink);
+			return FWD_ERROR;
+		}
+		++sink->stats.nb_write;
+		
+		/* release the frames completely written */
+		while (n > 0) {
+			rem = frame_len(sink->slot[sink->head]) - sink->head_sent;
+			if (n < rem) {
+				sink->head_sent += n;
+				break;
+			}
+			n -= rem;
+			sink->head_sent = 0;
+			sink->head = (sink->head + 1) % sink->size;
+			--sink->nb;
+			++sink->stats.nb_sent;
+		}
+		if (sink->head_sent > 0) {
+			return FWD_SUCCESS; /* partial write, socket buffer full */
+		}
+	}
+	return FWD_SUCCESS;
+}
+
+int fwd_get_stats(fwd_sink_t *sink, struct fwd_stats_s *stats) {
+	if ((sink == NULL) || (stats == NULL)) {
+		return FWD_ERROR;
+	}
+	*stats = sink->stats;
+	return FWD_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
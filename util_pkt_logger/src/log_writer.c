@@ -0,0 +1,429 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Packet log writer thread, fed by a single-producer/single-consumer queue.
+	The RX path only copies the packets in the queue, the writer thread
+	formats them (CSV lines or binary records, see pktlog.h) into a large
+	stdio buffer that is written to the file when full or when the oldest
+	buffered packet is older than the flush delay.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+	#define _XOPEN_SOURCE 600
+#else
+	#define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+#include <stdio.h>		/* fprintf fputs fopen setvbuf */
+#include <stdlib.h>		/* malloc free */
+#include <string.h>		/* memcpy */
+#include <stddef.h>		/* offsetof */
+#include <errno.h>		/* EINTR */
+#include <time.h>		/* time clock_gettime gmtime strftime */
+#include <pthread.h>	/* writer thread */
+#include <poll.h>		/* poll */
+#include <unistd.h>		/* read write close fdatasync */
+#include <sys/eventfd.h>	/* writer notification */
+
+#include "log_writer.h"
+#include "pktlog.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
+#define MSG(args...)	fprintf(stderr,"loragw_pkt_logger: " args) /* message that is destined to the user */
+
+/* indexes shared between the RX path and the writer thread */
+#define LOAD_ACQ(v)			__atomic_load_n(&(v), __ATOMIC_ACQUIRE)
+#define STORE_REL(v, x)		__atomic_store_n(&(v), (x), __ATOMIC_RELEASE)
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define LOGW_QUEUE_MAX		65536	/* max number of packets in the queue */
+#define LOGW_IDLE_MS		1000	/* max sleep of the writer, bounds the rotation and sync latency */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* queued packet, only the received part of the payload is copied */
+struct logw_entry_s {
+	struct timespec		fetch;	/* time the packet was fetched */
+	struct lgw_pkt_rx_s	pkt;
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static struct logw_conf_s logw_conf;
+static struct logw_entry_s *logw_buf = NULL; /* queue slots, NULL when the writer is not running */
+static uint32_t logw_mask; /* number of slots - 1 */
+static uint32_t logw_head; /* next slot written, only written by the RX path */
+static uint32_t logw_tail; /* next slot read, only written by the writer thread */
+static int logw_efd = -1; /* eventfd signalled when packets are queued */
+static bool logw_quit; /* stop request for the writer thread */
+static pthread_t logw_thread;
+
+static struct logw_stats_s logw_stats; /* counters are only written by one side each */
+
+/* log file, only used by the writer thread once started */
+static FILE *log_file = NULL;
+static char *log_chunk = NULL; /* stdio buffer of the log file */
+static char log_file_name[64];
+static time_t log_start_time;
+static unsigned long pkt_in_log; /* packets written in the current log file */
+static char gateway_id[17]; /* gateway MAC address in hexadecimal */
+
+/* CSV: timestamp string of the last packet, packets fetched together share it */
+static char ts_str[PKTLOG_TIMESTAMP_LEN];
+static time_t ts_sec;
+static long ts_ms = -1;
+
+/* binary: time base of the last sync marker and packets written since */
+static uint64_t sync_base_ms;
+static unsigned sync_nb_pkt;
+static bool sync_needed;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static int log_open(time_t now);
+
+static void log_close(void);
+
+static void log_entry(const struct logw_entry_s *e);
+
+static int64_t mono_ms(void);
+
+void *logw_run(void *arg);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* open the log file, with its chunk buffer, and write the CSV header */
+static int log_open(time_t now) {
+	FILE *f;
+	char iso_date[20];
+	uint8_t head[PKTLOG_HEAD_SIZE];
+	int i;
+	
+	strftime(iso_date,ARRAY_SIZE(iso_date),"%Y%m%dT%H%M%SZ",gmtime(&now)); /* format yyyymmddThhmmssZ */
+	
+	/*modified to save in same log file*/
+	//sprintf(log_file_name, "pktlog_%s_%s.csv", gateway_id, iso_date);
+	sprintf(log_file_name, "pktlog_%s.%s", gateway_id, (logw_conf.format == LOGW_FORMAT_BIN) ? "bin" : "csv");
+	f = fopen(log_file_name, "a"); /* create log file, append if file already exist */
+	if (f == NULL) {
+		MSG("ERROR: impossible to create log file %s\n", log_file_name);
+		return LOGW_ERROR;
+	}
+	setvbuf(f, log_chunk, _IOFBF, logw_conf.chunk_size);
+	
+	/* file header, a binary log appended to an existing file gets a header too */
+	if (logw_conf.format == LOGW_FORMAT_BIN) {
+		pktlog_bin_head(head, logw_conf.gateway_mac, now);
+		i = (fwrite(head, PKTLOG_HEAD_SIZE, 1, f) == 1) ? 0 : -1;
+		sync_needed = true;
+	} else {
+		i = pktlog_csv_head(f);
+	}
+	if (i < 0) {
+		MSG("ERROR: impossible to write to log file %s\n", log_file_name);
+		fclose(f);
+		return LOGW_ERROR;
+	}
+	
+	log_file = f;
+	log_start_time = now; /* keep track of when the log was started, for log rotation */
+	pkt_in_log = 0;
+	MSG("INFO: Now writing to log file %s\n", log_file_name);
+	return LOGW_SUCCESS;
+}
+
+/* write what is buffered, make it durable if asked and close the log file */
+static void log_close(void) {
+	fflush(log_file);
+	__atomic_add_fetch(&logw_stats.nb_flush, 1, __ATOMIC_RELAXED);
+	if (logw_conf.sync_s > 0) {
+		fdatasync(fileno(log_file));
+		__atomic_add_fetch(&logw_stats.nb_sync, 1, __ATOMIC_RELAXED);
+	}
+	fclose(log_file);
+	log_file = NULL;
+	MSG("INFO: log file %s closed, %lu packet(s) recorded\n", log_file_name, pkt_in_log);
+}
+
+/* format one packet into the log file buffer */
+static void log_entry(const struct logw_entry_s *e) {
+	uint8_t rec[PKTLOG_REC_MAX];
+	uint64_t fetch_ms;
+	int size;
+	
+	if (logw_conf.format == LOGW_FORMAT_BIN) {
+		/* packet times are stored relative to the last sync marker */
+		fetch_ms = (uint64_t)e->fetch.tv_sec * 1000 + e->fetch.tv_nsec / 1000000;
+		if (sync_needed || (sync_nb_pkt >= PKTLOG_SYNC_INTERVAL) || (fetch_ms < sync_base_ms) || ((fetch_ms - sync_base_ms) > UINT32_MAX)) {
+			size = pktlog_bin_sync(rec, fetch_ms);
+			fwrite(rec, size, 1, log_file);
+			sync_base_ms = fetch_ms;
+			sync_nb_pkt = 0;
+			sync_needed = false;
+		}
+		size = pktlog_bin_pkt(rec, (uint32_t)(fetch_ms - sync_base_ms), &e->pkt);
+		fwrite(rec, size, 1, log_file);
+		++sync_nb_pkt;
+	} else {
+		if ((e->fetch.tv_sec != ts_sec) || ((e->fetch.tv_nsec / 1000000) != ts_ms)) {
+			ts_sec = e->fetch.tv_sec;
+			ts_ms = e->fetch.tv_nsec / 1000000;
+			pktlog_timestamp(ts_str, ts_sec, ts_ms);
+		}
+		pktlog_csv(log_file, gateway_id, ts_str, &e->pkt);
+	}
+}
+
+static int64_t mono_ms(void) {
+	struct timespec t;
+	
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (int64_t)t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
+
+/* writer thread: format the queued packets, flush and rotate the log file */
+void *logw_run(void *arg) {
+	struct pollfd pfd;
+	time_t now_time;
+	int64_t now_ms;
+	int64_t flush_at = -1; /* deadline of the buffered packets, -1 if nothing is buffered */
+	int64_t sync_at;
+	bool unsynced = false;
+	uint32_t head, tail;
+	uint64_t cnt;
+	int timeout;
+	
+	(void)arg;
+	tail = logw_tail;
+	sync_at = mono_ms() + 1000 * (int64_t)logw_conf.sync_s;
+	pfd.fd = logw_efd;
+	pfd.events = POLLIN;
+	for (;;) {
+		/* the event counter is cleared before reading the head, a push after
+		that still leaves the eventfd readable */
+		if (read(logw_efd, &cnt, sizeof(cnt)) < 0) {
+			cnt = 0; /* EAGAIN, no event pending */
+		}
+		head = LOAD_ACQ(logw_head);
+		
+		/* format everything queued, stdio writes to the file each time the chunk is full */
+		for (; tail != head; ++tail) {
+			log_entry(&logw_buf[tail & logw_mask]);
+			++pkt_in_log;
+		}
+		if (head != logw_tail) {
+			__atomic_add_fetch(&logw_stats.nb_written, head - logw_tail, __ATOMIC_RELAXED);
+			STORE_REL(logw_tail, head); /* hand the slots back to the RX path */
+			if (flush_at < 0) {
+				flush_at = mono_ms() + logw_conf.flush_ms;
+			}
+		}
+		if (LOAD_ACQ(logw_quit) && (LOAD_ACQ(logw_head) == tail)) {
+			break;
+		}
+		
+		/* time policy: the oldest buffered packet waited long enough */
+		now_ms = mono_ms();
+		if ((flush_at >= 0) && (now_ms >= flush_at)) {
+			fflush(log_file);
+			__atomic_add_fetch(&logw_stats.nb_flush, 1, __ATOMIC_RELAXED);
+			flush_at = -1;
+			unsynced = true;
+		}
+		if ((logw_conf.sync_s > 0) && (now_ms >= sync_at)) {
+			if (unsynced) {
+				fdatasync(fileno(log_file));
+				__atomic_add_fetch(&logw_stats.nb_sync, 1, __ATOMIC_RELAXED);
+				unsynced = false;
+			}
+			sync_at = now_ms + 1000 * (int64_t)logw_conf.sync_s;
+		}
+		
+		/* rotation, the old file is closed before the new one (same name) is opened, packets wait in the queue meanwhile */
+		time(&now_time);
+		if ((logw_conf.rotate_s > 0) && (difftime(now_time, log_start_time) > logw_conf.rotate_s)) {
+			log_close();
+			if (log_open(now_time) != LOGW_SUCCESS) {
+				exit(EXIT_FAILURE); /* same as a failure to open the first log file */
+			}
+			flush_at = -1;
+			unsynced = false;
+		}
+		
+		/* sleep until packets are queued or the next deadline */
+		timeout = LOGW_IDLE_MS;
+		if ((flush_at >= 0) && ((flush_at - now_ms) < timeout)) {
+			timeout = (int)(flush_at - now_ms);
+		}
+		if (poll(&pfd, 1, timeout) < 0) {
+			if (errno != EINTR) {
+				MSG("WARNING: failed to wait for packets to log\n");
+			}
+		}
+	}
+	
+	log_close();
+	return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int logw_start(const struct logw_conf_s *conf) {
+	uint32_t nb_slots = 1;
+	
+	if ((conf == NULL) || (logw_buf != NULL)) {
+		return LOGW_ERROR;
+	}
+	logw_conf = *conf;
+	sprintf(gateway_id, "%08X%08X", (uint32_t)(logw_conf.gateway_mac >> 32), (uint32_t)(logw_conf.gateway_mac & 0xFFFFFFFF));
+	ts_ms = -1;
+	if (logw_conf.queue_size == 0) {
+		logw_conf.queue_size = LOGW_QUEUE_DEFAULT;
+	} else if (logw_conf.queue_size > LOGW_QUEUE_MAX) {
+		logw_conf.queue_size = LOGW_QUEUE_MAX;
+	}
+	if (logw_conf.chunk_size == 0) {
+		logw_conf.chunk_size = LOGW_CHUNK_DEFAULT;
+	}
+	if (logw_conf.flush_ms == 0) {
+		logw_conf.flush_ms = LOGW_FLUSH_DEFAULT;
+	}
+	
+	/* queue size is a power of 2, indexes are free-running */
+	while (nb_slots < logw_conf.queue_size) {
+		nb_slots <<= 1;
+	}
+	logw_buf = malloc(nb_slots * sizeof(struct logw_entry_s));
+	log_chunk = malloc(logw_conf.chunk_size);
+	logw_efd = eventfd(0, EFD_NONBLOCK);
+	if ((logw_buf == NULL) || (log_chunk == NULL) || (logw_efd < 0)) {
+		MSG("ERROR: failed to allocate the log writer queue\n");
+		goto fail;
+	}
+	logw_mask = nb_slots - 1;
+	logw_head = 0;
+	logw_tail = 0;
+	logw_quit = false;
+	memset(&logw_stats, 0, sizeof(logw_stats));
+	
+	if (log_open(time(NULL)) != LOGW_SUCCESS) {
+		goto fail;
+	}
+	if (pthread_create(&logw_thread, NULL, logw_run, NULL) != 0) {
+		MSG("ERROR: failed to start the log writer thread\n");
+		fclose(log_file);
+		log_file = NULL;
+		goto fail;
+	}
+	return LOGW_SUCCESS;
+	
+	fail:
+	if (logw_efd >= 0) {
+		close(logw_efd);
+		logw_efd = -1;
+	}
+	free(log_chunk);
+	log_chunk = NULL;
+	free(logw_buf);
+	logw_buf = NULL;
+	return LOGW_ERROR;
+}
+
+int logw_stop(void) {
+	uint64_t one = 1;
+	
+	if (logw_buf == NULL) {
+		return LOGW_ERROR;
+	}
+	STORE_REL(logw_quit, true);
+	if (write(logw_efd, &one, sizeof(one)) < 0) {
+		MSG("WARNING: failed to wake up the log writer\n");
+	}
+	pthread_join(logw_thread, NULL);
+	close(logw_efd);
+	logw_efd = -1;
+	free(log_chunk);
+	log_chunk = NULL;
+	free(logw_buf);
+	logw_buf = NULL;
+	return LOGW_SUCCESS;
+}
+
+int logw_push(int nb_pkt, const struct lgw_pkt_rx_s *pkt_data, const struct timespec *fetch_time) {
+	struct logw_entry_s *e;
+	uint32_t head, fill;
+	uint64_t one = 1;
+	int i;
+	
+	if ((logw_buf == NULL) || (pkt_data == NULL) || (fetch_time == NULL) || (nb_pkt <= 0)) {
+		return 0;
+	}
+	
+	head = logw_head;
+	fill = head - LOAD_ACQ(logw_tail);
+	for (i = 0; (i < nb_pkt) && (fill <= logw_mask); ++i) {
+		e = &logw_buf[head & logw_mask];
+		e->fetch = *fetch_time;
+		memcpy(&e->pkt, &pkt_data[i], offsetof(struct lgw_pkt_rx_s, payload) + pkt_data[i].size);
+		++head;
+		++fill;
+	}
+	if (i < nb_pkt) {
+		__atomic_add_fetch(&logw_stats.nb_dropped, nb_pkt - i, __ATOMIC_RELAXED);
+	}
+	if (i == 0) {
+		return 0;
+	}
+	
+	/* publish the packets, then wake up the writer (once per batch) */
+	STORE_REL(logw_head, head);
+	__atomic_add_fetch(&logw_stats.nb_queued, i, __ATOMIC_RELAXED);
+	if (fill > __atomic_load_n(&logw_stats.max_fill, __ATOMIC_RELAXED)) {
+		__atomic_store_n(&logw_stats.max_fill, fill, __ATOMIC_RELAXED);
+	}
+	if (write(logw_efd, &one, sizeof(one)) < 0) {
+		MSG("WARNING: failed to wake up the log writer\n");
+	}
+	return i;
+}
+
+int logw_get_stats(struct logw_stats_s *stats) {
+	if (stats == NULL) {
+		return LOGW_ERROR;
+	}
+	stats->nb_queued = __atomic_load_n(&logw_stats.nb_queued, __ATOMIC_RELAXED);
+	stats->nb_dropped = __atomic_load_n(&logw_stats.nb_dropped, __ATOMIC_RELAXED);
+	stats->nb_written = __atomic_load_n(&logw_stats.nb_written, __ATOMIC_RELAXED);
+	stats->nb_flush = __atomic_load_n(&logw_stats.nb_flush, __ATOMIC_RELAXED);
+	stats->nb_sync = __atomic_load_n(&logw_stats.nb_sync, __ATOMIC_RELAXED);
+	stats->max_fill = __atomic_load_n(&logw_stats.max_fill, __ATOMIC_RELAXED);
+	return LOGW_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,447 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Packet log formats: CSV lines and compact binary records, see pktlog.h
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+	#define _XOPEN_SOURCE 600
+#else
+	#define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+#include <stdio.h>		/* fprintf fwrite snprintf */
+#include <string.h>		/* memcpy memcmp memset */
+#include <math.h>		/* signbit */
+#include <time.h>		/* gmtime */
+
+#include "pktlog.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+/* copy a string literal, without its terminating null */
+#define PUT_LIT(b, s)	do { memcpy((b), (s), sizeof(s) - 1); (b) += sizeof(s) - 1; } while (0)
+
+/* two hexadecimal digits of each byte value, high nibble first */
+#define HEX_ROW(h)		h"0" h"1" h"2" h"3" h"4" h"5" h"6" h"7" h"8" h"9" h"A" h"B" h"C" h"D" h"E" h"F"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define FLOAT_FAST_MAX	1e15	/* larger values (or NaN) are formatted by snprintf */
+
+static const uint8_t head_magic[8] = {0x89, 'L', 'G', 'W', 'L', 'O', 'G', '\n'};
+static const uint8_t sync_magic[8] = {0xA5, 0x5A, 'S', 'Y', 'N', 'C', 0xC3, 0x3C};
+
+static const char hex_pair[] = HEX_ROW("0") HEX_ROW("1") HEX_ROW("2") HEX_ROW("3") HEX_ROW("4") HEX_ROW("5") HEX_ROW("6") HEX_ROW("7") HEX_ROW("8") HEX_ROW("9") HEX_ROW("A") HEX_ROW("B") HEX_ROW("C") HEX_ROW("D") HEX_ROW("E") HEX_ROW("F");
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static void put_u16(uint8_t *b, uint16_t v);
+
+static void put_u32(uint8_t *b, uint32_t v);
+
+static void put_u64(uint8_t *b, uint64_t v);
+
+static uint16_t get_u16(const uint8_t *b);
+
+static uint32_t get_u32(const uint8_t *b);
+
+static uint64_t get_u64(const uint8_t *b);
+
+static int16_t to_centi(float x);
+
+static char *put_str(char *b, const char *s);
+
+static char *put_uint(char *b, uint32_t v, int width);
+
+static char *put_zero(char *b, uint32_t v, int digits);
+
+static char *put_float(char *b, float x, int decimals, int width);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static void put_u16(uint8_t *b, uint16_t v) {
+	b[0] = (uint8_t)v;
+	b[1] = (uint8_t)(v >> 8);
+}
+
+static void put_u32(uint8_t *b, uint32_t v) {
+	put_u16(b, (uint16_t)v);
+	put_u16(b + 2, (uint16_t)(v >> 16));
+}
+
+static void put_u64(uint8_t *b, uint64_t v) {
+	put_u32(b, (uint32_t)v);
+	put_u32(b + 4, (uint32_t)(v >> 32));
+}
+
+static uint16_t get_u16(const uint8_t *b) {
+	return (uint16_t)(b[0] | (b[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t *b) {
+	return get_u16(b) | ((uint32_t)get_u16(b + 2) << 16);
+}
+
+static uint64_t get_u64(const uint8_t *b) {
+	return get_u32(b) | ((uint64_t)get_u32(b + 4) << 32);
+}
+
+/* dB to signed 0.01 dB, rounded and saturated */
+static int16_t to_centi(float x) {
+	float c = x * 100.0;
+	
+	if (c >= 32767.0) {
+		return 32767;
+	} else if (c <= -32768.0) {
+		return -32768;
+	}
+	return (int16_t)((c < 0) ? (c - 0.5) : (c + 0.5));
+}
+
+static char *put_str(char *b, const char *s) {
+	while (*s != '\0') {
+		*b++ = *s++;
+	}
+	return b;
+}
+
+/* same as printf "%<width>u" */
+static char *put_uint(char *b, uint32_t v, int width) {
+	char tmp[10];
+	int n = 0;
+	
+	do {
+		tmp[n++] = '0' + (v % 10);
+		v /= 10;
+	} while (v != 0);
+	for (; width > n; --width) {
+		*b++ = ' ';
+	}
+	while (n > 0) {
+		*b++ = tmp[--n];
+	}
+	return b;
+}
+
+/* same as printf "%0<digits>u", v must fit in 'digits' digits */
+static char *put_zero(char *b, uint32_t v, int digits) {
+	int i;
+	
+	for (i = digits - 1; i >= 0; --i) {
+		b[i] = '0' + (v % 10);
+		v /= 10;
+	}
+	return b + digits;
+}
+
+/* same as printf "%+<width>.<decimals>f", for 0 or 1 decimal */
+static char *put_float(char *b, float x, int decimals, int width) {
+	double d = x;
+	uint64_t i;
+	char tmp[64]; /* a float has up to 39 integer digits */
+	int n = 0;
+	
+	/* a float times 10 is exact in a double, so rounding sees the same value as printf */
+	if (decimals > 0) {
+		d *= 10.0;
+	}
+	if (!((d > -FLOAT_FAST_MAX) && (d < FLOAT_FAST_MAX))) {
+		n = snprintf(tmp, sizeof(tmp), (decimals > 0) ? "%+*.1f" : "%+*.0f", width, x);
+		memcpy(b, tmp, n);
+		return b + n;
+	}
+	
+	/* round half to even, as printf does with the default rounding mode */
+	if (d < 0) {
+		d = -d;
+	}
+	i = (uint64_t)d;
+	d -= (double)i;
+	if ((d > 0.5) || ((d == 0.5) && ((i & 1) != 0))) {
+		++i;
+	}
+	
+	/* digits backwards, then sign and padding */
+	if (decimals > 0) {
+		tmp[n++] = '0' + (i % 10);
+		tmp[n++] = '.';
+		i /= 10;
+	}
+	do {
+		tmp[n++] = '0' + (i % 10);
+		i /= 10;
+	} while (i != 0);
+	tmp[n++] = signbit(x) ? '-' : '+';
+	for (; width > n; --width) {
+		*b++ = ' ';
+	}
+	while (n > 0) {
+		*b++ = tmp[--n];
+	}
+	return b;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+void pktlog_timestamp(char *buf, time_t sec, long ms) {
+	struct tm *x;
+	char *b = buf;
+	
+	/* ISO 8601 format, yyyy-mm-dd hh:mm:ss.mmmZ */
+	x = gmtime(&sec);
+	b = put_zero(b, (x->tm_year) + 1900, 4);
+	*b++ = '-';
+	b = put_zero(b, (x->tm_mon) + 1, 2);
+	*b++ = '-';
+	b = put_zero(b, x->tm_mday, 2);
+	*b++ = ' ';
+	b = put_zero(b, x->tm_hour, 2);
+	*b++ = ':';
+	b = put_zero(b, x->tm_min, 2);
+	*b++ = ':';
+	b = put_zero(b, x->tm_sec, 2);
+	*b++ = '.';
+	b = put_zero(b, ms, 3);
+	*b++ = 'Z';
+	*b = '\0';
+}
+
+int pktlog_csv_head(FILE *f) {
+	return fprintf(f, "\"gateway ID\",\"node MAC\",\"UTC timestamp\",\"us count\",\"frequency\",\"RF chain\",\"RX chain\",\"status\",\"size\",\"modulation\",\"bandwidth\",\"datarate\",\"coderate\",\"RSSI\",\"SNR\",\"payload\"\n");
+}
+
+int pktlog_csv_line(char *line, const char *gateway_id, const char *timestamp, const struct lgw_pkt_rx_s *p) {
+	char *b = line;
+	const uint8_t *pl;
+	int j;
+	
+	/* writing gateway ID */
+	*b++ = '"';
+	b = put_str(b, gateway_id);
+	PUT_LIT(b, "\",");
+	
+	/* writing node MAC address */
+	PUT_LIT(b, "\"\","); // TODO: need to parse payload
+	
+	/* writing UTC timestamp*/
+	*b++ = '"';
+	b = put_str(b, timestamp);
+	PUT_LIT(b, "\",");
+	// TODO: replace with GPS time when available
+	
+	/* writing internal clock */
+	b = put_uint(b, p->count_us, 10);
+	*b++ = ',';
+	
+	/* writing RX frequency */
+	b = put_uint(b, p->freq_hz, 10);
+	*b++ = ',';
+	
+	/* writing RF chain */
+	b = put_uint(b, p->rf_chain, 0);
+	*b++ = ',';
+	
+	/* writing RX modem/IF chain */
+	b = put_uint(b, p->if_chain, 2);
+	*b++ = ',';
+	
+	/* writing status */
+	switch(p->status) {
+		case STAT_CRC_OK:	PUT_LIT(b, "\"CRC_OK\" ,"); break;
+		case STAT_CRC_BAD:	PUT_LIT(b, "\"CRC_BAD\","); break;
+		case STAT_NO_CRC:	PUT_LIT(b, "\"NO_CRC\" ,"); break;
+		case STAT_UNDEFINED:PUT_LIT(b, "\"UNDEF\"  ,"); break;
+		default: PUT_LIT(b, "\"ERR\"    ,");
+	}
+	
+	/* writing payload size */
+	b = put_uint(b, p->size, 3);
+	*b++ = ',';
+	
+	/* writing modulation */
+	switch(p->modulation) {
+		case MOD_LORA:	PUT_LIT(b, "\"LORA\","); break;
+		case MOD_FSK:	PUT_LIT(b, "\"FSK\" ,"); break;
+		default: PUT_LIT(b, "\"ERR\" ,");
+	}
+	
+	/* writing bandwidth */
+	switch(p->bandwidth) {
+		case BW_500KHZ:	PUT_LIT(b, "500000,"); break;
+		case BW_250KHZ:	PUT_LIT(b, "250000,"); break;
+		case BW_125KHZ:	PUT_LIT(b, "125000,"); break;
+		case BW_62K5HZ:	PUT_LIT(b, "62500 ,"); break;
+		case BW_31K2HZ:	PUT_LIT(b, "31200 ,"); break;
+		case BW_15K6HZ:	PUT_LIT(b, "15600 ,"); break;
+		case BW_7K8HZ:	PUT_LIT(b, "7800  ,"); break;
+		case BW_UNDEFINED: PUT_LIT(b, "0     ,"); break;
+		default: PUT_LIT(b, "-1    ,");
+	}
+	
+	/* writing datarate */
+	if (p->modulation == MOD_LORA) {
+		switch (p->datarate) {
+			case DR_LORA_SF7:	PUT_LIT(b, "\"SF7\"   ,"); break;
+			case DR_LORA_SF8:	PUT_LIT(b, "\"SF8\"   ,"); break;
+			case DR_LORA_SF9:	PUT_LIT(b, "\"SF9\"   ,"); break;
+			case DR_LORA_SF10:	PUT_LIT(b, "\"SF10\"  ,"); break;
+			case DR_LORA_SF11:	PUT_LIT(b, "\"SF11\"  ,"); break;
+			case DR_LORA_SF12:	PUT_LIT(b, "\"SF12\"  ,"); break;
+			default: PUT_LIT(b, "\"ERR\"   ,");
+		}
+	} else if (p->modulation == MOD_FSK) {
+		*b++ = '"';
+		b = put_uint(b, p->datarate, 6);
+		PUT_LIT(b, "\",");
+	} else {
+		PUT_LIT(b, "\"ERR\"   ,");
+	}
+	
+	/* writing coderate */
+	switch (p->coderate) {
+		case CR_LORA_4_5:	PUT_LIT(b, "\"4/5\","); break;
+		case CR_LORA_4_6:	PUT_LIT(b, "\"2/3\","); break;
+		case CR_LORA_4_7:	PUT_LIT(b, "\"4/7\","); break;
+		case CR_LORA_4_8:	PUT_LIT(b, "\"1/2\","); break;
+		case CR_UNDEFINED:	PUT_LIT(b, "\"\"   ,"); break;
+		default: PUT_LIT(b, "\"ERR\",");
+	}
+	
+	/* writing packet RSSI */
+	b = put_float(b, p->rssi, 0, 0);
+	*b++ = ',';
+	
+	/* writing packet average SNR */
+	b = put_float(b, p->snr, 1, 5);
+	*b++ = ',';
+	
+	/* writing hex-encoded payload, two digits per byte from the table */
+	*b++ = '"';
+	pl = p->payload;
+	for (j = 0; j < p->size; ++j) {
+		memcpy(b, &hex_pair[2 * pl[j]], 2);
+		b += 2;
+	}
+	
+	/* end of log file line */
+	PUT_LIT(b, "\"\n");
+	return (int)(b - line);
+}
+
+void pktlog_csv(FILE *f, const char *gateway_id, const char *timestamp, const struct lgw_pkt_rx_s *p) {
+	char line[PKTLOG_CSV_LINE_MAX];
+	
+	fwrite(line, 1, pktlog_csv_line(line, gateway_id, timestamp, p), f);
+}
+
+int pktlog_bin_head(uint8_t *buf, uint64_t gateway_mac, time_t start_time) {
+	memcpy(buf, head_magic, sizeof(head_magic));
+	put_u16(buf + 8, PKTLOG_VERSION);
+	put_u16(buf + 10, PKTLOG_HEAD_SIZE);
+	put_u16(buf + 12, PKTLOG_REC_SIZE);
+	put_u16(buf + 14, PKTLOG_SYNC_INTERVAL);
+	put_u64(buf + 16, gateway_mac);
+	put_u64(buf + 24, (uint64_t)start_time);
+	return PKTLOG_HEAD_SIZE;
+}
+
+int pktlog_bin_sync(uint8_t *buf, uint64_t base_ms) {
+	memcpy(buf, sync_magic, sizeof(sync_magic));
+	put_u64(buf + 8, base_ms);
+	return PKTLOG_SYNC_SIZE;
+}
+
+int pktlog_bin_pkt(uint8_t *buf, uint32_t offset_ms, const struct lgw_pkt_rx_s *p) {
+	buf[0] = PKTLOG_TAG_PKT;
+	buf[1] = p->status;
+	put_u16(buf + 2, p->size);
+	put_u32(buf + 4, offset_ms);
+	put_u32(buf + 8, p->count_us);
+	put_u32(buf + 12, p->freq_hz);
+	put_u32(buf + 16, p->datarate);
+	put_u16(buf + 20, (uint16_t)to_centi(p->rssi));
+	put_u16(buf + 22, (uint16_t)to_centi(p->snr));
+	buf[24] = p->if_chain;
+	buf[25] = p->rf_chain;
+	buf[26] = p->modulation;
+	buf[27] = p->bandwidth;
+	buf[28] = p->coderate;
+	buf[29] = 0;
+	put_u16(buf + 30, p->crc);
+	memcpy(buf + PKTLOG_REC_SIZE, p->payload, p->size);
+	return PKTLOG_REC_SIZE + p->size;
+}
+
+int pktlog_bin_get_head(const uint8_t *buf, struct pktlog_head_s *head) {
+	if (memcmp(buf, head_magic, sizeof(head_magic)) != 0) {
+		return -1;
+	}
+	head->version = get_u16(buf + 8);
+	head->head_size = get_u16(buf + 10);
+	head->rec_size = get_u16(buf + 12);
+	head->sync_interval = get_u16(buf + 14);
+	head->gateway_mac = get_u64(buf + 16);
+	head->start_time = get_u64(buf + 24);
+	/* later versions may only extend the header and the record metadata */
+	if ((head->version == 0) || (head->head_size < PKTLOG_HEAD_SIZE) || (head->rec_size < PKTLOG_REC_SIZE)) {
+		return -1;
+	}
+	return 0;
+}
+
+int pktlog_bin_get_sync(const uint8_t *buf, uint64_t *base_ms) {
+	if (memcmp(buf, sync_magic, sizeof(sync_magic)) != 0) {
+		return -1;
+	}
+	*base_ms = get_u64(buf + 8);
+	return 0;
+}
+
+int pktlog_bin_get_pkt(const uint8_t *buf, uint16_t rec_size, uint32_t *offset_ms, struct lgw_pkt_rx_s *p) {
+	uint16_t size;
+	
+	size = get_u16(buf + 2);
+	if ((buf[0] != PKTLOG_TAG_PKT) || (buf[29] != 0) || (size > sizeof(p->payload))) {
+		return -1;
+	}
+	memset(p, 0, sizeof(*p));
+	p->status = buf[1];
+	p->size = size;
+	*offset_ms = get_u32(buf + 4);
+	p->count_us = get_u32(buf + 8);
+	p->freq_hz = get_u32(buf + 12);
+	p->datarate = get_u32(buf + 16);
+	p->rssi = (int16_t)get_u16(buf + 20) / 100.0;
+	p->snr = (int16_t)get_u16(buf + 22) / 100.0;
+	p->if_chain = buf[24];
+	p->rf_chain = buf[25];
+	p->modulation = buf[26];
+	p->bandwidth = buf[27];
+	p->coderate = buf[28];
+	p->crc = get_u16(buf + 30);
+	return rec_size + size;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,489 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Uplink of the Semtech UDP packet forwarder protocol, see udp_fwd.h.
+	The rxpk objects are formatted straight into the datagram buffer as the
+	packets are pushed, the datagram is closed and sent by udp_fwd_send.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+	#define _XOPEN_SOURCE 600
+#else
+	#define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+#include <stdio.h>		/* snprintf */
+#include <stdlib.h>		/* calloc free rand */
+#include <string.h>		/* memcpy */
+#include <errno.h>		/* EINTR */
+#include <time.h>		/* clock_gettime time gmtime strftime */
+#include <fcntl.h>		/* fcntl */
+#include <unistd.h>		/* close */
+#include <netdb.h>		/* getaddrinfo */
+#include <sys/socket.h>	/* socket connect send recvmsg */
+#include <sys/uio.h>	/* iovec */
+
+#include "udp_fwd.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define PROTOCOL_VERSION	1
+#define PKT_PUSH_DATA		0
+#define PKT_PUSH_ACK		1
+
+#define DGRAM_HEAD			12		/* version, token, identifier, gateway MAC address */
+#define RXPK_MAX			640		/* max size of one rxpk object, with a 256-byte payload */
+#define PEND_NB				16		/* PUSH_DATA waiting for their PUSH_ACK */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* PUSH_DATA sent and not acknowledged yet */
+struct pend_s {
+	uint16_t	token;
+	uint64_t	sent_ms;
+};
+
+struct udp_fwd_s {
+	struct udp_fwd_conf_s conf;
+	int fd;
+	
+	/* datagram being built, the rxpk array starts after the header */
+	uint8_t dgram[UDP_FWD_DGRAM_MAX];
+	int len;
+	int nb_rxpk; /* packets in the datagram */
+	
+	struct pend_s pend[PEND_NB];
+	int nb_pend;
+	
+	/* measures since the last stat datagram */
+	uint64_t stat_ms; /* monotonic time of the next stat datagram */
+	uint32_t meas_rxnb;
+	uint32_t meas_rxok;
+	uint32_t meas_rxfw;
+	uint32_t meas_push;
+	uint32_t meas_ack;
+	
+	struct udp_fwd_stats_s stats;
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static const char b64_char[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static uint64_t mono_ms(void);
+
+static int b64_encode(char *out, const uint8_t *in, int size);
+
+static void dgram_start(udp_fwd_t *fwd);
+
+static int dgram_send(udp_fwd_t *fwd);
+
+static void ack_expire(udp_fwd_t *fwd, uint64_t now);
+
+static uint64_t ack_time(struct msghdr *msg, uint64_t now, const struct timespec *real);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static uint64_t mono_ms(void) {
+	struct timespec t;
+	
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
+
+/* base64 with padding, as expected in the "data" field, returns the number of characters */
+static int b64_encode(char *out, const uint8_t *in, int size) {
+	char *o = out;
+	uint32_t v;
+	int i;
+	
+	for (i = 0; (i + 2) < size; i += 3) {
+		v = (in[i] << 16) | (in[i+1] << 8) | in[i+2];
+		*o++ = b64_char[(v >> 18) & 0x3F];
+		*o++ = b64_char[(v >> 12) & 0x3F];
+		*o++ = b64_char[(v >> 6) & 0x3F];
+		*o++ = b64_char[v & 0x3F];
+	}
+	if (i < size) {
+		v = in[i] << 16;
+		if ((i + 1) < size) {
+			v |= in[i+1] << 8;
+		}
+		*o++ = b64_char[(v >> 18) & 0x3F];
+		*o++ = b64_char[(v >> 12) & 0x3F];
+		*o++ = ((i + 1) < size) ? b64_char[(v >> 6) & 0x3F] : '=';
+		*o++ = '=';
+	}
+	return (int)(o - out);
+}
+
+/* PUSH_DATA header, the token is set when the datagram is sent */
+static void dgram_start(udp_fwd_t *fwd) {
+	uint64_t id = fwd->conf.gateway_id;
+	int i;
+	
+	fwd->dgram[0] = PROTOCOL_VERSION;
+	fwd->dgram[3] = PKT_PUSH_DATA;
+	for (i = 0; i < 8; ++i) {
+		fwd->dgram[4 + i] = (uint8_t)(id >> (56 - 8 * i)); /* MSB first */
+	}
+	fwd->len = DGRAM_HEAD;
+	fwd->nb_rxpk = 0;
+}
+
+/* send the datagram built in fwd->dgram and wait for its PUSH_ACK in the background */
+static int dgram_send(udp_fwd_t *fwd) {
+	uint16_t token = (uint16_t)rand();
+	uint64_t now = mono_ms();
+	int i, oldest;
+	
+	fwd->dgram[1] = (uint8_t)(token >> 8);
+	fwd->dgram[2] = (uint8_t)token;
+	if (send(fwd->fd, fwd->dgram, fwd->len, 0) != fwd->len) {
+		++fwd->stats.nb_send_error; /* no route, server port closed, ... */
+		return UDP_FWD_ERROR;
+	}
+	++fwd->stats.nb_push;
+	++fwd->meas_push;
+	
+	/* no room left to track it: the oldest PUSH_DATA is given up */
+	if (fwd->nb_pend == PEND_NB) {
+		oldest = 0;
+		for (i = 1; i < PEND_NB; ++i) {
+			if (fwd->pend[i].sent_ms < fwd->pend[oldest].sent_ms) {
+				oldest = i;
+			}
+		}
+		fwd->pend[oldest] = fwd->pend[--fwd->nb_pend];
+		++fwd->stats.nb_no_ack;
+	}
+	fwd->pend[fwd->nb_pend].token = token;
+	fwd->pend[fwd->nb_pend].sent_ms = now;
+	++fwd->nb_pend;
+	return UDP_FWD_SUCCESS;
+}
+
+/* the PUSH_DATA without PUSH_ACK after the timeout are counted as not acknowledged */
+static void ack_expire(udp_fwd_t *fwd, uint64_t now) {
+	int i = 0;
+	
+	while (i < fwd->nb_pend) {
+		if ((now - fwd->pend[i].sent_ms) >= fwd->conf.ack_ms) {
+			fwd->pend[i] = fwd->pend[--fwd->nb_pend];
+			++fwd->stats.nb_no_ack;
+		} else {
+			++i;
+		}
+	}
+}
+
+/* arrival time of a datagram on the monotonic clock, from its kernel receive timestamp (now if it has none) */
+static uint64_t ack_time(struct msghdr *msg, uint64_t now, const struct timespec *real) {
+	struct cmsghdr *c;
+	struct timespec ts;
+	int64_t age_ms;
+	
+#ifdef SCM_TIMESTAMPNS
+	for (c = CMSG_FIRSTHDR(msg); c != NULL; c = CMSG_NXTHDR(msg, c)) {
+		if ((c->cmsg_level == SOL_SOCKET) && (c->cmsg_type == SCM_TIMESTAMPNS)) {
+			memcpy(&ts, CMSG_DATA(c), sizeof ts);
+			age_ms = (int64_t)(real->tv_sec - ts.tv_sec) * 1000 + (real->tv_nsec - ts.tv_nsec) / 1000000;
+			if ((age_ms > 0) && ((uint64_t)age_ms < now)) {
+				return now - age_ms;
+			}
+		}
+	}
+#else
+	(void)msg; (void)real; (void)c; (void)ts; (void)age_ms;
+#endif
+	return now;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+udp_fwd_t *udp_fwd_open(const struct udp_fwd_conf_s *conf) {
+	udp_fwd_t *fwd;
+	struct addrinfo hints;
+	struct addrinfo *res;
+	char port_str[8];
+	int flags;
+	int one = 1;
+	
+	if (conf == NULL) {
+		return NULL;
+	}
+	fwd = calloc(1, sizeof *fwd);
+	if (fwd == NULL) {
+		return NULL;
+	}
+	fwd->conf = *conf;
+	fwd->conf.host[sizeof(fwd->conf.host) - 1] = '\0';
+	if (fwd->conf.port_up == 0) {
+		fwd->conf.port_up = UDP_FWD_PORT_DEFAULT;
+	}
+	if (fwd->conf.stat_s == 0) {
+		fwd->conf.stat_s = UDP_FWD_STAT_DEFAULT;
+	}
+	if (fwd->conf.ack_ms == 0) {
+		fwd->conf.ack_ms = UDP_FWD_ACK_DEFAULT;
+	}
+	
+	/* connected socket: send needs no address and only the server datagrams are received */
+	memset(&hints, 0, sizeof hints);
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	snprintf(port_str, sizeof port_str, "%u", fwd->conf.port_up);
+	if ((getaddrinfo(fwd->conf.host, port_str, &hints, &res) != 0) || (res == NULL)) {
+		free(fwd);
+		return NULL;
+	}
+	fwd->fd = socket(res->ai_family, SOCK_DGRAM, 0);
+	if ((fwd->fd < 0) || (connect(fwd->fd, res->ai_addr, res->ai_addrlen) != 0)) {
+		if (fwd->fd >= 0) {
+			close(fwd->fd);
+		}
+		freeaddrinfo(res);
+		free(fwd);
+		return NULL;
+	}
+	freeaddrinfo(res);
+	flags = fcntl(fwd->fd, F_GETFL, 0);
+	fcntl(fwd->fd, F_SETFL, flags | O_NONBLOCK);
+#ifdef SO_TIMESTAMPNS
+	setsockopt(fwd->fd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof one); /* PUSH_ACK arrival time, see ack_time */
+#else
+	(void)one;
+#endif
+	
+	srand(time(NULL) ^ (unsigned)fwd->conf.gateway_id); /* PUSH_DATA tokens */
+	dgram_start(fwd);
+	fwd->stat_ms = mono_ms() + 1000 * (uint64_t)fwd->conf.stat_s;
+	return fwd;
+}
+
+void udp_fwd_close(udp_fwd_t *fwd) {
+	if (fwd == NULL) {
+		return;
+	}
+	udp_fwd_send(fwd);
+	close(fwd->fd);
+	free(fwd);
+}
+
+int udp_fwd_push(udp_fwd_t *fwd, const struct lgw_pkt_rx_s *p) {
+	char *b;
+	int stat;
+	uint32_t sf = 0, bw = 0;
+	const char *cr = "";
+	
+	if ((fwd == NULL) || (p == NULL)) {
+		return UDP_FWD_ERROR;
+	}
+	++fwd->stats.nb_rx;
+	++fwd->meas_rxnb;
+	
+	/* CRC filters */
+	switch (p->status) {
+		case STAT_CRC_OK:
+			++fwd->meas_rxok;
+			if (!fwd->conf.fwd_crc_valid) {
+				return UDP_FWD_ERROR;
+			}
+			stat = 1;
+			break;
+		case STAT_CRC_BAD:
+			if (!fwd->conf.fwd_crc_error) {
+				return UDP_FWD_ERROR;
+			}
+			stat = -1;
+			break;
+		case STAT_NO_CRC:
+			if (!fwd->conf.fwd_no_crc) {
+				return UDP_FWD_ERROR;
+			}
+			stat = 0;
+			break;
+		default:
+			return UDP_FWD_ERROR;
+	}
+	
+	/* LoRa datarate and coderate as the protocol writes them */
+	if (p->modulation == MOD_LORA) {
+		switch (p->datarate) {
+			case DR_LORA_SF7:	sf = 7; break;
+			case DR_LORA_SF8:	sf = 8; break;
+			case DR_LORA_SF9:	sf = 9; break;
+			case DR_LORA_SF10:	sf = 10; break;
+			case DR_LORA_SF11:	sf = 11; break;
+			case DR_LORA_SF12:	sf = 12; break;
+			default: return UDP_FWD_ERROR;
+		}
+		switch (p->bandwidth) {
+			case BW_125KHZ:	bw = 125; break;
+			case BW_250KHZ:	bw = 250; break;
+			case BW_500KHZ:	bw = 500; break;
+			default: return UDP_FWD_ERROR;
+		}
+		switch (p->coderate) {
+			case CR_LORA_4_5:	cr = "4/5"; break;
+			case CR_LORA_4_6:	cr = "4/6"; break;
+			case CR_LORA_4_7:	cr = "4/7"; break;
+			case CR_LORA_4_8:	cr = "4/8"; break;
+			default: cr = "OFF";
+		}
+	} else if (p->modulation != MOD_FSK) {
+		return UDP_FWD_ERROR;
+	}
+	
+	/* datagram full, send it and go on in a new one */
+	if ((fwd->len + RXPK_MAX + 2) > UDP_FWD_DGRAM_MAX) {
+		udp_fwd_send(fwd);
+	}
+	
+	b = (char *)fwd->dgram + fwd->len;
+	b += sprintf(b, "%s{\"tmst\":%u,\"chan\":%u,\"rfch\":%u,\"freq\":%.6f,\"stat\":%d,", (fwd->nb_rxpk == 0) ? "{\"rxpk\":[" : ",", p->count_us, p->if_chain, p->rf_chain, (double)p->freq_hz / 1e6, stat);
+	if (p->modulation == MOD_LORA) {
+		b += sprintf(b, "\"modu\":\"LORA\",\"datr\":\"SF%uBW%u\",\"codr\":\"%s\",\"lsnr\":%.1f,", sf, bw, cr, p->snr);
+	} else {
+		b += sprintf(b, "\"modu\":\"FSK\",\"datr\":%u,", p->datarate);
+	}
+	b += sprintf(b, "\"rssi\":%.0f,\"size\":%u,\"data\":\"", p->rssi, p->size);
+	b += b64_encode(b, p->payload, p->size);
+	*b++ = '"';
+	*b++ = '}';
+	fwd->len = (int)((uint8_t *)b - fwd->dgram);
+	++fwd->nb_rxpk;
+	++fwd->stats.nb_rxpk;
+	++fwd->meas_rxfw;
+	return UDP_FWD_SUCCESS;
+}
+
+int udp_fwd_send(udp_fwd_t *fwd) {
+	int i;
+	
+	if (fwd == NULL) {
+		return UDP_FWD_ERROR;
+	}
+	if (fwd->nb_rxpk == 0) {
+		return UDP_FWD_SUCCESS;
+	}
+	fwd->dgram[fwd->len++] = ']';
+	fwd->dgram[fwd->len++] = '}';
+	i = dgram_send(fwd);
+	dgram_start(fwd);
+	return i;
+}
+
+int udp_fwd_service(udp_fwd_t *fwd) {
+	uint8_t ack[64];
+	struct iovec iov;
+	struct msghdr msg;
+	union {
+		char buf[64];
+		struct cmsghdr align;
+	} ctl;
+	struct timespec real;
+	uint16_t token;
+	uint64_t now, rx_ms;
+	char iso_time[32];
+	time_t t;
+	int n, i;
+	
+	if (fwd == NULL) {
+		return UDP_FWD_ERROR;
+	}
+	
+	/* PUSH_ACK received, matched with the PUSH_DATA still waiting */
+	/* they are timed by their arrival, not by when they are read, as service calls can be far apart */
+	now = mono_ms();
+	clock_gettime(CLOCK_REALTIME, &real); /* clock of the receive timestamps */
+	for (;;) {
+		iov.iov_base = ack;
+		iov.iov_len = sizeof ack;
+		memset(&msg, 0, sizeof msg);
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = ctl.buf;
+		msg.msg_controllen = sizeof ctl.buf;
+		n = recvmsg(fwd->fd, &msg, 0);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break; /* EAGAIN, or ECONNREFUSED reported for a datagram sent */
+		}
+		if ((n < 4) || (ack[0] != PROTOCOL_VERSION) || (ack[3] != PKT_PUSH_ACK)) {
+			continue;
+		}
+		token = (ack[1] << 8) | ack[2];
+		for (i = 0; i < fwd->nb_pend; ++i) {
+			if (fwd->pend[i].token == token) {
+				rx_ms = ack_time(&msg, now, &real);
+				if ((rx_ms < fwd->pend[i].sent_ms) || ((rx_ms - fwd->pend[i].sent_ms) < fwd->conf.ack_ms)) {
+					++fwd->stats.nb_ack;
+					++fwd->meas_ack;
+				} else {
+					++fwd->stats.nb_no_ack; /* arrived after the timeout */
+				}
+				fwd->pend[i] = fwd->pend[--fwd->nb_pend];
+				break;
+			}
+		}
+	}
+	ack_expire(fwd, now);
+	
+	/* stat datagram, it also keeps the gateway known to the server when no packet is received */
+	if (now < fwd->stat_ms) {
+		return UDP_FWD_SUCCESS;
+	}
+	fwd->stat_ms = now + 1000 * (uint64_t)fwd->conf.stat_s;
+	udp_fwd_send(fwd); /* the stat goes in a datagram of its own */
+	t = time(NULL);
+	strftime(iso_time, sizeof iso_time, "%F %T %Z", gmtime(&t));
+	fwd->len += sprintf((char *)fwd->dgram + fwd->len, "{\"stat\":{\"time\":\"%s\",\"rxnb\":%u,\"rxok\":%u,\"rxfw\":%u,\"ackr\":%.1f,\"dwnb\":0,\"txnb\":0}}", iso_time, fwd->meas_rxnb, fwd->meas_rxok, fwd->meas_rxfw, (fwd->meas_push > 0) ? (100.0 * fwd->meas_ack / fwd->meas_push) : 0.0);
+	fwd->meas_rxnb = 0;
+	fwd->meas_rxok = 0;
+	fwd->meas_rxfw = 0;
+	fwd->meas_push = 0;
+	fwd->meas_ack = 0;
+	i = dgram_send(fwd);
+	if (i == UDP_FWD_SUCCESS) {
+		++fwd->stats.nb_stat;
+	}
+	dgram_start(fwd);
+	return i;
+}
+
+int udp_fwd_get_stats(udp_fwd_t *fwd, struct udp_fwd_stats_s *stats) {
+	if ((fwd == NULL) || (stats == NULL)) {
+		return UDP_FWD_ERROR;
+	}
+	*stats = fwd->stats;
+	return UDP_FWD_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
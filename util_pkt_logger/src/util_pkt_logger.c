@@ -26,25 +26,20 @@ Maintainer: Sylvain Miermont
 
 #include <stdint.h>		/* C99 types */
 #include <stdbool.h>	/* bool type */
-#include <stdio.h>		/* printf fprintf sprintf fopen fputs */
+#include <stdio.h>		/* printf fprintf sprintf */
 
 #include <string.h>		/* memset */
 #include <signal.h>		/* sigaction */
-#include <time.h>		/* time clock_gettime strftime gmtime clock_nanosleep*/
+#include <time.h>		/* time clock_gettime strftime gmtime */
 #include <unistd.h>		/* getopt access */
 #include <stdlib.h>		/* atoi */
 
 #include "parson.h"
+#include "fwd.h"
+#include "log_writer.h"
+#include "udp_fwd.h"
 #include "loragw_hal.h"
-
-/* header files to support socket programming */
-#include <sys/socket.h>
-#include <sys/types.h>
-#include <netinet/in.h>
-#include <netdb.h>
-#include <errno.h>
-#include <arpa/inet.h>
-
+#include "loragw_ring.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -52,6 +47,13 @@ Maintainer: Sylvain Miermont
 #define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
 #define MSG(args...)	fprintf(stderr,"loragw_pkt_logger: " args) /* message that is destined to the user */
 
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define FWD_SINK_MAX	4	/* max number of forwarding sinks */
+#define FWD_HOST_DFLT	"127.0.0.1"	/* sink used when the configuration has no "forward" list */
+#define FWD_PORT_DFLT	1680
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES (GLOBAL) ------------------------------------------- */
 
@@ -62,13 +64,25 @@ static int quit_sig = 0; /* 1 -> application terminates without shutting down th
 
 /* configuration variables needed by the application  */
 uint64_t lgwm = 0; /* LoRa gateway MAC address */
-char lgwm_str[17];
 
-/* clock and log file management */
-time_t now_time;
-time_t log_start_time;
-FILE * log_file = NULL;
-char log_file_name[64];
+/* calibration cache, to restart the concentrator faster */
+static char cal_cache_file[256];
+static struct lgw_conf_start_s startconf;
+static struct lgw_conf_board_s boardconf; /* SPI link, completed by each configuration file */
+
+/* forwarding of the CRC-OK packets, one persistent connection per sink */
+static struct fwd_conf_s fwd_conf[FWD_SINK_MAX];
+static int fwd_nb = -1; /* number of configured sinks, -1 for the default sink */
+static fwd_sink_t *fwd_sink[FWD_SINK_MAX];
+static bool fwd_up[FWD_SINK_MAX]; /* connection state last reported to the user */
+
+/* log file, written by the log writer thread */
+static struct logw_conf_s logw_conf;
+
+/* optional network server uplink (Semtech UDP protocol), enabled by "server_address" */
+static struct udp_fwd_conf_s udp_conf = {.fwd_crc_valid = true};
+static bool udp_on = false;
+static udp_fwd_t *udp_up = NULL;
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
@@ -79,10 +93,16 @@ int parse_SX1301_configuration(const char * conf_file);
 
 int parse_gateway_configuration(const char * conf_file);
 
-void open_log(void);
-
 void usage (void);
 
+void print_start_profile(void);
+
+void fwd_report(bool all);
+
+void logw_report(void);
+
+void udp_report(void);
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
@@ -104,6 +124,7 @@ int parse_SX1301_configuration(const char * conf_file) {
 	JSON_Object *root = NULL;
 	JSON_Object *conf = NULL;
 	JSON_Value *val;
+	const char *str;
 	uint32_t sf, bw;
 	
 	/* try to parse JSON */
@@ -121,6 +142,29 @@ int parse_SX1301_configuration(const char * conf_file) {
 		MSG("INFO: %s does contain a JSON object named %s, parsing SX1301 parameters\n", conf_file, conf_obj);
 	}
 	
+	/* optional SPI link parameters, defaults (or LGW_SPI_ environment variables) otherwise */
+	str = json_object_dotget_string(conf, "spi_path");
+	if (str != NULL) {
+		strncpy(boardconf.spi_path, str, sizeof(boardconf.spi_path) - 1);
+	}
+	val = json_object_dotget_value(conf, "spi_speed");
+	if (json_value_get_type(val) == JSONNumber) {
+		boardconf.spi_speed = (uint32_t)json_value_get_number(val);
+	}
+	val = json_object_dotget_value(conf, "spi_chunk");
+	if (json_value_get_type(val) == JSONNumber) {
+		boardconf.spi_chunk = (uint16_t)json_value_get_number(val);
+	}
+	val = json_object_dotget_value(conf, "spi_autotune");
+	if (json_value_get_type(val) == JSONBoolean) {
+		boardconf.spi_autotune = (bool)json_value_get_boolean(val);
+	}
+	if (lgw_board_setconf(boardconf) != LGW_HAL_SUCCESS) {
+		MSG("WARNING: invalid SPI link configuration\n");
+	} else if ((boardconf.spi_path[0] != '\0') || (boardconf.spi_speed != 0) || (boardconf.spi_chunk != 0) || boardconf.spi_autotune) {
+		MSG("INFO: SPI link on %s, clock %u Hz%s, chunk %u bytes%s\n", (boardconf.spi_path[0] != '\0') ? boardconf.spi_path : "default device", boardconf.spi_speed, boardconf.spi_autotune ? " max" : "", boardconf.spi_chunk, boardconf.spi_autotune ? ", auto-tuned" : "");
+	}
+	
 	/* set configuration for RF chains */
 	for (i = 0; i < LGW_RF_CHAIN_NB; ++i) {
 		memset(&rfconf, 0, sizeof(rfconf)); /* initialize configuration structure */
@@ -267,7 +311,12 @@ int parse_gateway_configuration(const char * conf_file) {
 	JSON_Value *root_val;
 	JSON_Object *root = NULL;
 	JSON_Object *conf = NULL;
+	JSON_Value *val;
+	const char *str;
+	JSON_Array *sinks;
+	JSON_Object *sink;
 	unsigned long long ull = 0;
+	size_t i;
 	
 	/* try to parse JSON */
 	root_val = json_parse_file_with_comments(conf_file);
@@ -289,34 +338,119 @@ int parse_gateway_configuration(const char * conf_file) {
 	lgwm = ull;
 	MSG("INFO: gateway MAC address is configured to %016llX\n", ull);
 	
-	json_value_free(root_val);
-	return 0;
-}
-
-void open_log(void) {
-	int i;
-	char iso_date[20];
+	/* optional GPIO line wired to the concentrator DGPIO0 'packets waiting' output */
+	str = json_object_dotget_string(conf, "rx_gpio_chip");
+	if (str != NULL) {
+		val = json_object_dotget_value(conf, "rx_gpio_line");
+		if (json_value_get_type(val) == JSONNumber) {
+			lgw_rxirq_setconf(str, (uint32_t)json_value_get_number(val));
+			MSG("INFO: RX 'packets waiting' event on %s line %u\n", str, (uint32_t)json_value_get_number(val));
+		} else {
+			MSG("WARNING: rx_gpio_chip set without rx_gpio_line, RX FIFO will be polled\n");
+		}
+	}
 	
-	strftime(iso_date,ARRAY_SIZE(iso_date),"%Y%m%dT%H%M%SZ",gmtime(&now_time)); /* format yyyymmddThhmmssZ */
-	log_start_time = now_time; /* keep track of when the log was started, for log rotation */
+	/* optional calibration cache, a restart then only runs the RX calibration */
+	str = json_object_dotget_string(conf, "cal_cache_file");
+	if (str != NULL) {
+		strncpy(cal_cache_file, str, sizeof(cal_cache_file) - 1);
+		startconf.cal_cache = cal_cache_file;
+		val = json_object_dotget_value(conf, "cal_max_age");
+		if (json_value_get_type(val) == JSONNumber) {
+			startconf.cal_max_age = (uint32_t)json_value_get_number(val);
+		}
+		MSG("INFO: calibration cache %s, max age %u s\n", cal_cache_file, startconf.cal_max_age);
+	}
 	
-	/*modified to save in same log file*/
-	//sprintf(log_file_name, "pktlog_%s_%s.csv", lgwm_str, iso_date);
-	sprintf(log_file_name, "pktlog_%s.csv", lgwm_str);
-	log_file = fopen(log_file_name, "a"); /* create log file, append if file already exist */
-	if (log_file == NULL) {
-		MSG("ERROR: impossible to create log file %s\n", log_file_name);
-		exit(EXIT_FAILURE);
+	/* optional forwarding sinks (an empty list disables forwarding) */
+	sinks = json_object_get_array(conf, "forward");
+	if (sinks != NULL) {
+		fwd_nb = 0;
+		for (i = 0; i < json_array_get_count(sinks); ++i) {
+			sink = json_array_get_object(sinks, i);
+			if ((sink == NULL) || (json_object_get_string(sink, "host") == NULL) || (json_value_get_type(json_object_get_value(sink, "port")) != JSONNumber)) {
+				MSG("WARNING: forwarding sink %u needs a \"host\" and a \"port\", ignored\n", (unsigned)i);
+				continue;
+			}
+			if (fwd_nb == FWD_SINK_MAX) {
+				MSG("WARNING: more than %d forwarding sinks, sink %u ignored\n", FWD_SINK_MAX, (unsigned)i);
+				continue;
+			}
+			memset(&fwd_conf[fwd_nb], 0, sizeof(fwd_conf[fwd_nb]));
+			strncpy(fwd_conf[fwd_nb].host, json_object_get_string(sink, "host"), sizeof(fwd_conf[fwd_nb].host) - 1);
+			fwd_conf[fwd_nb].port = (uint16_t)json_object_get_number(sink, "port");
+			fwd_conf[fwd_nb].queue_size = (uint32_t)json_object_get_number(sink, "queue_size"); /* 0 if absent */
+			str = json_object_get_string(sink, "queue_policy");
+			fwd_conf[fwd_nb].policy = ((str != NULL) && (strcmp(str, "drop_newest") == 0)) ? FWD_DROP_NEWEST : FWD_DROP_OLDEST;
+			MSG("INFO: forwarding to %s:%u, queue of %u packets, %s when full\n", fwd_conf[fwd_nb].host, fwd_conf[fwd_nb].port, (fwd_conf[fwd_nb].queue_size != 0) ? fwd_conf[fwd_nb].queue_size : FWD_QUEUE_DEFAULT, (fwd_conf[fwd_nb].policy == FWD_DROP_NEWEST) ? "drop newest" : "drop oldest");
+			++fwd_nb;
+		}
 	}
 	
-	i = fprintf(log_file, "\"gateway ID\",\"node MAC\",\"UTC timestamp\",\"us count\",\"frequency\",\"RF chain\",\"RX chain\",\"status\",\"size\",\"modulation\",\"bandwidth\",\"datarate\",\"coderate\",\"RSSI\",\"SNR\",\"payload\"\n");
-	if (i < 0) {
-		MSG("ERROR: impossible to write to log file %s\n", log_file_name);
-		exit(EXIT_FAILURE);
+	/* optional network server uplink, PUSH_DATA datagrams of the Semtech packet forwarder protocol */
+	str = json_object_dotget_string(conf, "server_address");
+	if (str != NULL) {
+		udp_on = true;
+		strncpy(udp_conf.host, str, sizeof(udp_conf.host) - 1);
+		val = json_object_dotget_value(conf, "serv_port_up");
+		if (json_value_get_type(val) == JSONNumber) {
+			udp_conf.port_up = (uint16_t)json_value_get_number(val);
+		}
+		val = json_object_dotget_value(conf, "stat_interval");
+		if (json_value_get_type(val) == JSONNumber) {
+			udp_conf.stat_s = (uint32_t)json_value_get_number(val);
+		}
+		val = json_object_dotget_value(conf, "push_timeout_ms");
+		if (json_value_get_type(val) == JSONNumber) {
+			udp_conf.ack_ms = (uint32_t)json_value_get_number(val);
+		}
+		val = json_object_dotget_value(conf, "forward_crc_valid");
+		if (json_value_get_type(val) == JSONBoolean) {
+			udp_conf.fwd_crc_valid = (json_value_get_boolean(val) == 1);
+		}
+		val = json_object_dotget_value(conf, "forward_crc_error");
+		if (json_value_get_type(val) == JSONBoolean) {
+			udp_conf.fwd_crc_error = (json_value_get_boolean(val) == 1);
+		}
+		val = json_object_dotget_value(conf, "forward_crc_disabled");
+		if (json_value_get_type(val) == JSONBoolean) {
+			udp_conf.fwd_no_crc = (json_value_get_boolean(val) == 1);
+		}
+		MSG("INFO: PUSH_DATA to network server %s:%u, stat every %u s\n", udp_conf.host, (udp_conf.port_up != 0) ? udp_conf.port_up : UDP_FWD_PORT_DEFAULT, (udp_conf.stat_s != 0) ? udp_conf.stat_s : UDP_FWD_STAT_DEFAULT);
+	}
+	
+	/* optional log file format, "csv" (default) or "binary" (see pktlog.h, util_pkt_convert turns it into CSV) */
+	str = json_object_dotget_string(conf, "log_format");
+	if (str != NULL) {
+		if (strcmp(str, "binary") == 0) {
+			logw_conf.format = LOGW_FORMAT_BIN;
+		} else if (strcmp(str, "csv") == 0) {
+			logw_conf.format = LOGW_FORMAT_CSV;
+		} else {
+			MSG("WARNING: unknown log_format \"%s\", keeping %s\n", str, (logw_conf.format == LOGW_FORMAT_BIN) ? "binary" : "csv");
+		}
 	}
 	
-	MSG("INFO: Now writing to log file %s\n", log_file_name);
-	return;
+	/* optional log writer tuning, see log_writer.h for the defaults */
+	val = json_object_dotget_value(conf, "log_queue_size");
+	if (json_value_get_type(val) == JSONNumber) {
+		logw_conf.queue_size = (uint32_t)json_value_get_number(val);
+	}
+	val = json_object_dotget_value(conf, "log_buffer_size");
+	if (json_value_get_type(val) == JSONNumber) {
+		logw_conf.chunk_size = (uint32_t)json_value_get_number(val);
+	}
+	val = json_object_dotget_value(conf, "log_flush_ms");
+	if (json_value_get_type(val) == JSONNumber) {
+		logw_conf.flush_ms = (uint32_t)json_value_get_number(val);
+	}
+	val = json_object_dotget_value(conf, "log_sync_s");
+	if (json_value_get_type(val) == JSONNumber) {
+		logw_conf.sync_s = (uint32_t)json_value_get_number(val);
+	}
+	
+	json_value_free(root_val);
+	return 0;
 }
 
 /* describe command line options */
@@ -325,6 +459,65 @@ void usage(void) {
 	printf( "Available options:\n");
 	printf( " -h print this help\n");
 	printf( " -r <int> rotate log file every N seconds (-1 disable log rotation)\n");
+	printf( " -t <int> fetch packets in a dedicated thread, with that SCHED_FIFO priority (0 for default scheduling)\n");
+}
+
+/* report connection changes of the forwarding sinks, and all their counters if asked */
+void fwd_report(bool all) {
+	struct fwd_stats_s st;
+	int i;
+	
+	for (i = 0; i < fwd_nb; ++i) {
+		fwd_get_stats(fwd_sink[i], &st);
+		if (st.connected != fwd_up[i]) {
+			fwd_up[i] = st.connected;
+			if (st.connected) {
+				MSG("INFO: connected to %s:%u\n", fwd_conf[i].host, fwd_conf[i].port);
+			} else {
+				MSG("WARNING: no connection to %s:%u, packets are queued\n", fwd_conf[i].host, fwd_conf[i].port);
+			}
+		}
+		if (all) {
+			MSG("INFO: %s:%u: %u packet(s) sent in %u write(s), %u dropped (queue full, max %u queued), %u connection(s), %u lost\n", fwd_conf[i].host, fwd_conf[i].port, st.nb_sent, st.nb_write, st.nb_dropped, st.queue_max, st.nb_connect, st.nb_lost);
+		}
+	}
+}
+
+/* counters of the log writer */
+void logw_report(void) {
+	struct logw_stats_s st;
+	
+	logw_get_stats(&st);
+	MSG("INFO: %u packet(s) logged, %u dropped (log queue full, max %u queued), %u flush(es), %u sync(s)\n", st.nb_written, st.nb_dropped, st.max_fill, st.nb_flush, st.nb_sync);
+}
+
+/* counters of the network server uplink */
+void udp_report(void) {
+	struct udp_fwd_stats_s st;
+	
+	if (udp_up == NULL) {
+		return;
+	}
+	udp_fwd_get_stats(udp_up, &st);
+	MSG("INFO: %s: %u packet(s) forwarded out of %u, %u PUSH_DATA (%u stat), %u acknowledged, %u not, %u send error(s)\n", udp_conf.host, st.nb_rxpk, st.nb_rx, st.nb_push, st.nb_stat, st.nb_ack, st.nb_no_ack, st.nb_send_error);
+}
+
+/* where the start time went, phase by phase */
+void print_start_profile(void) {
+	struct lgw_start_profile_s prof;
+	struct lgw_start_wait_s wait;
+	int i;
+	
+	if (lgw_get_start_profile(&prof) != LGW_HAL_SUCCESS) {
+		return;
+	}
+	MSG("INFO: concentrator start took %u ms\n", prof.total_us / 1000);
+	for (i = 0; i < LGW_START_PHASE_NB; ++i) {
+		MSG("INFO:   %-16s %6u ms, %5u SPI transactions, %7llu bytes\n", prof.phase[i].name, prof.phase[i].duration_us / 1000, prof.phase[i].nb_submit, (unsigned long long)prof.phase[i].nb_byte);
+	}
+	if (lgw_get_start_wait(&wait) == LGW_HAL_SUCCESS) {
+		MSG("INFO:   waited %u ms for calibration, %u ms for AGC init\n", wait.cal_us / 1000, (wait.agc_boot_us + wait.agc_lut_us + wait.agc_chan_us + wait.agc_final_us) / 1000);
+	}
 }
 
 
@@ -334,12 +527,15 @@ void usage(void) {
 int main(int argc, char **argv)
 {
 	int i, j; /* loop and temporary variables */
-	struct timespec sleep_time = {0, 3000000}; /* 3 ms */
+	int rx_wait_ms = 100; /* max time spent waiting for packets, keeps signals and log rotation responsive */
+	int rx_thread_prio = -1; /* SCHED_FIFO priority of the RX fetch thread, -1 to fetch from the main loop */
+	struct lgw_ring_stats_s ring_stats;
 	
 	/* clock and log rotation management */
 	int log_rotate_interval = 3600; /* by default, rotation every hour */
 	int time_check = 0; /* variable used to limit the number of calls to time() function */
-	unsigned long pkt_in_log = 0; /* count the number of packet written in each log file */
+	time_t now_time;
+	time_t report_time; /* counters are reported at each log rotation interval */
 	
 	/* configuration file related */
 	const char global_conf_fname[] = "global_conf.json"; /* contain global (typ. network-wide) configuration */
@@ -351,34 +547,11 @@ int main(int argc, char **argv)
 	struct lgw_pkt_rx_s *p; /* pointer on a RX packet */
 	int nb_pkt;
 	
-	/* local timestamp variables until we get accurate GPS time */
+	/* local timestamp until we get accurate GPS time */
 	struct timespec fetch_time;
-	char fetch_timestamp[30];
-	struct tm * x;
 	
-	/*socket parameters*/
-    int sockfd = 0;
-    uint8_t recvBuff[256];
-    memset(recvBuff, '0', sizeof(recvBuff));
-
-    struct sockaddr_in serv_addr,smap_addr;
-
-    /* Initialize sockaddr_in data structure */
-    serv_addr.sin_family = AF_INET;
-    serv_addr.sin_port = htons(1680); // port
-    serv_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
-
-
-    /* Initialize smapaddr_in data structure */
-    smap_addr.sin_family = AF_INET;
-    smap_addr.sin_port = htons(1690); // port
-    smap_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
-
-
-
-
 	/* parse command line options */
-	while ((i = getopt (argc, argv, "hr:")) != -1) {
+	while ((i = getopt (argc, argv, "hr:t:")) != -1) {
 		switch (i) {
 			case 'h':
 				usage();
@@ -393,6 +566,14 @@ int main(int argc, char **argv)
 				}
 				break;
 			
+			case 't':
+				rx_thread_prio = atoi(optarg);
+				if ((rx_thread_prio < 0) || (rx_thread_prio > 99)) {
+					MSG( "ERROR: Invalid argument for -t option\n");
+					return EXIT_FAILURE;
+				}
+				break;
+			
 			default:
 				MSG("ERROR: argument parsing use -h option for help\n");
 				usage();
@@ -435,215 +616,157 @@ int main(int argc, char **argv)
 	}
 	
 	/* starting the concentrator */
-	i = lgw_start();
+	i = lgw_start_ex(&startconf);
 	if (i == LGW_HAL_SUCCESS) {
 		MSG("INFO: concentrator started, packet can now be received\n");
+		print_start_profile();
+		if (lgw_get_rx_fd() < 0) {
+			MSG("INFO: no 'packets waiting' event, RX FIFO is polled\n");
+		}
 	} else {
 		MSG("ERROR: failed to start the concentrator\n");
 		return EXIT_FAILURE;
 	}
 	
-	/* transform the MAC address into a string */
-	sprintf(lgwm_str, "%08X%08X", (uint32_t)(lgwm >> 32), (uint32_t)(lgwm & 0xFFFFFFFF));
+	/* optional RX fetch thread, so that logging and forwarding never delay the FIFO drain */
+	if (rx_thread_prio >= 0) {
+		if (lgw_ring_start(LGW_RING_SIZE_DEFAULT, rx_thread_prio) != LGW_RING_SUCCESS) {
+			MSG("ERROR: failed to start the RX fetch thread\n");
+			return EXIT_FAILURE;
+		}
+		lgw_ring_get_stats(&ring_stats);
+		if ((ring_stats.rt_sched == true) || (rx_thread_prio == 0)) {
+			MSG("INFO: packets fetched by a dedicated thread\n");
+		} else {
+			MSG("WARNING: SCHED_FIFO priority %d refused, packets fetched by a dedicated thread with default scheduling\n", rx_thread_prio);
+		}
+	}
+	
+	/* open the forwarding sinks, connections are made in the background */
+	if (fwd_nb < 0) {
+		memset(&fwd_conf[0], 0, sizeof(fwd_conf[0]));
+		strcpy(fwd_conf[0].host, FWD_HOST_DFLT);
+		fwd_conf[0].port = FWD_PORT_DFLT;
+		fwd_conf[0].policy = FWD_DROP_OLDEST;
+		fwd_nb = 1;
+	}
+	for (i = 0; i < fwd_nb; ++i) {
+		fwd_sink[i] = fwd_open(&fwd_conf[i]);
+		if (fwd_sink[i] == NULL) {
+			MSG("ERROR: impossible to resolve forwarding sink %s:%u\n", fwd_conf[i].host, fwd_conf[i].port);
+			return EXIT_FAILURE;
+		}
+	}
+	
+	/* network server uplink, the gateway MAC address identifies the datagrams */
+	if (udp_on) {
+		udp_conf.gateway_id = lgwm;
+		udp_up = udp_fwd_open(&udp_conf);
+		if (udp_up == NULL) {
+			MSG("ERROR: impossible to resolve network server %s\n", udp_conf.host);
+			return EXIT_FAILURE;
+		}
+	}
 	
-	/* opening log file and writing CSV header*/
-	time(&now_time);
-	open_log();
+	/* opening log file and writing its header, then formatting and writing are left to the log writer thread */
+	logw_conf.gateway_mac = lgwm;
+	logw_conf.rotate_s = log_rotate_interval;
+	if (logw_start(&logw_conf) != LOGW_SUCCESS) {
+		MSG("ERROR: failed to start the log writer\n");
+		return EXIT_FAILURE;
+	}
+	time(&report_time);
 	
 	/* main loop */
 	while ((quit_sig != 1) && (exit_sig != 1)) {
-		/* fetch packets */
-		nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
+		/* fetch packets, sleeping on DGPIO0 when available (polling otherwise) */
+		if (rx_thread_prio >= 0) {
+			nb_pkt = lgw_ring_pop_wait(rx_wait_ms, ARRAY_SIZE(rxpkt), rxpkt);
+		} else {
+			nb_pkt = lgw_receive_wait(rx_wait_ms, ARRAY_SIZE(rxpkt), rxpkt);
+		}
 		if (nb_pkt == LGW_HAL_ERROR) {
 			MSG("ERROR: failed packet fetch, exiting\n");
 			return EXIT_FAILURE;
-		} else if (nb_pkt == 0) {
-			clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL); /* wait a short time if no packets */
-		} else {
+		} else if (nb_pkt > 0) {
 			/* local timestamp generation until we get accurate GPS time */
 			clock_gettime(CLOCK_REALTIME, &fetch_time);
-			x = gmtime(&(fetch_time.tv_sec));
-			sprintf(fetch_timestamp,"%04i-%02i-%02i %02i:%02i:%02i.%03liZ",(x->tm_year)+1900,(x->tm_mon)+1,x->tm_mday,x->tm_hour,x->tm_min,x->tm_sec,(fetch_time.tv_nsec)/1000000); /* ISO 8601 format */
+			logw_push(nb_pkt, rxpkt, &fetch_time); /* never waits for the storage, drops when the log queue is full */
 		}
 		
-		/* log packets */
 		for (i=0; i < nb_pkt; ++i) {
 			p = &rxpkt[i];
 			
-			/* writing gateway ID */
-			fprintf(log_file, "\"%08X%08X\",", (uint32_t)(lgwm >> 32), (uint32_t)(lgwm & 0xFFFFFFFF));
-			
-			/* writing node MAC address */
-			fputs("\"\",", log_file); // TODO: need to parse payload
-			
-			/* writing UTC timestamp*/
-			fprintf(log_file, "\"%s\",", fetch_timestamp);
-			// TODO: replace with GPS time when available
-			
-			/* writing internal clock */
-			fprintf(log_file, "%10u,", p->count_us);
-			
-			/* writing RX frequency */
-			fprintf(log_file, "%10u,", p->freq_hz);
-			
-			/* writing RF chain */
-			fprintf(log_file, "%u,", p->rf_chain);
-			
-			/* writing RX modem/IF chain */
-			fprintf(log_file, "%2d,", p->if_chain);
-			
-			/* writing status */
-			switch(p->status) {
-				case STAT_CRC_OK:	fputs("\"CRC_OK\" ,", log_file); break;
-				case STAT_CRC_BAD:	fputs("\"CRC_BAD\",", log_file); break;
-				case STAT_NO_CRC:	fputs("\"NO_CRC\" ,", log_file); break;
-				case STAT_UNDEFINED:fputs("\"UNDEF\"  ,", log_file); break;
-				default: fputs("\"ERR\"    ,", log_file);
-			}
-			
-			/* writing payload size */
-			fprintf(log_file, "%3u,", p->size);
-			
-			/* writing modulation */
-			switch(p->modulation) {
-				case MOD_LORA:	fputs("\"LORA\",", log_file); break;
-				case MOD_FSK:	fputs("\"FSK\" ,", log_file); break;
-				default: fputs("\"ERR\" ,", log_file);
-			}
-			
-			/* writing bandwidth */
-			switch(p->bandwidth) {
-				case BW_500KHZ:	fputs("500000,", log_file); break;
-				case BW_250KHZ:	fputs("250000,", log_file); break;
-				case BW_125KHZ:	fputs("125000,", log_file); break;
-				case BW_62K5HZ:	fputs("62500 ,", log_file); break;
-				case BW_31K2HZ:	fputs("31200 ,", log_file); break;
-				case BW_15K6HZ:	fputs("15600 ,", log_file); break;
-				case BW_7K8HZ:	fputs("7800  ,", log_file); break;
-				case BW_UNDEFINED: fputs("0     ,", log_file); break;
-				default: fputs("-1    ,", log_file);
-			}
-			
-			/* writing datarate */
-			if (p->modulation == MOD_LORA) {
-				switch (p->datarate) {
-					case DR_LORA_SF7:	fputs("\"SF7\"   ,", log_file); break;
-					case DR_LORA_SF8:	fputs("\"SF8\"   ,", log_file); break;
-					case DR_LORA_SF9:	fputs("\"SF9\"   ,", log_file); break;
-					case DR_LORA_SF10:	fputs("\"SF10\"  ,", log_file); break;
-					case DR_LORA_SF11:	fputs("\"SF11\"  ,", log_file); break;
-					case DR_LORA_SF12:	fputs("\"SF12\"  ,", log_file); break;
-					default: fputs("\"ERR\"   ,", log_file);
-				}
-			} else if (p->modulation == MOD_FSK) {
-				fprintf(log_file, "\"%6u\",", p->datarate);
-			} else {
-				fputs("\"ERR\"   ,", log_file);
-			}
-			
-			/* writing coderate */
-			switch (p->coderate) {
-				case CR_LORA_4_5:	fputs("\"4/5\",", log_file); break;
-				case CR_LORA_4_6:	fputs("\"2/3\",", log_file); break;
-				case CR_LORA_4_7:	fputs("\"4/7\",", log_file); break;
-				case CR_LORA_4_8:	fputs("\"1/2\",", log_file); break;
-				case CR_UNDEFINED:	fputs("\"\"   ,", log_file); break;
-				default: fputs("\"ERR\",", log_file);
-			}
-			
-			/* writing packet RSSI */
-			fprintf(log_file, "%+.0f,", p->rssi);
-			
-			/* writing packet average SNR */
-			fprintf(log_file, "%+5.1f,", p->snr);
-			
-			/* writing hex-encoded payload (bundled in 32-bit words) */
 			printf("DATA: ");
-			fputs("\"", log_file);
 			for (j = 0; j < p->size; ++j) {
-				/* Removed the bundling of 32 bit words*/
-				//if ((j > 0) && (j%4 == 0)) fputs("-", log_file);
-				fprintf(log_file, "%02X", p->payload[j]);
-
 				printf("%c",p->payload[j]);
-				/*to copy the payload to recvBuff*/
-			    recvBuff[j]=p->payload[j];
 			}
 			printf("\n");
 			
-			if (p->status == STAT_CRC_OK){
-			    /* Create a socket first */
-			    if((sockfd = socket(AF_INET, SOCK_STREAM, 0))< 0){
-			        printf("\n Error : Could not create socket \n");
-			        return 1;
-			    }
-
-				/* Attempt a connection */
-				if(connect(sockfd, (struct sockaddr *)&serv_addr, sizeof(serv_addr))<0){
-					printf("\n Error : Connect Failed \n");
-					return 1;
+			/* queue the payload for each sink, sent after the batch */
+			if ((p->status == STAT_CRC_OK) && (p->size > 0)) {
+				for (j = 0; j < fwd_nb; ++j) {
+					fwd_push(fwd_sink[j], p->payload, p->size);
 				}
-		    	/* If read was success, send data. */
-		    	if(p->size > 0){
-		    		printf("Sending \n");
-		    		write(sockfd, recvBuff, p->size);
-		    	}
-		    	/*close socket*/
-		    	close(sockfd);
-
-//			    /* Create a socket first */
-//			    if((sockfd = socket(AF_INET, SOCK_STREAM, 0))< 0){
-//			        printf("\n Error : Could not create socket \n");
-//			        return 1;
-//			    }
-//
-//				/* Attempt a connection for smap */
-//				if(connect(sockfd, (struct sockaddr *)&smap_addr, sizeof(smap_addr))<0){
-//					printf("\n Error : Connect Failed \n");
-//					return 1;
-//				}
-//		    	/* If read was success, send data. */
-//		    	if(p->size > 0){
-//		    		printf("Sending \n");
-//		    		write(sockfd, recvBuff, p->size);
-//		    	}
-//		    	/*close socket*/
-//		    	close(sockfd);
 			}
-
-			/* end of log file line */
-			fputs("\"\n", log_file);
-			fflush(log_file);
-			++pkt_in_log;
+			
+			/* rxpk array of the batch, filtered on the CRC status */
+			udp_fwd_push(udp_up, p);
 		}
 		
-		/* check time and rotate log file if necessary */
+		/* one PUSH_DATA for the whole batch, then PUSH_ACK and stat keepalive */
+		if (udp_up != NULL) {
+			udp_fwd_send(udp_up);
+			udp_fwd_service(udp_up);
+		}
+		
+		/* send the queued packets (one write per sink), reconnect lost sinks */
+		for (i = 0; i < fwd_nb; ++i) {
+			fwd_service(fwd_sink[i]);
+		}
+		fwd_report(false);
+		
+		/* report the counters at the log rotation interval (rotation itself is done by the log writer) */
 		++time_check;
 		if (time_check >= 8) {
 			time_check = 0;
 			time(&now_time);
-			if (difftime(now_time, log_start_time) > log_rotate_interval) {
-				fclose(log_file);
-				MSG("INFO: log file %s closed, %lu packet(s) recorded\n", log_file_name, pkt_in_log);
-				pkt_in_log = 0;
-				open_log();
+			if ((log_rotate_interval > 0) && (difftime(now_time, report_time) > log_rotate_interval)) {
+				report_time = now_time;
+				logw_report();
+				fwd_report(true);
+				udp_report();
 			}
 		}
-
+	
 	}
 	
 	if (exit_sig == 1) {
-		/* clean up before leaving */
+		/* shut down the hardware */
+		if (rx_thread_prio >= 0) {
+			lgw_ring_get_stats(&ring_stats);
+			lgw_ring_stop();
+			MSG("INFO: RX fetch thread stopped, %u packet(s) fetched, %u dropped (ring full)\n", ring_stats.nb_fetched, ring_stats.nb_overrun);
+		}
 		i = lgw_stop();
 		if (i == LGW_HAL_SUCCESS) {
 			MSG("INFO: concentrator stopped successfully\n");
 		} else {
 			MSG("WARNING: failed to stop concentrator successfully\n");
 		}
-		fclose(log_file);
-		MSG("INFO: log file %s closed, %lu packet(s) recorded\n", log_file_name, pkt_in_log);
 	}
 	
+	/* on both exit signals, the packets already fetched are not lost */
+	logw_stop(); /* writes the packets still queued */
+	logw_report();
+	fwd_report(true);
+	for (i = 0; i < fwd_nb; ++i) {
+		fwd_close(fwd_sink[i]);
+	}
+	udp_fwd_service(udp_up); /* last PUSH_ACK */
+	udp_report();
+	udp_fwd_close(udp_up);
+	
 	MSG("INFO: Exiting packet logger program\n");
 	return EXIT_SUCCESS;
 }
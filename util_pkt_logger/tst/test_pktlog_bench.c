@@ -0,0 +1,266 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Microbenchmark of the CSV log formatting.
+	Checks that pktlog_csv writes the same bytes as the stdio formatting it
+	replaced (kept here as reference), on random packets and on the rounding
+	corner cases of the RSSI and SNR, then measures the records/s of both.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+	#define _XOPEN_SOURCE 600
+#else
+	#define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>		/* C99 types */
+#include <stdio.h>		/* printf fprintf snprintf tmpfile */
+#include <stdlib.h>		/* rand malloc */
+#include <string.h>		/* memset memcmp */
+#include <time.h>		/* clock_gettime */
+
+#include "pktlog.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define NB_PKT			1024	/* distinct packets, formatted in turn */
+#define BENCH_REPEAT	200		/* passes over the packets per measure */
+#define CHUNK_SIZE		65536	/* stdio buffer, as the log writer default */
+
+static const uint8_t stat_val[] = {STAT_CRC_OK, STAT_CRC_OK, STAT_CRC_BAD, STAT_NO_CRC, STAT_UNDEFINED, 0x55};
+static const uint8_t mod_val[] = {MOD_LORA, MOD_LORA, MOD_FSK, MOD_UNDEFINED};
+static const uint8_t bw_val[] = {BW_125KHZ, BW_250KHZ, BW_500KHZ, BW_62K5HZ, BW_31K2HZ, BW_15K6HZ, BW_7K8HZ, BW_UNDEFINED, 0x77};
+static const uint8_t cr_val[] = {CR_LORA_4_5, CR_LORA_4_6, CR_LORA_4_7, CR_LORA_4_8, CR_UNDEFINED, 0x66};
+static const float db_val[] = {0.0, -0.0, 0.25, -0.25, 0.5, -0.5, 1.5, -1.5, 2.5, -2.5, 0.05, -0.05, 0.15, 0.25, 0.35, -0.45, 9.95, -9.95, 99.95, 999.95, -127.5, 1e20, -3e38};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static struct lgw_pkt_rx_s pkt[NB_PKT];
+static char chunk[CHUNK_SIZE];
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+/* CSV formatting of util_pkt_logger before pktlog_csv_line */
+static void ref_csv(FILE *f, const char *gateway_id, const char *timestamp, const struct lgw_pkt_rx_s *p) {
+	int j;
+	
+	fprintf(f, "\"%s\",", gateway_id);
+	fputs("\"\",", f);
+	fprintf(f, "\"%s\",", timestamp);
+	fprintf(f, "%10u,", p->count_us);
+	fprintf(f, "%10u,", p->freq_hz);
+	fprintf(f, "%u,", p->rf_chain);
+	fprintf(f, "%2d,", p->if_chain);
+	switch(p->status) {
+		case STAT_CRC_OK:	fputs("\"CRC_OK\" ,", f); break;
+		case STAT_CRC_BAD:	fputs("\"CRC_BAD\",", f); break;
+		case STAT_NO_CRC:	fputs("\"NO_CRC\" ,", f); break;
+		case STAT_UNDEFINED:fputs("\"UNDEF\"  ,", f); break;
+		default: fputs("\"ERR\"    ,", f);
+	}
+	fprintf(f, "%3u,", p->size);
+	switch(p->modulation) {
+		case MOD_LORA:	fputs("\"LORA\",", f); break;
+		case MOD_FSK:	fputs("\"FSK\" ,", f); break;
+		default: fputs("\"ERR\" ,", f);
+	}
+	switch(p->bandwidth) {
+		case BW_500KHZ:	fputs("500000,", f); break;
+		case BW_250KHZ:	fputs("250000,", f); break;
+		case BW_125KHZ:	fputs("125000,", f); break;
+		case BW_62K5HZ:	fputs("62500 ,", f); break;
+		case BW_31K2HZ:	fputs("31200 ,", f); break;
+		case BW_15K6HZ:	fputs("15600 ,", f); break;
+		case BW_7K8HZ:	fputs("7800  ,", f); break;
+		case BW_UNDEFINED: fputs("0     ,", f); break;
+		default: fputs("-1    ,", f);
+	}
+	if (p->modulation == MOD_LORA) {
+		switch (p->datarate) {
+			case DR_LORA_SF7:	fputs("\"SF7\"   ,", f); break;
+			case DR_LORA_SF8:	fputs("\"SF8\"   ,", f); break;
+			case DR_LORA_SF9:	fputs("\"SF9\"   ,", f); break;
+			case DR_LORA_SF10:	fputs("\"SF10\"  ,", f); break;
+			case DR_LORA_SF11:	fputs("\"SF11\"  ,", f); break;
+			case DR_LORA_SF12:	fputs("\"SF12\"  ,", f); break;
+			default: fputs("\"ERR\"   ,", f);
+		}
+	} else if (p->modulation == MOD_FSK) {
+		fprintf(f, "\"%6u\",", p->datarate);
+	} else {
+		fputs("\"ERR\"   ,", f);
+	}
+	switch (p->coderate) {
+		case CR_LORA_4_5:	fputs("\"4/5\",", f); break;
+		case CR_LORA_4_6:	fputs("\"2/3\",", f); break;
+		case CR_LORA_4_7:	fputs("\"4/7\",", f); break;
+		case CR_LORA_4_8:	fputs("\"1/2\",", f); break;
+		case CR_UNDEFINED:	fputs("\"\"   ,", f); break;
+		default: fputs("\"ERR\",", f);
+	}
+	fprintf(f, "%+.0f,", p->rssi);
+	fprintf(f, "%+5.1f,", p->snr);
+	fputs("\"", f);
+	for (j = 0; j < p->size; ++j) {
+		fprintf(f, "%02X", p->payload[j]);
+	}
+	fputs("\"\n", f);
+}
+
+/* random packets, RSSI and SNR as the HAL computes them or from the corner cases */
+static void make_pkt(void) {
+	struct lgw_pkt_rx_s *p;
+	int i, j;
+	
+	srand(1);
+	memset(pkt, 0, sizeof(pkt));
+	for (i = 0; i < NB_PKT; ++i) {
+		p = &pkt[i];
+		p->status = stat_val[rand() % ARRAY_SIZE(stat_val)];
+		p->modulation = mod_val[rand() % ARRAY_SIZE(mod_val)];
+		p->bandwidth = bw_val[rand() % ARRAY_SIZE(bw_val)];
+		p->coderate = cr_val[rand() % ARRAY_SIZE(cr_val)];
+		p->datarate = (p->modulation == MOD_FSK) ? (uint32_t)(rand() % 1000000) : (1u << (rand() % 8));
+		p->if_chain = rand() % 10;
+		p->rf_chain = rand() % 2;
+		p->freq_hz = (i % 16 == 0) ? (uint32_t)(rand() % 1000) : (uint32_t)(863000000 + rand() % 7000000);
+		p->count_us = (i % 16 == 1) ? (uint32_t)(rand() % 1000) : (uint32_t)rand() * 2;
+		if (i % 4 == 0) {
+			p->rssi = db_val[rand() % ARRAY_SIZE(db_val)];
+			p->snr = db_val[rand() % ARRAY_SIZE(db_val)];
+		} else {
+			p->rssi = -166.0 + (rand() % 256) / 2.0;
+			p->snr = (int8_t)(rand() % 256) / 4.0;
+		}
+		p->size = (i % 8 == 0) ? (rand() % 257) : (rand() % 52); /* mostly short LoRaWAN frames */
+		for (j = 0; j < p->size; ++j) {
+			p->payload[j] = rand();
+		}
+	}
+}
+
+/* write all the packets with one of the formatters, return the file */
+static FILE *write_all(int use_ref, const char *gateway_id, const char *timestamp) {
+	FILE *f;
+	int i;
+	
+	f = tmpfile();
+	if (f == NULL) {
+		return NULL;
+	}
+	for (i = 0; i < NB_PKT; ++i) {
+		if (use_ref) {
+			ref_csv(f, gateway_id, timestamp, &pkt[i]);
+		} else {
+			pktlog_csv(f, gateway_id, timestamp, &pkt[i]);
+		}
+	}
+	rewind(f);
+	return f;
+}
+
+static double bench(int use_ref, FILE *f, const char *gateway_id, const char *timestamp) {
+	struct timespec t0, t1;
+	int i, k;
+	
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (k = 0; k < BENCH_REPEAT; ++k) {
+		for (i = 0; i < NB_PKT; ++i) {
+			if (use_ref) {
+				ref_csv(f, gateway_id, timestamp, &pkt[i]);
+			} else {
+				pktlog_csv(f, gateway_id, timestamp, &pkt[i]);
+			}
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return (double)NB_PKT * BENCH_REPEAT / ((t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(void)
+{
+	const char gateway_id[] = "AA555A0000000000";
+	char timestamp[PKTLOG_TIMESTAMP_LEN];
+	char ref_ts[128]; /* room for any int, as the compiler checks */
+	FILE *fa, *fb;
+	int ca, cb;
+	long pos = 0;
+	double ref_rate, new_rate;
+	time_t t;
+	struct tm *x;
+	
+	make_pkt();
+	
+	/* timestamps, against the sprintf they replaced */
+	for (t = 0; t < 2000000000; t += 86399 + 3600 * 7) {
+		x = gmtime(&t);
+		snprintf(ref_ts, sizeof(ref_ts), "%04i-%02i-%02i %02i:%02i:%02i.%03liZ", (x->tm_year)+1900, (x->tm_mon)+1, x->tm_mday, x->tm_hour, x->tm_min, x->tm_sec, (long)(t % 1000));
+		pktlog_timestamp(timestamp, t, (long)(t % 1000));
+		if (strcmp(timestamp, ref_ts) != 0) {
+			printf("ERROR: timestamp %s instead of %s\n", timestamp, ref_ts);
+			return EXIT_FAILURE;
+		}
+	}
+	
+	/* CSV lines, byte for byte */
+	fa = write_all(1, gateway_id, timestamp);
+	fb = write_all(0, gateway_id, timestamp);
+	if ((fa == NULL) || (fb == NULL)) {
+		printf("ERROR: failed to create temporary files\n");
+		return EXIT_FAILURE;
+	}
+	do {
+		ca = fgetc(fa);
+		cb = fgetc(fb);
+		if (ca != cb) {
+			printf("ERROR: CSV output differs at byte %li\n", pos);
+			return EXIT_FAILURE;
+		}
+		++pos;
+	} while (ca != EOF);
+	fclose(fa);
+	fclose(fb);
+	printf("CSV output identical to the stdio formatting (%i packets, %li bytes)\n", NB_PKT, pos - 1);
+	
+	/* records/s, through a stdio chunk buffer as in the log writer */
+	fa = fopen("/dev/null", "w");
+	if (fa == NULL) {
+		printf("ERROR: failed to open /dev/null\n");
+		return EXIT_FAILURE;
+	}
+	setvbuf(fa, chunk, _IOFBF, sizeof(chunk));
+	ref_rate = bench(1, fa, gateway_id, timestamp);
+	new_rate = bench(0, fa, gateway_id, timestamp);
+	fclose(fa);
+	printf("stdio formatting:  %10.0f records/s\n", ref_rate);
+	printf("pktlog_csv:        %10.0f records/s (x%.1f)\n", new_rate, new_rate / ref_rate);
+	
+	return EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,290 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Test of the network server uplink (udp_fwd) against a stand-in server on
+	a loopback UDP socket.
+	Checks the PUSH_DATA header, the rxpk fields and base64 payloads, the CRC
+	filters, the PUSH_ACK matching and timeout, the split of a batch larger
+	than a datagram, and the stat datagram.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+	#define _XOPEN_SOURCE 600
+#else
+	#define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+#include <stdio.h>		/* printf */
+#include <stdlib.h>		/* EXIT_FAILURE */
+#include <string.h>		/* memset strcmp */
+#include <time.h>		/* nanosleep */
+#include <unistd.h>		/* close */
+#include <netinet/in.h>	/* sockaddr_in */
+#include <arpa/inet.h>	/* htonl */
+#include <sys/socket.h>	/* socket bind recvfrom sendto */
+#include <sys/time.h>		/* timeval */
+
+#include "parson.h"
+#include "udp_fwd.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define CHECK(cond)		if (!(cond)) { printf("ERROR: line %d: %s\n", __LINE__, #cond); ++nb_err; }
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define GATEWAY_ID		0xAA555A0000000101ULL
+#define ACK_MS			200		/* PUSH_ACK timeout under test */
+#define NB_BIG_PKT		40		/* packets of 255 bytes, more than a datagram holds */
+
+/* payloads covering the three base64 paddings, with their encoding */
+static const char *b64_in[] = {"f", "fo", "foo", "foobar"};
+static const char *b64_out[] = {"Zg==", "Zm8=", "Zm9v", "Zm9vYmFy"};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static int srv; /* stand-in network server socket */
+static struct sockaddr_in peer; /* uplink socket, as seen by the server */
+static uint8_t dgram[UDP_FWD_DGRAM_MAX + 1];
+static int nb_err = 0;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static void wait_ms(long ms) {
+	struct timespec t = {ms / 1000, (ms % 1000) * 1000000};
+	nanosleep(&t, NULL);
+}
+
+/* receive a PUSH_DATA datagram and check its header, return its JSON object (NULL on error) */
+static JSON_Value *recv_push(uint16_t *token) {
+	socklen_t len = sizeof peer;
+	uint64_t id = 0;
+	int i, n;
+	
+	n = recvfrom(srv, dgram, sizeof(dgram) - 1, 0, (struct sockaddr *)&peer, &len);
+	if (n < 12) {
+		printf("ERROR: no PUSH_DATA received\n");
+		++nb_err;
+		return NULL;
+	}
+	for (i = 4; i < 12; ++i) {
+		id = (id << 8) | dgram[i];
+	}
+	CHECK(dgram[0] == 1); /* protocol version */
+	CHECK(dgram[3] == 0); /* PUSH_DATA */
+	CHECK(id == GATEWAY_ID); /* MSB first */
+	CHECK(n <= UDP_FWD_DGRAM_MAX);
+	*token = (dgram[1] << 8) | dgram[2];
+	dgram[n] = '\0';
+	return json_parse_string((const char *)dgram + 12);
+}
+
+/* answer a PUSH_DATA */
+static void send_ack(uint16_t token) {
+	uint8_t ack[4] = {1, (uint8_t)(token >> 8), (uint8_t)token, 1};
+	
+	sendto(srv, ack, sizeof ack, 0, (struct sockaddr *)&peer, sizeof peer);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(void)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof addr;
+	struct timeval tv = {2, 0};
+	struct udp_fwd_conf_s conf;
+	struct udp_fwd_stats_s st;
+	struct lgw_pkt_rx_s p;
+	udp_fwd_t *fwd;
+	JSON_Value *root;
+	JSON_Array *rxpk;
+	JSON_Object *o;
+	uint16_t token, prev_token;
+	int nb_rxpk, nb_dgram;
+	int i;
+	
+	/* stand-in network server on a loopback port chosen by the system */
+	srv = socket(AF_INET, SOCK_DGRAM, 0);
+	memset(&addr, 0, sizeof addr);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if ((srv < 0) || (bind(srv, (struct sockaddr *)&addr, sizeof addr) != 0) || (getsockname(srv, (struct sockaddr *)&addr, &len) != 0)) {
+		printf("ERROR: failed to open the server socket\n");
+		return EXIT_FAILURE;
+	}
+	setsockopt(srv, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+	
+	memset(&conf, 0, sizeof conf);
+	strcpy(conf.host, "127.0.0.1");
+	conf.port_up = ntohs(addr.sin_port);
+	conf.gateway_id = GATEWAY_ID;
+	conf.stat_s = 1;
+	conf.ack_ms = ACK_MS;
+	conf.fwd_crc_valid = true;
+	fwd = udp_fwd_open(&conf);
+	if (fwd == NULL) {
+		printf("ERROR: failed to open the uplink\n");
+		return EXIT_FAILURE;
+	}
+	
+	/* one batch: the CRC-OK packets go in one rxpk array, the others are filtered out */
+	memset(&p, 0, sizeof p);
+	p.if_chain = 2;
+	p.rf_chain = 1;
+	p.freq_hz = 868100000;
+	p.modulation = MOD_LORA;
+	p.bandwidth = BW_125KHZ;
+	p.datarate = DR_LORA_SF7;
+	p.coderate = CR_LORA_4_5;
+	p.rssi = -57.0;
+	p.snr = 7.5;
+	for (i = 0; i < (int)ARRAY_SIZE(b64_in); ++i) {
+		p.status = STAT_CRC_OK;
+		p.count_us = 1000 * i;
+		p.size = strlen(b64_in[i]);
+		memcpy(p.payload, b64_in[i], p.size);
+		CHECK(udp_fwd_push(fwd, &p) == UDP_FWD_SUCCESS);
+	}
+	p.status = STAT_CRC_BAD;
+	CHECK(udp_fwd_push(fwd, &p) == UDP_FWD_ERROR);
+	p.status = STAT_NO_CRC;
+	CHECK(udp_fwd_push(fwd, &p) == UDP_FWD_ERROR);
+	p.status = STAT_CRC_OK;
+	p.bandwidth = BW_UNDEFINED;
+	CHECK(udp_fwd_push(fwd, &p) == UDP_FWD_ERROR);
+	p.bandwidth = BW_125KHZ;
+	CHECK(udp_fwd_send(fwd) == UDP_FWD_SUCCESS);
+	
+	root = recv_push(&token);
+	rxpk = json_object_get_array(json_value_get_object(root), "rxpk");
+	CHECK(json_array_get_count(rxpk) == ARRAY_SIZE(b64_in));
+	for (i = 0; (rxpk != NULL) && (i < (int)json_array_get_count(rxpk)); ++i) {
+		o = json_array_get_object(rxpk, i);
+		CHECK(json_object_get_number(o, "tmst") == 1000 * i);
+		CHECK(json_object_get_number(o, "chan") == 2);
+		CHECK(json_object_get_number(o, "rfch") == 1);
+		CHECK(json_object_get_number(o, "freq") == 868.1);
+		CHECK(json_object_get_number(o, "stat") == 1);
+		CHECK(strcmp(json_object_get_string(o, "modu"), "LORA") == 0);
+		CHECK(strcmp(json_object_get_string(o, "datr"), "SF7BW125") == 0);
+		CHECK(strcmp(json_object_get_string(o, "codr"), "4/5") == 0);
+		CHECK(json_object_get_number(o, "lsnr") == 7.5);
+		CHECK(json_object_get_number(o, "rssi") == -57);
+		CHECK(json_object_get_number(o, "size") == strlen(b64_in[i]));
+		CHECK(strcmp(json_object_get_string(o, "data"), b64_out[i]) == 0);
+	}
+	json_value_free(root);
+	
+	/* its PUSH_ACK, after one with a wrong token that must be ignored */
+	send_ack(token ^ 0x5A5A);
+	send_ack(token);
+	wait_ms(20);
+	udp_fwd_service(fwd);
+	udp_fwd_get_stats(fwd, &st);
+	CHECK((st.nb_ack == 1) && (st.nb_no_ack == 0));
+	
+	/* FSK packet, never acknowledged */
+	p.modulation = MOD_FSK;
+	p.datarate = 50000;
+	CHECK(udp_fwd_push(fwd, &p) == UDP_FWD_SUCCESS);
+	CHECK(udp_fwd_send(fwd) == UDP_FWD_SUCCESS);
+	root = recv_push(&token);
+	o = json_array_get_object(json_object_get_array(json_value_get_object(root), "rxpk"), 0);
+	CHECK(strcmp(json_object_get_string(o, "modu"), "FSK") == 0);
+	CHECK(json_object_get_number(o, "datr") == 50000);
+	CHECK(json_object_get_value(o, "codr") == NULL);
+	json_value_free(root);
+	udp_fwd_service(fwd);
+	udp_fwd_get_stats(fwd, &st);
+	CHECK(st.nb_no_ack == 0); /* not expired yet */
+	wait_ms(ACK_MS + 50);
+	send_ack(token); /* too late */
+	udp_fwd_service(fwd);
+	udp_fwd_get_stats(fwd, &st);
+	CHECK((st.nb_ack == 1) && (st.nb_no_ack == 1));
+	
+	/* batch larger than a datagram: split, every packet sent once, each datagram acknowledged */
+	p.modulation = MOD_LORA;
+	p.datarate = DR_LORA_SF12;
+	p.size = 255;
+	memset(p.payload, 0xA5, p.size);
+	for (i = 0; i < NB_BIG_PKT; ++i) {
+		CHECK(udp_fwd_push(fwd, &p) == UDP_FWD_SUCCESS);
+	}
+	CHECK(udp_fwd_send(fwd) == UDP_FWD_SUCCESS);
+	nb_rxpk = 0;
+	nb_dgram = 0;
+	prev_token = token;
+	while (nb_rxpk < NB_BIG_PKT) {
+		root = recv_push(&token);
+		if (root == NULL) {
+			break;
+		}
+		rxpk = json_object_get_array(json_value_get_object(root), "rxpk");
+		CHECK(rxpk != NULL);
+		nb_rxpk += json_array_get_count(rxpk);
+		++nb_dgram;
+		CHECK(token != prev_token);
+		prev_token = token;
+		send_ack(token);
+		json_value_free(root);
+	}
+	wait_ms(20);
+	udp_fwd_service(fwd);
+	udp_fwd_get_stats(fwd, &st);
+	printf("%d packets of 255 bytes sent in %d datagrams\n", nb_rxpk, nb_dgram);
+	CHECK((nb_rxpk == NB_BIG_PKT) && (nb_dgram > 1));
+	CHECK((st.nb_ack == (uint32_t)(1 + nb_dgram)) && (st.nb_no_ack == 1));
+	
+	/* stat datagram, once per stat interval */
+	wait_ms(1000 * conf.stat_s);
+	udp_fwd_service(fwd);
+	root = recv_push(&token);
+	o = json_object_get_object(json_value_get_object(root), "stat");
+	CHECK(o != NULL);
+	CHECK(json_object_get_number(o, "rxnb") == ARRAY_SIZE(b64_in) + 3 + 1 + NB_BIG_PKT);
+	CHECK(json_object_get_number(o, "rxok") == ARRAY_SIZE(b64_in) + 1 + 1 + NB_BIG_PKT);
+	CHECK(json_object_get_number(o, "rxfw") == ARRAY_SIZE(b64_in) + 1 + NB_BIG_PKT);
+	json_value_free(root);
+	send_ack(token);
+	wait_ms(20);
+	udp_fwd_service(fwd);
+	
+	udp_fwd_get_stats(fwd, &st);
+	printf("%u packets pushed, %u forwarded, %u PUSH_DATA (%u stat), %u acknowledged, %u not, %u send errors\n", st.nb_rx, st.nb_rxpk, st.nb_push, st.nb_stat, st.nb_ack, st.nb_no_ack, st.nb_send_error);
+	CHECK((st.nb_stat == 1) && (st.nb_push == (uint32_t)(3 + nb_dgram)) && (st.nb_ack == (uint32_t)(2 + nb_dgram)) && (st.nb_send_error == 0));
+	udp_fwd_close(fwd);
+	close(srv);
+	
+	if (nb_err != 0) {
+		printf("ERROR: %d check(s) failed\n", nb_err);
+		return EXIT_FAILURE;
+	}
+	printf("End of test for udp_fwd\n");
+	return EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
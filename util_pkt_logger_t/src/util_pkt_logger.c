@@ -35,17 +35,9 @@ Maintainer: Sylvain Miermont
 #include <stdlib.h>		/* atoi */
 
 #include "parson.h"
+#include "fwd.h"
 #include "loragw_hal.h"
 
-/* header files to support socket programming */
-#include <sys/socket.h>
-#include <sys/types.h>
-#include <netinet/in.h>
-#include <netdb.h>
-#include <errno.h>
-#include <arpa/inet.h>
-#include <json/json.h>
-
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -370,7 +362,7 @@ int setupconf(void){
 
 int execute()
 {
-	int i, j; /* loop and temporary variables */
+	int i; /* loop and temporary variables */
 	struct timespec sleep_time = {0, 3000000}; /* 3 ms */
 
 	/* allocate memory for packet fetching and processing */
@@ -385,17 +377,9 @@ int execute()
 	char fetch_timestamp[30];
 	struct tm * x;
 
-	/*socket parameters*/
-    int sockfd = 0;
-    uint8_t recvBuff[256];
-    memset(recvBuff, '0', sizeof(recvBuff));
-
-    struct sockaddr_in serv_addr,smap_addr;
-
-    /* Initialize sockaddr_in data structure */
-    serv_addr.sin_family = AF_INET;
-    serv_addr.sin_port = htons(1680); // port
-    serv_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	/* forwarding sink, one persistent connection */
+	struct fwd_conf_s fwd_conf = {.host = "127.0.0.1", .port = 1680, .policy = FWD_DROP_OLDEST};
+	fwd_sink_t *fwd_sink;
 	
 	/* configure signal handling */
 	sigemptyset(&sigact.sa_mask);
@@ -414,6 +398,11 @@ int execute()
 		MSG("ERROR: failed to start the concentrator\n");
 		return EXIT_FAILURE;
 	}
+	fwd_sink = fwd_open(&fwd_conf);
+	if (fwd_sink == NULL) {
+		MSG("ERROR: impossible to resolve forwarding sink %s:%u\n", fwd_conf.host, fwd_conf.port);
+		return EXIT_FAILURE;
+	}
 	
 	/* main loop */
 	while ((quit_sig != 1) && (exit_sig != 1)) {
@@ -430,29 +419,10 @@ int execute()
 			p = &rxpkt[i];
 			if(p->status == STAT_CRC_OK){
 				corrupt_pkt_count=0;
-
-				for (j = 0; j < p->size; ++j) {
-					//printf("%c",p->payload[j]);
-					/*to copy the payload to recvBuff*/
-				    recvBuff[j]=p->payload[j];
-				}
-				/* Create a socket first */
-				if((sockfd = socket(AF_INET, SOCK_STREAM, 0))< 0){
-				    printf("\n Error : Could not create socket \n");
-				    return 1;
+				/* queued, sent after the batch */
+				if (p->size > 0) {
+					fwd_push(fwd_sink, p->payload, p->size);
 				}
-				/* Attempt a connection */
-				if(connect(sockfd, (struct sockaddr *)&serv_addr, sizeof(serv_addr))<0){
-					printf("\n Error : Connect Failed \n");
-					return 1;
-				}
-			    /* If read was success, send data. */
-			    if(p->size > 0){
-			    	printf("Sending \n");
-			    	write(sockfd, recvBuff, p->size);
-			    }
-			    /*close socket*/
-			    close(sockfd);
 			} else {
 				corrupt_pkt_count++;
 				if (corrupt_pkt_count==10){
@@ -460,6 +430,9 @@ int execute()
 				}
 			}
 		}
+		/* send the queued packets in one write, reconnect if the connection was lost */
+		fwd_service(fwd_sink);
+	}
 	if (exit_sig == 1) {
 		/* clean up before leaving */
 		i = lgw_stop();
@@ -468,9 +441,8 @@ int execute()
 		} else {
 			MSG("WARNING: failed to stop concentrator successfully\n");
 		}
-		fclose(log_file);
-		MSG("INFO: log file %s closed, %lu packet(s) recorded\n", log_file_name, pkt_in_log);
 	}
+	fwd_close(fwd_sink);
 	
 	MSG("INFO: Exiting packet logger program\n");
 	return EXIT_SUCCESS;
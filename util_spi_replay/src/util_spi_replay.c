@@ -0,0 +1,486 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Analysis and replay of the SPI traces recorded by libloragw
+	(see lgw_reg_trace_start and the LGW_SPI_TRACE environment variable)
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+	#define _XOPEN_SOURCE 600
+#else
+	#define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+#include <stdio.h>		/* printf fprintf fopen fread */
+#include <string.h>		/* memcmp memset */
+#include <unistd.h>		/* getopt */
+#include <stdlib.h>		/* malloc free qsort */
+#include <time.h>		/* clock_gettime */
+
+#include "loragw_spi.h"
+#include "loragw_reg.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
+#define MSG(args...)	fprintf(stderr, args) /* message that is destined to the user */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define		PAGE_ADDR		0x00	/* page/reset register, see loragw_reg.c */
+#define		PAGE_MASK		0x03
+#define		SOFT_RESET		0x80
+#define		NB_PAGES		4
+#define		NB_ADDR			128
+
+#define		TOP_DFLT		20		/* addresses listed by default, see -a */
+#define		FRAMES_MAX		256		/* frames replayed per batch submission */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* one record of the trace, data pointing into the loaded file */
+struct trace_rec_s {
+	uint32_t	delta_us;
+	uint8_t		flags;
+	uint8_t		addr;
+	uint8_t		site;
+	uint16_t	size;
+	uint8_t		*data;
+};
+
+/* accesses made from one call site */
+struct site_stat_s {
+	uint32_t	nb_rec;			/* SPI accesses (chip-select frames) */
+	uint32_t	nb_submit;		/* SPI submissions, a batch counting for one */
+	uint64_t	nb_byte;		/* data bytes */
+	uint32_t	nb_page_sw;		/* writes to the page register */
+	uint32_t	nb_page_same;	/* writes to the page register selecting the current page */
+	uint32_t	nb_w_same;		/* single-byte writes of the last known value */
+	uint32_t	nb_r_same;		/* single-byte reads returning the last known value */
+};
+
+/* accesses made to one register address of one page */
+struct addr_stat_s {
+	uint32_t	nb_w;
+	uint32_t	nb_r;
+	uint32_t	nb_w_same;
+	uint32_t	nb_r_same;
+	uint64_t	nb_byte;
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES (GLOBAL) ------------------------------------------- */
+
+static const char *site_name[] = {"none", "lgw_start", "lgw_stop", "lgw_receive", "lgw_send", "lgw_status", "lgw_get_trigcnt", "lgw_get_instcnt"};
+
+static struct site_stat_s site_stat[256];
+static struct addr_stat_s addr_stat[NB_PAGES][NB_ADDR];
+static int16_t known[NB_PAGES][NB_ADDR]; /* last value written or read at that address, -1 if unknown */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+void usage (void);
+
+uint8_t *load_trace(const char *path, long *size);
+
+int next_rec(const uint8_t *buf, long size, long *pos, struct trace_rec_s *rec);
+
+void analyse(const struct trace_rec_s *rec, int *page);
+
+int cmp_addr(const void *a, const void *b);
+
+void report(int top);
+
+int replay(uint8_t *buf, long size, const char *spi_path);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* describe command line options */
+void usage(void) {
+	MSG( "Usage: util_spi_replay [options] <trace file>\n");
+	MSG( "Available options:\n");
+	MSG( " -h print this help\n");
+	MSG( " -a <int> number of register addresses listed, most accessed first (default %i)\n", TOP_DFLT);
+	MSG( " -r replay the trace on the SPI link after the analysis\n");
+	MSG( " -d <path> SPI device used by -r (default: SPI layer default)\n");
+}
+
+/* read a whole trace file in memory and check its header */
+uint8_t *load_trace(const char *path, long *size) {
+	FILE *f;
+	uint8_t *buf;
+	
+	f = fopen(path, "rb");
+	if (f == NULL) {
+		MSG("ERROR: failed to open %s\n", path);
+		return NULL;
+	}
+	fseek(f, 0, SEEK_END);
+	*size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	if (*size < LGW_TRACE_HEAD_SIZE) {
+		MSG("ERROR: %s is not an SPI trace\n", path);
+		fclose(f);
+		return NULL;
+	}
+	buf = malloc(*size);
+	if (buf == NULL) {
+		MSG("ERROR: failed to allocate %li bytes\n", *size);
+		fclose(f);
+		return NULL;
+	}
+	if (fread(buf, 1, *size, f) != (size_t)*size) {
+		MSG("ERROR: failed to read %s\n", path);
+		free(buf);
+		fclose(f);
+		return NULL;
+	}
+	fclose(f);
+	if ((memcmp(buf, LGW_TRACE_MAGIC, 4) != 0) || (buf[4] != LGW_TRACE_VERSION)) {
+		MSG("ERROR: %s is not an SPI trace, or not of version %i\n", path, LGW_TRACE_VERSION);
+		free(buf);
+		return NULL;
+	}
+	return buf;
+}
+
+/* decode the record at *pos and move past it, return 0 at the end of the trace, -1 if truncated */
+int next_rec(const uint8_t *buf, long size, long *pos, struct trace_rec_s *rec) {
+	const uint8_t *p = buf + *pos;
+	
+	if (*pos == size) {
+		return 0;
+	}
+	if ((size - *pos) < LGW_TRACE_REC_SIZE) {
+		return -1;
+	}
+	rec->delta_us = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+	rec->flags = p[4];
+	rec->addr = p[5];
+	rec->site = p[6];
+	rec->size = (uint16_t)p[7] | ((uint16_t)p[8] << 8);
+	if ((size - *pos - LGW_TRACE_REC_SIZE) < rec->size) {
+		return -1;
+	}
+	rec->data = (uint8_t *)p + LGW_TRACE_REC_SIZE;
+	*pos += LGW_TRACE_REC_SIZE + rec->size;
+	return 1;
+}
+
+/* account for one record, tracking the selected page and the last known value of each byte */
+void analyse(const struct trace_rec_s *rec, int *page) {
+	struct site_stat_s *s = &site_stat[rec->site];
+	struct addr_stat_s *a;
+	bool write = ((rec->flags & LGW_TRACE_WRITE) != 0);
+	int pg = (*page < 0) ? 0 : *page;
+	uint8_t addr = rec->addr & 0x7F;
+	
+	++s->nb_rec;
+	if (((rec->flags & LGW_TRACE_BATCH) == 0) || ((rec->flags & LGW_TRACE_BATCH_FIRST) != 0)) {
+		++s->nb_submit;
+	}
+	s->nb_byte += rec->size;
+	a = &addr_stat[pg][addr];
+	a->nb_byte += rec->size;
+	if (write) {
+		++a->nb_w;
+	} else {
+		++a->nb_r;
+	}
+	if ((rec->flags & LGW_TRACE_ERROR) != 0) {
+		memset(known, -1, sizeof(known)); /* register file content uncertain */
+		return;
+	}
+	
+	/* page register: page switches and soft reset */
+	if (write && (addr == PAGE_ADDR) && (rec->size == 1)) {
+		if ((rec->data[0] & SOFT_RESET) != 0) {
+			memset(known, -1, sizeof(known));
+			*page = 0;
+		} else {
+			++s->nb_page_sw;
+			if ((rec->data[0] & PAGE_MASK) == *page) {
+				++s->nb_page_same;
+				++a->nb_w_same;
+			}
+			*page = rec->data[0] & PAGE_MASK;
+		}
+		return;
+	}
+	
+	/* single-byte accesses, the value of a burst target depends on the auto-increment */
+	if (rec->size == 1) {
+		if (known[pg][addr] == rec->data[0]) {
+			if (write) {
+				++s->nb_w_same;
+				++a->nb_w_same;
+			} else {
+				++s->nb_r_same;
+				++a->nb_r_same;
+			}
+		}
+		known[pg][addr] = rec->data[0];
+	} else {
+		known[pg][addr] = -1;
+	}
+}
+
+/* sort addresses by decreasing number of accesses */
+int cmp_addr(const void *a, const void *b) {
+	const struct addr_stat_s *x = &addr_stat[0][0] + *(const int *)a;
+	const struct addr_stat_s *y = &addr_stat[0][0] + *(const int *)b;
+	uint32_t nx = x->nb_w + x->nb_r;
+	uint32_t ny = y->nb_w + y->nb_r;
+	
+	return (nx < ny) ? 1 : ((nx > ny) ? -1 : (*(const int *)a - *(const int *)b));
+}
+
+/* print the access counts per call site and the most accessed addresses */
+void report(int top) {
+	struct site_stat_s t;
+	int idx[NB_PAGES * NB_ADDR];
+	struct addr_stat_s *a;
+	int i;
+	
+	memset(&t, 0, sizeof(t));
+	printf("\n%-16s %9s %9s %11s %9s %9s %9s %9s\n", "call site", "accesses", "submits", "bytes", "page_sw", "page_same", "w_same", "r_same");
+	for (i=0; i<(int)ARRAY_SIZE(site_stat); ++i) {
+		if (site_stat[i].nb_rec == 0) {
+			continue;
+		}
+		if (i < (int)ARRAY_SIZE(site_name)) {
+			printf("%-16s", site_name[i]);
+		} else {
+			printf("user %-11i", i);
+		}
+		printf(" %9u %9u %11llu %9u %9u %9u %9u\n", site_stat[i].nb_rec, site_stat[i].nb_submit, (unsigned long long)site_stat[i].nb_byte, site_stat[i].nb_page_sw, site_stat[i].nb_page_same, site_stat[i].nb_w_same, site_stat[i].nb_r_same);
+		t.nb_rec += site_stat[i].nb_rec;
+		t.nb_submit += site_stat[i].nb_submit;
+		t.nb_byte += site_stat[i].nb_byte;
+		t.nb_page_sw += site_stat[i].nb_page_sw;
+		t.nb_page_same += site_stat[i].nb_page_same;
+		t.nb_w_same += site_stat[i].nb_w_same;
+		t.nb_r_same += site_stat[i].nb_r_same;
+	}
+	printf("%-16s %9u %9u %11llu %9u %9u %9u %9u\n", "total", t.nb_rec, t.nb_submit, (unsigned long long)t.nb_byte, t.nb_page_sw, t.nb_page_same, t.nb_w_same, t.nb_r_same);
+	
+	for (i=0; i<(NB_PAGES * NB_ADDR); ++i) {
+		idx[i] = i;
+	}
+	qsort(idx, ARRAY_SIZE(idx), sizeof(idx[0]), cmp_addr);
+	printf("\n%-9s %9s %9s %9s %9s %11s\n", "page:addr", "writes", "w_same", "reads", "r_same", "bytes");
+	for (i=0; (i<top) && (i<(NB_PAGES * NB_ADDR)); ++i) {
+		a = &addr_stat[0][0] + idx[i];
+		if ((a->nb_w + a->nb_r) == 0) {
+			break;
+		}
+		printf("%i:0x%02X    %9u %9u %9u %9u %11llu\n", idx[i] / NB_ADDR, idx[i] % NB_ADDR, a->nb_w, a->nb_w_same, a->nb_r, a->nb_r_same, (unsigned long long)a->nb_byte);
+	}
+}
+
+/* send the trace again on the SPI link, compare the data read with the recorded one */
+int replay(uint8_t *buf, long size, const char *spi_path) {
+	void *spi_target = NULL;
+	struct lgw_spi_frame_s frames[FRAMES_MAX];
+	uint8_t *rec_data[FRAMES_MAX]; /* recorded data of the batched reads */
+	struct trace_rec_s rec;
+	struct timespec start, end;
+	uint8_t *rd_buf;
+	uint8_t u = 0;
+	long pos = LGW_TRACE_HEAD_SIZE;
+	long rd_pos = 0;
+	uint32_t nb_submit = 0, nb_mismatch = 0, nb_fail = 0;
+	uint64_t rec_us = 0;
+	int nb_frames = 0;
+	int x = 1;
+	int i;
+	
+	rd_buf = malloc(size); /* receives the batched reads, never more than the trace size */
+	if (rd_buf == NULL) {
+		MSG("ERROR: failed to allocate %li bytes\n", size);
+		return -1;
+	}
+	if (lgw_spi_open_path(&spi_target, spi_path) != LGW_SPI_SUCCESS) {
+		MSG("ERROR: failed to open SPI link\n");
+		free(rd_buf);
+		return -1;
+	}
+	
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (x != 0) {
+		x = next_rec(buf, size, &pos, &rec);
+		/* a pending batch is complete when a record does not continue it */
+		if ((nb_frames > 0) && ((x <= 0) || ((rec.flags & LGW_TRACE_BATCH) == 0) || ((rec.flags & LGW_TRACE_BATCH_FIRST) != 0) || (nb_frames == FRAMES_MAX))) {
+			nb_fail += (lgw_spi_batch(spi_target, frames, nb_frames) != LGW_SPI_SUCCESS);
+			++nb_submit;
+			for (i=0; i<nb_frames; ++i) {
+				if ((frames[i].write == false) && (memcmp(frames[i].data, rec_data[i], frames[i].size) != 0)) {
+					++nb_mismatch;
+				}
+			}
+			nb_frames = 0;
+			rd_pos = 0;
+		}
+		if (x < 0) {
+			MSG("WARNING: trace truncated, last record ignored\n");
+		}
+		if (x <= 0) {
+			break;
+		}
+		rec_us += rec.delta_us;
+		if ((rec.flags & LGW_TRACE_BATCH) != 0) {
+			frames[nb_frames].address = rec.addr;
+			frames[nb_frames].write = ((rec.flags & LGW_TRACE_WRITE) != 0);
+			frames[nb_frames].size = rec.size;
+			if (frames[nb_frames].write) {
+				frames[nb_frames].data = rec.data;
+			} else {
+				frames[nb_frames].data = rd_buf + rd_pos;
+				rd_pos += rec.size;
+			}
+			rec_data[nb_frames] = rec.data;
+			++nb_frames;
+			continue;
+		}
+		if ((rec.flags & LGW_TRACE_WRITE) != 0) {
+			if (rec.size == 1) {
+				nb_fail += (lgw_spi_w(spi_target, rec.addr, rec.data[0]) != LGW_SPI_SUCCESS);
+			} else {
+				nb_fail += (lgw_spi_wb(spi_target, rec.addr, rec.data, rec.size) != LGW_SPI_SUCCESS);
+			}
+		} else {
+			if (rec.size == 1) {
+				nb_fail += (lgw_spi_r(spi_target, rec.addr, &u) != LGW_SPI_SUCCESS);
+				nb_mismatch += (u != rec.data[0]);
+			} else {
+				nb_fail += (lgw_spi_rb(spi_target, rec.addr, rd_buf, rec.size) != LGW_SPI_SUCCESS);
+				nb_mismatch += (memcmp(rd_buf, rec.data, rec.size) != 0);
+			}
+		}
+		++nb_submit;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	lgw_spi_close(spi_target);
+	free(rd_buf);
+	
+	printf("\nreplay: %u SPI submissions in %.3f s (%.3f s recorded, idle time included)\n", nb_submit, (end.tv_sec - start.tv_sec) + (1E-9 * (end.tv_nsec - start.tv_nsec)), 1E-6 * rec_us);
+	printf("replay: %u SPI errors, %u reads returning other data than recorded\n", nb_fail, nb_mismatch);
+	return (nb_fail == 0) ? 0 : -1;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+	int i;
+	int xi = 0;
+	
+	/* application option */
+	int top = TOP_DFLT;
+	bool replay_mode = false;
+	const char *spi_path = NULL;
+	
+	/* trace */
+	struct trace_rec_s rec;
+	uint8_t *buf;
+	long size = 0;
+	long pos = LGW_TRACE_HEAD_SIZE;
+	int page = -1;
+	uint32_t nb_rec = 0, nb_w = 0, nb_batch = 0, nb_err = 0;
+	uint64_t nb_byte = 0;
+	uint64_t rec_us = 0;
+	int x;
+	
+	/* parse command line options */
+	while ((i = getopt (argc, argv, "ha:rd:")) != -1) {
+		switch (i) {
+			case 'h':
+				usage();
+				return EXIT_FAILURE;
+				break;
+			
+			case 'a':
+				i = sscanf(optarg, "%i", &xi);
+				if ((i != 1) || (xi < 0)) {
+					MSG("ERROR: invalid number of addresses\n");
+					return EXIT_FAILURE;
+				} else {
+					top = xi;
+				}
+				break;
+			
+			case 'r':
+				replay_mode = true;
+				break;
+			
+			case 'd':
+				spi_path = optarg;
+				break;
+			
+			default:
+				MSG("ERROR: argument parsing use -h option for help\n");
+				usage();
+				return EXIT_FAILURE;
+		}
+	}
+	if (optind != (argc - 1)) {
+		MSG("ERROR: one trace file expected\n");
+		usage();
+		return EXIT_FAILURE;
+	}
+	
+	buf = load_trace(argv[optind], &size);
+	if (buf == NULL) {
+		return EXIT_FAILURE;
+	}
+	
+	/* analysis */
+	memset(known, -1, sizeof(known));
+	while ((x = next_rec(buf, size, &pos, &rec)) > 0) {
+		analyse(&rec, &page);
+		++nb_rec;
+		nb_w += ((rec.flags & LGW_TRACE_WRITE) != 0);
+		nb_batch += ((rec.flags & LGW_TRACE_BATCH_FIRST) != 0);
+		nb_err += ((rec.flags & LGW_TRACE_ERROR) != 0);
+		nb_byte += rec.size;
+		rec_us += rec.delta_us;
+	}
+	if (x < 0) {
+		MSG("WARNING: trace truncated after %u records\n", nb_rec);
+	}
+	printf("trace: %s, %u SPI accesses in %.3f s, %llu data bytes\n", argv[optind], nb_rec, 1E-6 * rec_us, (unsigned long long)nb_byte);
+	printf("trace: %u writes, %u reads, %u batch submissions, %u SPI errors\n", nb_w, nb_rec - nb_w, nb_batch, nb_err);
+	report(top);
+	
+	/* replay */
+	x = 0;
+	if (replay_mode) {
+		x = replay(buf, size, spi_path);
+	}
+	free(buf);
+	return (x == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -7,7 +7,7 @@
   (C)2013 Semtech-Cycleo
 
 Description:
-	SPI stress test
+	SPI stress test, and SPI benchmark with a JSON report (-b)
 
 License: Revised BSD License, see LICENSE.TXT file include in the project
 Maintainer: Sylvain Miermont
@@ -28,10 +28,15 @@ Maintainer: Sylvain Miermont
 #include <stdbool.h>	/* bool type */
 #include <stdio.h>		/* printf fprintf sprintf fopen fputs */
 
+#include <string.h>		/* memset */
 #include <signal.h>		/* sigaction */
-#include <unistd.h>		/* getopt access */
-#include <stdlib.h>		/* rand */
+#include <unistd.h>		/* getopt access sleep */
+#include <stdlib.h>		/* rand rand_r qsort */
+#include <pthread.h>	/* concurrent accesses of test 5 */
+#include <time.h>		/* clock_gettime */
+#include <sys/utsname.h>	/* uname, kernel in the benchmark report */
 
+#include "loragw_hal.h"
 #include "loragw_reg.h"
 
 /* -------------------------------------------------------------------------- */
@@ -46,6 +51,49 @@ Maintainer: Sylvain Miermont
 #define		VERS				103
 #define		READS_WHEN_ERROR	16 /* number of times a read is repeated if there is a read error */
 #define		BUFF_SIZE			1024
+#define		MT_BUFF_SIZE		256 /* size of the data buffer segment of each test 5 buffer thread */
+
+#define		BENCH_NB_DFLT		10000	/* operations timed per benchmark, see -n */
+#define		BENCH_NB_MAX		1000000
+#define		BENCH_BURST_MAX		8192	/* largest burst benchmarked, sizes are powers of 2 from 1 byte */
+#define		BENCH_BURST_BYTES	4000000	/* bytes moved per burst size, within the operation count */
+#define		BENCH_BURST_MIN		100		/* bursts per size, at least */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* one thread of test 5, writing and reading back a register or a data buffer segment */
+struct mt_thread_s {
+	uint16_t	reg_id;		/* register written and read back */
+	int			leng;		/* width of that register in bits, 0 for a data buffer thread */
+	int32_t		buf_addr;	/* start of the data buffer segment (data buffer thread) */
+	unsigned	seed;		/* rand_r state */
+	uint32_t	nb_ok;		/* write + read back cycles without error */
+	bool		error;
+	int32_t		wr_value;	/* last value written (register thread) */
+	int32_t		rd_value;	/* last value read back (register thread) */
+};
+
+/* operations timed by the benchmark */
+enum bench_op_e {
+	BENCH_W,			/* 8-bit register write */
+	BENCH_R,			/* 8-bit register read */
+	BENCH_RMW,			/* 4-bit field write (read-modify-write) */
+	BENCH_SAME_PAGE,	/* reads alternating between two registers of the same page */
+	BENCH_ALT_PAGE,		/* reads alternating between two registers of different pages */
+	BENCH_WB,			/* data buffer burst write */
+	BENCH_RB			/* data buffer burst read */
+};
+
+/* result of one benchmark */
+struct bench_res_s {
+	int			nb;			/* operations timed */
+	double		total_s;	/* sum of their latencies */
+	uint32_t	p50_ns;		/* latency percentiles */
+	uint32_t	p99_ns;
+	uint32_t	p999_ns;
+	uint32_t	max_ns;
+};
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES (GLOBAL) ------------------------------------------- */
@@ -55,6 +103,24 @@ struct sigaction sigact; /* SIGQUIT&SIGINT&SIGTERM signal handling */
 static int exit_sig = 0; /* 1 -> application terminates cleanly (shut down hardware, close open files, etc) */
 static int quit_sig = 0; /* 1 -> application terminates without shutting down the hardware */
 
+/* test 5: registers on different pages, pairs of bit fields sharing a byte
+(read-modify-write) and two data buffer segments accessed through one address
+register, all at the same time */
+static struct mt_thread_s mt_threads[] = {
+	{LGW_IMPLICIT_PAYLOAD_LENGHT, 8, 0, 1, 0, false, 0, 0},
+	{LGW_FSK_REF_PATTERN_LSB, 32, 0, 2, 0, false, 0, 0},
+	{LGW_FRAME_SYNCH_PEAK1_POS, 4, 0, 3, 0, false, 0, 0},
+	{LGW_FRAME_SYNCH_PEAK2_POS, 4, 0, 4, 0, false, 0, 0},
+	{LGW_MBWSSF_FRAME_SYNCH_PEAK1_POS, 4, 0, 5, 0, false, 0, 0},
+	{LGW_MBWSSF_FRAME_SYNCH_PEAK2_POS, 4, 0, 6, 0, false, 0, 0},
+	{LGW_RX_DATA_BUF_DATA, 0, 0, 7, 0, false, 0, 0},
+	{LGW_RX_DATA_BUF_DATA, 0, 512, 8, 0, false, 0, 0}
+};
+static bool mt_error = false; /* 1 -> a test 5 thread detected an error, all threads stop */
+
+static uint32_t bench_lat[BENCH_NB_MAX]; /* latency of each benchmark operation, in ns */
+static uint8_t bench_buff[BENCH_BURST_MAX];
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
 
@@ -62,6 +128,16 @@ static void sig_handler(int sigio);
 
 void usage (void);
 
+void *thread_stress(void *arg);
+
+int cmp_u32(const void *a, const void *b);
+
+void bench_run(enum bench_op_e op, int nb, uint16_t size, struct bench_res_s *res);
+
+void bench_print(const struct bench_res_s *res, uint16_t size);
+
+int benchmark(int nb);
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
@@ -77,7 +153,178 @@ static void sig_handler(int sigio) {
 void usage(void) {
 	MSG( "Available options:\n");
 	MSG( " -h print this help\n");
-	MSG( " -t <int> specify which test you want to run (1-4)\n");
+	MSG( " -t <int> specify which test you want to run (1-5)\n");
+	MSG( " -b run the SPI benchmark instead, JSON report on stdout\n");
+	MSG( " -n <int> number of operations timed per benchmark (default %i)\n", BENCH_NB_DFLT);
+}
+
+/* test 5 thread, write random data and read it back until an error or a signal */
+void *thread_stress(void *arg) {
+	struct mt_thread_s *t = (struct mt_thread_s *)arg;
+	uint8_t test_buff[MT_BUFF_SIZE];
+	uint8_t read_buff[MT_BUFF_SIZE];
+	int i;
+	
+	while ((quit_sig != 1) && (exit_sig != 1) && (mt_error == false)) {
+		if (t->leng > 0) {
+			/* single register, sub-byte fields are read-modify-written */
+			t->wr_value = rand_r(&t->seed) & 0xFFFF;
+			t->wr_value += (int32_t)(rand_r(&t->seed) & 0xFFFF) << 16;
+			if (t->leng < 32) {
+				t->wr_value &= (1 << t->leng) - 1;
+			}
+			lgw_reg_w(t->reg_id, t->wr_value);
+			lgw_reg_r(t->reg_id, &t->rd_value);
+			if (t->rd_value != t->wr_value) {
+				t->error = true;
+			}
+		} else {
+			/* data buffer segment, address and data accesses in one atomic batch */
+			for (i=0; i<MT_BUFF_SIZE; ++i) {
+				test_buff[i] = rand_r(&t->seed) & 0xFF;
+			}
+			lgw_reg_batch_begin();
+			lgw_reg_batch_add_w(LGW_RX_DATA_BUF_ADDR, t->buf_addr);
+			lgw_reg_batch_add_wb(LGW_RX_DATA_BUF_DATA, test_buff, MT_BUFF_SIZE);
+			lgw_reg_batch_add_w(LGW_RX_DATA_BUF_ADDR, t->buf_addr);
+			lgw_reg_batch_add_rb(LGW_RX_DATA_BUF_DATA, read_buff, MT_BUFF_SIZE);
+			lgw_reg_batch_commit();
+			if (memcmp(test_buff, read_buff, MT_BUFF_SIZE) != 0) {
+				t->error = true;
+			}
+		}
+		if (t->error) {
+			mt_error = true;
+		} else {
+			++t->nb_ok;
+		}
+	}
+	return NULL;
+}
+
+int cmp_u32(const void *a, const void *b) {
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
+	return (x > y) - (x < y);
+}
+
+/* time nb operations one by one, then sort the latencies to get the percentiles */
+void bench_run(enum bench_op_e op, int nb, uint16_t size, struct bench_res_s *res) {
+	struct timespec start, end;
+	int32_t val;
+	int i;
+	
+	if ((op == BENCH_WB) || (op == BENCH_RB)) {
+		lgw_reg_w(LGW_RX_DATA_BUF_ADDR, 0); /* the pointer then wraps around the buffer */
+	}
+	res->total_s = 0;
+	for (i=0; i<nb; ++i) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		switch (op) {
+			case BENCH_W:
+				lgw_reg_w(LGW_IMPLICIT_PAYLOAD_LENGHT, i & 0xFF);
+				break;
+			case BENCH_R:
+				lgw_reg_r(LGW_IMPLICIT_PAYLOAD_LENGHT, &val);
+				break;
+			case BENCH_RMW:
+				lgw_reg_w(LGW_FRAME_SYNCH_PEAK1_POS, i & 0x0F);
+				break;
+			case BENCH_SAME_PAGE:
+				lgw_reg_r((i & 1) ? LGW_FRAME_SYNCH_PEAK1_POS : LGW_IMPLICIT_PAYLOAD_LENGHT, &val);
+				break;
+			case BENCH_ALT_PAGE:
+				lgw_reg_r((i & 1) ? LGW_MBWSSF_FRAME_SYNCH_PEAK1_POS : LGW_IMPLICIT_PAYLOAD_LENGHT, &val);
+				break;
+			case BENCH_WB:
+				lgw_reg_wb(LGW_RX_DATA_BUF_DATA, bench_buff, size);
+				break;
+			case BENCH_RB:
+				lgw_reg_rb(LGW_RX_DATA_BUF_DATA, bench_buff, size);
+				break;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		bench_lat[i] = (uint32_t)((end.tv_sec - start.tv_sec) * 1000000000 + (end.tv_nsec - start.tv_nsec));
+		res->total_s += 1e-9 * bench_lat[i];
+	}
+	
+	qsort(bench_lat, nb, sizeof(bench_lat[0]), cmp_u32);
+	res->nb = nb;
+	res->p50_ns = bench_lat[(nb * 50 - 1) / 100];
+	res->p99_ns = bench_lat[(nb * 99 - 1) / 100];
+	res->p999_ns = bench_lat[(int)(((int64_t)nb * 999 - 1) / 1000)];
+	res->max_ns = bench_lat[nb - 1];
+}
+
+/* JSON object of a benchmark result, with the throughput if the operations move data */
+void bench_print(const struct bench_res_s *res, uint16_t size) {
+	printf("{\"ops\": %i, \"ops_per_s\": %.0f, ", res->nb, res->nb / res->total_s);
+	if (size > 0) {
+		printf("\"mb_per_s\": %.3f, ", 1e-6 * size * res->nb / res->total_s);
+	}
+	printf("\"p50_us\": %.2f, \"p99_us\": %.2f, \"p999_us\": %.2f, \"max_us\": %.2f}", 1e-3 * res->p50_ns, 1e-3 * res->p99_ns, 1e-3 * res->p999_ns, 1e-3 * res->max_ns);
+}
+
+/* run all the benchmarks, print the JSON report on stdout */
+int benchmark(int nb) {
+	struct bench_res_s res, same;
+	struct lgw_reg_stats_s stats;
+	struct utsname host;
+	uint32_t spi_speed = 0;
+	uint16_t spi_chunk = 0;
+	uint16_t size;
+	int nb_burst;
+	
+	lgw_reg_cache_enable(false); /* every access goes on the bus */
+	lgw_reg_spi_getconf(&spi_speed, &spi_chunk);
+	memset(&host, 0, sizeof(host));
+	uname(&host);
+	
+	printf("{\n");
+	printf("\t\"host\": {\"kernel\": \"%s %s\", \"machine\": \"%s\"},\n", host.sysname, host.release, host.machine);
+	printf("\t\"spi\": {\"speed_hz\": %u, \"chunk_size\": %u},\n", spi_speed, spi_chunk);
+	
+	MSG("INFO: single register accesses, %i operations each\n", nb);
+	bench_run(BENCH_W, nb, 0, &res);
+	printf("\t\"reg_write\": ");
+	bench_print(&res, 0);
+	bench_run(BENCH_R, nb, 0, &res);
+	printf(",\n\t\"reg_read\": ");
+	bench_print(&res, 0);
+	bench_run(BENCH_RMW, nb, 0, &res);
+	printf(",\n\t\"reg_rmw\": ");
+	bench_print(&res, 0);
+	
+	/* page switch cost: difference between reads alternating pages and reads on one page */
+	MSG("INFO: page switch cost\n");
+	bench_run(BENCH_SAME_PAGE, nb, 0, &same);
+	lgw_reg_reset_stats();
+	bench_run(BENCH_ALT_PAGE, nb, 0, &res);
+	lgw_reg_get_stats(&stats);
+	printf(",\n\t\"page_switch\": {\"nb_switch\": %u, \"cost_us\": %.2f,\n\t\t\"same_page\": ", stats.nb_page_switch, (stats.nb_page_switch > 0) ? 1e6 * (res.total_s - same.total_s) / stats.nb_page_switch : 0.0);
+	bench_print(&same, 0);
+	printf(",\n\t\t\"alternating\": ");
+	bench_print(&res, 0);
+	printf("}");
+	
+	/* bursts in the data buffer, fewer repetitions for large sizes */
+	MSG("INFO: data buffer bursts, 1 to %i bytes\n", BENCH_BURST_MAX);
+	printf(",\n\t\"burst\": [");
+	for (size = 1; size <= BENCH_BURST_MAX; size *= 2) {
+		nb_burst = BENCH_BURST_BYTES / size;
+		nb_burst = (nb_burst < BENCH_BURST_MIN) ? BENCH_BURST_MIN : nb_burst;
+		nb_burst = (nb_burst > nb) ? nb : nb_burst;
+		printf("%s\n\t\t{\"size\": %u, \"write\": ", (size == 1) ? "" : ",", size);
+		bench_run(BENCH_WB, nb_burst, size, &res);
+		bench_print(&res, size);
+		printf(", \"read\": ");
+		bench_run(BENCH_RB, nb_burst, size, &res);
+		bench_print(&res, size);
+		printf("}");
+	}
+	printf("\n\t],\n");
+	printf("\t\"lib_version\": \"%s\"\n}\n", lgw_version_info());
+	return EXIT_SUCCESS;
 }
 
 /* -------------------------------------------------------------------------- */
@@ -87,9 +334,13 @@ int main(int argc, char **argv)
 {
 	int i;
 	int xi = 0;
+	pthread_t mt_thrid[ARRAY_SIZE(mt_threads)];
+	uint32_t mt_nb_ok, mt_last_ok = 0;
 	
 	/* application option */
 	int test_number = 1;
+	bool bench_mode = false;
+	int bench_nb = BENCH_NB_DFLT;
 	int cycle_number = 0;
 	int repeats_per_cycle = 1000;
 	bool error = false;
@@ -105,7 +356,7 @@ int main(int argc, char **argv)
 	uint8_t read_buff[BUFF_SIZE];
 	
 	/* parse command line options */
-	while ((i = getopt (argc, argv, "ht:")) != -1) {
+	while ((i = getopt (argc, argv, "ht:bn:")) != -1) {
 		switch (i) {
 			case 'h':
 				usage();
@@ -114,7 +365,7 @@ int main(int argc, char **argv)
 			
 			case 't':
 				i = sscanf(optarg, "%i", &xi);
-				if ((i != 1) || (xi < 1) || (xi > 4)) {
+				if ((i != 1) || (xi < 1) || (xi > 5)) {
 					MSG("ERROR: invalid test number\n");
 					return EXIT_FAILURE;
 				} else {
@@ -122,13 +373,31 @@ int main(int argc, char **argv)
 				}
 				break;
 			
+			case 'b':
+				bench_mode = true;
+				break;
+			
+			case 'n':
+				i = sscanf(optarg, "%i", &xi);
+				if ((i != 1) || (xi < 1) || (xi > BENCH_NB_MAX)) {
+					MSG("ERROR: invalid number of operations\n");
+					return EXIT_FAILURE;
+				} else {
+					bench_nb = xi;
+				}
+				break;
+			
 			default:
 				MSG("ERROR: argument parsing use -h option for help\n");
 				usage();
 				return EXIT_FAILURE;
 		}
 	}
-	MSG("INFO: Starting LoRa concentrator SPI stress-test number %i\n", test_number);
+	if (bench_mode) {
+		MSG("INFO: Starting LoRa concentrator SPI benchmark\n");
+	} else {
+		MSG("INFO: Starting LoRa concentrator SPI stress-test number %i\n", test_number);
+	}
 	
 	/* configure signal handling */
 	sigemptyset(&sigact.sa_mask);
@@ -145,7 +414,10 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 	
-	if (test_number == 1) {
+	if (bench_mode) {
+		/* throughput and latency of the register accesses */
+		benchmark(bench_nb);
+	} else if (test_number == 1) {
 		/* single 8b register R/W stress test */
 		while ((quit_sig != 1) && (exit_sig != 1)) {
 			printf("Cycle %i > ", cycle_number);
@@ -271,6 +543,39 @@ int main(int argc, char **argv)
 				++cycle_number;
 			}
 		}
+	} else if (test_number == 5) {
+		/* concurrent R/W from several threads stress test */
+		for (i=0; i<(int)ARRAY_SIZE(mt_threads); ++i) {
+			if (pthread_create(&mt_thrid[i], NULL, thread_stress, &mt_threads[i]) != 0) {
+				MSG("ERROR: failed to create stress thread\n");
+				return EXIT_FAILURE;
+			}
+		}
+		while ((quit_sig != 1) && (exit_sig != 1) && (mt_error == false)) {
+			sleep(1);
+			mt_nb_ok = 0;
+			for (i=0; i<(int)ARRAY_SIZE(mt_threads); ++i) {
+				mt_nb_ok += mt_threads[i].nb_ok;
+			}
+			printf("Cycle %i > did %u concurrent R/W in %i threads with no error\n", cycle_number, mt_nb_ok - mt_last_ok, (int)ARRAY_SIZE(mt_threads));
+			mt_last_ok = mt_nb_ok;
+			++cycle_number;
+		}
+		for (i=0; i<(int)ARRAY_SIZE(mt_threads); ++i) {
+			pthread_join(mt_thrid[i], NULL);
+		}
+		if (mt_error) {
+			for (i=0; i<(int)ARRAY_SIZE(mt_threads); ++i) {
+				if (mt_threads[i].error == false) {
+					continue;
+				} else if (mt_threads[i].leng > 0) {
+					printf("error in thread %i after %u R/W: register %u, write 0x%08X, read 0x%08X\n", i, mt_threads[i].nb_ok, mt_threads[i].reg_id, mt_threads[i].wr_value, mt_threads[i].rd_value);
+				} else {
+					printf("error in thread %i after %u R/W: data buffer segment at 0x%04X\n", i, mt_threads[i].nb_ok, mt_threads[i].buf_addr);
+				}
+			}
+			return EXIT_FAILURE;
+		}
 	} else {
 		MSG("ERROR: invalid test number");
 		usage();
@@ -65,6 +65,8 @@ static void sig_handler(int sigio);
 
 void usage (void);
 
+void print_start_profile(void);
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
@@ -92,6 +94,24 @@ void usage(void) {
 	printf( " -i send packet using inverted modulation polarity \n");
 }
 
+/* where the start time went, phase by phase */
+void print_start_profile(void) {
+	struct lgw_start_profile_s prof;
+	struct lgw_start_wait_s wait;
+	int i;
+	
+	if (lgw_get_start_profile(&prof) != LGW_HAL_SUCCESS) {
+		return;
+	}
+	MSG("INFO: concentrator start took %u ms\n", prof.total_us / 1000);
+	for (i = 0; i < LGW_START_PHASE_NB; ++i) {
+		MSG("INFO:   %-16s %6u ms, %5u SPI transactions, %7llu bytes\n", prof.phase[i].name, prof.phase[i].duration_us / 1000, prof.phase[i].nb_submit, (unsigned long long)prof.phase[i].nb_byte);
+	}
+	if (lgw_get_start_wait(&wait) == LGW_HAL_SUCCESS) {
+		MSG("INFO:   waited %u ms for calibration, %u ms for AGC init\n", wait.cal_us / 1000, (wait.agc_boot_us + wait.agc_lut_us + wait.agc_chan_us + wait.agc_final_us) / 1000);
+	}
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- MAIN FUNCTION -------------------------------------------------------- */
 
@@ -255,6 +275,7 @@ int main(int argc, char **argv)
 	i = lgw_start();
 	if (i == LGW_HAL_SUCCESS) {
 		MSG("INFO: concentrator started, packet can be sent\n");
+		print_start_profile();
 	} else {
 		MSG("ERROR: failed to start the concentrator\n");
 		return EXIT_FAILURE;